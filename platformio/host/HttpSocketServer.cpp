@@ -0,0 +1,351 @@
+/**
+ * @file HttpSocketServer.cpp
+ * @brief Implementation of the Linux HTTP transport.
+ */
+
+#include "HttpSocketServer.h"
+#include "../src/util/LiveStream.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @brief HttpResponse writing HTTP/1.1 to a connected socket.
+ *
+ * The head is held back until the first chunk or `finish()`, so it can say
+ * whether a chunked body follows.
+ */
+class SocketResponse : public HttpResponse {
+private:
+  HttpSocketServer &server;
+  int fd;
+  bool keepAlive;
+  int status = 500;
+  std::string headers;
+  bool headSent = false;
+
+  void sendAll(const struct iovec *parts, int count) {
+    struct iovec iov[3];
+    memcpy(iov, parts, count * sizeof(*parts));
+    struct msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+
+    while (ok && message.msg_iovlen != 0) {
+      ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+      if (sent <= 0) {
+        ok = false;
+        return;
+      }
+      while (message.msg_iovlen != 0 &&
+             (size_t)sent >= message.msg_iov->iov_len) {
+        sent -= message.msg_iov->iov_len;
+        message.msg_iov++;
+        message.msg_iovlen--;
+      }
+      if (message.msg_iovlen != 0) {
+        message.msg_iov->iov_base = (char *)message.msg_iov->iov_base + sent;
+        message.msg_iov->iov_len -= sent;
+      }
+    }
+  }
+
+  void sendHead(bool chunked) {
+    char statusLine[64];
+    snprintf(statusLine, sizeof(statusLine), "HTTP/1.1 %d %s\r\n", status,
+             httpReason(status));
+    std::string head = statusLine + headers;
+    head += chunked ? "Transfer-Encoding: chunked\r\n"
+                    : "Content-Length: 0\r\n";
+    if (!keepAlive)
+      head += "Connection: close\r\n";
+    head += "\r\n";
+
+    struct iovec part = {(void *)head.data(), head.size()};
+    sendAll(&part, 1);
+    headSent = true;
+  }
+
+public:
+  bool ok = true;
+  bool streaming = false;
+
+  SocketResponse(HttpSocketServer &server, int fd, bool keepAlive)
+      : server(server), fd(fd), keepAlive(keepAlive) {}
+
+  void begin(int code, const char *contentType) override {
+    status = code;
+    headers.clear();
+    if (contentType != nullptr)
+      header("Content-Type", contentType);
+  }
+
+  void header(const char *name, const char *value) override {
+    headers += name;
+    headers += ": ";
+    headers += value;
+    headers += "\r\n";
+  }
+
+  bool chunk(const char *data, size_t length) override {
+    if (length == 0)
+      return ok;
+    if (!headSent)
+      sendHead(true);
+
+    char size[20];
+    int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+    struct iovec parts[3] = {{size, (size_t)sizeLength},
+                             {(void *)data, length},
+                             {(void *)"\r\n", 2}};
+    sendAll(parts, 3);
+    return ok;
+  }
+
+  void finish() override {
+    if (!headSent) {
+      sendHead(false);
+      return;
+    }
+    struct iovec last = {(void *)"0\r\n\r\n", 5};
+    sendAll(&last, 1);
+  }
+
+  bool stream(int client) override {
+    static const char head[] = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/event-stream\r\n"
+                               "Cache-Control: no-cache\r\n"
+                               "\r\n";
+    struct iovec part = {(void *)head, sizeof(head) - 1};
+    sendAll(&part, 1);
+    if (!ok)
+      return false;
+
+    server.addLive(fd, client);
+    streaming = true;
+    return true;
+  }
+};
+
+static HttpMethod parseMethod(const std::string &method) {
+  if (method == "GET")
+    return HTTP_METHOD_GET;
+  if (method == "HEAD")
+    return HTTP_METHOD_HEAD;
+  if (method == "POST")
+    return HTTP_METHOD_POST;
+  if (method == "PUT")
+    return HTTP_METHOD_PUT;
+  return HTTP_METHOD_OTHER;
+}
+
+HttpSocketServer::HttpSocketServer(WebApp &app) : app(app) {}
+
+HttpSocketServer::~HttpSocketServer() {
+  if (listenFd >= 0)
+    close(listenFd);
+}
+
+/**
+ * @brief Binds and listens.
+ *
+ * @param address IPv4 address to bind, e.g. "127.0.0.1".
+ * @param port TCP port.
+ */
+
+bool HttpSocketServer::listen(const char *address, uint16_t port) {
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    return false;
+
+  int yes = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    return false;
+
+  return bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+         ::listen(listenFd, SOMAXCONN) == 0;
+}
+
+/**
+ * @brief Accepts and serves connections until the process exits.
+ */
+
+void HttpSocketServer::run() {
+  std::thread(&HttpSocketServer::sendLive, this).detach();
+
+  while (true) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    std::thread([this, fd] {
+      if (!serveConnection(fd))
+        close(fd);
+    }).detach();
+  }
+}
+
+/**
+ * @brief Hands a connection whose live stream head has been sent to the
+ * sender thread, which closes it when the client goes away.
+ */
+
+void HttpSocketServer::addLive(int fd, int client) {
+  std::lock_guard<std::mutex> guard(liveLock);
+  liveSockets.push_back({fd, client});
+}
+
+/**
+ * @brief Sender thread: drains every live client to its socket.
+ */
+
+void HttpSocketServer::sendLive() {
+  while (true) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(HTTP_SOCKET_LIVE_PERIOD_MS));
+
+    std::lock_guard<std::mutex> guard(liveLock);
+    for (size_t i = 0; i < liveSockets.size();) {
+      LiveSocket &socket = liveSockets[i];
+      bool failed = false;
+      const uint8_t *data;
+      size_t length;
+      while (!failed && (length = liveStream.peek(socket.client, data)) != 0) {
+        ssize_t sent =
+            send(socket.fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+          failed = errno != EAGAIN && errno != EWOULDBLOCK;
+          break;
+        }
+        liveStream.consume(socket.client, sent);
+        if ((size_t)sent < length)
+          break;
+      }
+
+      if (!failed) {
+        i++;
+        continue;
+      }
+      close(socket.fd);
+      liveStream.detach(socket.client);
+      socket = liveSockets.back();
+      liveSockets.pop_back();
+    }
+  }
+}
+
+/**
+ * @brief Serves requests on one connection until it closes or asks to.
+ *
+ * @return `true` if the connection became a live stream and now belongs to
+ * the sender thread.
+ */
+
+bool HttpSocketServer::serveConnection(int fd) {
+  std::string pending;
+  char buffer[4096];
+
+  while (true) {
+    size_t headEnd;
+    while ((headEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+      if (pending.size() > HTTP_SOCKET_HEADER_LIMIT)
+        return false;
+      ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+      if (received <= 0)
+        return false;
+      pending.append(buffer, received);
+    }
+
+    // Request line
+    size_t lineEnd = pending.find("\r\n");
+    std::string line = pending.substr(0, lineEnd);
+    size_t space1 = line.find(' ');
+    size_t space2 = line.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos)
+      return false;
+    std::string method = line.substr(0, space1);
+    std::string target = line.substr(space1 + 1, space2 - space1 - 1);
+    std::string version = line.substr(space2 + 1);
+    std::string path = target.substr(0, target.find('?'));
+
+    // Headers
+    size_t contentLength = 0;
+    std::string ifNoneMatch, encoding, connection;
+    bool hasIfNoneMatch = false, hasEncoding = false;
+    size_t at = lineEnd + 2;
+    while (at < headEnd) {
+      size_t end = pending.find("\r\n", at);
+      std::string field = pending.substr(at, end - at);
+      at = end + 2;
+
+      size_t colon = field.find(':');
+      if (colon == std::string::npos)
+        continue;
+      std::string name = field.substr(0, colon);
+      size_t valueStart = field.find_first_not_of(' ', colon + 1);
+      std::string value =
+          valueStart == std::string::npos ? "" : field.substr(valueStart);
+
+      if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+        contentLength = strtoul(value.c_str(), nullptr, 10);
+      } else if (strcasecmp(name.c_str(), "If-None-Match") == 0) {
+        ifNoneMatch = value;
+        hasIfNoneMatch = true;
+      } else if (strcasecmp(name.c_str(), "Accept-Encoding") == 0) {
+        encoding = value;
+        hasEncoding = true;
+      } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+        connection = value;
+      }
+    }
+
+    // Body
+    size_t bodyStart = headEnd + 4;
+    while (pending.size() < bodyStart + contentLength) {
+      ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+      if (received <= 0)
+        return false;
+      pending.append(buffer, received);
+    }
+    std::string body = pending.substr(
+        bodyStart, contentLength < WEB_MAX_BODY ? contentLength : WEB_MAX_BODY);
+    pending.erase(0, bodyStart + contentLength);
+
+    bool keepAlive = version == "HTTP/1.1"
+                         ? strcasecmp(connection.c_str(), "close") != 0
+                         : strcasecmp(connection.c_str(), "keep-alive") == 0;
+
+    HttpRequest request = {parseMethod(method),
+                           path.c_str(),
+                           hasIfNoneMatch ? ifNoneMatch.c_str() : nullptr,
+                           !hasEncoding || encoding.find("gzip") !=
+                                               std::string::npos,
+                           body.c_str(),
+                           body.size()};
+    SocketResponse response(*this, fd, keepAlive);
+    app.handle(request, response);
+
+    if (response.streaming)
+      return true;
+    if (!keepAlive || !response.ok)
+      return false;
+  }
+}
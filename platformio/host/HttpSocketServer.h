@@ -0,0 +1,49 @@
+#ifndef HTTP_SOCKET_SERVER_H
+#define HTTP_SOCKET_SERVER_H
+#include "../src/util/WebApp.h"
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#define HTTP_SOCKET_HEADER_LIMIT 4096
+#define HTTP_SOCKET_LIVE_PERIOD_MS 10
+
+/**
+ * @class HttpSocketServer
+ * @brief Minimal HTTP/1.1 transport for WebApp over POSIX sockets.
+ *
+ * Serves each connection on its own thread, with keep-alive so a load
+ * generator can reuse connections. Request heads larger than
+ * HTTP_SOCKET_HEADER_LIMIT are rejected.
+ *
+ * Live stream connections leave their thread once the head is sent; one
+ * sender thread then drains every LiveStream client to its socket with
+ * non-blocking sends every HTTP_SOCKET_LIVE_PERIOD_MS, as the live sender
+ * task does on target.
+ */
+
+class HttpSocketServer {
+private:
+  struct LiveSocket {
+    int fd;
+    int client;
+  };
+
+  WebApp &app;
+  int listenFd = -1;
+  std::mutex liveLock;
+  std::vector<LiveSocket> liveSockets;
+
+  bool serveConnection(int fd);
+  void sendLive();
+
+public:
+  explicit HttpSocketServer(WebApp &app);
+  ~HttpSocketServer();
+
+  bool listen(const char *address, uint16_t port);
+  void run();
+  void addLive(int fd, int client);
+};
+
+#endif
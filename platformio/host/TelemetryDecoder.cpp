@@ -0,0 +1,58 @@
+/**
+ * @file TelemetryDecoder.cpp
+ * @brief Implementation of the TelemetryDecoder class.
+ */
+
+#include "TelemetryDecoder.h"
+#include <utility>
+
+/**
+ * @brief Constructs a decoder.
+ *
+ * @param onRecord Called once for every valid record, in stream order.
+ */
+
+TelemetryDecoder::TelemetryDecoder(
+    std::function<void(const TelemetryRecord &)> onRecord)
+    : _onRecord(std::move(onRecord)) {
+  pending.reserve(TELEMETRY_MAX_FRAME);
+}
+
+/**
+ * @brief Feeds the next chunk of the stream.
+ */
+
+void TelemetryDecoder::feed(const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] == 0) {
+      finishFrame();
+    } else if (pending.size() < TELEMETRY_MAX_FRAME) {
+      pending.push_back(data[i]);
+    } else {
+      overflowed = true;
+    }
+  }
+}
+
+/**
+ * @brief Decodes the bytes collected since the last delimiter.
+ */
+
+void TelemetryDecoder::finishFrame() {
+  if (pending.empty() && !overflowed)
+    return;
+
+  TelemetryRecord record;
+  if (overflowed || !decodeTelemetry(pending.data(), pending.size(), record)) {
+    corruptFrames++;
+  } else {
+    if (lastSeq >= 0)
+      lostFrames += (uint8_t)(record.seq - lastSeq - 1);
+    lastSeq = record.seq;
+    decodedFrames++;
+    _onRecord(record);
+  }
+
+  pending.clear();
+  overflowed = false;
+}
@@ -0,0 +1,41 @@
+#ifndef TELEMETRY_DECODER_H
+#define TELEMETRY_DECODER_H
+#include "../src/util/TelemetryCodec.h"
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @class TelemetryDecoder
+ * @brief Splits a raw byte stream into telemetry records.
+ *
+ * Bytes can be fed in arbitrary chunks, e.g. as they arrive from a serial
+ * port. Frames are delimited by 0x00; frames that fail COBS, CRC or length
+ * checks are counted and skipped, which also skips any plain-text debug
+ * output sharing the port. Gaps in the 8-bit sequence number are counted as
+ * lost frames.
+ */
+
+class TelemetryDecoder {
+private:
+  std::function<void(const TelemetryRecord &)> _onRecord;
+  std::vector<uint8_t> pending;
+  bool overflowed = false;
+  int lastSeq = -1;
+  uint64_t decodedFrames = 0;
+  uint64_t corruptFrames = 0;
+  uint64_t lostFrames = 0;
+
+  void finishFrame();
+
+public:
+  explicit TelemetryDecoder(
+      std::function<void(const TelemetryRecord &)> onRecord);
+
+  void feed(const uint8_t *data, size_t length);
+  uint64_t decoded() const { return decodedFrames; }
+  uint64_t corrupt() const { return corruptFrames; }
+  uint64_t lost() const { return lostFrames; }
+};
+
+#endif
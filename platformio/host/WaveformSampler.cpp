@@ -0,0 +1,157 @@
+/**
+ * @file WaveformSampler.cpp
+ * @brief Implementation of the WaveformSampler host stand-in.
+ */
+
+#include "WaveformSampler.h"
+#include <math.h>
+#include <stdio.h>
+#include <utility>
+
+/**
+ * @brief Constructs a WaveformSampler driven by a synthetic waveform.
+ *
+ * @param waveform Returns the raw 12-bit reading at a time in seconds.
+ * @param sampleRateHz The rate at which samples are pushed to the ring.
+ */
+
+WaveformSampler::WaveformSampler(std::function<uint16_t(double)> waveform,
+                                 uint32_t sampleRateHz)
+    : _sampleRateHz(sampleRateHz ? sampleRateHz : 1),
+      _waveform(std::move(waveform)) {}
+
+/**
+ * @brief Constructs a WaveformSampler that replays a recording.
+ *
+ * @param sampleRateHz The rate at which samples are pushed to the ring.
+ *
+ * Call `loadRecording()` before advancing; until then the ring is fed zeros.
+ */
+
+WaveformSampler::WaveformSampler(uint32_t sampleRateHz)
+    : _sampleRateHz(sampleRateHz ? sampleRateHz : 1) {}
+
+/**
+ * @brief Replaces the synthetic waveform.
+ */
+
+void WaveformSampler::setWaveform(std::function<uint16_t(double)> waveform) {
+  _waveform = std::move(waveform);
+}
+
+/**
+ * @brief Changes the sample rate; call before the first `advance()`.
+ */
+
+void WaveformSampler::setSampleRate(uint32_t sampleRateHz) {
+  _sampleRateHz = sampleRateHz ? sampleRateHz : 1;
+}
+
+/**
+ * @brief Loads a recorded trace, one raw reading per line.
+ *
+ * @param path Path of the text file to load.
+ * @return `true` if at least one sample was read.
+ *
+ * The recording is replayed at the configured sample rate and loops when it
+ * runs out.
+ */
+
+bool WaveformSampler::loadRecording(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr)
+    return false;
+
+  recording.clear();
+  unsigned int value;
+  while (fscanf(file, "%u", &value) == 1)
+    recording.push_back(value > 4095 ? 4095 : (uint16_t)value);
+
+  fclose(file);
+  return !recording.empty();
+}
+
+/**
+ * @brief Advances simulated time and pushes the samples it would produce.
+ *
+ * @param elapsedMs Simulated milliseconds since the previous call.
+ *
+ * Converting on demand, nothing is pushed until `convert()`.
+ */
+
+void WaveformSampler::advance(uint32_t elapsedMs) {
+  elapsedMicros += (uint64_t)elapsedMs * 1000;
+  uint64_t due = elapsedMicros * _sampleRateHz / 1000000;
+
+  if (onDemand) {
+    produced = due;
+    return;
+  }
+  while (produced < due) {
+    ring.push(sampleAt(produced));
+    produced++;
+  }
+}
+
+/**
+ * @brief Gives access to the ring consumed by SolarIndex.
+ */
+
+SolarSampleRing &WaveformSampler::samples() { return ring; }
+
+/**
+ * @brief Stops or resumes pushing samples as time advances.
+ */
+
+bool WaveformSampler::setOnDemand(bool onDemand) {
+  this->onDemand = onDemand;
+  return true;
+}
+
+/**
+ * @brief Pushes the `count` samples leading up to the current time.
+ *
+ * @return The number of samples pushed; 0 unless converting on demand.
+ *
+ * On target a burst takes a few milliseconds; here it replays the samples
+ * the continuous stream would have ended on, so a burst carries the noise
+ * of the waveform or recording but never looks ahead of the clock.
+ */
+
+size_t WaveformSampler::convert(size_t count) {
+  if (!onDemand)
+    return 0;
+
+  uint64_t first = produced > count ? produced - count : 0;
+  size_t pushed = 0;
+  for (uint64_t index = first; index < produced; index++)
+    pushed += ring.push(sampleAt(index));
+  return pushed;
+}
+
+/**
+ * @brief Returns the reading for a sample index.
+ */
+
+uint16_t WaveformSampler::sampleAt(uint64_t index) const {
+  if (!recording.empty())
+    return recording[index % recording.size()];
+  if (_waveform)
+    return _waveform((double)index / _sampleRateHz);
+  return 0;
+}
+
+/**
+ * @brief Clear-sky day from 06:00 to 18:00 with passing clouds.
+ */
+
+uint16_t syntheticDay(double seconds) {
+  double hour = fmod(seconds / 3600.0, 24.0);
+  if (hour < 6.0 || hour > 18.0)
+    return 12;
+
+  double sun = sin(M_PI * (hour - 6.0) / 12.0);
+  double cloud = cos(seconds / 230.0);
+  double shade = 0.6 + 0.4 * cos(seconds / 700.0) * cloud * cloud;
+  return (uint16_t)(12 + 3900.0 * sun * shade);
+}
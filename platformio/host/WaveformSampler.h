@@ -0,0 +1,45 @@
+#ifndef WAVEFORM_SAMPLER_H
+#define WAVEFORM_SAMPLER_H
+#include "../src/util/hal.h"
+#include <functional>
+#include <vector>
+
+/**
+ * @class WaveformSampler
+ * @brief Host stand-in for AdcSampler; the Linux HalAdc backend.
+ *
+ * The WaveformSampler class fills the same SolarSampleRing that AdcSampler
+ * fills on target, but from a synthetic waveform or a recorded trace. Time is
+ * driven explicitly through `advance()` so replays are deterministic and run
+ * as fast as the host allows.
+ */
+
+class WaveformSampler : public HalAdc {
+private:
+  SolarSampleRing ring;
+  uint32_t _sampleRateHz;
+  std::function<uint16_t(double)> _waveform;
+  std::vector<uint16_t> recording;
+  uint64_t produced = 0;
+  uint64_t elapsedMicros = 0;
+  bool onDemand = false;
+
+  uint16_t sampleAt(uint64_t index) const;
+
+public:
+  WaveformSampler(std::function<uint16_t(double)> waveform,
+                  uint32_t sampleRateHz = 1000);
+  explicit WaveformSampler(uint32_t sampleRateHz = 1000);
+
+  void setWaveform(std::function<uint16_t(double)> waveform);
+  void setSampleRate(uint32_t sampleRateHz);
+  bool loadRecording(const char *path);
+  void advance(uint32_t elapsedMs);
+  SolarSampleRing &samples() override;
+  bool setOnDemand(bool onDemand) override;
+  size_t convert(size_t count) override;
+};
+
+uint16_t syntheticDay(double seconds);
+
+#endif
@@ -0,0 +1,361 @@
+/**
+ * @file adaptive_replay.cpp
+ * @brief Compares adaptive with fixed-rate sampling on the same day trace.
+ *
+ * Usage: adaptive_replay [options]
+ *
+ *   --trace <file>       replay raw readings, one per line, instead of the
+ *                        synthetic day
+ *   --hours <n>          simulated duration (default 24)
+ *   --adc-rate <hz>      scripted ADC sample rate (default 1000, as
+ *                        ADC_SAMPLE_RATE_HZ)
+ *   --period-ms <ms>     fixed control period, as RuntimeConfig (default 100)
+ *   --min-period <ms>    adaptive period bounds (default 100 and 2000)
+ *   --max-period <ms>
+ *   --on-demand <ms>     period from which the ADC converts on demand
+ *                        (default 500)
+ *   --resolution <index> index change allowed between readings (default 2)
+ *   --noise <index>      noise that keeps the period short (default 3)
+ *   --interval <min>     switch interval in minutes (default 5)
+ *   --min <index>        lower threshold (default 400)
+ *   --max <index>        upper threshold (default 1000)
+ *   --ap-minutes <min>   how long the access point stays up after boot
+ *                        without a station (default 10, as
+ *                        WEB_AP_IDLE_MINUTES); 0 leaves Wi-Fi out
+ *
+ * Two pipelines read the same trace, each with its own WaveformSampler and
+ * SolarIndex: one every --period-ms with the ADC converting continuously,
+ * one at the period a SampleScheduler picks, as Runtime does with adaptive
+ * sampling. Each pipeline drives one SwitchController per SwitchMode.
+ *
+ * The report gives readings and ADC conversions per hour, and the share of
+ * time the CPU is awake. The continuous ADC and the Wi-Fi access point
+ * each hold a power management lock, so a pipeline counts as always awake
+ * while it converts continuously or the AP is up; otherwise every reading
+ * costs a light-sleep wake, the burst's conversions and the reading itself,
+ * and the service task wakes once a second. With no dashboard connected the
+ * live sender never wakes, so it costs nothing. The costs are
+ * the REPLAY_*_MICROS estimates below, not measurements. For each mode the
+ * report then compares the adaptive relay with the fixed one: toggles, the
+ * share of seconds they agree and how far each fixed-rate transition moved.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define REPLAY_FIRST_PIN 4
+#define REPLAY_TICK_MS 10 // CONFIG_FREERTOS_HZ=100
+#define REPLAY_WAKE_MICROS 1000      // light-sleep exit and re-entry
+#define REPLAY_CONVERSION_MICROS 40  // one oneshot conversion
+#define REPLAY_READING_MICROS 200    // filtering and the controllers
+#define REPLAY_SERVICE_MICROS 300    // storage, log and telemetry ticks
+#define REPLAY_MATCH_SECONDS 120     // furthest a transition may move
+#define REPLAY_AP_MINUTES 10         // WEB_AP_IDLE_MINUTES
+
+struct AdaptiveOptions {
+  const char *trace = nullptr;
+  double hours = 24;
+  uint32_t adcRateHz = ADC_SAMPLE_RATE_HZ;
+  uint32_t periodMs = 100;
+  AdaptiveSamplingConfig adaptive;
+  unsigned short intervalMinutes = 5;
+  double min = 400;
+  double max = 1000;
+  double apMinutes = REPLAY_AP_MINUTES;
+};
+
+struct Pipeline {
+  const char *name;
+  WaveformSampler adc;
+  SolarIndex index;
+  SwitchController *relays[3];
+  hal_pin_t firstPin;
+  uint32_t periodMs;
+  unsigned long dueMillis = 0;
+  bool onDemand = false;
+  uint64_t readings = 0;
+  uint64_t conversions = 0;
+  uint64_t awakeMicros = 0;
+  std::vector<bool> on[3]; // relay levels, once a second
+
+  Pipeline(const char *name, const char *key, uint32_t adcRateHz,
+           hal_pin_t firstPin, uint32_t periodMs)
+      : name(name), adc(adcRateHz), index(key, adc.samples()),
+        firstPin(firstPin), periodMs(periodMs) {}
+};
+
+static const SwitchMode modes[] = {SWITCH_MODE_INTERVAL,
+                                   SWITCH_MODE_PREDICTIVE, SWITCH_MODE_EVENT};
+static const char *modeNames[] = {"interval", "predictive", "event"};
+static const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [--trace file] [--hours n] [--adc-rate hz] "
+          "[--period-ms ms]\n"
+          "       [--min-period ms] [--max-period ms] [--on-demand ms]\n"
+          "       [--resolution index] [--noise index] [--interval min]\n"
+          "       [--min index] [--max index] [--ap-minutes min]\n",
+          name);
+}
+
+static bool parseOptions(int argc, char **argv, AdaptiveOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--trace") == 0)
+      options.trace = value;
+    else if (strcmp(arg, "--hours") == 0)
+      options.hours = atof(value);
+    else if (strcmp(arg, "--adc-rate") == 0)
+      options.adcRateHz = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--period-ms") == 0)
+      options.periodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--min-period") == 0)
+      options.adaptive.minPeriodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--max-period") == 0)
+      options.adaptive.maxPeriodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--on-demand") == 0)
+      options.adaptive.onDemandPeriodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--resolution") == 0)
+      options.adaptive.resolution = atof(value);
+    else if (strcmp(arg, "--noise") == 0)
+      options.adaptive.noiseLimit = atof(value);
+    else if (strcmp(arg, "--interval") == 0)
+      options.intervalMinutes = (unsigned short)atoi(value);
+    else if (strcmp(arg, "--min") == 0)
+      options.min = atof(value);
+    else if (strcmp(arg, "--max") == 0)
+      options.max = atof(value);
+    else if (strcmp(arg, "--ap-minutes") == 0)
+      options.apMinutes = atof(value);
+    else
+      return false;
+  }
+  return options.hours > 0 && options.adcRateHz > 0 &&
+         options.periodMs >= REPLAY_TICK_MS && options.apMinutes >= 0;
+}
+
+/**
+ * @brief Rounds a period down to whole ticks, as `pdMS_TO_TICKS()` does.
+ */
+
+static uint32_t inTicks(uint32_t periodMs) {
+  uint32_t ticks = periodMs / REPLAY_TICK_MS;
+  return (ticks ? ticks : 1) * REPLAY_TICK_MS;
+}
+
+/**
+ * @brief Takes one reading and runs the pipeline's controllers with it.
+ *
+ * @return The reading.
+ */
+
+static solar_num_t sample(Pipeline &pipeline, unsigned long now) {
+  if (pipeline.onDemand) {
+    size_t converted = pipeline.adc.convert(ADAPTIVE_BURST_SAMPLES);
+    pipeline.conversions += converted;
+    pipeline.awakeMicros += REPLAY_WAKE_MICROS +
+                            converted * REPLAY_CONVERSION_MICROS +
+                            REPLAY_READING_MICROS;
+  }
+  solar_num_t solarIndex = pipeline.index.read();
+  for (size_t i = 0; i < modeCount; i++)
+    pipeline.relays[i]->run(solarIndex, now);
+  pipeline.readings++;
+  return solarIndex;
+}
+
+/**
+ * @brief Mean shift of the fixed-rate relay's transitions in the adaptive
+ * relay, and the number with no transition the same way within
+ * REPLAY_MATCH_SECONDS.
+ */
+
+static double transitionShift(const std::vector<bool> &fixed,
+                              const std::vector<bool> &adaptive,
+                              size_t &unmatched) {
+  std::vector<size_t> moves;
+  for (size_t second = 1; second < adaptive.size(); second++) {
+    if (adaptive[second] != adaptive[second - 1])
+      moves.push_back(second);
+  }
+
+  double shiftSum = 0;
+  size_t matched = 0;
+  unmatched = 0;
+  for (size_t second = 1; second < fixed.size(); second++) {
+    if (fixed[second] == fixed[second - 1])
+      continue;
+    long best = REPLAY_MATCH_SECONDS + 1;
+    for (size_t move : moves) {
+      long shift = (long)move - (long)second;
+      if (adaptive[move] == fixed[second] && labs(shift) < labs(best))
+        best = shift;
+    }
+    if (labs(best) > REPLAY_MATCH_SECONDS) {
+      unmatched++;
+      continue;
+    }
+    shiftSum += best;
+    matched++;
+  }
+  return matched ? shiftSum / matched : 0.0;
+}
+
+int main(int argc, char **argv) {
+  AdaptiveOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Pipeline fixed("fixed", "FixedRead", options.adcRateHz, REPLAY_FIRST_PIN,
+                 options.periodMs);
+  Pipeline adaptive("adaptive", "AdaptiveRead", options.adcRateHz,
+                    REPLAY_FIRST_PIN + modeCount, options.adaptive.minPeriodMs);
+  Pipeline *pipelines[] = {&fixed, &adaptive};
+
+  for (Pipeline *pipeline : pipelines) {
+    if (options.trace != nullptr) {
+      if (!pipeline->adc.loadRecording(options.trace)) {
+        fprintf(stderr, "%s: no readings\n", options.trace);
+        return 1;
+      }
+    } else {
+      pipeline->adc.setWaveform(syntheticDay);
+    }
+  }
+
+  init_nvs();
+
+  for (Pipeline *pipeline : pipelines) {
+    for (size_t i = 0; i < modeCount; i++) {
+      hal_pin_t pin = pipeline->firstPin + i;
+      pipeline->relays[i] = new SwitchController(pin);
+      pipeline->relays[i]->setMode(modes[i]);
+      if (!pipeline->relays[i]->setInterval(options.intervalMinutes) ||
+          !pipeline->relays[i]->setSolarThresholds(options.max,
+                                                   options.min)) {
+        fprintf(stderr, "invalid interval or thresholds\n");
+        return 2;
+      }
+      pipeline->relays[i]->begin();
+    }
+  }
+
+  SampleScheduler scheduler(options.adaptive);
+  const uint64_t ticks =
+      (uint64_t)(options.hours * 3600000.0 / REPLAY_TICK_MS);
+  const uint64_t ticksPerSecond = 1000 / REPLAY_TICK_MS;
+  uint64_t serviceWakes = 0;
+  fixed.periodMs = inTicks(fixed.periodMs);
+  adaptive.periodMs = inTicks(adaptive.periodMs);
+  fixed.dueMillis = (uint32_t)millis() + fixed.periodMs;
+  adaptive.dueMillis = (uint32_t)millis() + adaptive.periodMs;
+
+  for (uint64_t tick = 1; tick <= ticks; tick++) {
+    virtualClock.advance(REPLAY_TICK_MS * 1000);
+    for (Pipeline *pipeline : pipelines)
+      pipeline->adc.advance(REPLAY_TICK_MS);
+    uint32_t now = (uint32_t)millis();
+
+    if (now >= fixed.dueMillis) {
+      sample(fixed, now);
+      fixed.dueMillis += fixed.periodMs;
+    }
+
+    if (now >= adaptive.dueMillis) {
+      solar_num_t solarIndex = sample(adaptive, now);
+      adaptive.periodMs = inTicks(scheduler.next(solarIndex, now));
+      if (scheduler.onDemand() != adaptive.onDemand &&
+          adaptive.adc.setOnDemand(scheduler.onDemand()))
+        adaptive.onDemand = scheduler.onDemand();
+      adaptive.dueMillis += adaptive.periodMs;
+    }
+
+    if (tick % ticksPerSecond == 0) {
+      serviceWakes++;
+      bool apUp = serviceWakes <= options.apMinutes * 60;
+      for (Pipeline *pipeline : pipelines) {
+        for (size_t i = 0; i < modeCount; i++)
+          pipeline->on[i].push_back(
+              memoryGpio.level(pipeline->firstPin + i) == 1);
+        // Converting continuously or with the AP up, the chip never sleeps
+        if (!pipeline->onDemand || apUp)
+          pipeline->awakeMicros += 1000000;
+        else
+          pipeline->awakeMicros += REPLAY_WAKE_MICROS + REPLAY_SERVICE_MICROS;
+      }
+    }
+    // Continuous conversions the ADC made this tick
+    for (Pipeline *pipeline : pipelines) {
+      if (!pipeline->onDemand)
+        pipeline->conversions +=
+            (uint64_t)options.adcRateHz * REPLAY_TICK_MS / 1000;
+    }
+  }
+
+  double hours = ticks * REPLAY_TICK_MS / 3600000.0;
+  double elapsedMicros = serviceWakes * 1000000.0;
+  printf("%.1f h at %u Hz, fixed period %u ms, adaptive %u-%u ms, on demand "
+         "from %u ms, access point up %.0f min\n",
+         hours, (unsigned)options.adcRateHz, (unsigned)fixed.periodMs,
+         (unsigned)options.adaptive.minPeriodMs,
+         (unsigned)options.adaptive.maxPeriodMs,
+         (unsigned)options.adaptive.onDemandPeriodMs, options.apMinutes);
+  printf("pipeline  readings/h  conversions/h     awake\n");
+  for (Pipeline *pipeline : pipelines) {
+    double awake = elapsedMicros > 0
+                       ? 100.0 * fmin(pipeline->awakeMicros, elapsedMicros) /
+                             elapsedMicros
+                       : 0.0;
+    printf("%-8s  %10.0f  %13.0f  %7.2f%%\n", pipeline->name,
+           pipeline->readings / hours, pipeline->conversions / hours, awake);
+  }
+  // The fixed rate with every reading a burst, for comparison
+  double burstMicros = REPLAY_WAKE_MICROS +
+                       ADAPTIVE_BURST_SAMPLES * REPLAY_CONVERSION_MICROS +
+                       REPLAY_READING_MICROS;
+  double burstAwake = (burstMicros * 1000.0 / fixed.periodMs +
+                       REPLAY_WAKE_MICROS + REPLAY_SERVICE_MICROS) /
+                      1e4;
+  double apShare = elapsedMicros > 0
+                       ? fmin(options.apMinutes * 60e6, elapsedMicros) /
+                             elapsedMicros
+                       : 0.0;
+  burstAwake = apShare * 100.0 + (1.0 - apShare) * burstAwake;
+  printf("%-8s  %10.0f  %13.0f  %7.2f%%  (fixed rate, on demand)\n", "bursts",
+         3600000.0 / fixed.periodMs,
+         3600000.0 / fixed.periodMs * ADAPTIVE_BURST_SAMPLES,
+         burstAwake > 100.0 ? 100.0 : burstAwake);
+
+  printf("\nmode        fixed toggles  adaptive toggles  agreement  "
+         "mean shift s  unmatched\n");
+  for (size_t i = 0; i < modeCount; i++) {
+    const std::vector<bool> &a = fixed.on[i], &b = adaptive.on[i];
+    size_t agreeing = 0;
+    for (size_t second = 0; second < a.size(); second++)
+      agreeing += a[second] == b[second];
+    size_t unmatched;
+    double shift = transitionShift(a, b, unmatched);
+    printf("%-10s  %13u  %16u  %8.1f%%  %12.1f  %9zu\n", modeNames[i],
+           (unsigned)memoryGpio.toggleCount(fixed.firstPin + i),
+           (unsigned)memoryGpio.toggleCount(adaptive.firstPin + i),
+           a.empty() ? 0.0 : 100.0 * agreeing / a.size(), shift, unmatched);
+  }
+
+  for (Pipeline *pipeline : pipelines) {
+    for (size_t i = 0; i < modeCount; i++)
+      delete pipeline->relays[i];
+  }
+  return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file adc_cal.cpp
+ * @brief Builds and verifies ADC calibration tables from measured points.
+ *
+ * Usage:
+ *   adc_cal build <points.csv> <table.bin>
+ *   adc_cal verify <table.bin> [points.csv]
+ *
+ * <points.csv> has one `raw,millivolts` pair per line: the count the board
+ * reports with a reference voltage on the ADC pin, and that voltage as read
+ * by a meter. Lines that do not parse, such as a header or `#` comments, are
+ * skipped; points must be in increasing `raw` order.
+ *
+ * `build` interpolates the table with the same AdcCalTable code the firmware
+ * uses, checks it and writes the blob the firmware loads from NVS under
+ * ADC_CAL_KEY. `verify` decodes a blob, e.g. read back from a board, checks
+ * its CRC and monotonicity and, given points, how closely it reproduces them.
+ * Both print how far the ideal `raw * 3.3 / 4095` conversion is from the
+ * table. Exits non-zero if a check fails.
+ *
+ * To provision a board, list the blob in an NVS partition CSV for
+ * nvs_partition_gen.py:
+ *
+ *   key,type,encoding,value
+ *   storage,namespace,,
+ *   adc_cal,file,binary,table.bin
+ */
+
+#include "../src/util/AdcCalibration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADC_CAL_TOLERANCE_MV 1 // interpolation rounding
+
+static bool readPoints(const char *path, AdcCalPoint *points, size_t &count) {
+  FILE *in = fopen(path, "r");
+  if (in == nullptr) {
+    perror(path);
+    return false;
+  }
+
+  char line[128];
+  count = 0;
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    unsigned raw, millivolts;
+    if (sscanf(line, " %u , %u", &raw, &millivolts) != 2)
+      continue;
+    if (count == ADC_CAL_MAX_POINTS) {
+      fprintf(stderr, "%s: more than %d points\n", path, ADC_CAL_MAX_POINTS);
+      fclose(in);
+      return false;
+    }
+    points[count++] = {(uint16_t)raw, (uint16_t)millivolts};
+  }
+  fclose(in);
+  return true;
+}
+
+/**
+ * @brief Prints the deviation of the ideal linear conversion from the table.
+ */
+
+static void reportLinearity(const AdcCalTable &table) {
+  AdcCalTable ideal;
+  ideal.linear();
+
+  int worst = 0;
+  uint16_t worstRaw = 0;
+  for (uint32_t raw = 0; raw < ADC_CAL_COUNTS; raw++) {
+    int error = ideal.millivolts(raw) - table.millivolts(raw);
+    if (abs(error) > abs(worst)) {
+      worst = error;
+      worstRaw = (uint16_t)raw;
+    }
+  }
+
+  printf("table: %s, %u mV at count 0, %u mV at count 4095\n",
+         adcCalSourceName(table.source()), table.millivolts(0),
+         table.millivolts(ADC_CAL_COUNTS - 1));
+  printf("linear conversion error: up to %+d mV at count %u\n", worst,
+         worstRaw);
+}
+
+/**
+ * @brief Checks that the table reproduces every measured point.
+ */
+
+static bool checkPoints(const AdcCalTable &table, const AdcCalPoint *points,
+                        size_t count) {
+  AdcCalTable ideal;
+  ideal.linear();
+
+  bool ok = true;
+  printf("raw,measured_mv,table_mv,linear_mv\n");
+  for (size_t i = 0; i < count; i++) {
+    uint16_t mv = table.millivolts(points[i].raw);
+    printf("%u,%u,%u,%u\n", points[i].raw, points[i].millivolts, mv,
+           ideal.millivolts(points[i].raw));
+    if (abs(mv - points[i].millivolts) > ADC_CAL_TOLERANCE_MV)
+      ok = false;
+  }
+  if (!ok)
+    fprintf(stderr, "table does not reproduce the measured points\n");
+  return ok;
+}
+
+static int build(const char *pointsPath, const char *tablePath) {
+  AdcCalPoint points[ADC_CAL_MAX_POINTS];
+  size_t count;
+  if (!readPoints(pointsPath, points, count))
+    return 1;
+
+  static AdcCalTable table;
+  if (!table.fromPoints(points, count)) {
+    fprintf(stderr,
+            "%s: need 2-%d points with raw 0-4095 in increasing order\n",
+            pointsPath, ADC_CAL_MAX_POINTS);
+    return 1;
+  }
+  if (!table.monotonic()) {
+    fprintf(stderr, "%s: millivolts decrease between points\n", pointsPath);
+    return 1;
+  }
+  bool ok = checkPoints(table, points, count);
+
+  static uint8_t blob[ADC_CAL_BLOB_SIZE];
+  table.encode(blob);
+  FILE *out = fopen(tablePath, "wb");
+  if (out == nullptr || fwrite(blob, 1, sizeof(blob), out) != sizeof(blob) ||
+      fclose(out) != 0) {
+    perror(tablePath);
+    return 1;
+  }
+
+  reportLinearity(table);
+  printf("wrote %s, %d bytes\n", tablePath, ADC_CAL_BLOB_SIZE);
+  return ok ? 0 : 1;
+}
+
+static int verify(const char *tablePath, const char *pointsPath) {
+  static uint8_t blob[ADC_CAL_BLOB_SIZE + 1];
+  FILE *in = fopen(tablePath, "rb");
+  if (in == nullptr) {
+    perror(tablePath);
+    return 1;
+  }
+  size_t length = fread(blob, 1, sizeof(blob), in);
+  fclose(in);
+
+  static AdcCalTable table;
+  if (!table.decode(blob, length)) {
+    fprintf(stderr, "%s: not a calibration table (size, magic or CRC)\n",
+            tablePath);
+    return 1;
+  }
+  bool ok = table.monotonic();
+  if (!ok)
+    fprintf(stderr, "%s: millivolts decrease with the count\n", tablePath);
+
+  if (pointsPath != nullptr) {
+    AdcCalPoint points[ADC_CAL_MAX_POINTS];
+    size_t count;
+    if (!readPoints(pointsPath, points, count))
+      return 1;
+    ok &= checkPoints(table, points, count);
+  }
+
+  reportLinearity(table);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 4 && strcmp(argv[1], "build") == 0)
+    return build(argv[2], argv[3]);
+  if ((argc == 3 || argc == 4) && strcmp(argv[1], "verify") == 0)
+    return verify(argv[2], argc == 4 ? argv[3] : nullptr);
+
+  fprintf(stderr,
+          "usage: %s build <points.csv> <table.bin>\n"
+          "       %s verify <table.bin> [points.csv]\n",
+          argv[0], argv[0]);
+  return 2;
+}
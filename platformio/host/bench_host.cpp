@@ -0,0 +1,95 @@
+/**
+ * @file bench_host.cpp
+ * @brief Host runner for the hot-path benchmarks, under Google Benchmark.
+ *
+ * Usage: bench_host [Google Benchmark flags]
+ *
+ * Runs the cases from Benchmark.cpp against the Linux HAL. Output is JSON by
+ * default (pass --benchmark_format=console for a table). Besides Google
+ * Benchmark's own per-iteration time, each benchmark reports the mean, p99 and
+ * max of the timed call alone as the counters mean_ns, p99_ns and max_ns.
+ * Compare runs with Google Benchmark's tools/compare.py.
+ */
+
+#include "../src/util/Benchmark.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <vector>
+
+/**
+ * @brief Serial port that only formats, so `send(double)` is measured without
+ * stdio.
+ */
+class NullSerial : public HalSerial {
+public:
+  void write(const char *, size_t) override {}
+};
+
+static NullSerial nullSerial;
+static BenchStats stats;
+static int64_t clockOverheadNs;
+
+static int64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Cost of an empty timed region, subtracted from every measurement
+static int64_t measureClockOverhead() {
+  int64_t best = INT64_MAX;
+  for (int i = 0; i < 1000; i++) {
+    int64_t ns = elapsedNs(std::chrono::steady_clock::now());
+    if (ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+static void runCase(benchmark::State &state, const BenchCase *bench) {
+  stats.reset();
+  uint32_t iteration = 0;
+
+  for (auto _ : state) {
+    if (bench->prepare != nullptr)
+      bench->prepare(iteration);
+
+    auto start = std::chrono::steady_clock::now();
+    bench->call(iteration);
+    int64_t ns = elapsedNs(start) - clockOverheadNs;
+    stats.add(ns > 0 ? (uint32_t)ns : 0);
+    iteration++;
+  }
+
+  BenchSummary summary = stats.summarize(bench->name);
+  state.counters["mean_ns"] = summary.mean;
+  state.counters["p99_ns"] = summary.p99;
+  state.counters["max_ns"] = summary.max;
+  if (bench->bytes != 0)
+    state.counters["bytes"] = bench->bytes;
+}
+
+int main(int argc, char **argv) {
+  // Default to JSON; a later --benchmark_format on the command line wins
+  std::vector<char *> args(argv, argv + argc);
+  char jsonFormat[] = "--benchmark_format=json";
+  args.insert(args.begin() + 1, jsonFormat);
+  int count = (int)args.size();
+
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    return 2;
+
+  init_nvs();
+  benchSetup(nullSerial);
+  clockOverheadNs = measureClockOverhead();
+
+  for (size_t i = 0; i < benchCaseCount; i++)
+    benchmark::RegisterBenchmark(benchCases[i].name, runCase, &benchCases[i]);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file boot_profile.cpp
+ * @brief Runs the firmware's staged boot sequence against the Linux HAL and
+ * prints the stage timing.
+ *
+ * Usage: boot_profile [options]
+ *
+ *   --assets <dir>    also load the web assets, as the services stage does
+ *                     (output of `tools/compress_assets.py`)
+ *   --period-ms <ms>  sampling period before the first reading (default 100,
+ *                     as RuntimeConfig)
+ *   --eager           start the services before the controllers, as the
+ *                     firmware did before the services were deferred
+ *
+ * The stages are those of app_main: drivers, storage, config, controllers,
+ * services. Each one runs on the stand-ins of hal_linux and the virtual clock
+ * is advanced by the wall time it took, so BootProfiler reports host
+ * durations. The controllers stage also waits one sampling period on the
+ * virtual clock, as the sampling task does before its first reading, and
+ * ends with the relay's first decision. On target the services stage also
+ * brings up Wi-Fi, which dominates it and has no stand-in here.
+ */
+
+#include "../src/util/BasicSwitchController.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BOOT_ADC_RATE_HZ 1000
+
+struct BootOptions {
+  const char *assetDir = nullptr;
+  uint32_t periodMs = 100;
+  bool eager = false;
+};
+
+static BasicSwitchController<SwitchConfig> relay;
+static SolarHistory history;
+static WebApp web;
+static BootProfiler boot;
+static BootOptions options;
+
+static bool parseOptions(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--eager") == 0) {
+      options.eager = true;
+      continue;
+    }
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(argv[i - 1], "--assets") == 0)
+      options.assetDir = value;
+    else if (strcmp(argv[i - 1], "--period-ms") == 0)
+      options.periodMs = (uint32_t)atoi(value);
+    else
+      return false;
+  }
+  return options.periodMs > 0;
+}
+
+static bool startDrivers() {
+  scriptedAdc.setSampleRate(BOOT_ADC_RATE_HZ);
+  scriptedAdc.setWaveform(syntheticDay);
+  return relay.begin();
+}
+
+static bool loadConfig() {
+  calibrateSolarIndex(
+      solar, dividerRatio(SolarSensorConfig::r1, SolarSensorConfig::r2));
+  solar.load();
+  relay.load();
+  return true;
+}
+
+static bool startControllers() {
+  relay.setHistory(&history);
+
+  // The sampling task's first reading comes one period after it starts
+  virtualClock.advance((int64_t)options.periodMs * 1000);
+  scriptedAdc.advance(options.periodMs);
+  relay.run(solar.read(), (uint32_t)millis());
+  boot.decided(micros());
+  return true;
+}
+
+static bool startServices() {
+  bool ok = solarLog.begin();
+  if (ok)
+    solarLog.logEvent(SOLAR_LOG_BOOT, 0);
+  if (options.assetDir != nullptr)
+    ok = web.begin(options.assetDir, relay) && ok;
+  return ok;
+}
+
+/**
+ * @brief Runs one stage and moves the virtual clock on by its wall time.
+ */
+
+static bool runStage(BootStage stage, bool (*work)()) {
+  boot.enter(stage);
+  auto wallStart = std::chrono::steady_clock::now();
+  bool ok = work();
+  auto wall = std::chrono::steady_clock::now() - wallStart;
+  virtualClock.advance(
+      std::chrono::duration_cast<std::chrono::microseconds>(wall).count());
+  boot.leave(stage, ok);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (!parseOptions(argc, argv)) {
+    fprintf(stderr,
+            "usage: %s [--assets dir] [--period-ms ms] [--eager]\n",
+            argv[0]);
+    return 2;
+  }
+
+  bool ok = runStage(BOOT_STAGE_DRIVERS, startDrivers) &&
+            runStage(BOOT_STAGE_STORAGE, init_nvs) &&
+            runStage(BOOT_STAGE_CONFIG, loadConfig);
+  if (ok && options.eager)
+    ok = runStage(BOOT_STAGE_SERVICES, startServices);
+  if (ok)
+    ok = runStage(BOOT_STAGE_CONTROLLERS, startControllers);
+  if (ok && !options.eager)
+    ok = runStage(BOOT_STAGE_SERVICES, startServices);
+
+  boot.report(Serial);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+# Fails unless the symbols of FILES match PATTERN (EXPECT=ON) or none of them
+# do (EXPECT=OFF).
+#
+#   cmake -DNM=nm -DFILES="a.o;b.o" -DPATTERN=regex -DEXPECT=OFF \
+#         -P check_symbols.cmake
+
+foreach(required NM FILES PATTERN EXPECT)
+  if(NOT DEFINED ${required})
+    message(FATAL_ERROR "check_symbols.cmake: ${required} is not set")
+  endif()
+endforeach()
+
+set(matches "")
+foreach(file IN LISTS FILES)
+  execute_process(COMMAND ${NM} -C ${file}
+                  OUTPUT_VARIABLE symbols
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} ${file} failed")
+  endif()
+  string(REGEX MATCHALL "[^\n]*(${PATTERN})[^\n]*" found "${symbols}")
+  list(APPEND matches ${found})
+endforeach()
+
+list(LENGTH matches count)
+if(EXPECT AND count EQUAL 0)
+  message(FATAL_ERROR "no symbol matches ${PATTERN}")
+elseif(NOT EXPECT AND NOT count EQUAL 0)
+  list(JOIN matches "\n  " lines)
+  message(FATAL_ERROR "${count} symbols match ${PATTERN}:\n  ${lines}")
+endif()
+message(STATUS "${count} symbols match ${PATTERN}")
@@ -0,0 +1,182 @@
+/**
+ * @file filter_flaps.cpp
+ * @brief Counts how often noise flips the index across a threshold, with and
+ * without the SolarFilter pipeline.
+ *
+ * Usage: filter_flaps [options]
+ *
+ *   --trace <file>    replay raw readings, one per line, at the ADC rate,
+ *                     instead of the noisy synthetic day
+ *   --hours <n>       simulated duration (default 24)
+ *   --noise <counts>  Gaussian noise added to the synthetic day, standard
+ *                     deviation in ADC counts (default 40)
+ *   --spikes <n>      one full-scale or zero spike every n synthetic samples
+ *                     (default 200)
+ *   --min <index>     lower threshold (default 300)
+ *   --max <index>     upper threshold (default 700)
+ *
+ * Samples arrive at ADC_SAMPLE_RATE_HZ and are read once per control period
+ * (100 ms, as RuntimeConfig). The raw path takes the newest sample, as
+ * SolarIndex did before the filters; the filtered path runs every sample
+ * through SolarFilter and takes its newest output. Each path scales its
+ * count to a 0-1000 index and feeds a SolarIndexMonitor, and every reading
+ * that moves the monitor into or out of the thresholds counts as a flap.
+ * For the synthetic day the noise-free waveform runs through a third monitor
+ * as the reference: flaps beyond its count are caused by noise.
+ *
+ * Exits non-zero if, on the synthetic day, the filter removes less than
+ * FLAPS_MIN_REMOVED of the flaps the noise causes.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLAPS_PERIOD_MS 100
+#define FLAPS_MIN_REMOVED 0.9
+#define FLAPS_FULL_SCALE 4095.0
+
+struct FlapsOptions {
+  const char *trace = nullptr;
+  double hours = 24;
+  double noise = 40;
+  uint32_t spikeEvery = 200;
+  double min = 300;
+  double max = 700;
+};
+
+/**
+ * @brief A monitor that counts the readings moving it into or out of the
+ * thresholds.
+ */
+struct FlapCounter {
+  BasicSolarIndexMonitor<double> monitor;
+  bool within = false;
+  bool started = false;
+  uint32_t flaps = 0;
+
+  explicit FlapCounter(const FlapsOptions &options) {
+    monitor.setThresholds(BasicSolarThresholds<double>(options.max,
+                                                       options.min));
+  }
+
+  void add(uint16_t raw, unsigned long currentMillis) {
+    monitor.updateSolarIndex(raw * (SOLAR_INDEX_MAX_VALUE / FLAPS_FULL_SCALE),
+                             currentMillis);
+    bool now = monitor.withinThresholds();
+    flaps += started && now != within;
+    within = now;
+    started = true;
+  }
+};
+
+static bool parseOptions(int argc, char **argv, FlapsOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--trace") == 0)
+      options.trace = value;
+    else if (strcmp(arg, "--hours") == 0)
+      options.hours = atof(value);
+    else if (strcmp(arg, "--noise") == 0)
+      options.noise = atof(value);
+    else if (strcmp(arg, "--spikes") == 0)
+      options.spikeEvery = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--min") == 0)
+      options.min = atof(value);
+    else if (strcmp(arg, "--max") == 0)
+      options.max = atof(value);
+    else
+      return false;
+  }
+  return options.hours > 0 && options.noise >= 0 && options.max >= options.min;
+}
+
+int main(int argc, char **argv) {
+  FlapsOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr,
+            "usage: %s [--trace file] [--hours n] [--noise counts] "
+            "[--spikes n]\n"
+            "       [--min index] [--max index]\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0.0, options.noise);
+  uint64_t synthetic = 0;
+  scriptedAdc.setSampleRate(ADC_SAMPLE_RATE_HZ);
+  if (options.trace != nullptr) {
+    if (!scriptedAdc.loadRecording(options.trace)) {
+      fprintf(stderr, "%s: no readings\n", options.trace);
+      return 1;
+    }
+  } else {
+    scriptedAdc.setWaveform([&](double seconds) {
+      if (options.spikeEvery != 0 && ++synthetic % options.spikeEvery == 0)
+        return (uint16_t)(rng() & 1 ? FLAPS_FULL_SCALE : 0);
+      double value = syntheticDay(seconds) + noise(rng);
+      if (value < 0)
+        return (uint16_t)0;
+      return (uint16_t)(value > FLAPS_FULL_SCALE ? FLAPS_FULL_SCALE : value);
+    });
+  }
+
+  SolarFilter filter;
+  FlapCounter raw(options), filtered(options), reference(options);
+  uint16_t newestRaw = 0, newestFiltered = 0;
+  SolarSampleRing &samples = scriptedAdc.samples();
+
+  const uint64_t steps =
+      (uint64_t)(options.hours * 3600000.0 / FLAPS_PERIOD_MS);
+  for (uint64_t step = 0; step < steps; step++) {
+    virtualClock.advance((int64_t)FLAPS_PERIOD_MS * 1000);
+    scriptedAdc.advance(FLAPS_PERIOD_MS);
+
+    uint16_t block[SOLAR_READ_BLOCK];
+    size_t count;
+    while ((count = samples.popBatch(block, SOLAR_READ_BLOCK)) != 0) {
+      for (size_t i = 0; i < count; i++) {
+        uint16_t out;
+        if (filter.process(block[i], out))
+          newestFiltered = out;
+      }
+      newestRaw = block[count - 1];
+    }
+
+    unsigned long now = (unsigned long)millis();
+    raw.add(newestRaw, now);
+    filtered.add(newestFiltered, now);
+    if (options.trace == nullptr)
+      reference.add(syntheticDay(now / 1000.0), now);
+  }
+
+  printf("%.1f h, thresholds %.0f-%.0f, %s\n", options.hours, options.min,
+         options.max, options.trace != nullptr ? options.trace : "synthetic");
+  printf("%-10s %8s\n", "path", "flaps");
+  printf("%-10s %8u\n", "raw", (unsigned)raw.flaps);
+  printf("%-10s %8u\n", "filtered", (unsigned)filtered.flaps);
+  if (options.trace != nullptr)
+    return 0;
+
+  printf("%-10s %8u\n", "reference", (unsigned)reference.flaps);
+  double excessRaw = (double)raw.flaps - reference.flaps;
+  double excessFiltered = (double)filtered.flaps - reference.flaps;
+  if (excessFiltered < 0)
+    excessFiltered = 0;
+  double removed = excessRaw > 0 ? 1.0 - excessFiltered / excessRaw : 1.0;
+  printf("noise flaps removed: %.1f%%\n", 100.0 * removed);
+  if (removed < FLAPS_MIN_REMOVED) {
+    fprintf(stderr, "filter removed under %.0f%% of the noise flaps\n",
+            100.0 * FLAPS_MIN_REMOVED);
+    return 1;
+  }
+  return 0;
+}
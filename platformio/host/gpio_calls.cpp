@@ -0,0 +1,136 @@
+/**
+ * @file gpio_calls.cpp
+ * @brief Counts the GPIO and ADC driver calls the controllers make per run.
+ *
+ * Usage: gpio_calls [--hours n] [--period-ms ms]
+ *
+ * Replays the synthetic day, one reading per control period (default 100
+ * ms, as RuntimeConfig), through SwitchControllers in each SwitchMode, one
+ * with relay readback, and a BasicSwitchController. MemoryGpio counts every
+ * configure, write, digital read and analog read; on target each of these
+ * reaches the GPIO or ADC registers. The report gives the calls per 1000
+ * runs.
+ *
+ * Exits non-zero if a controller reads the relay through the ADC, configures
+ * its pin more than once, writes other than to switch, or reads the pin
+ * other than once at start and, with readback, once per write.
+ */
+
+#include "../src/util/BasicSwitchController.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CALLS_FIRST_PIN 4
+#define CALLS_BASIC_PIN 25
+#define CALLS_MIN 400.0
+#define CALLS_MAX 1000.0
+
+struct CallsSwitchConfig : SwitchConfig {
+  static constexpr hal_pin_t relayPin = CALLS_BASIC_PIN;
+  static constexpr unsigned short slot = 8;
+};
+
+struct CallsCase {
+  const char *name;
+  SwitchControl *relay;
+  hal_pin_t pin;
+  bool readback;
+  GpioCallCounts calls;
+};
+
+/**
+ * @brief Adds the calls made since `before` to `total`.
+ */
+
+static void addCalls(GpioCallCounts &total, const GpioCallCounts &before) {
+  const GpioCallCounts &after = memoryGpio.calls();
+  total.configures += after.configures - before.configures;
+  total.writes += after.writes - before.writes;
+  total.reads += after.reads - before.reads;
+  total.analogReads += after.analogReads - before.analogReads;
+}
+
+int main(int argc, char **argv) {
+  double hours = 24;
+  uint32_t periodMs = 100;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--hours") == 0)
+      hours = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--period-ms") == 0)
+      periodMs = (uint32_t)atoi(argv[i + 1]);
+    else
+      hours = 0;
+  }
+  if (argc % 2 == 0 || hours <= 0 || periodMs == 0 || periodMs > 1000) {
+    fprintf(stderr, "usage: %s [--hours n] [--period-ms ms]\n", argv[0]);
+    return 2;
+  }
+
+  scriptedAdc.setWaveform(syntheticDay);
+  init_nvs();
+
+  SwitchController interval(CALLS_FIRST_PIN);
+  SwitchController predictive(CALLS_FIRST_PIN + 1);
+  SwitchController event(CALLS_FIRST_PIN + 2);
+  SwitchController checked(CALLS_FIRST_PIN + 3);
+  BasicSwitchController<CallsSwitchConfig> basic;
+  predictive.setMode(SWITCH_MODE_PREDICTIVE);
+  event.setMode(SWITCH_MODE_EVENT);
+  checked.setMode(SWITCH_MODE_EVENT);
+  checked.setRelayReadback(true);
+
+  CallsCase cases[] = {
+      {"interval", &interval, CALLS_FIRST_PIN, false, {}},
+      {"predictive", &predictive, CALLS_FIRST_PIN + 1, false, {}},
+      {"event", &event, CALLS_FIRST_PIN + 2, false, {}},
+      {"event, readback", &checked, CALLS_FIRST_PIN + 3, true, {}},
+      {"BasicSwitchController", &basic, CallsSwitchConfig::relayPin, false,
+       {}},
+  };
+  const size_t caseCount = sizeof(cases) / sizeof(cases[0]);
+  for (CallsCase &test : cases) {
+    test.relay->setInterval(5);
+    test.relay->setSolarThresholds(CALLS_MAX, CALLS_MIN);
+  }
+
+  const uint64_t runs = (uint64_t)(hours * 3600000.0 / periodMs);
+  for (uint64_t run = 0; run < runs; run++) {
+    virtualClock.advance((int64_t)periodMs * 1000);
+    scriptedAdc.advance(periodMs);
+    uint32_t now = (uint32_t)millis();
+    solar_num_t solarIndex = solar.read();
+
+    for (CallsCase &test : cases) {
+      GpioCallCounts before = memoryGpio.calls();
+      test.relay->run(solarIndex, now);
+      addCalls(test.calls, before);
+    }
+  }
+
+  printf("%.1f h, %llu runs per controller, calls per 1000 runs\n", hours,
+         (unsigned long long)runs);
+  printf("%-22s  %7s  %10s  %8s  %8s  %8s\n", "controller", "toggles",
+         "configures", "writes", "reads", "analog");
+
+  bool ok = true;
+  for (size_t i = 0; i < caseCount; i++) {
+    const CallsCase &test = cases[i];
+    const GpioCallCounts &calls = test.calls;
+    uint32_t toggles = memoryGpio.toggleCount(test.pin);
+    printf("%-22s  %7u  %10.3f  %8.3f  %8.3f  %8.3f\n", test.name,
+           (unsigned)toggles, 1000.0 * calls.configures / runs,
+           1000.0 * calls.writes / runs, 1000.0 * calls.reads / runs,
+           1000.0 * calls.analogReads / runs);
+
+    uint64_t reads = 1 + (test.readback ? calls.writes : 0);
+    if (calls.analogReads != 0 || calls.configures > 1 ||
+        calls.writes != toggles || calls.reads > reads) {
+      fprintf(stderr, "%s: unexpected driver calls\n", test.name);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
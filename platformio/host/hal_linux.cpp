@@ -0,0 +1,152 @@
+/**
+ * @file hal_linux.cpp
+ * @brief Linux backend of the hardware abstraction layer.
+ *
+ * Virtual clock, scripted ADC, in-memory GPIO, NVS and log flash, and a
+ * stdout serial port, so the controller core runs deterministically and as
+ * fast as the host allows.
+ */
+
+#include "hal_linux.h"
+#include "../src/util/main.h"
+#include <string.h>
+
+bool MemoryGpio::configureOutput(hal_pin_t pin) {
+  _calls.configures++;
+  levels[pin] = 0;
+  return true;
+}
+
+bool MemoryGpio::digitalWrite(hal_pin_t pin, int level) {
+  _calls.writes++;
+  int &current = levels[pin];
+  if ((current != 0) != (level != 0))
+    toggles[pin]++;
+  current = level != 0;
+  return true;
+}
+
+int MemoryGpio::digitalRead(hal_pin_t pin) {
+  _calls.reads++;
+  return level(pin);
+}
+
+int MemoryGpio::analogRead(hal_pin_t pin) {
+  _calls.analogReads++;
+  auto it = levels.find(pin);
+  if (it == levels.end())
+    return -1;
+  return it->second ? 4095 : 0;
+}
+
+int MemoryGpio::level(hal_pin_t pin) const {
+  auto it = levels.find(pin);
+  return it == levels.end() ? -1 : it->second;
+}
+
+uint32_t MemoryGpio::toggleCount(hal_pin_t pin) const {
+  auto it = toggles.find(pin);
+  return it == toggles.end() ? 0 : it->second;
+}
+
+bool MemoryKvStore::put(const char *key, ItemType type, const void *value,
+                        size_t length) {
+  if (strlen(key) >= HAL_KV_KEY_SIZE)
+    return false;
+  const uint8_t *bytes = static_cast<const uint8_t *>(value);
+  items[key] = Item{type, std::vector<uint8_t>(bytes, bytes + length)};
+  return true;
+}
+
+bool MemoryKvStore::fetch(const char *key, ItemType type, void *value,
+                          size_t *length) {
+  auto it = items.find(key);
+  if (it == items.end() || it->second.type != type ||
+      it->second.bytes.size() > *length)
+    return false;
+  memcpy(value, it->second.bytes.data(), it->second.bytes.size());
+  *length = it->second.bytes.size();
+  return true;
+}
+
+bool MemoryKvStore::setI32(const char *key, int32_t value) {
+  return put(key, ITEM_I32, &value, sizeof(value));
+}
+
+bool MemoryKvStore::getI32(const char *key, int32_t *value) {
+  size_t length = sizeof(*value);
+  return fetch(key, ITEM_I32, value, &length);
+}
+
+bool MemoryKvStore::setStr(const char *key, const char *value) {
+  return put(key, ITEM_STR, value, strlen(value) + 1);
+}
+
+bool MemoryKvStore::getStr(const char *key, char *value, size_t *length) {
+  return fetch(key, ITEM_STR, value, length);
+}
+
+bool MemoryKvStore::setBlob(const char *key, const void *value,
+                            size_t length) {
+  return put(key, ITEM_BLOB, value, length);
+}
+
+bool MemoryKvStore::getBlob(const char *key, void *value, size_t *length) {
+  return fetch(key, ITEM_BLOB, value, length);
+}
+
+bool MemoryKvStore::erase(const char *key) { return items.erase(key) != 0; }
+
+bool MemoryKvStore::commit() {
+  commits++;
+  return true;
+}
+
+bool MemoryFlash::erase(size_t offset, size_t length) {
+  if (offset + length > bytes.size())
+    return false;
+  memset(bytes.data() + offset, 0xFF, length);
+  return true;
+}
+
+bool MemoryFlash::write(size_t offset, const void *data, size_t length) {
+  if (offset + length > bytes.size())
+    return false;
+  const uint8_t *src = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < length; i++)
+    bytes[offset + i] &= src[i];
+  return true;
+}
+
+/**
+ * @brief Writes the image to a file readable by `solarlog_read`.
+ */
+
+bool MemoryFlash::save(const char *path) const {
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr)
+    return false;
+  bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return fclose(file) == 0 && written;
+}
+
+void StdoutSerial::write(const char *data, size_t length) {
+  fwrite(data, 1, length, out);
+}
+
+VirtualClock virtualClock;
+WaveformSampler scriptedAdc;
+MemoryGpio memoryGpio;
+MemoryKvStore memoryKv;
+MemoryFlash memoryLogFlash(HOST_LOG_FLASH_SIZE);
+StdoutSerial stdoutSerial;
+
+HalClock &halClock = virtualClock;
+HalAdc &halAdc = scriptedAdc;
+HalGpio &halGpio = memoryGpio;
+HalKvStore &halKv = memoryKv;
+HalFlash &halLogFlash = memoryLogFlash;
+HalSerial &Serial = stdoutSerial;
+
+// Defined after the backends so they are constructed first
+SolarIndex solar("SolarRead", scriptedAdc.samples());
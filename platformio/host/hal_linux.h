@@ -0,0 +1,144 @@
+#ifndef HAL_LINUX_H
+#define HAL_LINUX_H
+#include "../src/util/hal.h"
+#include "WaveformSampler.h"
+#include <atomic>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Same size as the "solarlog" partition in partitions.csv
+#define HOST_LOG_FLASH_SIZE 0x80000
+
+/**
+ * @class VirtualClock
+ * @brief Clock that only moves when told to.
+ */
+
+class VirtualClock : public HalClock {
+private:
+  std::atomic<int64_t> now{0};
+
+public:
+  int64_t micros() override { return now.load(); }
+  void advance(int64_t elapsedMicros) { now += elapsedMicros; }
+};
+
+/**
+ * @brief Driver calls made on a MemoryGpio, each of which would reach the
+ * GPIO or ADC registers on target.
+ */
+struct GpioCallCounts {
+  uint64_t configures;
+  uint64_t writes;
+  uint64_t reads;
+  uint64_t analogReads;
+};
+
+/**
+ * @class MemoryGpio
+ * @brief Records relay levels and counts driver calls; reading a pin returns
+ * its last written level, as a full-scale or zero ADC count for
+ * `analogRead()`.
+ */
+
+class MemoryGpio : public HalGpio {
+private:
+  std::map<hal_pin_t, int> levels;
+  std::map<hal_pin_t, uint32_t> toggles;
+  GpioCallCounts _calls = {};
+
+public:
+  bool configureOutput(hal_pin_t pin) override;
+  bool digitalWrite(hal_pin_t pin, int level) override;
+  int digitalRead(hal_pin_t pin) override;
+  int analogRead(hal_pin_t pin) override;
+
+  int level(hal_pin_t pin) const;
+  uint32_t toggleCount(hal_pin_t pin) const;
+  const GpioCallCounts &calls() const { return _calls; }
+  void resetCalls() { _calls = {}; }
+};
+
+/**
+ * @class MemoryKvStore
+ * @brief In-memory NVS namespace.
+ *
+ * Like NVS, a key holds one typed item and reading it as another type fails.
+ * Commits are only counted.
+ */
+
+class MemoryKvStore : public HalKvStore {
+private:
+  enum ItemType { ITEM_I32, ITEM_STR, ITEM_BLOB };
+
+  struct Item {
+    ItemType type;
+    std::vector<uint8_t> bytes;
+  };
+
+  std::map<std::string, Item> items;
+  uint32_t commits = 0;
+
+  bool put(const char *key, ItemType type, const void *value, size_t length);
+  bool fetch(const char *key, ItemType type, void *value, size_t *length);
+
+public:
+  bool init() override { return true; }
+  bool open() override { return true; }
+  bool setI32(const char *key, int32_t value) override;
+  bool getI32(const char *key, int32_t *value) override;
+  bool setStr(const char *key, const char *value) override;
+  bool getStr(const char *key, char *value, size_t *length) override;
+  bool setBlob(const char *key, const void *value, size_t length) override;
+  bool getBlob(const char *key, void *value, size_t *length) override;
+  bool erase(const char *key) override;
+  bool commit() override;
+
+  uint32_t commitCount() const { return commits; }
+};
+
+/**
+ * @class MemoryFlash
+ * @brief RAM image of the log partition with NOR erase/program semantics.
+ */
+
+class MemoryFlash : public HalFlash {
+private:
+  std::vector<uint8_t> bytes;
+
+public:
+  explicit MemoryFlash(size_t size) : bytes(size, 0xFF) {}
+
+  const void *map() override { return bytes.data(); }
+  size_t size() override { return bytes.size(); }
+  bool erase(size_t offset, size_t length) override;
+  bool write(size_t offset, const void *data, size_t length) override;
+
+  bool save(const char *path) const;
+};
+
+/**
+ * @class StdoutSerial
+ * @brief Serial port writing to a stdio stream, stdout by default.
+ */
+
+class StdoutSerial : public HalSerial {
+private:
+  FILE *out = stdout;
+
+public:
+  void redirect(FILE *stream) { out = stream; }
+  void write(const char *data, size_t length) override;
+  void flush() override { fflush(out); }
+};
+
+extern VirtualClock virtualClock;
+extern WaveformSampler scriptedAdc;
+extern MemoryGpio memoryGpio;
+extern MemoryKvStore memoryKv;
+extern MemoryFlash memoryLogFlash;
+extern StdoutSerial stdoutSerial;
+
+#endif
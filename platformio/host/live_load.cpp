@@ -0,0 +1,255 @@
+/**
+ * @file live_load.cpp
+ * @brief Load generator for the live stream of a running web_serve.
+ *
+ * Usage: live_load [options]
+ *
+ *   --port <n>        web_serve port on 127.0.0.1 (default 8080)
+ *   --clients <n>     concurrent /api/live connections (default 64)
+ *   --seconds <n>     how long to receive after connecting (default 10)
+ *   --server-pid <n>  sample web_serve's resident memory before and after
+ *                     connecting, to report memory per client
+ *
+ * All clients are read from one epoll loop that counts whole event frames.
+ * A summary goes to stdout.
+ */
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#define LIVE_LOAD_SETTLE_MS 1000
+
+struct LoadOptions {
+  uint16_t port = 8080;
+  int clients = 64;
+  double seconds = 10;
+  int serverPid = 0;
+};
+
+/**
+ * @brief Receive state of one connection.
+ */
+struct LoadClient {
+  int fd = -1;
+  bool headDone = false;
+  bool rejected = false;
+  bool open = false;
+  char head[256];
+  size_t headLength = 0;
+  bool previousNewline = false;
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+};
+
+static bool parseOptions(int argc, char **argv, LoadOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--port") == 0)
+      options.port = (uint16_t)atoi(value);
+    else if (strcmp(arg, "--clients") == 0)
+      options.clients = atoi(value);
+    else if (strcmp(arg, "--seconds") == 0)
+      options.seconds = atof(value);
+    else if (strcmp(arg, "--server-pid") == 0)
+      options.serverPid = atoi(value);
+    else
+      return false;
+  }
+  return options.clients > 0 && options.seconds > 0;
+}
+
+/**
+ * @brief Resident set size of a process in KiB, or -1.
+ */
+
+static long residentKib(int pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE *status = fopen(path, "r");
+  if (status == nullptr)
+    return -1;
+
+  char line[128];
+  long kib = -1;
+  while (fgets(line, sizeof(line), status) != nullptr) {
+    if (sscanf(line, "VmRSS: %ld kB", &kib) == 1)
+      break;
+  }
+  fclose(status);
+  return kib;
+}
+
+static bool connectClient(LoadClient &client, uint16_t port) {
+  client.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (client.fd < 0)
+    return false;
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client.fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    return false;
+
+  static const char request[] = "GET /api/live HTTP/1.1\r\n"
+                                "Host: 127.0.0.1\r\n"
+                                "Accept: text/event-stream\r\n"
+                                "\r\n";
+  if (send(client.fd, request, sizeof(request) - 1, MSG_NOSIGNAL) !=
+      (ssize_t)sizeof(request) - 1)
+    return false;
+
+  fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL) | O_NONBLOCK);
+  client.open = true;
+  return true;
+}
+
+/**
+ * @brief Consumes received bytes: the response head first, then frames,
+ * each ended by a blank line.
+ */
+
+static void receive(LoadClient &client, const char *data, size_t length) {
+  client.bytes += length;
+  size_t at = 0;
+
+  while (!client.headDone && at < length) {
+    if (client.headLength < sizeof(client.head) - 1)
+      client.head[client.headLength++] = data[at];
+    at++;
+    client.head[client.headLength] = '\0';
+    if (strstr(client.head, "\r\n\r\n") != nullptr) {
+      client.headDone = true;
+      client.rejected = strncmp(client.head, "HTTP/1.1 200", 12) != 0;
+    }
+  }
+
+  for (; at < length; at++) {
+    bool newline = data[at] == '\n';
+    if (newline && client.previousNewline)
+      client.frames++;
+    client.previousNewline = newline;
+  }
+}
+
+/**
+ * @brief Reads every client until `deadline`.
+ */
+
+static void pump(int epoll, std::vector<LoadClient> &clients,
+                 std::chrono::steady_clock::time_point deadline,
+                 bool count) {
+  struct epoll_event events[64];
+  char buffer[16384];
+
+  while (std::chrono::steady_clock::now() < deadline) {
+    int ready = epoll_wait(epoll, events, 64, 50);
+    for (int e = 0; e < ready; e++) {
+      LoadClient &client = clients[events[e].data.u32];
+      while (true) {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+          if (count || !client.headDone)
+            receive(client, buffer, received);
+          continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          epoll_ctl(epoll, EPOLL_CTL_DEL, client.fd, nullptr);
+          client.open = false;
+        }
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  LoadOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr,
+            "usage: %s [--port n] [--clients n] [--seconds n] "
+            "[--server-pid pid]\n",
+            argv[0]);
+    return 2;
+  }
+
+  long rssBefore = options.serverPid ? residentKib(options.serverPid) : -1;
+
+  std::vector<LoadClient> clients(options.clients);
+  int epoll = epoll_create1(0);
+  for (int i = 0; i < options.clients; i++) {
+    if (!connectClient(clients[i], options.port)) {
+      perror("connect");
+      return 1;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t)i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, clients[i].fd, &event);
+  }
+
+  // Let every connection be answered before measuring
+  auto settled = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(LIVE_LOAD_SETTLE_MS);
+  pump(epoll, clients, settled, false);
+  long rssAfter = options.serverPid ? residentKib(options.serverPid) : -1;
+
+  for (LoadClient &client : clients)
+    client.frames = client.bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline =
+      start + std::chrono::microseconds((int64_t)(options.seconds * 1e6));
+  pump(epoll, clients, deadline, true);
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  int streaming = 0, rejected = 0, closed = 0;
+  uint64_t frames = 0, bytes = 0, minFrames = UINT64_MAX, maxFrames = 0;
+  for (LoadClient &client : clients) {
+    if (client.rejected) {
+      rejected++;
+      continue;
+    }
+    if (!client.open)
+      closed++;
+    streaming++;
+    frames += client.frames;
+    bytes += client.bytes;
+    if (client.frames < minFrames)
+      minFrames = client.frames;
+    if (client.frames > maxFrames)
+      maxFrames = client.frames;
+    close(client.fd);
+  }
+  if (streaming == 0)
+    minFrames = 0;
+
+  printf("clients        %d streaming, %d rejected, %d closed early\n",
+         streaming, rejected, closed);
+  printf("frames/s       %.1f total, %.2f per client (min %llu, max %llu "
+         "frames)\n",
+         frames / elapsed, streaming ? frames / elapsed / streaming : 0.0,
+         (unsigned long long)minFrames, (unsigned long long)maxFrames);
+  printf("throughput     %.1f KiB/s\n", bytes / elapsed / 1024.0);
+  if (rssBefore >= 0 && rssAfter >= 0 && streaming != 0)
+    printf("server memory  %ld KiB -> %ld KiB, %.1f KiB per client\n",
+           rssBefore, rssAfter,
+           (double)(rssAfter - rssBefore) / streaming);
+  return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file numeric_match.cpp
+ * @brief Checks that the double and Q16.16 solar index paths switch alike.
+ *
+ * Usage: numeric_match [--trace file] [--hours n]
+ *
+ * Every ADC sample of the trace (the synthetic day by default) is copied into
+ * two sample rings, one read by a BasicSolarIndex<double> and one by a
+ * BasicSolarIndex<Q16_16>. Each index feeds a BasicSolarIndexMonitor of its
+ * own type, one reading per control period (100 ms, as RuntimeConfig), and
+ * a relay decided as SwitchController's interval mode does (5 min interval).
+ * Several threshold pairs, including the default 0-1000, run side by side.
+ *
+ * The report gives, per pair, the relay toggles of either path, the intervals
+ * decided differently, the readings placed in a different zone and the
+ * largest index difference. Exits non-zero if any interval is decided
+ * differently, or if a Q16.16 build fails to migrate what the double build
+ * stored: the highest voltage as a legacy string or a tagged double, and
+ * thresholds as a legacy untagged blob or tagged doubles.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define MATCH_PERIOD_MS 100
+#define MATCH_INTERVAL_MS (5 * MINUTES_TO_MILLIS)
+#define MATCH_ADC_RATE_HZ 40
+
+struct MatchThresholds {
+  double max;
+  double min;
+};
+
+static const MatchThresholds matchThresholds[] = {
+    {SOLAR_INDEX_MAX_VALUE, 0}, {1000, 400}, {700, 300}, {900, 100}};
+
+/**
+ * @brief One index, monitor and relay decision in numeric type `T`.
+ */
+template <typename T> struct MatchPath {
+  SolarSampleRing ring;
+  BasicSolarIndex<T> index;
+  BasicSolarIndexMonitor<T> monitor;
+  unsigned long previousMillis = 0;
+  int level = 0;
+  uint32_t toggles = 0;
+
+  MatchPath(const char *key, const MatchThresholds &thresholds)
+      : index(key, ring) {
+    monitor.setThresholds(
+        BasicSolarThresholds<T>(T(thresholds.max), T(thresholds.min)));
+  }
+
+  /**
+   * @brief Takes one reading; returns `true` when an interval was decided.
+   */
+  bool run(unsigned long currentMillis, T &value) {
+    value = index.read();
+    monitor.updateSolarIndex(value, currentMillis);
+    if (currentMillis - previousMillis < MATCH_INTERVAL_MS)
+      return false;
+
+    unsigned long rangeDuration;
+    monitor.getDurationWithinThreshold(rangeDuration);
+    int next = rangeDuration > MATCH_INTERVAL_MS;
+    toggles += next != level;
+    level = next;
+    previousMillis = currentMillis;
+    monitor.resetTimer();
+    return true;
+  }
+};
+
+struct MatchResult {
+  uint64_t intervals;
+  uint64_t decisionMismatches;
+  uint64_t zoneMismatches;
+  double maxDifference;
+};
+
+/**
+ * @brief Both paths for one threshold pair, each with its own NVS key.
+ */
+struct MatchPair {
+  const MatchThresholds &thresholds;
+  MatchPath<double> floating;
+  MatchPath<Q16_16> fixed;
+  MatchResult result = {};
+
+  MatchPair(const MatchThresholds &thresholds, const char *doubleKey,
+            const char *fixedKey)
+      : thresholds(thresholds), floating(doubleKey, thresholds),
+        fixed(fixedKey, thresholds) {}
+
+  void run(const uint16_t *block, size_t count) {
+    floating.ring.pushBatch(block, count);
+    fixed.ring.pushBatch(block, count);
+  }
+
+  void run(unsigned long currentMillis) {
+    double floatingValue;
+    Q16_16 fixedValue;
+    bool decided = floating.run(currentMillis, floatingValue);
+    fixed.run(currentMillis, fixedValue);
+
+    double difference = fabs(floatingValue - fixedValue.toDouble());
+    if (difference > result.maxDifference)
+      result.maxDifference = difference;
+    result.zoneMismatches +=
+        floating.monitor.withinThresholds() != fixed.monitor.withinThresholds();
+    if (decided) {
+      result.intervals++;
+      result.decisionMismatches += floating.level != fixed.level;
+    }
+  }
+};
+
+static const char *const matchDoubleKeys[] = {"nm_dbl0", "nm_dbl1",
+                                              "nm_dbl2", "nm_dbl3"};
+static const char *const matchFixedKeys[] = {"nm_q160", "nm_q161", "nm_q162",
+                                             "nm_q163"};
+
+/**
+ * @brief Reads back, as Q16.16, each encoding a double build may have left.
+ */
+
+static bool checkMigration() {
+  BasicSolarThresholds<double> legacy(800.5, 200.25);
+  memoryKv.setStr("nm_str", "12.5");
+  memoryKv.setBlob("nm_raw", &legacy, sizeof(legacy));
+  store("nm_dbl", 7.25);
+  store("nm_thr", legacy);
+
+  const BasicSolarThresholds<Q16_16> expected(Q16_16(800.5), Q16_16(200.25));
+  bool ok = true;
+  for (int pass = 0; pass < 2; pass++) {
+    Q16_16 fromString, fromDouble;
+    BasicSolarThresholds<Q16_16> fromRaw, fromTagged;
+    if (!retrieve("nm_str", fromString) || fromString != Q16_16(12.5) ||
+        !retrieve("nm_dbl", fromDouble) || fromDouble != Q16_16(7.25) ||
+        !retrieve("nm_raw", fromRaw) || fromRaw != expected ||
+        !retrieve("nm_thr", fromTagged) || fromTagged != expected) {
+      // The second pass reads the values the first one rewrote
+      fprintf(stderr, "Q16.16 migration failed on pass %d\n", pass + 1);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const char *trace = nullptr;
+  double hours = 24;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--trace") == 0)
+      trace = argv[i + 1];
+    else if (strcmp(argv[i], "--hours") == 0)
+      hours = atof(argv[i + 1]);
+    else
+      hours = 0;
+  }
+  if (argc % 2 == 0 || hours <= 0) {
+    fprintf(stderr, "usage: %s [--trace file] [--hours n]\n", argv[0]);
+    return 2;
+  }
+
+  if (trace != nullptr) {
+    if (!scriptedAdc.loadRecording(trace)) {
+      fprintf(stderr, "%s: no readings\n", trace);
+      return 1;
+    }
+  } else {
+    scriptedAdc.setWaveform(syntheticDay);
+  }
+  init_nvs();
+  bool ok = checkMigration();
+  scriptedAdc.setSampleRate(MATCH_ADC_RATE_HZ);
+
+  static_assert(sizeof(matchThresholds) / sizeof(matchThresholds[0]) ==
+                    sizeof(matchDoubleKeys) / sizeof(matchDoubleKeys[0]),
+                "one pair of keys per threshold pair");
+  std::vector<std::unique_ptr<MatchPair>> pairs;
+  for (size_t i = 0; i < sizeof(matchThresholds) / sizeof(matchThresholds[0]);
+       i++)
+    pairs.emplace_back(new MatchPair(matchThresholds[i], matchDoubleKeys[i],
+                                     matchFixedKeys[i]));
+
+  SolarSampleRing &source = scriptedAdc.samples();
+  const uint64_t steps = (uint64_t)(hours * 3600000.0 / MATCH_PERIOD_MS);
+  for (uint64_t step = 0; step < steps; step++) {
+    virtualClock.advance((int64_t)MATCH_PERIOD_MS * 1000);
+    scriptedAdc.advance(MATCH_PERIOD_MS);
+
+    uint16_t block[SOLAR_READ_BLOCK];
+    size_t count;
+    while ((count = source.popBatch(block, SOLAR_READ_BLOCK)) != 0)
+      for (auto &pair : pairs)
+        pair->run(block, count);
+
+    unsigned long now = (unsigned long)millis();
+    for (auto &pair : pairs)
+      pair->run(now);
+  }
+
+  printf("%.1f h, %u ms period, %u min interval\n", hours,
+         (unsigned)MATCH_PERIOD_MS,
+         (unsigned)(MATCH_INTERVAL_MS / MINUTES_TO_MILLIS));
+  printf("%-11s  %8s  %8s  %9s  %9s  %12s  %9s\n", "thresholds", "double",
+         "Q16.16", "intervals", "decisions", "zone diffs", "max diff");
+
+  for (auto &pair : pairs) {
+    const MatchResult &result = pair->result;
+    char range[16];
+    snprintf(range, sizeof(range), "%.0f-%.0f", pair->thresholds.min,
+             pair->thresholds.max);
+    printf("%-11s  %8u  %8u  %9llu  %9llu  %12llu  %9.4f\n", range,
+           (unsigned)pair->floating.toggles, (unsigned)pair->fixed.toggles,
+           (unsigned long long)result.intervals,
+           (unsigned long long)result.decisionMismatches,
+           (unsigned long long)result.zoneMismatches, result.maxDifference);
+    if (result.decisionMismatches != 0) {
+      fprintf(stderr, "%s: double and Q16.16 decide differently\n", range);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file nvs_boot.cpp
+ * @brief Counts the NVS opens and commits of a boot plus one threshold
+ * update.
+ *
+ * Usage: nvs_boot [--provisioned]
+ *
+ * Runs what app_main does with storage, against MemoryKvStore: init_nvs(),
+ * the ADC calibration, loading the highest voltage and the relay's
+ * thresholds, and the first reading, which stores a new highest voltage.
+ * Then the thresholds are changed once, as the web API does. By default the
+ * store starts empty, as on a new device, so boot writes the defaults;
+ * --provisioned seeds it with the values a previous boot left.
+ *
+ * For each phase the report gives the outermost NvsSessions and the store
+ * calls, which before NvsSession and the write-back cache each cost an
+ * `nvs_open` and an `nvs_commit` respectively, next to the opens and commits
+ * made now, and the host wall time. MemoryKvStore commits in no time, so on
+ * target the latency saved is the commits saved times the INSTR_NVS_COMMIT
+ * time.
+ */
+
+#include "../src/util/BasicSwitchController.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define BOOT_PERIOD_MS 100
+#define BOOT_SEED_VOLTS 14.0
+
+struct BootPhase {
+  const char *name;
+  StorageCacheStats stats;
+  uint32_t kvCommits;
+  double wallMicros;
+};
+
+/**
+ * @brief Writes a value to MemoryKvStore as `store<T>()` would have, without
+ * going through the cache.
+ */
+
+template <typename T> static void seed(const char *key, const T &value) {
+  uint8_t blob[sizeof(StorageTag) + sizeof(T)];
+  StorageTag tag = {StorageType<T>::id, StorageType<T>::version,
+                    (uint8_t)sizeof(T), 0};
+  memcpy(blob, &tag, sizeof(tag));
+  memcpy(blob + sizeof(tag), &value, sizeof(T));
+  memoryKv.setBlob(key, blob, sizeof(blob));
+}
+
+/**
+ * @brief Runs `work` and records the storage counters it moved.
+ */
+
+template <typename Work>
+static BootPhase measure(const char *name, Work work) {
+  StorageCacheStats before = getStorageCacheStats();
+  uint32_t kvBefore = memoryKv.commitCount();
+  auto wallStart = std::chrono::steady_clock::now();
+  work();
+  auto wall = std::chrono::steady_clock::now() - wallStart;
+  StorageCacheStats after = getStorageCacheStats();
+
+  BootPhase phase = {name, {}, memoryKv.commitCount() - kvBefore,
+                     std::chrono::duration<double, std::micro>(wall).count()};
+  phase.stats.sessions = after.sessions - before.sessions;
+  phase.stats.stores = after.stores - before.stores;
+  phase.stats.opens = after.opens - before.opens;
+  phase.stats.commits = after.commits - before.commits;
+  return phase;
+}
+
+static void printPhase(const BootPhase &phase) {
+  printf("%-18s  %8u  %6u  %6u  %7u  %8.1f\n", phase.name,
+         (unsigned)phase.stats.sessions, (unsigned)phase.stats.stores,
+         (unsigned)phase.stats.opens, (unsigned)phase.kvCommits,
+         phase.wallMicros);
+}
+
+int main(int argc, char **argv) {
+  bool provisioned = argc == 2 && strcmp(argv[1], "--provisioned") == 0;
+  if (argc > 2 || (argc == 2 && !provisioned)) {
+    fprintf(stderr, "usage: %s [--provisioned]\n", argv[0]);
+    return 2;
+  }
+
+  BasicSwitchController<SwitchConfig> relay;
+  char slotKey[SWITCH_SLOT_KEY_SIZE];
+  switchSlotKey(SwitchConfig::slot, slotKey);
+  if (provisioned) {
+    seed("SolarRead", solar_num_t(BOOT_SEED_VOLTS));
+    seed(slotKey, SolarThresholds(solar_num_t(900.0), solar_num_t(200.0)));
+  }
+  scriptedAdc.setWaveform(syntheticDay);
+
+  BootPhase boot = measure("boot", [&] {
+    init_nvs();
+    calibrateSolarIndex(
+        solar, dividerRatio(SolarSensorConfig::r1, SolarSensorConfig::r2));
+    solar.load();
+    relay.load();
+
+    virtualClock.advance((int64_t)BOOT_PERIOD_MS * 1000);
+    scriptedAdc.advance(BOOT_PERIOD_MS);
+    relay.run(solar.read(), (uint32_t)millis());
+  });
+  BootPhase update =
+      measure("threshold update", [&] { relay.setSolarThresholds(800, 300); });
+  BootPhase settle = measure("flush", [] { flushStorage(); });
+
+  BootPhase total = {"total", {}, 0, 0};
+  for (const BootPhase *phase : {&boot, &update, &settle}) {
+    total.stats.sessions += phase->stats.sessions;
+    total.stats.stores += phase->stats.stores;
+    total.stats.opens += phase->stats.opens;
+    total.kvCommits += phase->kvCommits;
+    total.wallMicros += phase->wallMicros;
+  }
+
+  printf("%s device\n", provisioned ? "provisioned" : "new");
+  printf("%-18s  %8s  %6s  %6s  %7s  %8s\n", "phase", "sessions", "stores",
+         "opens", "commits", "wall us");
+  printPhase(boot);
+  printPhase(update);
+  printPhase(settle);
+  printPhase(total);
+  printf("before sessions: %u opens, %u commits\n",
+         (unsigned)total.stats.sessions, (unsigned)total.stats.stores);
+  return 0;
+}
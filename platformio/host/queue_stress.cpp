@@ -0,0 +1,170 @@
+/**
+ * @file queue_stress.cpp
+ * @brief Two-thread stress test and throughput comparison for SpscQueue.
+ *
+ * Usage: queue_stress [--items n]
+ *
+ * A producer thread pushes sequence-numbered SolarReadings in random batch
+ * sizes and a consumer thread pops them in other random batch sizes,
+ * checking that every reading arrives once, in order and intact. This runs
+ * for SolarReadingQueue (the 8-slot queue between Runtime's sampling and
+ * control tasks) and for a 1024-slot queue, and then for a mutex and
+ * condition variable queue that blocks like a FreeRTOS xQueue, as the
+ * baseline. Build with -DSOLAR_SANITIZE_THREAD=ON to run it under
+ * ThreadSanitizer. Exits non-zero if any reading is lost, duplicated or
+ * reordered.
+ */
+
+#include "../src/util/main.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define STRESS_DEFAULT_ITEMS 10000000
+#define STRESS_MAX_BATCH 16
+
+/**
+ * @brief Bounded blocking queue with the semantics of a FreeRTOS xQueue:
+ * one lock around every copy, waiters sleep until there is room or data.
+ */
+template <typename T, size_t Capacity> class BlockingQueue {
+private:
+  T buffer[Capacity];
+  size_t head = 0;
+  size_t tail = 0;
+  std::mutex lock;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+
+public:
+  void send(const T &element) {
+    std::unique_lock<std::mutex> guard(lock);
+    notFull.wait(guard, [this] { return head - tail < Capacity; });
+    buffer[head++ % Capacity] = element;
+    notEmpty.notify_one();
+  }
+
+  void receive(T &element) {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this] { return head != tail; });
+    element = buffer[tail++ % Capacity];
+    notFull.notify_one();
+  }
+};
+
+static SolarReading stressReading(uint32_t sequence) {
+  return {solar_num_t((int32_t)(sequence % 1000)), sequence,
+          (int64_t)sequence * 7};
+}
+
+static bool stressIntact(const SolarReading &reading, uint32_t expected) {
+  SolarReading wanted = stressReading(expected);
+  return reading.millis == expected &&
+         reading.takenMicros == wanted.takenMicros &&
+         reading.solarIndex == wanted.solarIndex;
+}
+
+/**
+ * @brief Small xorshift generator, one per thread, for batch sizes.
+ */
+static size_t nextBatch(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return 1 + state % STRESS_MAX_BATCH;
+}
+
+template <size_t Capacity>
+static bool stressSpsc(const char *name, uint32_t items) {
+  static SpscQueue<SolarReading, Capacity> queue;
+  bool intact = true;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([items] {
+    SolarReading block[STRESS_MAX_BATCH];
+    uint32_t state = 0x12345678, next = 0;
+    while (next < items) {
+      size_t count = nextBatch(state);
+      if (count > items - next)
+        count = items - next;
+      for (size_t i = 0; i < count; i++)
+        block[i] = stressReading(next + i);
+
+      size_t pushed = 0;
+      while (pushed < count) {
+        size_t n = queue.pushBatch(block + pushed, count - pushed);
+        if (n == 0)
+          std::this_thread::yield();
+        pushed += n;
+      }
+      next += count;
+    }
+  });
+
+  SolarReading block[STRESS_MAX_BATCH];
+  uint32_t state = 0x9abcdef0, expected = 0;
+  while (expected < items) {
+    size_t count = queue.popBatch(block, nextBatch(state));
+    if (count == 0)
+      std::this_thread::yield();
+    for (size_t i = 0; i < count; i++)
+      intact &= stressIntact(block[i], expected++);
+  }
+  producer.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%-28s %8.1f M readings/s  %s\n", name, items / seconds / 1e6,
+         intact ? "intact" : "CORRUPTED");
+  return intact;
+}
+
+template <size_t Capacity>
+static bool stressBlocking(const char *name, uint32_t items) {
+  static BlockingQueue<SolarReading, Capacity> queue;
+  bool intact = true;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([items] {
+    for (uint32_t i = 0; i < items; i++)
+      queue.send(stressReading(i));
+  });
+
+  SolarReading reading;
+  for (uint32_t i = 0; i < items; i++) {
+    queue.receive(reading);
+    intact &= stressIntact(reading, i);
+  }
+  producer.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%-28s %8.1f M readings/s  %s\n", name, items / seconds / 1e6,
+         intact ? "intact" : "CORRUPTED");
+  return intact;
+}
+
+int main(int argc, char **argv) {
+  uint32_t items = STRESS_DEFAULT_ITEMS;
+  if (argc == 3 && strcmp(argv[1], "--items") == 0) {
+    items = (uint32_t)strtoul(argv[2], nullptr, 10);
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--items n]\n", argv[0]);
+    return 2;
+  }
+
+  bool intact = true;
+  intact &=
+      stressSpsc<RUNTIME_SAMPLE_QUEUE_LENGTH>("SpscQueue, 8 slots", items);
+  intact &= stressSpsc<1024>("SpscQueue, 1024 slots", items);
+  intact &= stressBlocking<RUNTIME_SAMPLE_QUEUE_LENGTH>(
+      "blocking queue, 8 slots", items);
+  intact &= stressBlocking<1024>("blocking queue, 1024 slots", items);
+  return intact ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file solar_history.cpp
+ * @brief Checks SolarHistory's rollups and measures its cost per sample.
+ *
+ * Usage: solar_history [--days n]
+ *
+ * Feeds a SolarHistory four samples a second for 31 days by default, so the
+ * hour tier wraps, leaving an empty second now and then. The same samples
+ * are kept and every tier is then recomputed from them in bulk: per second
+ * the mean of the samples, per minute and hour the minimum and maximum of
+ * the samples and the mean of the tier below, empty periods skipped. Every
+ * entry the history still holds must match.
+ *
+ * Each `add()` is timed and sorted by what it closed: nothing, a second, a
+ * minute or an hour. The report gives the mean time of each kind and of
+ * every day; a rollup does a fixed amount of work whatever the history
+ * holds, so the last day costs what the first one did. Also reports
+ * `sizeof(SolarHistory)` against SOLAR_HISTORY_RAM_BUDGET.
+ *
+ * Exits non-zero if an entry differs, the history is over its budget, or
+ * the last day's mean cost per sample is more than SHIST_MAX_GROWTH times
+ * the first day's.
+ */
+
+#include "../src/util/SolarHistory.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define SHIST_PERIOD_MS 250
+#define SHIST_EMPTY_EVERY 97 // seconds; one in this many gets no samples
+#define SHIST_MAX_GROWTH 4.0
+
+typedef std::chrono::steady_clock HistoryClock;
+
+enum RollupKind { ROLLUP_NONE, ROLLUP_SECOND, ROLLUP_MINUTE, ROLLUP_HOUR };
+
+static const char *const rollupNames[] = {"sample", "second", "minute",
+                                          "hour"};
+
+/**
+ * @brief Running minimum, mean and maximum, as the history aggregates them.
+ */
+struct ReferenceAccumulator {
+  uint32_t sum = 0;
+  uint16_t count = 0;
+  uint16_t min = SOLAR_HISTORY_NO_DATA;
+  uint16_t max = 0;
+
+  void add(uint16_t mean, uint16_t low, uint16_t high) {
+    sum += mean;
+    count++;
+    if (low < min)
+      min = low;
+    if (high > max)
+      max = high;
+  }
+
+  HistoryAggregate result() const {
+    if (count == 0)
+      return {SOLAR_HISTORY_NO_DATA, SOLAR_HISTORY_NO_DATA,
+              SOLAR_HISTORY_NO_DATA};
+    return {min, (uint16_t)((sum + count / 2) / count), max};
+  }
+};
+
+static bool sameAggregate(const HistoryAggregate &a,
+                          const HistoryAggregate &b) {
+  return a.min == b.min && a.mean == b.mean && a.max == b.max;
+}
+
+/**
+ * @brief Rolls `fine` up `per` entries at a time.
+ */
+
+static std::vector<HistoryAggregate>
+rollUp(const std::vector<HistoryAggregate> &fine, size_t per) {
+  std::vector<HistoryAggregate> coarse;
+  for (size_t start = 0; start + per <= fine.size(); start += per) {
+    ReferenceAccumulator accumulator;
+    for (size_t i = start; i < start + per; i++)
+      if (fine[i].mean != SOLAR_HISTORY_NO_DATA)
+        accumulator.add(fine[i].mean, fine[i].min, fine[i].max);
+    coarse.push_back(accumulator.result());
+  }
+  return coarse;
+}
+
+static uint16_t sampleValue(uint32_t sample) {
+  uint32_t x = sample * 2654435761u;
+  return (uint16_t)((x >> 16) % (SOLAR_HISTORY_SCALE * 1000 + 1));
+}
+
+int main(int argc, char **argv) {
+  double days = 31;
+  if (argc == 3 && strcmp(argv[1], "--days") == 0)
+    days = atof(argv[2]);
+  if ((argc != 1 && argc != 3) || days <= 0 || days > 45) {
+    fprintf(stderr, "usage: %s [--days n]   (n up to 45)\n", argv[0]);
+    return 2;
+  }
+  bool ok = true;
+
+  printf("sizeof(SolarHistory) %u bytes, budget %u\n",
+         (unsigned)sizeof(SolarHistory), (unsigned)SOLAR_HISTORY_RAM_BUDGET);
+  if (sizeof(SolarHistory) > SOLAR_HISTORY_RAM_BUDGET)
+    ok = false;
+
+  std::unique_ptr<SolarHistory> history(new SolarHistory());
+  const uint32_t totalSeconds = (uint32_t)(days * 86400);
+  std::vector<HistoryAggregate> seconds;
+  seconds.reserve(totalSeconds);
+
+  double kindNanos[4] = {};
+  uint64_t kindCalls[4] = {};
+  std::vector<double> dayNanos((totalSeconds + 86399) / 86400);
+  std::vector<uint64_t> dayCalls(dayNanos.size());
+  uint32_t sample = 0;
+
+  // One sample at the start of the last second closes every one before it
+  for (uint32_t second = 0; second <= totalSeconds; second++) {
+    bool empty = second % SHIST_EMPTY_EVERY == SHIST_EMPTY_EVERY - 1 &&
+                 second != totalSeconds;
+    ReferenceAccumulator accumulator;
+
+    for (uint32_t ms = 0; ms < 1000; ms += SHIST_PERIOD_MS) {
+      if (empty || (second == totalSeconds && ms != 0))
+        continue;
+      uint16_t value = sampleValue(sample++);
+      accumulator.add(value, value, value);
+
+      // The first sample of a second closes the one before it
+      RollupKind kind = ROLLUP_NONE;
+      if (ms == 0 && second != 0)
+        kind = second % 3600 == 0  ? ROLLUP_HOUR
+               : second % 60 == 0 ? ROLLUP_MINUTE
+                                  : ROLLUP_SECOND;
+
+      HistoryClock::time_point start = HistoryClock::now();
+      history->add(second * 1000 + ms, value);
+      double nanos = std::chrono::duration<double, std::nano>(
+                         HistoryClock::now() - start)
+                         .count();
+      kindNanos[kind] += nanos;
+      kindCalls[kind]++;
+      if (second < totalSeconds) {
+        dayNanos[second / 86400] += nanos;
+        dayCalls[second / 86400]++;
+      }
+    }
+    if (second < totalSeconds)
+      seconds.push_back(accumulator.result());
+  }
+
+  std::vector<HistoryAggregate> minutes = rollUp(seconds, 60);
+  std::vector<HistoryAggregate> hours = rollUp(minutes, 60);
+
+  uint32_t mismatches = 0;
+  if (history->secondCount() !=
+          (seconds.size() < SOLAR_HISTORY_SECONDS ? seconds.size()
+                                                  : SOLAR_HISTORY_SECONDS) ||
+      history->minuteCount() !=
+          (minutes.size() < SOLAR_HISTORY_MINUTES ? minutes.size()
+                                                  : SOLAR_HISTORY_MINUTES) ||
+      history->hourCount() != (hours.size() < SOLAR_HISTORY_HOURS
+                                   ? hours.size()
+                                   : SOLAR_HISTORY_HOURS)) {
+    fprintf(stderr, "tier sizes %u/%u/%u, expected from %u/%u/%u\n",
+            (unsigned)history->secondCount(), (unsigned)history->minuteCount(),
+            (unsigned)history->hourCount(), (unsigned)seconds.size(),
+            (unsigned)minutes.size(), (unsigned)hours.size());
+    ok = false;
+  } else {
+    for (size_t age = 0; age < history->secondCount(); age++)
+      mismatches +=
+          history->second(age) != seconds[seconds.size() - 1 - age].mean;
+    for (size_t age = 0; age < history->minuteCount(); age++)
+      mismatches += !sameAggregate(history->minute(age),
+                                   minutes[minutes.size() - 1 - age]);
+    for (size_t age = 0; age < history->hourCount(); age++)
+      mismatches +=
+          !sameAggregate(history->hour(age), hours[hours.size() - 1 - age]);
+  }
+
+  printf("%.1f days, %u samples, tiers %u s / %u min / %u h, "
+         "%u mismatches\n",
+         days, (unsigned)sample, (unsigned)history->secondCount(),
+         (unsigned)history->minuteCount(), (unsigned)history->hourCount(),
+         (unsigned)mismatches);
+  if (mismatches != 0)
+    ok = false;
+
+  printf("%-8s %10s %10s\n", "closes", "calls", "mean ns");
+  for (int kind = ROLLUP_NONE; kind <= ROLLUP_HOUR; kind++)
+    printf("%-8s %10llu %10.1f\n", rollupNames[kind],
+           (unsigned long long)kindCalls[kind],
+           kindCalls[kind] ? kindNanos[kind] / kindCalls[kind] : 0.0);
+
+  double firstDay = dayNanos.front() / dayCalls.front();
+  double lastDay = dayNanos.back() / dayCalls.back();
+  printf("mean ns per sample: first day %.1f, last day %.1f\n", firstDay,
+         lastDay);
+  if (lastDay > SHIST_MAX_GROWTH * firstDay) {
+    fprintf(stderr, "cost per sample grew with the history\n");
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file solar_replay.cpp
+ * @brief Runs the controller core against simulated time on the host.
+ *
+ * Usage: solar_replay [options]
+ *
+ *   --trace <file>      replay raw readings, one per line, instead of the
+ *                       synthetic day
+ *   --hours <n>         simulated duration (default 24)
+ *   --adc-rate <hz>     scripted ADC sample rate (default 40)
+ *   --period-ms <ms>    control period, as RuntimeConfig (default 100)
+ *   --interval <min>    switch interval in minutes (default 5)
+ *   --log <file>        write the solar log partition image on exit
+ *   --telemetry <file>  write the binary telemetry stream
+ *
+ * The loop does what the firmware's sampling, control and service tasks do,
+ * in one thread and in lockstep with a virtual clock, so a day replays in
+ * well under a second and every run is reproducible. The log image can be
+ * read with `solarlog_read` and the telemetry stream with `telemetry_decode`.
+ * A summary goes to stderr.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_RELAY_PIN 4
+#define REPLAY_SERVICE_PERIOD_MS 1000
+
+struct ReplayOptions {
+  const char *trace = nullptr;
+  const char *logPath = nullptr;
+  const char *telemetryPath = nullptr;
+  double hours = 24;
+  uint32_t adcRateHz = 40;
+  uint32_t periodMs = 100;
+  unsigned short intervalMinutes = 5;
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [--trace file] [--hours n] [--adc-rate hz] "
+          "[--period-ms ms]\n"
+          "       [--interval min] [--log file] [--telemetry file]\n",
+          name);
+}
+
+static bool parseOptions(int argc, char **argv, ReplayOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--trace") == 0)
+      options.trace = value;
+    else if (strcmp(arg, "--hours") == 0)
+      options.hours = atof(value);
+    else if (strcmp(arg, "--adc-rate") == 0)
+      options.adcRateHz = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--period-ms") == 0)
+      options.periodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--interval") == 0)
+      options.intervalMinutes = (unsigned short)atoi(value);
+    else if (strcmp(arg, "--log") == 0)
+      options.logPath = value;
+    else if (strcmp(arg, "--telemetry") == 0)
+      options.telemetryPath = value;
+    else
+      return false;
+  }
+  return options.hours > 0 && options.periodMs > 0;
+}
+
+int main(int argc, char **argv) {
+  ReplayOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  scriptedAdc.setSampleRate(options.adcRateHz);
+  if (options.trace != nullptr) {
+    if (!scriptedAdc.loadRecording(options.trace)) {
+      fprintf(stderr, "%s: no readings\n", options.trace);
+      return 1;
+    }
+  } else {
+    scriptedAdc.setWaveform(syntheticDay);
+  }
+
+  FILE *telemetryFile = nullptr;
+  if (options.telemetryPath != nullptr) {
+    telemetryFile = fopen(options.telemetryPath, "wb");
+    if (telemetryFile == nullptr) {
+      perror(options.telemetryPath);
+      return 1;
+    }
+    stdoutSerial.redirect(telemetryFile);
+  }
+
+  init_nvs();
+  if (telemetryFile != nullptr)
+    telemetry.begin();
+  solarLog.begin();
+  solarLog.logEvent(SOLAR_LOG_BOOT, 0);
+
+  SwitchController relay(REPLAY_RELAY_PIN);
+  SolarHistory history;
+  relay.begin();
+  relay.setInterval(options.intervalMinutes);
+  relay.setHistory(&history);
+
+  const uint64_t steps =
+      (uint64_t)(options.hours * 3600000.0 / options.periodMs);
+  uint64_t onSteps = 0;
+  uint32_t loggedMillis = 0, serviceMillis = 0;
+  bool logged = false;
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (uint64_t step = 0; step < steps; step++) {
+    virtualClock.advance((int64_t)options.periodMs * 1000);
+    scriptedAdc.advance(options.periodMs);
+
+    uint32_t now = (uint32_t)millis();
+    solar_num_t solarIndex = solar.read();
+    relay.run(solarIndex, now);
+    onSteps += memoryGpio.level(REPLAY_RELAY_PIN) == 1;
+
+    if (!logged || now - loggedMillis >= SOLAR_LOG_SAMPLE_PERIOD_MS) {
+      solarLog.logSample(historyValue(solarIndex));
+      loggedMillis = now;
+      logged = true;
+    }
+
+    if (now - serviceMillis >= REPLAY_SERVICE_PERIOD_MS) {
+      storageTick();
+      solarLog.tick();
+      telemetry.tick();
+      serviceMillis = now;
+    }
+  }
+
+  solarLog.flush();
+  flushStorage();
+
+  double wallSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - wallStart)
+                           .count();
+
+  if (telemetryFile != nullptr)
+    fclose(telemetryFile);
+  if (options.logPath != nullptr && !memoryLogFlash.save(options.logPath)) {
+    perror(options.logPath);
+    return 1;
+  }
+
+  SolarLogStats log = solarLog.stats();
+  double simulatedSeconds = steps * options.periodMs / 1000.0;
+  fprintf(stderr,
+          "simulated %.1f h in %.3f s wall (%.0fx real time)\n"
+          "%llu control steps, relay toggled %u times, on %.1f%% of the "
+          "time\n"
+          "%u NVS commits, %u log records in %u pages\n",
+          simulatedSeconds / 3600.0, wallSeconds,
+          wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0.0,
+          (unsigned long long)steps,
+          (unsigned)memoryGpio.toggleCount(REPLAY_RELAY_PIN),
+          steps ? 100.0 * onSteps / steps : 0.0,
+          (unsigned)memoryKv.commitCount(), (unsigned)log.records,
+          (unsigned)log.pagesWritten);
+  return 0;
+}
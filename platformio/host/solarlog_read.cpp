@@ -0,0 +1,101 @@
+/**
+ * @file solarlog_read.cpp
+ * @brief Command-line reader for an image of the "solarlog" partition.
+ *
+ * Usage: solarlog_read <image> [from-ms [to-ms]]
+ *
+ * <image> is a raw copy of the partition, e.g. from
+ * `parttool.py read_partition --partition-name solarlog --output log.bin`.
+ * The image is memory-mapped and read in place with the same SolarLogImage
+ * code the firmware uses. Records in the time range are written to stdout as
+ * CSV; a summary including the encoded bytes per record goes to stderr.
+ */
+
+#include "../src/util/SolarLogCodec.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Summary {
+  size_t samples;
+  size_t events;
+};
+
+static const char *eventName(uint8_t type) {
+  switch (type) {
+  case SOLAR_LOG_BOOT:
+    return "boot";
+  case SOLAR_LOG_RELAY:
+    return "relay";
+  default:
+    return "unknown";
+  }
+}
+
+static bool printRecord(const SolarLogRecord &record, void *context) {
+  Summary *summary = static_cast<Summary *>(context);
+  if (record.kind == SOLAR_LOG_SAMPLE) {
+    summary->samples++;
+    printf("%llu,sample,,%u\n", (unsigned long long)record.millis,
+           record.value);
+  } else {
+    summary->events++;
+    printf("%llu,event,%s,%u\n", (unsigned long long)record.millis,
+           eventName(record.type), record.value);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "usage: %s <image> [from-ms [to-ms]]\n", argv[0]);
+    return 2;
+  }
+
+  uint64_t from = argc > 2 ? strtoull(argv[2], nullptr, 0) : 0;
+  uint64_t to = argc > 3 ? strtoull(argv[3], nullptr, 0) : UINT64_MAX;
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  SolarLogImage image;
+  image.mount(mapped, st.st_size);
+
+  Summary summary = {};
+  printf("millis,kind,event,value\n");
+  image.query(from, to, printRecord, &summary);
+
+  size_t encoded = 0, records = 0;
+  SolarLogPageHeader header{};
+  const uint8_t *base = static_cast<const uint8_t *>(mapped);
+  for (size_t i = 0; i < image.pages(); i++) {
+    if (readSolarLogHeader(base + i * SOLAR_LOG_PAGE_SIZE, header)) {
+      encoded += header.length;
+      records += header.records;
+    }
+  }
+
+  fprintf(stderr, "pages %zu/%zu, %zu records, %zu encoded bytes",
+          image.usedPages(), image.pages(), records, encoded);
+  if (records != 0)
+    fprintf(stderr, " (%.2f bytes/record)", (double)encoded / records);
+  fprintf(stderr, "\nin range: %zu samples, %zu events\n", summary.samples,
+          summary.events);
+
+  munmap(mapped, st.st_size);
+  close(fd);
+  return 0;
+}
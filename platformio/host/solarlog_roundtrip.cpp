@@ -0,0 +1,398 @@
+/**
+ * @file solarlog_roundtrip.cpp
+ * @brief Round trip of the solar log through the host flash image, across
+ * reboots, torn pages and pages of another format.
+ *
+ * Usage: solarlog_roundtrip [--save image]
+ *
+ * Runs SolarLog over MemoryFlash with the virtual clock, one sample a second
+ * and a relay event every ROUNDTRIP_EVENT_EVERY seconds. Each boot is a new
+ * SolarLog mounting what the previous one left, in this order:
+ *
+ *   1. migration: every sector holds a page of another format version or
+ *      random bytes, as left by an older layout; the log starts over
+ *      around them;
+ *   2. reboot: time and page sequence continue from the newest page, and
+ *      the log wraps the ring;
+ *   3. torn erase: power is lost right after the head sector was erased,
+ *      with the newest page in the middle of the ring;
+ *   4. torn write: power is lost half way through writing a page;
+ *   5. bit flip: one bit of a page in the middle of the ring is cleared.
+ *
+ * After every boot the log is read back with `query()` and compared with
+ * what was appended, restricted to the pages whose CRC checks out, scanned
+ * directly from the image: the records must come back exactly, in order,
+ * and those pages must hold every record logged in their time span. Each
+ * step also checks how many pages it may lose, and the last one checks
+ * random time ranges. The report gives the encoded bytes per record and
+ * the host time per append.
+ *
+ * With --save the final image is written for `solarlog_read`. Exits non-zero
+ * if a check fails.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define ROUNDTRIP_PAGES (HOST_LOG_FLASH_SIZE / SOLAR_LOG_PAGE_SIZE)
+#define ROUNDTRIP_EVENT_EVERY 600
+#define ROUNDTRIP_RANGES 200
+#define ROUNDTRIP_MAX_BYTES_PER_RECORD 2.5
+
+typedef std::chrono::steady_clock RoundtripClock;
+
+struct Roundtrip {
+  std::vector<SolarLogRecord> written;
+  uint32_t samples = 0;
+  double appendNanos = 0;
+  uint64_t appends = 0;
+  bool ok = true;
+};
+
+struct PageSpan {
+  uint32_t sequence;
+  uint64_t firstMillis;
+  uint64_t lastMillis;
+  uint16_t records;
+  uint16_t length;
+};
+
+static bool sameRecord(const SolarLogRecord &a, const SolarLogRecord &b) {
+  return a.millis == b.millis && a.kind == b.kind && a.type == b.type &&
+         a.value == b.value;
+}
+
+static bool collect(const SolarLogRecord &record, void *context) {
+  static_cast<std::vector<SolarLogRecord> *>(context)->push_back(record);
+  return true;
+}
+
+static const uint8_t *flashPage(size_t slot) {
+  return static_cast<const uint8_t *>(memoryLogFlash.map()) +
+         slot * SOLAR_LOG_PAGE_SIZE;
+}
+
+/**
+ * @brief The pages of the image whose header and CRC check out, in
+ * sequence order.
+ */
+
+static std::vector<PageSpan> validPages() {
+  std::vector<PageSpan> pages;
+  SolarLogPageReader reader;
+  for (size_t slot = 0; slot < ROUNDTRIP_PAGES; slot++) {
+    if (!reader.open(flashPage(slot)))
+      continue;
+    const SolarLogPageHeader &header = reader.header();
+    pages.push_back({header.sequence, header.firstMillis, header.lastMillis,
+                     header.records, header.length});
+  }
+  std::sort(pages.begin(), pages.end(),
+            [](const PageSpan &a, const PageSpan &b) {
+              return a.sequence < b.sequence;
+            });
+  return pages;
+}
+
+/**
+ * @brief What the log should return: the appended records that fall in a
+ * valid page. Fails if a page does not hold every record of its span.
+ */
+
+static std::vector<SolarLogRecord>
+expected(Roundtrip &run, const std::vector<PageSpan> &pages) {
+  std::vector<SolarLogRecord> records;
+  for (const PageSpan &page : pages) {
+    auto first = std::lower_bound(
+        run.written.begin(), run.written.end(), page.firstMillis,
+        [](const SolarLogRecord &r, uint64_t millis) {
+          return r.millis < millis;
+        });
+    size_t count = 0;
+    for (auto it = first; it != run.written.end() &&
+                          it->millis <= page.lastMillis;
+         it++, count++)
+      records.push_back(*it);
+    if (count != page.records) {
+      fprintf(stderr, "page %u holds %u records, %zu logged in its span\n",
+              (unsigned)page.sequence, (unsigned)page.records, count);
+      run.ok = false;
+    }
+  }
+  return records;
+}
+
+/**
+ * @brief Reads the whole log back and compares it with `expected()`.
+ *
+ * @return The number of valid pages.
+ */
+
+static size_t verify(Roundtrip &run, SolarLog &log, const char *step) {
+  std::vector<PageSpan> pages = validPages();
+  std::vector<SolarLogRecord> want = expected(run, pages);
+  std::vector<SolarLogRecord> got;
+  log.query(0, UINT64_MAX, collect, &got);
+
+  size_t wrong = got.size() == want.size() ? 0 : 1;
+  for (size_t i = 0; i < got.size() && i < want.size(); i++)
+    wrong += !sameRecord(got[i], want[i]);
+
+  printf("%-12s %6zu %10zu %10zu %8zu\n", step, pages.size(), want.size(),
+         got.size(), wrong);
+  if (wrong != 0) {
+    fprintf(stderr, "%s: log differs from what was appended\n", step);
+    run.ok = false;
+  }
+  return pages.size();
+}
+
+static uint16_t sampleValue(uint32_t sample) {
+  double slow = 500 + 300 * sin(sample / 3600.0);
+  return (uint16_t)(slow + (sample * 2654435761u >> 29));
+}
+
+/**
+ * @brief Mounts the image as a new SolarLog and logs a boot event, as
+ * `app_main()` does.
+ */
+
+static std::unique_ptr<SolarLog> boot(Roundtrip &run) {
+  std::unique_ptr<SolarLog> log(new SolarLog());
+  if (!log->begin()) {
+    fprintf(stderr, "the log did not mount\n");
+    run.ok = false;
+  }
+  virtualClock.advance(1000);
+  SolarLogRecord record = {log->now(), SOLAR_LOG_EVENT, SOLAR_LOG_BOOT, 0};
+  if (log->logEvent(SOLAR_LOG_BOOT, 0))
+    run.written.push_back(record);
+  return log;
+}
+
+/**
+ * @brief Logs `hours` of samples and relay events, then flushes.
+ */
+
+static void logFor(Roundtrip &run, SolarLog &log, double hours) {
+  const uint32_t seconds = (uint32_t)(hours * 3600);
+  for (uint32_t s = 0; s < seconds; s++) {
+    virtualClock.advance(1000000);
+    uint16_t value = sampleValue(run.samples++);
+    SolarLogRecord record = {log.now(), SOLAR_LOG_SAMPLE, 0, value};
+
+    RoundtripClock::time_point start = RoundtripClock::now();
+    bool appended = log.logSample(value);
+    run.appendNanos += std::chrono::duration<double, std::nano>(
+                           RoundtripClock::now() - start)
+                           .count();
+    run.appends++;
+    if (appended)
+      run.written.push_back(record);
+
+    if (s % ROUNDTRIP_EVENT_EVERY == ROUNDTRIP_EVENT_EVERY / 2) {
+      virtualClock.advance(500000);
+      uint32_t relay = (4u << 1) | (s / ROUNDTRIP_EVENT_EVERY % 2);
+      record = {log.now(), SOLAR_LOG_EVENT, SOLAR_LOG_RELAY, relay};
+      if (log.logEvent(SOLAR_LOG_RELAY, relay))
+        run.written.push_back(record);
+    }
+    log.tick();
+  }
+  log.flush();
+
+  if (log.stats().droppedRecords != 0) {
+    fprintf(stderr, "%u records dropped\n",
+            (unsigned)log.stats().droppedRecords);
+    run.ok = false;
+  }
+}
+
+/**
+ * @brief Fills every sector with what another layout could have left: a
+ * log page of a different format version, or random bytes.
+ */
+
+static void writeForeignImage() {
+  std::mt19937 rng(1);
+  uint8_t page[SOLAR_LOG_PAGE_SIZE];
+  for (size_t slot = 0; slot < ROUNDTRIP_PAGES; slot++) {
+    if (slot % 2 == 0) {
+      SolarLogPageWriter writer;
+      writer.begin(page);
+      for (uint32_t i = 0; i < 100; i++)
+        writer.append({1000000 + slot * 1000 + i, SOLAR_LOG_SAMPLE, 0, i});
+      writer.finish(1000 + slot);
+      page[2] = SOLAR_LOG_VERSION + 1;
+    } else {
+      for (uint8_t &byte : page)
+        byte = (uint8_t)rng();
+    }
+    memoryLogFlash.erase(slot * SOLAR_LOG_PAGE_SIZE, SOLAR_LOG_PAGE_SIZE);
+    memoryLogFlash.write(slot * SOLAR_LOG_PAGE_SIZE, page, sizeof(page));
+  }
+}
+
+/**
+ * @brief The slot the next page goes to: after the highest sequence.
+ */
+
+static size_t headSlot(uint32_t &newestSequence) {
+  size_t newest = 0;
+  bool found = false;
+  SolarLogPageHeader header{};
+  for (size_t slot = 0; slot < ROUNDTRIP_PAGES; slot++) {
+    if (readSolarLogHeader(flashPage(slot), header) &&
+        (!found || header.sequence > newestSequence)) {
+      found = true;
+      newestSequence = header.sequence;
+      newest = slot;
+    }
+  }
+  return (newest + 1) % ROUNDTRIP_PAGES;
+}
+
+static void expectPages(Roundtrip &run, const char *step, size_t pages,
+                        size_t expectedPages) {
+  if (pages != expectedPages) {
+    fprintf(stderr, "%s: %zu valid pages, expected %zu\n", step, pages,
+            expectedPages);
+    run.ok = false;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *save = nullptr;
+  if (argc == 3 && strcmp(argv[1], "--save") == 0)
+    save = argv[2];
+  else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--save image]\n", argv[0]);
+    return 2;
+  }
+
+  Roundtrip run;
+  printf("%u pages of %u bytes\n", (unsigned)ROUNDTRIP_PAGES,
+         (unsigned)SOLAR_LOG_PAGE_SIZE);
+  printf("%-12s %6s %10s %10s %8s\n", "step", "pages", "expected", "read",
+         "wrong");
+
+  // 1. Another layout's data everywhere; none of it may be read
+  writeForeignImage();
+  std::unique_ptr<SolarLog> log = boot(run);
+  logFor(run, *log, 10);
+  size_t pages = verify(run, *log, "migration");
+  expectPages(run, "migration", pages, log->stats().pagesWritten);
+
+  // 2. Time and sequence continue; the log wraps the ring
+  uint64_t lastMillis = run.written.back().millis;
+  log = boot(run);
+  if (run.written.back().millis != lastMillis + 1 + 1) {
+    fprintf(stderr, "reboot: log time restarted at %llu after %llu\n",
+            (unsigned long long)run.written.back().millis,
+            (unsigned long long)lastMillis);
+    run.ok = false;
+  }
+  logFor(run, *log, 100);
+  pages = verify(run, *log, "reboot");
+  expectPages(run, "reboot", pages, ROUNDTRIP_PAGES);
+
+  // 3. Power lost right after erasing the head sector, the oldest page
+  uint32_t newestSequence = 0;
+  size_t head = headSlot(newestSequence);
+  memoryLogFlash.erase(head * SOLAR_LOG_PAGE_SIZE, SOLAR_LOG_PAGE_SIZE);
+  log = boot(run);
+  pages = verify(run, *log, "torn erase");
+  expectPages(run, "torn erase", pages, ROUNDTRIP_PAGES - 1);
+  // The next page goes to the erased sector
+  logFor(run, *log, 0);
+  pages = verify(run, *log, "rewritten");
+  expectPages(run, "rewritten", pages, ROUNDTRIP_PAGES);
+
+  // 4. Power lost half way through programming the head page
+  head = headSlot(newestSequence);
+  uint8_t page[SOLAR_LOG_PAGE_SIZE];
+  SolarLogPageWriter writer;
+  writer.begin(page);
+  uint64_t tornMillis = log->now() + 1000;
+  while (writer.append({tornMillis, SOLAR_LOG_SAMPLE, 0,
+                        sampleValue(run.samples++)}))
+    tornMillis += 1000;
+  writer.finish(newestSequence + 1);
+  memoryLogFlash.erase(head * SOLAR_LOG_PAGE_SIZE, SOLAR_LOG_PAGE_SIZE);
+  memoryLogFlash.write(head * SOLAR_LOG_PAGE_SIZE, page, sizeof(page) / 2);
+  log = boot(run);
+  logFor(run, *log, 2);
+  pages = verify(run, *log, "torn write");
+  expectPages(run, "torn write", pages, ROUNDTRIP_PAGES - 1);
+
+  // 5. One bit cleared in the records of a page in the middle
+  head = headSlot(newestSequence);
+  size_t middle = (head + ROUNDTRIP_PAGES / 2) % ROUNDTRIP_PAGES;
+  SolarLogPageHeader header{};
+  readSolarLogHeader(flashPage(middle), header);
+  uint8_t flip[SOLAR_LOG_PAGE_SIZE];
+  memset(flip, 0xFF, sizeof(flip));
+  for (size_t i = SOLAR_LOG_HEADER_SIZE; i < SOLAR_LOG_HEADER_SIZE + 64; i++) {
+    uint8_t byte = flashPage(middle)[i];
+    if (byte != 0) {
+      flip[i] = (uint8_t)~(byte & -byte);
+      break;
+    }
+  }
+  memoryLogFlash.write(middle * SOLAR_LOG_PAGE_SIZE, flip, sizeof(flip));
+  log = boot(run);
+  logFor(run, *log, 0);
+  pages = verify(run, *log, "bit flip");
+  expectPages(run, "bit flip", pages, ROUNDTRIP_PAGES - 2);
+
+  // Random ranges, some starting in the damaged page
+  std::vector<SolarLogRecord> all = expected(run, validPages());
+  std::mt19937_64 rng(2);
+  uint64_t span = all.back().millis - all.front().millis;
+  size_t wrongRanges = 0;
+  for (int i = 0; i < ROUNDTRIP_RANGES; i++) {
+    uint64_t from = i % 4 == 0 ? header.firstMillis + rng() % 60000
+                               : all.front().millis + rng() % span;
+    uint64_t to = from + rng() % (span / 8);
+    std::vector<SolarLogRecord> got, want;
+    log->query(from, to, collect, &got);
+    for (const SolarLogRecord &record : all)
+      if (record.millis >= from && record.millis <= to)
+        want.push_back(record);
+    bool same = got.size() == want.size();
+    for (size_t r = 0; same && r < got.size(); r++)
+      same = sameRecord(got[r], want[r]);
+    wrongRanges += !same;
+  }
+  printf("%d ranges, %zu wrong\n", ROUNDTRIP_RANGES, wrongRanges);
+  if (wrongRanges != 0)
+    run.ok = false;
+
+  size_t encoded = 0, records = 0;
+  for (const PageSpan &valid : validPages()) {
+    encoded += valid.length;
+    records += valid.records;
+  }
+  double bytesPerRecord = (double)encoded / records;
+  printf("%.2f bytes/record, %.1f ns per append\n", bytesPerRecord,
+         run.appendNanos / run.appends);
+  if (bytesPerRecord > ROUNDTRIP_MAX_BYTES_PER_RECORD) {
+    fprintf(stderr, "over %.1f bytes/record\n",
+            ROUNDTRIP_MAX_BYTES_PER_RECORD);
+    run.ok = false;
+  }
+
+  if (save != nullptr && !memoryLogFlash.save(save)) {
+    perror(save);
+    run.ok = false;
+  }
+  return run.ok ? 0 : 1;
+}
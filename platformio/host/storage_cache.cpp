@@ -0,0 +1,177 @@
+/**
+ * @file storage_cache.cpp
+ * @brief Checks NvsSession and the write-back cache against MemoryKvStore.
+ *
+ * Usage: storage_cache
+ *
+ * Each check starts from a flushed cache and counts the commits MemoryKvStore
+ * sees:
+ *
+ *   - sessions: nested and back-to-back sessions open the namespace once and
+ *     a session commits its sets once, when it ends;
+ *   - batching: stores below STORAGE_DIRTY_THRESHOLD stay in RAM, readable
+ *     through the cache, until `flushStorage()` writes them in one commit;
+ *   - threshold: the STORAGE_DIRTY_THRESHOLD-th dirty key flushes at once;
+ *   - unchanged: storing the value a key already holds costs nothing;
+ *   - tick: `storageTick()` flushes only once STORAGE_FLUSH_INTERVAL_MS of
+ *     the virtual clock has passed since the last flush, and a store made
+ *     after that never flushes by itself;
+ *   - eviction: with the cache full, a new key takes a clean entry without
+ *     a commit and the dirty ones keep their values.
+ *
+ * Exits non-zero if a check fails.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <stdio.h>
+
+struct StorageCheck {
+  const char *name;
+  bool (*run)();
+};
+
+/**
+ * @brief Whether MemoryKvStore itself holds `key`, bypassing the cache.
+ */
+
+static bool inKvStore(const char *key) {
+  int32_t value;
+  return memoryKv.getI32(key, &value);
+}
+
+static bool checkSessions() {
+  uint32_t opens = getStorageCacheStats().opens;
+  uint32_t commits = memoryKv.commitCount();
+  {
+    NvsSession outer;
+    outer.set("sc_a", 1);
+    {
+      NvsSession inner;
+      inner.set("sc_b", 2);
+    }
+    outer.set("sc_c", 3);
+  }
+  { NvsSession idle; }
+
+  // init_nvs() opened the namespace; nothing here may open it again. The
+  // inner session and the outer one each commit their own sets, the idle
+  // one nothing.
+  return getStorageCacheStats().opens == opens &&
+         memoryKv.commitCount() - commits == 2 && inKvStore("sc_a") &&
+         inKvStore("sc_b") && inKvStore("sc_c");
+}
+
+static bool checkBatching() {
+  uint32_t commits = memoryKv.commitCount();
+  for (int32_t i = 0; i < STORAGE_DIRTY_THRESHOLD - 1; i++) {
+    char key[HAL_KV_KEY_SIZE];
+    snprintf(key, sizeof(key), "sc_batch%d", (int)i);
+    if (!storeValue(key, i * 10) || inKvStore(key))
+      return false;
+
+    int32_t cached;
+    if (!retrieveIntValue(key, &cached) || cached != i * 10)
+      return false;
+  }
+  if (memoryKv.commitCount() != commits)
+    return false;
+
+  return flushStorage() && memoryKv.commitCount() - commits == 1 &&
+         inKvStore("sc_batch0");
+}
+
+static bool checkThreshold() {
+  uint32_t commits = memoryKv.commitCount();
+  for (int32_t i = 0; i < STORAGE_DIRTY_THRESHOLD; i++) {
+    char key[HAL_KV_KEY_SIZE];
+    snprintf(key, sizeof(key), "sc_dirty%d", (int)i);
+    storeValue(key, i);
+  }
+  return memoryKv.commitCount() - commits == 1 && inKvStore("sc_dirty0");
+}
+
+static bool checkUnchanged() {
+  storeValue("sc_same", 42);
+  flushStorage();
+  uint32_t commits = memoryKv.commitCount();
+  storeValue("sc_same", 42);
+  return flushStorage() && memoryKv.commitCount() == commits;
+}
+
+static bool checkTick() {
+  uint32_t commits = memoryKv.commitCount();
+  storeValue("sc_tick", 7);
+
+  virtualClock.advance((int64_t)(STORAGE_FLUSH_INTERVAL_MS - 1) * 1000);
+  storageTick();
+  if (memoryKv.commitCount() != commits || inKvStore("sc_tick"))
+    return false;
+
+  virtualClock.advance(1000);
+  storageTick();
+  if (memoryKv.commitCount() - commits != 1 || !inKvStore("sc_tick"))
+    return false;
+
+  // Overdue, but the store leaves the commit to the next tick
+  virtualClock.advance((int64_t)STORAGE_FLUSH_INTERVAL_MS * 1000);
+  storeValue("sc_late", 8);
+  if (memoryKv.commitCount() - commits != 1 || inKvStore("sc_late"))
+    return false;
+
+  storageTick();
+  return memoryKv.commitCount() - commits == 2 && inKvStore("sc_late");
+}
+
+static bool checkEviction() {
+  // Fill every entry with a clean value, then dirty as many as the
+  // threshold allows with the new key still to come
+  for (int32_t i = 0; i < STORAGE_CACHE_ENTRIES; i++) {
+    char key[HAL_KV_KEY_SIZE];
+    snprintf(key, sizeof(key), "sc_full%d", (int)i);
+    storeValue(key, i);
+    flushStorage();
+  }
+  uint32_t commits = memoryKv.commitCount();
+  for (int32_t i = 0; i < STORAGE_DIRTY_THRESHOLD - 2; i++) {
+    char key[HAL_KV_KEY_SIZE];
+    snprintf(key, sizeof(key), "sc_full%d", (int)i);
+    storeValue(key, i + 100);
+  }
+  if (memoryKv.commitCount() != commits)
+    return false;
+
+  storeValue("sc_new", 1);
+  int32_t value;
+  return memoryKv.commitCount() == commits &&
+         retrieveIntValue("sc_full0", &value) && value == 100 &&
+         retrieveIntValue("sc_new", &value) && value == 1;
+}
+
+static const StorageCheck storageChecks[] = {
+    {"sessions", checkSessions},   {"batching", checkBatching},
+    {"threshold", checkThreshold}, {"unchanged", checkUnchanged},
+    {"tick", checkTick},           {"eviction", checkEviction},
+};
+
+int main() {
+  if (!init_nvs()) {
+    fprintf(stderr, "init_nvs failed\n");
+    return 1;
+  }
+
+  bool ok = true;
+  for (const StorageCheck &check : storageChecks) {
+    flushStorage();
+    bool passed = check.run();
+    printf("%-10s %s\n", check.name, passed ? "ok" : "FAILED");
+    ok = ok && passed;
+  }
+
+  StorageCacheStats stats = getStorageCacheStats();
+  printf("%u stores, %u commits, %u avoided, %u hits, %u misses\n",
+         (unsigned)stats.stores, (unsigned)stats.commits,
+         (unsigned)stats.commitsAvoided, (unsigned)stats.hits,
+         (unsigned)stats.misses);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file switch_bank.cpp
+ * @brief Per-tick cost of a SwitchBank against as many SwitchControllers.
+ *
+ * Usage: switch_bank [--ticks n]
+ *
+ * For N = 1, 2, 4, ... 64 relays, a SwitchBank<N> and N new
+ * SwitchControllers in interval mode are given the same thresholds per
+ * channel and fed the same readings: a triangle sweeping the full index
+ * range, one reading per control period (100 ms, as RuntimeConfig), with a
+ * 1 min interval. The report gives the host wall time per tick, in total and
+ * per relay, of the bank's one `tick()` and of the N controllers' `run()`
+ * calls.
+ *
+ * Exits non-zero if a bank channel ever commands a different relay level
+ * than the controller with its thresholds.
+ */
+
+#include "../src/util/SwitchBank.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BANK_MAX_RELAYS 64
+#define BANK_CONTROLLER_FIRST_PIN 100
+#define BANK_FIRST_PIN 200
+#define BANK_PERIOD_MS 100
+#define BANK_DEFAULT_TICKS 200000
+
+typedef std::chrono::steady_clock BankClock;
+
+struct BankResult {
+  double bankNanos;
+  double controllerNanos;
+  uint64_t mismatches;
+  uint32_t toggles;
+};
+
+static double bankMin(size_t channel) { return (double)(channel * 13 % 500); }
+
+static double bankMax(size_t channel) {
+  double max = bankMin(channel) + 300 + channel % 5 * 100;
+  return max > SOLAR_INDEX_MAX_VALUE ? SOLAR_INDEX_MAX_VALUE : max;
+}
+
+static solar_num_t bankReading(uint32_t tick) {
+  uint32_t phase = tick % 2000;
+  return solar_num_t((phase < 1000 ? phase : 2000 - phase) *
+                     (SOLAR_INDEX_MAX_VALUE / 1000.0));
+}
+
+/**
+ * @brief Runs `ticks` readings through a SwitchBank<N> and then through N
+ * new SwitchControllers, timing each.
+ */
+
+template <size_t N> static BankResult measure(SolarIndex &index,
+                                              uint32_t ticks) {
+  SwitchBank<N> bank(index);
+  bank.setInterval(1);
+  std::vector<std::unique_ptr<SwitchController>> controllers;
+  for (size_t i = 0; i < N; i++) {
+    bank.addChannel(BANK_FIRST_PIN + i);
+    bank.setSolarThresholds(i, bankMax(i), bankMin(i));
+
+    controllers.emplace_back(
+        new SwitchController(BANK_CONTROLLER_FIRST_PIN + i));
+    controllers[i]->begin();
+    controllers[i]->setInterval(1);
+    controllers[i]->setSolarThresholds(bankMax(i), bankMin(i));
+  }
+
+  uint32_t togglesBefore = 0;
+  for (size_t i = 0; i < N; i++)
+    togglesBefore += memoryGpio.toggleCount(BANK_FIRST_PIN + i);
+
+  std::vector<uint8_t> bankLevels((size_t)ticks * N);
+  BankClock::time_point start = BankClock::now();
+  for (uint32_t tick = 0; tick < ticks; tick++) {
+    bank.tick(bankReading(tick), tick * BANK_PERIOD_MS);
+    for (size_t i = 0; i < N; i++)
+      bankLevels[(size_t)tick * N + i] = (uint8_t)bank.relayLevel(i);
+  }
+  double bankElapsed =
+      std::chrono::duration<double, std::nano>(BankClock::now() - start)
+          .count();
+
+  std::vector<uint8_t> levels((size_t)ticks * N);
+  start = BankClock::now();
+  for (uint32_t tick = 0; tick < ticks; tick++) {
+    solar_num_t reading = bankReading(tick);
+    for (size_t i = 0; i < N; i++) {
+      controllers[i]->run(reading, tick * BANK_PERIOD_MS);
+      levels[(size_t)tick * N + i] =
+          (uint8_t)memoryGpio.level(BANK_CONTROLLER_FIRST_PIN + i);
+    }
+  }
+  double controllerElapsed =
+      std::chrono::duration<double, std::nano>(BankClock::now() - start)
+          .count();
+
+  BankResult result = {};
+  for (size_t i = 0; i < levels.size(); i++)
+    result.mismatches += levels[i] != bankLevels[i];
+  for (size_t i = 0; i < N; i++)
+    result.toggles += memoryGpio.toggleCount(BANK_FIRST_PIN + i);
+  result.toggles -= togglesBefore;
+
+  // Leave every pin low for the next, larger bank
+  for (size_t i = 0; i < N; i++) {
+    digitalWrite(BANK_FIRST_PIN + i, 0);
+    digitalWrite(BANK_CONTROLLER_FIRST_PIN + i, 0);
+  }
+  result.bankNanos = bankElapsed / ticks;
+  result.controllerNanos = controllerElapsed / ticks;
+  return result;
+}
+
+template <size_t N> static bool report(SolarIndex &index, uint32_t ticks) {
+  BankResult result = measure<N>(index, ticks);
+  printf("%6u  %10.1f  %11.1f  %9.2f  %9.2f  %8u  %10llu\n", (unsigned)N,
+         result.bankNanos, result.controllerNanos, result.bankNanos / N,
+         result.controllerNanos / N, (unsigned)result.toggles,
+         (unsigned long long)result.mismatches);
+  if (result.mismatches != 0)
+    fprintf(stderr, "%u relays: bank and controllers disagree\n",
+            (unsigned)N);
+  return result.mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t ticks = BANK_DEFAULT_TICKS;
+  if (argc == 3 && strcmp(argv[1], "--ticks") == 0)
+    ticks = (uint32_t)atoi(argv[2]);
+  if ((argc != 1 && argc != 3) || ticks == 0) {
+    fprintf(stderr, "usage: %s [--ticks n]\n", argv[0]);
+    return 2;
+  }
+
+  init_nvs();
+  SolarSampleRing ring;
+  SolarIndex index("sb_volt", ring);
+
+  printf("%u ticks of %u ms, 1 min interval, host ns per tick\n",
+         (unsigned)ticks, (unsigned)BANK_PERIOD_MS);
+  printf("%6s  %10s  %11s  %9s  %9s  %8s  %10s\n", "relays", "bank",
+         "controllers", "bank/ch", "ctrl/ch", "toggles", "mismatches");
+  bool ok = report<1>(index, ticks);
+  ok = report<2>(index, ticks) && ok;
+  ok = report<4>(index, ticks) && ok;
+  ok = report<8>(index, ticks) && ok;
+  ok = report<16>(index, ticks) && ok;
+  ok = report<32>(index, ticks) && ok;
+  ok = report<BANK_MAX_RELAYS>(index, ticks) && ok;
+  return ok ? 0 : 1;
+}
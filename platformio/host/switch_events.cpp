@@ -0,0 +1,177 @@
+/**
+ * @file switch_events.cpp
+ * @brief Crossing-to-actuation latency and chatter check for event mode.
+ *
+ * Usage: switch_events [--period-ms ms]
+ *
+ * Drives SwitchControllers in SWITCH_MODE_EVENT with scripted index values
+ * against the virtual clock, one reading per control period (default 100
+ * ms, as RuntimeConfig), with thresholds 400-1000:
+ *
+ *   - a clean step across the minimum, for several dwell times, and the
+ *     same step in interval mode for comparison;
+ *   - a slow ramp across the minimum, where the hysteresis band adds to the
+ *     latency;
+ *   - an hour of Gaussian noise centred on the minimum, and a noisy step
+ *     across it, with and without hysteresis and dwell.
+ *
+ * Latency is measured from the first reading past the threshold to the
+ * relay write. Exits non-zero if a step is not followed within one control
+ * period of its dwell, or if the default hysteresis and dwell let the noisy
+ * cases switch more than once.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVENTS_FIRST_PIN 4
+#define EVENTS_MIN 400.0
+#define EVENTS_MAX 1000.0
+#define EVENTS_NOISE_SIGMA 5.0
+
+struct EventCase {
+  const char *name;
+  SwitchMode mode;
+  EventConfig config;
+  uint32_t durationMs;
+  double (*index)(uint32_t elapsedMs, std::mt19937 &noise);
+};
+
+struct EventResult {
+  long crossingMs = -1; // first reading past the threshold
+  long actuationMs = -1; // first relay write after it
+  uint32_t toggles = 0;
+};
+
+static double gaussian(std::mt19937 &noise) {
+  static std::normal_distribution<double> normal(0.0, EVENTS_NOISE_SIGMA);
+  return normal(noise);
+}
+
+// 200 for 10 s, then 600
+static double step(uint32_t elapsedMs, std::mt19937 &) {
+  return elapsedMs < 10000 ? 200.0 : 600.0;
+}
+
+// From 350 up by one index point a second
+static double ramp(uint32_t elapsedMs, std::mt19937 &) {
+  return 350.0 + elapsedMs / 1000.0;
+}
+
+static double noisyLevel(uint32_t, std::mt19937 &noise) {
+  return EVENTS_MIN + gaussian(noise);
+}
+
+// 380 for 10 minutes, then 420, both with noise
+static double noisyStep(uint32_t elapsedMs, std::mt19937 &noise) {
+  return (elapsedMs < 600000 ? 380.0 : 420.0) + gaussian(noise);
+}
+
+static EventResult runCase(const EventCase &test, hal_pin_t pin,
+                           uint32_t periodMs) {
+  SwitchController relay(pin);
+  relay.begin();
+  relay.setSolarThresholds(EVENTS_MAX, EVENTS_MIN);
+  relay.setInterval(1);
+  relay.setEventConfig(test.config);
+  relay.setMode(test.mode);
+
+  std::mt19937 noise(1);
+  EventResult result;
+  uint32_t start = (uint32_t)millis();
+  int level = memoryGpio.level(pin);
+
+  for (uint32_t elapsed = 0; elapsed < test.durationMs; elapsed += periodMs) {
+    virtualClock.advance((int64_t)periodMs * 1000);
+    uint32_t now = (uint32_t)millis();
+    double value = test.index(now - start, noise);
+    relay.run(solar_num_t(value), now);
+
+    if (result.crossingMs < 0 && value >= EVENTS_MIN)
+      result.crossingMs = now - start;
+    if (memoryGpio.level(pin) != level) {
+      level = memoryGpio.level(pin);
+      result.toggles++;
+      if (result.crossingMs >= 0 && result.actuationMs < 0)
+        result.actuationMs = now - start;
+    }
+  }
+  return result;
+}
+
+static void printResult(const EventCase &test, const EventResult &result) {
+  printf("%-34s  %6u  %5.0f  %8u  ", test.name, (unsigned)test.config.dwellMs,
+         test.config.hysteresis, (unsigned)result.toggles);
+  if (result.crossingMs >= 0 && result.actuationMs >= 0)
+    printf("%10ld\n", result.actuationMs - result.crossingMs);
+  else
+    printf("%10s\n", "-");
+}
+
+int main(int argc, char **argv) {
+  uint32_t periodMs = 100;
+  if (argc == 3 && strcmp(argv[1], "--period-ms") == 0) {
+    periodMs = (uint32_t)atoi(argv[2]);
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--period-ms ms]\n", argv[0]);
+    return 2;
+  }
+  if (periodMs == 0 || periodMs > 1000) {
+    fprintf(stderr, "period must be 1-1000 ms\n");
+    return 2;
+  }
+
+  init_nvs();
+
+  const EventConfig defaults;
+  const uint32_t minute = MINUTES_TO_MILLIS, hour = 60 * MINUTES_TO_MILLIS;
+  const EventCase cases[] = {
+      {"step, interval mode (1 min)", SWITCH_MODE_INTERVAL, defaults,
+       3 * minute, step},
+      {"step", SWITCH_MODE_EVENT, {0, 0.0}, minute, step},
+      {"step", SWITCH_MODE_EVENT, {100, 0.0}, minute, step},
+      {"step", SWITCH_MODE_EVENT, defaults, minute, step},
+      {"ramp, 1 point/s", SWITCH_MODE_EVENT, defaults, 2 * minute, ramp},
+      {"noise on the minimum, 1 h", SWITCH_MODE_EVENT, {0, 0.0}, hour,
+       noisyLevel},
+      {"noise on the minimum, 1 h", SWITCH_MODE_EVENT, defaults, hour,
+       noisyLevel},
+      {"noisy step 380 -> 420", SWITCH_MODE_EVENT, {0, 0.0}, 20 * minute,
+       noisyStep},
+      {"noisy step 380 -> 420", SWITCH_MODE_EVENT, defaults, 20 * minute,
+       noisyStep},
+  };
+  const size_t caseCount = sizeof(cases) / sizeof(cases[0]);
+
+  printf("thresholds %.0f-%.0f, control period %u ms, noise sigma %.0f\n",
+         EVENTS_MIN, EVENTS_MAX, (unsigned)periodMs, EVENTS_NOISE_SIGMA);
+  printf("%-34s  %6s  %5s  %8s  %10s\n", "case", "dwell", "band", "toggles",
+         "latency ms");
+
+  bool ok = true;
+  for (size_t i = 0; i < caseCount; i++) {
+    const EventCase &test = cases[i];
+    EventResult result = runCase(test, EVENTS_FIRST_PIN + i, periodMs);
+    printResult(test, result);
+
+    if (test.mode != SWITCH_MODE_EVENT)
+      continue;
+    long latency = result.actuationMs - result.crossingMs;
+    if (test.index == step &&
+        (result.actuationMs < 0 || latency > test.config.dwellMs + periodMs)) {
+      fprintf(stderr, "%s: relay not switched within the dwell\n", test.name);
+      ok = false;
+    }
+    bool damped = test.config.dwellMs == defaults.dwellMs &&
+                  test.config.hysteresis == defaults.hysteresis;
+    if (damped && test.index != step && result.toggles > 1) {
+      fprintf(stderr, "%s: relay chattered\n", test.name);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file switch_match.cpp
+ * @brief Checks that SwitchController and BasicSwitchController switch alike.
+ *
+ * Usage: switch_match [--hours n] [--noise counts]
+ *
+ * Replays the synthetic day with Gaussian noise (default 20 ADC counts), one
+ * reading per control period (100 ms, as RuntimeConfig), through a
+ * SwitchController and a BasicSwitchController per SwitchMode, each pair
+ * with the same thresholds and the 5 min default interval. The noise keeps
+ * the predictive forecast flipping between confident and unsure, so forecast
+ * switches land both inside an interval and at its end.
+ *
+ * The report gives, per mode, the relay toggles of either controller and the
+ * runs after which their relays differ. Exits non-zero if any run does.
+ */
+
+#include "../src/util/BasicSwitchController.h"
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MATCH_PERIOD_MS 100
+#define MATCH_FIRST_PIN 4
+#define MATCH_BASIC_FIRST_PIN 24
+#define MATCH_BASIC_FIRST_SLOT 5
+#define MATCH_MIN 400.0
+#define MATCH_MAX 1000.0
+#define MATCH_FULL_SCALE 4095.0
+
+template <SwitchMode Mode> struct MatchConfig : SwitchConfig {
+  static constexpr hal_pin_t relayPin = MATCH_BASIC_FIRST_PIN + Mode;
+  static constexpr unsigned short slot = MATCH_BASIC_FIRST_SLOT + Mode;
+  static constexpr SwitchMode mode = Mode;
+};
+
+struct MatchCase {
+  const char *name;
+  SwitchController *controller;
+  SwitchControl *basic;
+  hal_pin_t pin;
+  hal_pin_t basicPin;
+  uint64_t mismatches;
+};
+
+int main(int argc, char **argv) {
+  double hours = 24;
+  double noiseCounts = 20;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--hours") == 0)
+      hours = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--noise") == 0)
+      noiseCounts = atof(argv[i + 1]);
+    else
+      hours = 0;
+  }
+  if (argc % 2 == 0 || hours <= 0 || noiseCounts < 0) {
+    fprintf(stderr, "usage: %s [--hours n] [--noise counts]\n", argv[0]);
+    return 2;
+  }
+
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0.0, noiseCounts);
+  scriptedAdc.setWaveform([&](double seconds) {
+    double value = syntheticDay(seconds) + noise(rng);
+    if (value < 0)
+      return (uint16_t)0;
+    return (uint16_t)(value > MATCH_FULL_SCALE ? MATCH_FULL_SCALE : value);
+  });
+  init_nvs();
+
+  SwitchController interval(MATCH_FIRST_PIN + SWITCH_MODE_INTERVAL);
+  SwitchController predictive(MATCH_FIRST_PIN + SWITCH_MODE_PREDICTIVE);
+  SwitchController event(MATCH_FIRST_PIN + SWITCH_MODE_EVENT);
+  predictive.setMode(SWITCH_MODE_PREDICTIVE);
+  event.setMode(SWITCH_MODE_EVENT);
+  BasicSwitchController<MatchConfig<SWITCH_MODE_INTERVAL>> basicInterval;
+  BasicSwitchController<MatchConfig<SWITCH_MODE_PREDICTIVE>> basicPredictive;
+  BasicSwitchController<MatchConfig<SWITCH_MODE_EVENT>> basicEvent;
+
+  MatchCase cases[] = {
+      {"interval", &interval, &basicInterval,
+       MATCH_FIRST_PIN + SWITCH_MODE_INTERVAL,
+       MatchConfig<SWITCH_MODE_INTERVAL>::relayPin, 0},
+      {"predictive", &predictive, &basicPredictive,
+       MATCH_FIRST_PIN + SWITCH_MODE_PREDICTIVE,
+       MatchConfig<SWITCH_MODE_PREDICTIVE>::relayPin, 0},
+      {"event", &event, &basicEvent, MATCH_FIRST_PIN + SWITCH_MODE_EVENT,
+       MatchConfig<SWITCH_MODE_EVENT>::relayPin, 0},
+  };
+  for (MatchCase &test : cases) {
+    test.controller->begin();
+    test.controller->setSolarThresholds(MATCH_MAX, MATCH_MIN);
+    test.basic->setSolarThresholds(MATCH_MAX, MATCH_MIN);
+  }
+  basicInterval.begin();
+  basicPredictive.begin();
+  basicEvent.begin();
+
+  const uint64_t runs = (uint64_t)(hours * 3600000.0 / MATCH_PERIOD_MS);
+  for (uint64_t run = 0; run < runs; run++) {
+    virtualClock.advance((int64_t)MATCH_PERIOD_MS * 1000);
+    scriptedAdc.advance(MATCH_PERIOD_MS);
+    uint32_t now = (uint32_t)millis();
+    solar_num_t solarIndex = solar.read();
+
+    for (MatchCase &test : cases) {
+      test.controller->run(solarIndex, now);
+      test.basic->run(solarIndex, now);
+      test.mismatches +=
+          memoryGpio.level(test.pin) != memoryGpio.level(test.basicPin);
+    }
+  }
+
+  printf("%.1f h, %llu runs, noise %.0f counts, thresholds %.0f-%.0f\n",
+         hours, (unsigned long long)runs, noiseCounts, MATCH_MIN, MATCH_MAX);
+  printf("%-12s  %10s  %10s  %10s\n", "mode", "toggles", "basic",
+         "mismatches");
+  bool ok = true;
+  for (const MatchCase &test : cases) {
+    printf("%-12s  %10u  %10u  %10llu\n", test.name,
+           (unsigned)memoryGpio.toggleCount(test.pin),
+           (unsigned)memoryGpio.toggleCount(test.basicPin),
+           (unsigned long long)test.mismatches);
+    if (test.mismatches != 0) {
+      fprintf(stderr, "%s: controllers disagree\n", test.name);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file switch_score.cpp
+ * @brief Scores the switch modes against each other on the same day trace.
+ *
+ * Usage: switch_score [options]
+ *
+ *   --trace <file>       replay raw readings, one per line, instead of the
+ *                        synthetic day
+ *   --hours <n>          simulated duration (default 24)
+ *   --adc-rate <hz>      scripted ADC sample rate (default 40)
+ *   --period-ms <ms>     control period, as RuntimeConfig (default 100)
+ *   --interval <min>     switch interval in minutes (default 5)
+ *   --min <index>        lower threshold (default 400)
+ *   --max <index>        upper threshold (default 1000)
+ *   --horizon <s>        predictive forecast horizon (default 60)
+ *   --confidence <k>     predictive band, in standard errors (default 2)
+ *   --dwell <ms>         event mode dwell time (default 2000)
+ *   --hysteresis <index> event mode hysteresis band (default 10)
+ *   --settle <s>         how long the index must stay on one side of the
+ *                        thresholds for a crossing to count (default 120)
+ *
+ * One SwitchController per SwitchMode sees the same readings. Each is
+ * scored against the settled
+ * crossings of the trace: the index's per-second mean entering or leaving
+ * the thresholds and then staying there for --settle seconds. For every
+ * crossing the harness finds the relay's first switch the same way, at
+ * most --settle seconds ahead of it, that the relay then holds for --settle
+ * seconds or until the next crossing. Its latency is negative when the relay
+ * switched ahead of the crossing; a crossing with no such switch is missed.
+ * Agreement is the share of seconds the relay matched the index's side of
+ * the thresholds.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define SCORE_FIRST_PIN 4
+
+struct ScoreOptions {
+  const char *trace = nullptr;
+  double hours = 24;
+  uint32_t adcRateHz = 40;
+  uint32_t periodMs = 100;
+  unsigned short intervalMinutes = 5;
+  double min = 400;
+  double max = 1000;
+  uint32_t horizonSeconds = 60;
+  double confidence = 2.0;
+  uint32_t dwellMs = 2000;
+  double hysteresis = 10.0;
+  uint32_t settleSeconds = 120;
+};
+
+struct ScoredMode {
+  const char *name;
+  SwitchMode mode;
+  std::vector<bool> on; // relay level, once a second
+};
+
+struct Crossing {
+  size_t second;
+  bool inside;
+};
+
+struct Score {
+  uint32_t toggles = 0;
+  size_t matched = 0;
+  size_t missed = 0;
+  double latencySum = 0;
+  long worstLatency = 0;
+  long bestLatency = 0;
+  size_t agreeing = 0;
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [--trace file] [--hours n] [--adc-rate hz] "
+          "[--period-ms ms]\n"
+          "       [--interval min] [--min index] [--max index] "
+          "[--horizon s]\n"
+          "       [--confidence k] [--dwell ms] [--hysteresis index] "
+          "[--settle s]\n",
+          name);
+}
+
+static bool parseOptions(int argc, char **argv, ScoreOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--trace") == 0)
+      options.trace = value;
+    else if (strcmp(arg, "--hours") == 0)
+      options.hours = atof(value);
+    else if (strcmp(arg, "--adc-rate") == 0)
+      options.adcRateHz = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--period-ms") == 0)
+      options.periodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--interval") == 0)
+      options.intervalMinutes = (unsigned short)atoi(value);
+    else if (strcmp(arg, "--min") == 0)
+      options.min = atof(value);
+    else if (strcmp(arg, "--max") == 0)
+      options.max = atof(value);
+    else if (strcmp(arg, "--horizon") == 0)
+      options.horizonSeconds = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--confidence") == 0)
+      options.confidence = atof(value);
+    else if (strcmp(arg, "--dwell") == 0)
+      options.dwellMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--hysteresis") == 0)
+      options.hysteresis = atof(value);
+    else if (strcmp(arg, "--settle") == 0)
+      options.settleSeconds = (uint32_t)atoi(value);
+    else
+      return false;
+  }
+  return options.hours > 0 && options.periodMs > 0 &&
+         options.periodMs <= 1000 && options.settleSeconds > 0;
+}
+
+/**
+ * @brief Finds the crossings after which the index stays on its new side of
+ * the thresholds for at least `settle` seconds.
+ */
+
+static std::vector<Crossing> settledCrossings(const std::vector<bool> &inside,
+                                              size_t settle) {
+  std::vector<Crossing> crossings;
+  bool settled = false, known = false;
+  size_t start = 0;
+
+  for (size_t second = 1; second <= inside.size(); second++) {
+    if (second < inside.size() && inside[second] == inside[start])
+      continue;
+    if (second - start >= settle) {
+      if (known && inside[start] != settled)
+        crossings.push_back({start, inside[start]});
+      settled = inside[start];
+      known = true;
+    }
+    start = second;
+  }
+  return crossings;
+}
+
+/**
+ * @brief Whether the relay holds `level` from `second` for `settle` seconds,
+ * or until `to` if that is sooner.
+ */
+
+static bool holds(const std::vector<bool> &relay, size_t second, size_t to,
+                  size_t settle, bool level) {
+  size_t end = second + settle < to ? second + settle : to;
+  for (; second < end; second++) {
+    if (relay[second] != level)
+      return false;
+  }
+  return true;
+}
+
+static Score score(const std::vector<bool> &inside,
+                   const std::vector<bool> &relay,
+                   const std::vector<Crossing> &crossings, uint32_t toggles,
+                   size_t settle) {
+  Score result;
+  result.toggles = toggles;
+
+  for (size_t second = 0; second < inside.size(); second++)
+    result.agreeing += inside[second] == relay[second];
+
+  for (size_t i = 0; i < crossings.size(); i++) {
+    // A switch more than `settle` ahead of the crossing is not counted as
+    // anticipating it; the relay already in place by then scores -settle
+    size_t from = i > 0 ? crossings[i - 1].second + 1 : 0;
+    if (crossings[i].second > from + settle)
+      from = crossings[i].second - settle;
+    size_t to = i + 1 < crossings.size() ? crossings[i + 1].second
+                                         : relay.size();
+    size_t found = to;
+    for (size_t second = from; second < to; second++) {
+      if (relay[second] == crossings[i].inside &&
+          (second == from || relay[second - 1] != crossings[i].inside) &&
+          holds(relay, second, to, settle, crossings[i].inside)) {
+        found = second;
+        break;
+      }
+    }
+
+    if (found == to) {
+      result.missed++;
+      continue;
+    }
+    long latency = (long)found - (long)crossings[i].second;
+    result.latencySum += latency;
+    if (result.matched == 0 || latency > result.worstLatency)
+      result.worstLatency = latency;
+    if (result.matched == 0 || latency < result.bestLatency)
+      result.bestLatency = latency;
+    result.matched++;
+  }
+  return result;
+}
+
+static void printScore(const char *name, const Score &result,
+                       size_t seconds) {
+  printf("%-10s  %7u  %7zu  %6zu  %10.1f  %8ld  %8ld  %8.1f%%\n", name,
+         (unsigned)result.toggles, result.matched, result.missed,
+         result.matched ? result.latencySum / result.matched : 0.0,
+         result.bestLatency, result.worstLatency,
+         seconds ? 100.0 * result.agreeing / seconds : 0.0);
+}
+
+int main(int argc, char **argv) {
+  ScoreOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  scriptedAdc.setSampleRate(options.adcRateHz);
+  if (options.trace != nullptr) {
+    if (!scriptedAdc.loadRecording(options.trace)) {
+      fprintf(stderr, "%s: no readings\n", options.trace);
+      return 1;
+    }
+  } else {
+    scriptedAdc.setWaveform(syntheticDay);
+  }
+
+  init_nvs();
+
+  ScoredMode modes[] = {{"interval", SWITCH_MODE_INTERVAL, {}},
+                        {"predictive", SWITCH_MODE_PREDICTIVE, {}},
+                        {"event", SWITCH_MODE_EVENT, {}}};
+  const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+  PredictiveConfig predictive;
+  predictive.horizonMs = options.horizonSeconds * 1000;
+  predictive.confidence = options.confidence;
+  EventConfig events;
+  events.dwellMs = options.dwellMs;
+  events.hysteresis = options.hysteresis;
+
+  std::vector<SwitchController *> relays;
+  for (size_t i = 0; i < modeCount; i++) {
+    SwitchController *relay = new SwitchController(SCORE_FIRST_PIN + i);
+    relay->setMode(modes[i].mode);
+    relay->setPredictiveConfig(predictive);
+    relay->setEventConfig(events);
+    if (!relay->setInterval(options.intervalMinutes) ||
+        !relay->setSolarThresholds(options.max, options.min)) {
+      fprintf(stderr, "invalid interval or thresholds\n");
+      return 2;
+    }
+    relay->begin();
+    relays.push_back(relay);
+  }
+
+  const uint64_t steps =
+      (uint64_t)(options.hours * 3600000.0 / options.periodMs);
+  const uint32_t stepsPerSecond = 1000 / options.periodMs;
+  std::vector<bool> inside;
+  double secondSum = 0;
+  uint32_t secondSteps = 0;
+
+  for (uint64_t step = 0; step < steps; step++) {
+    virtualClock.advance((int64_t)options.periodMs * 1000);
+    scriptedAdc.advance(options.periodMs);
+
+    uint32_t now = (uint32_t)millis();
+    solar_num_t solarIndex = solar.read();
+    for (SwitchController *relay : relays)
+      relay->run(solarIndex, now);
+
+#ifdef SOLAR_FIXED_POINT
+    secondSum += solarIndex.toDouble();
+#else
+    secondSum += solarIndex;
+#endif
+    if (++secondSteps == stepsPerSecond) {
+      double mean = secondSum / secondSteps;
+      inside.push_back(mean >= options.min && mean <= options.max);
+      for (size_t i = 0; i < modeCount; i++)
+        modes[i].on.push_back(memoryGpio.level(SCORE_FIRST_PIN + i) == 1);
+      secondSum = 0;
+      secondSteps = 0;
+    }
+  }
+
+  std::vector<Crossing> crossings =
+      settledCrossings(inside, options.settleSeconds);
+  printf("%.1f h, thresholds %.0f-%.0f, interval %u min, %zu settled "
+         "crossings\n",
+         options.hours, options.min, options.max,
+         (unsigned)options.intervalMinutes, crossings.size());
+  printf("mode        toggles  matched  missed  mean lat s  best s    "
+         "worst s   agreement\n");
+  for (size_t i = 0; i < modeCount; i++) {
+    printScore(modes[i].name,
+               score(inside, modes[i].on, crossings,
+                     memoryGpio.toggleCount(SCORE_FIRST_PIN + i),
+                     options.settleSeconds),
+               inside.size());
+    delete relays[i];
+  }
+  return 0;
+}
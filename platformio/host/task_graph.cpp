@@ -0,0 +1,440 @@
+/**
+ * @file task_graph.cpp
+ * @brief Runs the Runtime task graph on std::thread against the virtual
+ * clock.
+ *
+ * Usage: task_graph [--hours n] [--start-hour h] [--adaptive]
+ *
+ * Three threads do what Runtime's FreeRTOS tasks do, with the same
+ * components and periods as RuntimeConfig's defaults:
+ *
+ *   - sampling: every 100 ms (or at the period a SampleScheduler picks with
+ *     --adaptive) reads the solar index, pushes a timestamped reading to a
+ *     SolarReadingQueue and notifies the control thread;
+ *   - control: sleeps on that notification, drains the queue and runs a
+ *     SwitchController, the live stream and the flash log with each reading;
+ *   - service: every 1000 ms runs `storageTick()`, `solarLog.tick()` and
+ *     `telemetry.tick()`.
+ *
+ * SimScheduler stands in for the FreeRTOS scheduler: a thread blocks in
+ * `delayUntil()` or `take()` as the task would in `xTaskDelayUntil()` or
+ * `ulTaskNotifyTake()`, and only when every thread is blocked does the
+ * scheduler move the virtual clock (and the scripted ADC) to the earliest
+ * deadline and wake the threads due then. A run is therefore deterministic
+ * and as fast as the host allows; the synthetic day is replayed from
+ * --start-hour (default 12, noon, when the clouds switch the relay).
+ *
+ * The report gives RuntimeStats for each thread. Jitter and queue latency
+ * are in virtual time, where the bodies take no time, so anything above zero
+ * is a scheduling fault; busy time is host wall time, and the CPU share
+ * relates it to the virtual uptime. Exits non-zero if a period is missed or
+ * drifts, a reading is dropped or processed out of order, the relay does
+ * not switch as a SwitchController fed the same readings on one thread does,
+ * or the live stream wakes its sender while no client is attached.
+ */
+
+#include "../src/util/main.h"
+#include "hal_linux.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#define GRAPH_SAMPLE_PERIOD_MS 100
+#define GRAPH_SERVICE_PERIOD_MS 1000
+#define GRAPH_RELAY_PIN 4
+#define GRAPH_REFERENCE_PIN 5
+
+enum SimTask { SIM_SAMPLING, SIM_CONTROL, SIM_SERVICE, SIM_TASKS };
+
+enum SimTaskState { SIM_RUNNING, SIM_SLEEPING, SIM_WAITING };
+
+typedef std::chrono::steady_clock GraphClock;
+
+/**
+ * @class SimScheduler
+ * @brief Lock-step scheduler moving the virtual clock between the deadlines
+ * of blocked threads.
+ */
+class SimScheduler {
+private:
+  std::mutex lock;
+  std::condition_variable changed;
+  SimTaskState states[SIM_TASKS] = {SIM_RUNNING, SIM_RUNNING, SIM_RUNNING};
+  int64_t wakeMicros[SIM_TASKS] = {};
+  bool notified[SIM_TASKS] = {};
+  bool stopping = false;
+
+  bool allBlocked() const {
+    for (SimTaskState state : states)
+      if (state == SIM_RUNNING)
+        return false;
+    return true;
+  }
+
+public:
+  /**
+   * @brief Blocks until the virtual clock reaches `deadlineMicros`.
+   *
+   * @return `false` once the run is over and the thread should return.
+   */
+  bool delayUntil(SimTask task, int64_t deadlineMicros) {
+    std::unique_lock<std::mutex> guard(lock);
+    states[task] = SIM_SLEEPING;
+    wakeMicros[task] = deadlineMicros;
+    changed.notify_all();
+    changed.wait(guard,
+                 [&] { return states[task] == SIM_RUNNING || stopping; });
+    return !stopping;
+  }
+
+  /**
+   * @brief Blocks until another thread calls `give()`, like
+   * `ulTaskNotifyTake(pdTRUE, portMAX_DELAY)`.
+   */
+  bool take(SimTask task) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!notified[task]) {
+      states[task] = SIM_WAITING;
+      changed.notify_all();
+      changed.wait(guard, [&] { return notified[task] || stopping; });
+    }
+    notified[task] = false;
+    return !stopping;
+  }
+
+  void give(SimTask task) {
+    std::lock_guard<std::mutex> guard(lock);
+    notified[task] = true;
+    // Running from here, so the clock waits for it
+    if (states[task] == SIM_WAITING)
+      states[task] = SIM_RUNNING;
+    changed.notify_all();
+  }
+
+  /**
+   * @brief Moves the virtual clock from deadline to deadline until
+   * `endMicros`, then stops every thread.
+   *
+   * @return `false` if every thread waited on a notification, with no
+   * deadline left to move to.
+   */
+  bool run(int64_t endMicros) {
+    std::unique_lock<std::mutex> guard(lock);
+    bool ok = true;
+    while (true) {
+      changed.wait(guard, [&] { return allBlocked(); });
+
+      int64_t next = INT64_MAX;
+      for (int i = 0; i < SIM_TASKS; i++)
+        if (states[i] == SIM_SLEEPING && wakeMicros[i] < next)
+          next = wakeMicros[i];
+      if (next == INT64_MAX)
+        ok = false;
+      if (next == INT64_MAX || next > endMicros)
+        break;
+
+      int64_t now = micros();
+      if (next > now) {
+        // Whole milliseconds, as every deadline is one
+        scriptedAdc.advance((uint32_t)(next / 1000 - now / 1000));
+        virtualClock.advance(next - now);
+      }
+      for (int i = 0; i < SIM_TASKS; i++)
+        if (states[i] == SIM_SLEEPING && wakeMicros[i] <= next)
+          states[i] = SIM_RUNNING;
+      changed.notify_all();
+    }
+
+    stopping = true;
+    changed.notify_all();
+    return ok;
+  }
+};
+
+/**
+ * @brief The task graph: the threads' shared state and their bodies.
+ */
+struct TaskGraph {
+  SimScheduler scheduler;
+  SolarIndex &index;
+  SwitchController &controller;
+  bool adaptive;
+  SolarReadingQueue readings;
+  std::mutex statsLock;
+  RuntimeStats timing = {};
+  std::vector<SolarReading> processed;
+  uint32_t outOfOrder = 0;
+
+  TaskGraph(SolarIndex &index, SwitchController &controller, bool adaptive)
+      : index(index), controller(controller), adaptive(adaptive) {}
+
+  void record(RuntimeTaskStats &task, int64_t jitterMicros,
+              GraphClock::duration busy, bool overrun) {
+    uint32_t jitter =
+        (uint32_t)(jitterMicros < 0 ? -jitterMicros : jitterMicros);
+    std::lock_guard<std::mutex> guard(statsLock);
+    task.runs++;
+    task.overruns += overrun;
+    task.jitterTotalMicros += jitter;
+    if (jitter > task.jitterMaxMicros)
+      task.jitterMaxMicros = jitter;
+    task.busyMicros +=
+        std::chrono::duration_cast<std::chrono::microseconds>(busy).count();
+  }
+
+  void sampling() {
+    SampleScheduler sampleScheduler;
+    uint32_t periodMs = GRAPH_SAMPLE_PERIOD_MS;
+    int64_t deadline = micros();
+    int64_t previousMicros = deadline;
+
+    while (true) {
+      int64_t periodMicros = (int64_t)periodMs * 1000;
+      deadline += periodMicros;
+      bool overrun = micros() >= deadline;
+      if (!scheduler.delayUntil(SIM_SAMPLING, deadline))
+        return;
+      int64_t wokeMicros = micros();
+      GraphClock::time_point begin = GraphClock::now();
+
+      SolarReading reading = {index.read(), (uint32_t)millis(), wokeMicros};
+      if (readings.push(reading)) {
+        scheduler.give(SIM_CONTROL);
+      } else {
+        std::lock_guard<std::mutex> guard(statsLock);
+        timing.control.overruns++;
+      }
+      if (adaptive)
+        periodMs = sampleScheduler.next(reading.solarIndex, reading.millis);
+      {
+        std::lock_guard<std::mutex> guard(statsLock);
+        timing.samplePeriodMs = periodMs;
+      }
+
+      record(timing.sampling, wokeMicros - previousMicros - periodMicros,
+             GraphClock::now() - begin, overrun);
+      previousMicros = wokeMicros;
+    }
+  }
+
+  void control() {
+    SolarReading block[RUNTIME_SAMPLE_QUEUE_LENGTH];
+    uint32_t loggedMillis = 0;
+    bool logged = false;
+
+    while (scheduler.take(SIM_CONTROL)) {
+      size_t count;
+      while ((count = readings.popBatch(block, RUNTIME_SAMPLE_QUEUE_LENGTH)) !=
+             0) {
+        for (size_t r = 0; r < count; r++) {
+          const SolarReading &reading = block[r];
+          int64_t beginMicros = micros();
+          GraphClock::time_point begin = GraphClock::now();
+
+          controller.run(reading.solarIndex, reading.millis);
+          if (timing.firstDecisionMicros == 0) {
+            std::lock_guard<std::mutex> guard(statsLock);
+            timing.firstDecisionMicros = beginMicros;
+          }
+          liveStream.sample(reading.millis, historyValue(reading.solarIndex));
+          if (!logged ||
+              reading.millis - loggedMillis >= SOLAR_LOG_SAMPLE_PERIOD_MS) {
+            solarLog.logSample(historyValue(reading.solarIndex));
+            loggedMillis = reading.millis;
+            logged = true;
+          }
+
+          if (!processed.empty() &&
+              reading.takenMicros <= processed.back().takenMicros)
+            outOfOrder++;
+          processed.push_back(reading);
+          record(timing.control, beginMicros - reading.takenMicros,
+                 GraphClock::now() - begin, false);
+        }
+      }
+    }
+  }
+
+  void service() {
+    const int64_t periodMicros = (int64_t)GRAPH_SERVICE_PERIOD_MS * 1000;
+    int64_t deadline = micros();
+    int64_t previousMicros = deadline;
+
+    while (true) {
+      deadline += periodMicros;
+      bool overrun = micros() >= deadline;
+      if (!scheduler.delayUntil(SIM_SERVICE, deadline))
+        return;
+      int64_t wokeMicros = micros();
+      GraphClock::time_point begin = GraphClock::now();
+
+      storageTick();
+      solarLog.tick();
+      telemetry.tick();
+
+      record(timing.service, wokeMicros - previousMicros - periodMicros,
+             GraphClock::now() - begin, overrun);
+      previousMicros = wokeMicros;
+    }
+  }
+
+  /**
+   * @brief Counters as Runtime::stats() derives them.
+   */
+  RuntimeStats stats(int64_t uptimeMicros) {
+    std::lock_guard<std::mutex> guard(statsLock);
+    RuntimeStats snapshot = timing;
+    snapshot.uptimeMicros = uptimeMicros;
+    for (RuntimeTaskStats *task :
+         {&snapshot.sampling, &snapshot.control, &snapshot.service}) {
+      if (task->runs != 0)
+        task->jitterMeanMicros =
+            (uint32_t)(task->jitterTotalMicros / task->runs);
+      task->cpuPermille =
+          (uint16_t)(task->busyMicros * 1000 / snapshot.uptimeMicros);
+    }
+    return snapshot;
+  }
+};
+
+static std::atomic<uint32_t> liveWakeups{0};
+
+static void countLiveWakeup() { liveWakeups++; }
+
+static void printTask(const char *name, const RuntimeTaskStats &task) {
+  printf("%-9s %8u %9u %11u %10u %10.2f %9u\n", name, (unsigned)task.runs,
+         (unsigned)task.overruns, (unsigned)task.jitterMeanMicros,
+         (unsigned)task.jitterMaxMicros,
+         task.runs ? (double)task.busyMicros / task.runs : 0.0,
+         (unsigned)task.cpuPermille);
+}
+
+int main(int argc, char **argv) {
+  double hours = 1;
+  double startHour = 12;
+  bool adaptive = false;
+  bool usage = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--adaptive") == 0)
+      adaptive = true;
+    else if (i + 1 < argc && strcmp(argv[i], "--hours") == 0)
+      hours = atof(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "--start-hour") == 0)
+      startHour = atof(argv[++i]);
+    else
+      usage = true;
+  }
+  if (usage || hours <= 0 || startHour < 0) {
+    fprintf(stderr, "usage: %s [--hours n] [--start-hour h] [--adaptive]\n",
+            argv[0]);
+    return 2;
+  }
+
+  const double startSeconds = startHour * 3600.0;
+  scriptedAdc.setWaveform(
+      [startSeconds](double seconds) {
+        return syntheticDay(startSeconds + seconds);
+      });
+  init_nvs();
+  calibrateSolarIndex(
+      solar, dividerRatio(SolarSensorConfig::r1, SolarSensorConfig::r2));
+  solar.load();
+
+  SwitchController controller(GRAPH_RELAY_PIN);
+  controller.begin();
+  controller.setSolarThresholds(1000, 400);
+
+  liveStream.onPublish(countLiveWakeup);
+  TaskGraph graph(solar, controller, adaptive);
+  int64_t startMicros = micros();
+  std::thread sampling(&TaskGraph::sampling, &graph);
+  std::thread control(&TaskGraph::control, &graph);
+  std::thread service(&TaskGraph::service, &graph);
+
+  GraphClock::time_point wallStart = GraphClock::now();
+  bool scheduled =
+      graph.scheduler.run(startMicros + (int64_t)(hours * 3600e6));
+  sampling.join();
+  control.join();
+  service.join();
+  double wallSeconds =
+      std::chrono::duration<double>(GraphClock::now() - wallStart).count();
+  RuntimeStats stats = graph.stats(micros() - startMicros);
+
+  // The same readings through a controller on this thread alone
+  SwitchController reference(GRAPH_REFERENCE_PIN);
+  reference.begin();
+  reference.setSolarThresholds(1000, 400);
+  for (const SolarReading &reading : graph.processed)
+    reference.run(reading.solarIndex, reading.millis);
+
+  printf("%.1f h from %.1f h in %.2f s wall, %s sampling, last period %u ms\n",
+         hours, startHour, wallSeconds, adaptive ? "adaptive" : "fixed",
+         (unsigned)stats.samplePeriodMs);
+  printf("%-9s %8s %9s %11s %10s %10s %9s\n", "task", "runs", "overruns",
+         "jitter mean", "jitter max", "busy us", "permille");
+  printTask("sampling", stats.sampling);
+  printTask("control", stats.control);
+  printTask("service", stats.service);
+  printf("first decision at %lld us, relay toggled %u times (reference %u)\n",
+         (long long)(stats.firstDecisionMicros - startMicros),
+         (unsigned)memoryGpio.toggleCount(GRAPH_RELAY_PIN),
+         (unsigned)memoryGpio.toggleCount(GRAPH_REFERENCE_PIN));
+
+  // With no client attached every frame above went nowhere; one attached
+  // client must be woken for each frame after that.
+  uint32_t idleWakeups = liveWakeups.load();
+  uint32_t idleFrames = liveStream.stats().frames;
+  int client = liveStream.attach();
+  liveStream.relay(GRAPH_RELAY_PIN, memoryGpio.level(GRAPH_RELAY_PIN),
+                   (uint32_t)millis());
+  uint32_t clientWakeups = liveWakeups.load() - idleWakeups;
+  liveStream.detach(client);
+  printf("live: %u frames, %u wakeups without a client, %u with one\n",
+         (unsigned)idleFrames, (unsigned)idleWakeups, (unsigned)clientWakeups);
+
+  bool ok = true;
+  const uint32_t servicePeriods =
+      (uint32_t)(hours * 3600000.0 / GRAPH_SERVICE_PERIOD_MS);
+  if (!scheduled) {
+    fprintf(stderr, "every thread waited with no deadline left\n");
+    ok = false;
+  }
+  if (stats.sampling.overruns || stats.sampling.jitterMaxMicros ||
+      stats.service.overruns || stats.service.jitterMaxMicros ||
+      stats.control.jitterMaxMicros) {
+    fprintf(stderr, "a period was missed or drifted\n");
+    ok = false;
+  }
+  if (stats.service.runs != servicePeriods ||
+      (!adaptive && stats.sampling.runs != servicePeriods *
+                                               GRAPH_SERVICE_PERIOD_MS /
+                                               GRAPH_SAMPLE_PERIOD_MS)) {
+    fprintf(stderr, "the periodic threads ran the wrong number of times\n");
+    ok = false;
+  }
+  if (stats.control.overruns || stats.control.runs != stats.sampling.runs ||
+      graph.outOfOrder) {
+    fprintf(stderr, "%u readings dropped, %u out of order\n",
+            (unsigned)stats.control.overruns, (unsigned)graph.outOfOrder);
+    ok = false;
+  }
+  if (memoryGpio.toggleCount(GRAPH_RELAY_PIN) !=
+          memoryGpio.toggleCount(GRAPH_REFERENCE_PIN) ||
+      memoryGpio.level(GRAPH_RELAY_PIN) !=
+          memoryGpio.level(GRAPH_REFERENCE_PIN)) {
+    fprintf(stderr, "the relay switched differently from the reference\n");
+    ok = false;
+  }
+  if (idleFrames == 0 || idleWakeups != 0 || clientWakeups != 1) {
+    fprintf(stderr, "the live stream woke its sender for the wrong frames\n");
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
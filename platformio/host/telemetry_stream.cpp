@@ -0,0 +1,171 @@
+/**
+ * @file telemetry_stream.cpp
+ * @brief Checks TelemetryDecoder against a byte stream with known damage.
+ *
+ * Usage: telemetry_stream
+ *
+ * Encodes STREAM_RECORDS records, cycling through every record type with
+ * values derived from their index, so the 8-bit sequence number wraps twice.
+ * The byte stream stands in for the serial port:
+ *
+ *   - a line of plain text, as ESP_LOG writes to the same port, before
+ *     every STREAM_TEXT_EVERY-th frame;
+ *   - frame STREAM_CORRUPT with one byte changed, so its CRC fails;
+ *   - frame STREAM_DROPPED left out, as if the UART had dropped it.
+ *
+ * The stream is fed to a fresh decoder whole, a byte at a time and in
+ * random chunks of 1 to STREAM_MAX_CHUNK bytes. Every time, each record but
+ * the corrupt and dropped ones must come out once, in order, with the values
+ * it was encoded with. Each text line and the corrupt frame count as one
+ * corrupt frame, and the sequence gaps they leave as lost frames: the
+ * corrupt frame and the dropped one.
+ *
+ * Exits non-zero if a record or counter differs.
+ */
+
+#include "TelemetryDecoder.h"
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define STREAM_RECORDS 600
+#define STREAM_TEXT_EVERY 50
+#define STREAM_CORRUPT 123
+#define STREAM_DROPPED 321
+#define STREAM_MAX_CHUNK 64
+
+static const char streamText[] = "I (1234) solar: plain text on the port\r\n";
+
+/**
+ * @brief The record with index `i`.
+ */
+
+static TelemetryRecord streamRecord(uint32_t i) {
+  TelemetryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.seq = (uint8_t)i;
+  record.millis = 1000 + i * 100;
+  switch (i % 4) {
+  case 0:
+    record.type = TELEMETRY_SAMPLE;
+    record.sample.raw = (uint16_t)(i * 7 % 4096);
+    break;
+  case 1:
+    record.type = TELEMETRY_SPAN;
+    record.span.kind = (uint8_t)(i % 3);
+    record.span.durationMillis = i * 1000 + 1;
+    break;
+  case 2:
+    record.type = TELEMETRY_RELAY;
+    record.relay.pin = (uint8_t)(i % 40);
+    record.relay.level = (uint8_t)(i / 4 % 2);
+    break;
+  default:
+    record.type = TELEMETRY_COUNTERS;
+    record.counters.frames = i;
+    record.counters.uartDroppedBytes = i * 2;
+    record.counters.adcDroppedSamples = i * 3;
+    record.counters.storageStores = i * 5;
+    record.counters.storageCommits = 0x01000000u + i;
+    break;
+  }
+  return record;
+}
+
+static bool sameRecord(const TelemetryRecord &a, const TelemetryRecord &b) {
+  if (a.type != b.type || a.seq != b.seq || a.millis != b.millis)
+    return false;
+  switch (a.type) {
+  case TELEMETRY_SAMPLE:
+    return a.sample.raw == b.sample.raw;
+  case TELEMETRY_SPAN:
+    return a.span.kind == b.span.kind &&
+           a.span.durationMillis == b.span.durationMillis;
+  case TELEMETRY_RELAY:
+    return a.relay.pin == b.relay.pin && a.relay.level == b.relay.level;
+  case TELEMETRY_COUNTERS:
+    return a.counters.frames == b.counters.frames &&
+           a.counters.uartDroppedBytes == b.counters.uartDroppedBytes &&
+           a.counters.adcDroppedSamples == b.counters.adcDroppedSamples &&
+           a.counters.storageStores == b.counters.storageStores &&
+           a.counters.storageCommits == b.counters.storageCommits;
+  }
+  return false;
+}
+
+/**
+ * @brief Feeds `stream` in chunks of `chunk()` bytes and checks the result.
+ */
+
+template <typename Chunk>
+static bool check(const char *name, const std::vector<uint8_t> &stream,
+                  const std::vector<uint32_t> &expected, uint64_t texts,
+                  Chunk chunk) {
+  std::vector<TelemetryRecord> records;
+  TelemetryDecoder decoder(
+      [&](const TelemetryRecord &record) { records.push_back(record); });
+  for (size_t at = 0; at < stream.size();) {
+    size_t length = chunk();
+    if (length > stream.size() - at)
+      length = stream.size() - at;
+    decoder.feed(stream.data() + at, length);
+    at += length;
+  }
+
+  uint32_t wrong = 0;
+  for (size_t i = 0; i < records.size() && i < expected.size(); i++)
+    wrong += !sameRecord(records[i], streamRecord(expected[i]));
+
+  bool ok = records.size() == expected.size() && wrong == 0 &&
+            decoder.decoded() == expected.size() &&
+            decoder.corrupt() == texts + 1 && decoder.lost() == 2;
+  printf("%-10s %8llu %8u %8llu %8llu  %s\n", name,
+         (unsigned long long)decoder.decoded(), (unsigned)wrong,
+         (unsigned long long)decoder.corrupt(),
+         (unsigned long long)decoder.lost(), ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  std::vector<uint8_t> stream;
+  std::vector<uint32_t> expected;
+  uint64_t texts = 0;
+
+  for (uint32_t i = 0; i < STREAM_RECORDS; i++) {
+    if (i % STREAM_TEXT_EVERY == STREAM_TEXT_EVERY - 1) {
+      stream.insert(stream.end(), streamText,
+                    streamText + sizeof(streamText) - 1);
+      texts++;
+    }
+
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t length = encodeTelemetry(streamRecord(i), frame);
+    if (i == STREAM_DROPPED)
+      continue;
+    if (i == STREAM_CORRUPT) {
+      // Any byte but a delimiter, so the frame stays one frame
+      frame[length / 2] ^= frame[length / 2] == 0x5A ? 0xA5 : 0x5A;
+    } else {
+      expected.push_back(i);
+    }
+    stream.insert(stream.end(), frame, frame + length);
+  }
+
+  printf("%u records, %zu bytes, %llu text lines, record %u corrupt, "
+         "record %u dropped\n",
+         (unsigned)STREAM_RECORDS, stream.size(), (unsigned long long)texts,
+         (unsigned)STREAM_CORRUPT, (unsigned)STREAM_DROPPED);
+  printf("%-10s %8s %8s %8s %8s\n", "chunks", "decoded", "wrong", "corrupt",
+         "lost");
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> random(1, STREAM_MAX_CHUNK);
+  bool ok = check("whole", stream, expected, texts,
+                  [&] { return stream.size(); });
+  ok = check("bytes", stream, expected, texts, [] { return (size_t)1; }) &&
+       ok;
+  ok = check("random", stream, expected, texts, [&] { return random(rng); }) &&
+       ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,360 @@
+/**
+ * @file uart_tx.cpp
+ * @brief Drives TxRing into a fake UART and measures what the caller of
+ * `send()` waits for.
+ *
+ * Usage: uart_tx [--baud n] [--seconds n]
+ *
+ * FakeUart is a HalSerial built as UartHandler is: synchronously it holds
+ * the caller for the wire time of every write, as `uart_write_bytes()` does
+ * once the driver buffer is full; asynchronously `write()` appends to a
+ * TxRing<UART_TX_RING_SIZE> under a lock and a drain thread, standing in for
+ * the TX task, hands the ring's spans to a sink paced at the baud rate.
+ * Every write is a sequence-numbered line, and the sink checks that the
+ * lines arrive whole and in order, with gaps only where writes were counted
+ * as dropped.
+ *
+ * Three runs:
+ *
+ *   - throughput: an unpaced sink and a producer that waits for room, as
+ *     UART_OVERFLOW_BLOCK does, for the bytes per second through the ring
+ *     and the sink's checking;
+ *   - telemetry: bursts of lines every 10 ms at about 75% of the wire rate,
+ *     synchronous and asynchronous, for the caller's write latency;
+ *   - overload: the same bursts at twice the wire rate, where the ring drops
+ *     whole writes.
+ *
+ * Exits non-zero if a line is corrupted, lost without being counted, or the
+ * telemetry run drops anything, or if an asynchronous write at the 99th
+ * percentile takes as long as one line on the wire.
+ */
+
+#include "../src/util/main.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define UART_TX_DEFAULT_BAUD 115200
+#define UART_TX_BITS_PER_BYTE 10 // 8N1
+#define UART_TX_SINK_CHUNK 64    // bytes the fake driver takes at a time
+#define UART_TX_BURST_MS 10
+#define UART_TX_THROUGHPUT_LINES 1000000
+
+typedef std::chrono::steady_clock UartTxClock;
+
+/**
+ * @brief Checks the lines reaching the sink: "#<sequence>,<value>\n".
+ */
+class LineChecker {
+private:
+  std::string partial;
+  uint32_t expected = 0;
+
+public:
+  uint32_t lines = 0;
+  uint32_t skipped = 0;
+  uint32_t corrupted = 0;
+  uint64_t bytes = 0;
+
+  void take(const uint8_t *data, size_t length) {
+    bytes += length;
+    for (size_t i = 0; i < length; i++) {
+      if (data[i] != '\n') {
+        partial += (char)data[i];
+        continue;
+      }
+      unsigned sequence;
+      double value;
+      char check[32];
+      if (sscanf(partial.c_str(), "#%u,%lf", &sequence, &value) != 2 ||
+          sequence < expected) {
+        corrupted++;
+      } else {
+        snprintf(check, sizeof(check), "#%u,%.3f", sequence,
+                 sequence * 0.125);
+        corrupted += partial != check;
+        skipped += sequence - expected;
+        expected = sequence + 1;
+      }
+      lines++;
+      partial.clear();
+    }
+  }
+
+  /**
+   * @brief Sequence numbers missing from what arrived, out of `writes`.
+   */
+  uint32_t missing(uint32_t writes) const {
+    return skipped + (writes - expected);
+  }
+};
+
+/**
+ * @class FakeUart
+ * @brief HalSerial with UartHandler's synchronous and asynchronous paths over
+ * a paced in-memory sink.
+ */
+class FakeUart : public HalSerial {
+private:
+  TxRing<UART_TX_RING_SIZE> txRing;
+  std::mutex writeLock;
+  std::mutex wakeLock;
+  std::condition_variable wake;
+  std::thread txThread;
+  std::atomic<bool> running{false};
+  std::atomic<uint32_t> droppedBytes{0};
+  std::atomic<uint32_t> droppedWrites{0};
+  std::atomic<uint32_t> highWater{0};
+  uint32_t queuedBytes = 0;
+  double secondsPerByte;
+  bool block;
+
+  void transmit(const uint8_t *data, size_t length) {
+    if (secondsPerByte > 0)
+      std::this_thread::sleep_for(
+          std::chrono::duration<double>(secondsPerByte * length));
+    sink.take(data, length);
+  }
+
+  void drain() {
+    const uint8_t *data;
+    while (true) {
+      size_t length = txRing.peek(data);
+      if (length == 0) {
+        if (!running.load(std::memory_order_acquire))
+          return;
+        std::unique_lock<std::mutex> guard(wakeLock);
+        wake.wait_for(guard, std::chrono::milliseconds(1),
+                      [this] { return txRing.size() != 0 || !running; });
+        continue;
+      }
+      length = std::min<size_t>(length, UART_TX_SINK_CHUNK);
+      transmit(data, length);
+      txRing.consume(length);
+    }
+  }
+
+public:
+  LineChecker sink;
+
+  /**
+   * @param baud Wire rate, 0 for a sink that takes bytes at once.
+   * @param async Queue through the TxRing instead of waiting for the wire.
+   * @param block Wait for room when the ring is full instead of dropping.
+   */
+  FakeUart(uint32_t baud, bool async, bool block = false)
+      : secondsPerByte(baud ? (double)UART_TX_BITS_PER_BYTE / baud : 0),
+        block(block) {
+    if (async) {
+      running = true;
+      txThread = std::thread(&FakeUart::drain, this);
+    }
+  }
+
+  ~FakeUart() { flush(); }
+
+  void write(const char *data, size_t length) override {
+    if (!txThread.joinable()) {
+      transmit((const uint8_t *)data, length);
+      queuedBytes += length;
+      return;
+    }
+
+    while (true) {
+      std::unique_lock<std::mutex> guard(writeLock);
+      bool queued = txRing.write(data, length);
+      size_t used = txRing.size();
+      guard.unlock();
+
+      if (queued) {
+        queuedBytes += length;
+        if (used > highWater.load(std::memory_order_relaxed))
+          highWater.store(used, std::memory_order_relaxed);
+        wake.notify_one();
+        return;
+      }
+      if (!block) {
+        droppedBytes.fetch_add(length, std::memory_order_relaxed);
+        droppedWrites.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      wake.notify_one();
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * @brief Waits until the ring is drained, then stops the drain thread;
+   * later writes are synchronous.
+   */
+  void flush() override {
+    if (!txThread.joinable())
+      return;
+    running.store(false, std::memory_order_release);
+    wake.notify_one();
+    txThread.join();
+  }
+
+  UartTxStats txStats() const override {
+    return {queuedBytes, droppedBytes.load(), droppedWrites.load(),
+            highWater.load()};
+  }
+};
+
+struct UartTxRun {
+  const char *name;
+  double seconds;
+  uint32_t writes;
+  std::vector<double> latencies; // microseconds per write
+};
+
+static size_t formatLine(char *line, size_t size, uint32_t sequence) {
+  return (size_t)snprintf(line, size, "#%u,%.3f\n", (unsigned)sequence,
+                          sequence * 0.125);
+}
+
+/**
+ * @brief Writes `lines` lines per burst, one burst every UART_TX_BURST_MS,
+ * for `seconds`, timing each write.
+ */
+
+static UartTxRun runBursts(const char *name, FakeUart &uart, uint32_t lines,
+                           double seconds) {
+  UartTxRun run = {name, seconds, 0, {}};
+  UartTxClock::time_point next = UartTxClock::now();
+  const uint32_t bursts = (uint32_t)(seconds * 1000 / UART_TX_BURST_MS);
+  char line[32];
+
+  for (uint32_t burst = 0; burst < bursts; burst++) {
+    std::this_thread::sleep_until(next);
+    next += std::chrono::milliseconds(UART_TX_BURST_MS);
+    for (uint32_t i = 0; i < lines; i++) {
+      size_t length = formatLine(line, sizeof(line), run.writes++);
+      UartTxClock::time_point start = UartTxClock::now();
+      uart.write(line, length);
+      run.latencies.push_back(
+          std::chrono::duration<double, std::micro>(UartTxClock::now() - start)
+              .count());
+    }
+  }
+  uart.flush();
+  return run;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+/**
+ * @brief Prints a run and returns `false` if its lines did not arrive intact.
+ */
+
+static bool report(const UartTxRun &run, FakeUart &uart) {
+  UartTxStats stats = uart.txStats();
+  const LineChecker &sink = uart.sink;
+  printf("%-18s %8u %8u %8u %9.1f %9.1f %9.1f %8u\n", run.name,
+         (unsigned)run.writes, (unsigned)sink.lines,
+         (unsigned)stats.droppedWrites, percentile(run.latencies, 0.5),
+         percentile(run.latencies, 0.99),
+         percentile(run.latencies, 1.0), (unsigned)stats.highWater);
+
+  bool intact = sink.corrupted == 0 &&
+                sink.lines + stats.droppedWrites == run.writes &&
+                sink.missing(run.writes) == stats.droppedWrites;
+  if (!intact)
+    fprintf(stderr, "%s: %u corrupted, %u missing, %u dropped\n", run.name,
+            (unsigned)sink.corrupted, (unsigned)sink.missing(run.writes),
+            (unsigned)stats.droppedWrites);
+  return intact;
+}
+
+int main(int argc, char **argv) {
+  uint32_t baud = UART_TX_DEFAULT_BAUD;
+  double seconds = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--baud") == 0)
+      baud = (uint32_t)atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--seconds") == 0)
+      seconds = atof(argv[i + 1]);
+    else
+      seconds = 0;
+  }
+  if (argc % 2 == 0 || baud == 0 || seconds <= 0) {
+    fprintf(stderr, "usage: %s [--baud n] [--seconds n]\n", argv[0]);
+    return 2;
+  }
+  bool ok = true;
+
+  {
+    FakeUart uart(0, true, true);
+    char line[32];
+    UartTxClock::time_point start = UartTxClock::now();
+    for (uint32_t i = 0; i < UART_TX_THROUGHPUT_LINES; i++)
+      uart.write(line, formatLine(line, sizeof(line), i));
+    uart.flush();
+    double elapsed =
+        std::chrono::duration<double>(UartTxClock::now() - start).count();
+
+    printf("throughput: %u lines, %.1f MB in %.3f s, %.1f MB/s\n",
+           (unsigned)uart.sink.lines, uart.sink.bytes / 1e6, elapsed,
+           uart.sink.bytes / 1e6 / elapsed);
+    if (uart.sink.lines != UART_TX_THROUGHPUT_LINES || uart.sink.corrupted) {
+      fprintf(stderr, "throughput: lines lost or corrupted\n");
+      ok = false;
+    }
+  }
+
+  // Line length of the later sequence numbers, for the wire rate
+  char line[32];
+  size_t lineBytes = formatLine(line, sizeof(line), 100000);
+  double wireBytesPerBurst =
+      baud / (double)UART_TX_BITS_PER_BYTE * UART_TX_BURST_MS / 1000.0;
+  uint32_t telemetryLines = (uint32_t)(0.75 * wireBytesPerBurst / lineBytes);
+  uint32_t overloadLines = (uint32_t)(2 * wireBytesPerBurst / lineBytes);
+  if (telemetryLines == 0)
+    telemetryLines = 1;
+  double lineWireMicros = 1e6 * lineBytes * UART_TX_BITS_PER_BYTE / baud;
+
+  printf("\n%u baud, %u lines of %u bytes every %u ms, %.0f us each on the "
+         "wire\n",
+         (unsigned)baud, (unsigned)telemetryLines, (unsigned)lineBytes,
+         (unsigned)UART_TX_BURST_MS, lineWireMicros);
+  printf("%-18s %8s %8s %8s %9s %9s %9s %8s\n", "run", "writes", "arrived",
+         "dropped", "p50 us", "p99 us", "max us", "ring hw");
+
+  FakeUart synchronous(baud, false);
+  UartTxRun syncRun =
+      runBursts("telemetry, sync", synchronous, telemetryLines, seconds);
+  ok = report(syncRun, synchronous) && ok;
+
+  FakeUart telemetry(baud, true);
+  UartTxRun asyncRun =
+      runBursts("telemetry, async", telemetry, telemetryLines, seconds);
+  ok = report(asyncRun, telemetry) && ok;
+  if (telemetry.txStats().droppedWrites != 0) {
+    fprintf(stderr, "telemetry: dropped writes under the wire rate\n");
+    ok = false;
+  }
+  if (percentile(asyncRun.latencies, 0.99) >= lineWireMicros) {
+    fprintf(stderr, "telemetry: async p99 write is not below the wire time\n");
+    ok = false;
+  }
+
+  FakeUart overload(baud, true);
+  UartTxRun overloadRun =
+      runBursts("overload, async", overload, overloadLines, seconds);
+  ok = report(overloadRun, overload) && ok;
+
+  return ok ? 0 : 1;
+}
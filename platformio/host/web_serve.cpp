@@ -0,0 +1,123 @@
+/**
+ * @file web_serve.cpp
+ * @brief Serves the dashboard, API and live stream from the host build.
+ *
+ * Usage: web_serve <asset-dir> [options]
+ *
+ *   --port <n>        TCP port on 127.0.0.1 (default 8080)
+ *   --period-ms <ms>  wall-clock period of the simulated control loop
+ *                     (default 100, as RuntimeConfig)
+ *   --speed <n>       simulated seconds per second (default 1)
+ *
+ * <asset-dir> is the output of `tools/compress_assets.py data <asset-dir>`,
+ * the same files that go into the "www" partition. The request handling is
+ * the firmware's WebApp over HttpSocketServer, so it can be load tested
+ * locally, e.g. `wrk -H 'Accept-Encoding: gzip' http://127.0.0.1:8080/` or
+ * `live_load` for the live stream. A feed thread plays the synthetic day from
+ * solar_replay, starting at WEB_SERVE_START_HOUR, through a SwitchController
+ * into the live stream in real time. Settings go to the in-memory key-value
+ * store and are lost on exit.
+ */
+
+#include "../src/util/main.h"
+#include "HttpSocketServer.h"
+#include "hal_linux.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define WEB_SERVE_DEFAULT_PORT 8080
+#define WEB_SERVE_RELAY_PIN 4
+#define WEB_SERVE_ADC_RATE_HZ 40
+#define WEB_SERVE_START_HOUR 10
+
+struct ServeOptions {
+  const char *assetDir = nullptr;
+  uint16_t port = WEB_SERVE_DEFAULT_PORT;
+  uint32_t periodMs = 100;
+  uint32_t speed = 1;
+};
+
+static bool parseOptions(int argc, char **argv, ServeOptions &options) {
+  if (argc < 2 || argv[1][0] == '-')
+    return false;
+  options.assetDir = argv[1];
+
+  for (int i = 2; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--port") == 0)
+      options.port = (uint16_t)atoi(value);
+    else if (strcmp(arg, "--period-ms") == 0)
+      options.periodMs = (uint32_t)atoi(value);
+    else if (strcmp(arg, "--speed") == 0)
+      options.speed = (uint32_t)atoi(value);
+    else
+      return false;
+  }
+  return options.periodMs > 0 && options.speed > 0;
+}
+
+/**
+ * @brief Feed thread: one control iteration per period, as the firmware's
+ * sampling and control tasks.
+ */
+
+static void feed(SwitchController &relay, const ServeOptions &options) {
+  const uint32_t simulatedMs = options.periodMs * options.speed;
+  auto next = std::chrono::steady_clock::now();
+
+  while (true) {
+    next += std::chrono::milliseconds(options.periodMs);
+    std::this_thread::sleep_until(next);
+
+    virtualClock.advance((int64_t)simulatedMs * 1000);
+    scriptedAdc.advance(simulatedMs);
+
+    uint32_t now = (uint32_t)millis();
+    solar_num_t solarIndex = solar.read();
+    relay.run(solarIndex, now);
+    liveStream.sample(now, historyValue(solarIndex));
+  }
+}
+
+int main(int argc, char **argv) {
+  ServeOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr,
+            "usage: %s <asset-dir> [--port n] [--period-ms ms] [--speed n]\n",
+            argv[0]);
+    return 2;
+  }
+
+  scriptedAdc.setSampleRate(WEB_SERVE_ADC_RATE_HZ);
+  scriptedAdc.setWaveform([](double seconds) {
+    return syntheticDay(seconds + WEB_SERVE_START_HOUR * 3600.0);
+  });
+
+  init_nvs();
+  static SwitchController relay(WEB_SERVE_RELAY_PIN);
+  relay.begin();
+  static WebApp web;
+  if (!web.begin(options.assetDir, relay))
+    fprintf(stderr, "%s: no manifest, serving the API only\n",
+            options.assetDir);
+
+  HttpSocketServer server(web);
+  if (!server.listen("127.0.0.1", options.port)) {
+    perror("listen");
+    return 1;
+  }
+
+  std::thread(feed, std::ref(relay), options).detach();
+
+  fprintf(stderr, "serving %zu assets on http://127.0.0.1:%u/\n",
+          web.assetsLoaded(), (unsigned)options.port);
+  server.run();
+  return 0;
+}
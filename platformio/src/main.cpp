@@ -1,10 +1,114 @@
+#include "./util/BasicSwitchController.h"
 #include "./util/main.h"
+#include "esp_system.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+// Services start once the first decision is taken, or after this long
+#define BOOT_FIRST_DECISION_TIMEOUT_MS 1000
+
+// Their constructors touch neither storage nor hardware; the stages below
+// bring them up in order.
+static BasicSwitchController<SwitchConfig> relay;
+static SolarHistory history;
+static BootProfiler boot;
+
+/**
+ * @brief Brings up the UART, the relay pin and the ADC, and power
+ * management.
+ */
+
+static bool startDrivers() {
+  uart0.beginAsync(UART_OVERFLOW_DROP);
+  relay.begin();
+
+  if (solarSampler.begin() != ESP_OK)
+    return false;
+
+#if CONFIG_PM_ENABLE
+  // Light-sleeps whenever no task is ready and nothing holds a PM lock. The
+  // continuous ADC holds one until adaptive sampling switches it to on
+  // demand, and Wi-Fi one until the access point stops for lack of
+  // stations.
+  esp_pm_config_esp32_t pm = {
+      .max_freq_mhz = 240,
+      .min_freq_mhz = 80,
+      .light_sleep_enable = true,
+  };
+  esp_pm_configure(&pm);
+#endif
+  return true;
+}
+
+/**
+ * @brief Loads what the first decision depends on: the ADC calibration,
+ * the highest voltage seen and the thresholds.
+ */
+
+static void loadConfig() {
+  // Before the runtime starts reading the index; stores the eFuse table on
+  // first boot.
+  calibrateSolarIndex(
+      solar, dividerRatio(SolarSensorConfig::r1, SolarSensorConfig::r2));
+  solar.load();
+  relay.load();
+}
+
+/**
+ * @brief Starts what the relay does not need: telemetry, the solar log and
+ * the web server.
+ */
+
+static bool startServices() {
+  telemetry.begin();
+
+  // Without the log partition the firmware still runs, just without history
+  // across reboots.
+  if (solarLog.begin())
+    solarLog.logEvent(SOLAR_LOG_BOOT, (uint32_t)esp_reset_reason());
+
+  // The controller runs whether or not the dashboard comes up
+  static WebApp web;
+  return startWebServer(web, relay);
+}
 
 extern "C" void app_main() {
-  if (init_nvs() != ESP_OK) {
+  boot.enter(BOOT_STAGE_DRIVERS);
+  bool started = startDrivers();
+  boot.leave(BOOT_STAGE_DRIVERS, started);
+
+  boot.enter(BOOT_STAGE_STORAGE);
+  bool stored = init_nvs();
+  boot.leave(BOOT_STAGE_STORAGE, stored);
+  if (!started || !stored) {
+    boot.report(Serial);
     return;
   }
 
-  while (true) {
-  }
-}
\ No newline at end of file
+#ifdef SOLAR_BENCH
+  runBenchmarks();
+  return;
+#endif
+
+  boot.enter(BOOT_STAGE_CONFIG);
+  loadConfig();
+  boot.leave(BOOT_STAGE_CONFIG);
+
+  boot.enter(BOOT_STAGE_CONTROLLERS);
+  RuntimeConfig config;
+  config.adaptiveSampling = true;
+  static Runtime runtime(solar, config);
+  relay.setHistory(&history);
+  runtime.addController(relay);
+  bool running =
+      runtime.start() && runtime.waitForFirstDecision(
+                             pdMS_TO_TICKS(BOOT_FIRST_DECISION_TIMEOUT_MS));
+  boot.leave(BOOT_STAGE_CONTROLLERS, running);
+  if (running)
+    boot.decided(runtime.stats().firstDecisionMicros);
+
+  boot.enter(BOOT_STAGE_SERVICES);
+  boot.leave(BOOT_STAGE_SERVICES, startServices());
+  boot.report(Serial);
+}
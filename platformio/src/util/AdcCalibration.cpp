@@ -0,0 +1,135 @@
+/**
+ * @file AdcCalibration.cpp
+ * @brief Building, checking and encoding ADC calibration tables.
+ *
+ * This file has no ESP-IDF dependencies so the host tool links it as-is.
+ */
+
+#include "AdcCalibration.h"
+#include "TelemetryCodec.h"
+
+static void putU16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t getU16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Fills the table with an ideal linear ADC.
+ *
+ * @param fullScaleMillivolts Millivolts at count 4095.
+ */
+
+void AdcCalTable::linear(uint16_t fullScaleMillivolts) {
+  const uint32_t top = ADC_CAL_COUNTS - 1;
+  for (uint32_t raw = 0; raw < ADC_CAL_COUNTS; raw++)
+    mv[raw] = (uint16_t)((raw * fullScaleMillivolts + top / 2) / top);
+  _source = ADC_CAL_LINEAR;
+}
+
+/**
+ * @brief Fills the table by piecewise-linear interpolation between measured
+ * points.
+ *
+ * @param points At least two points, in strictly increasing `raw` order.
+ * @param count Number of points, at most ADC_CAL_MAX_POINTS.
+ * @param source Recorded with the table.
+ * @return `false`, leaving the table unchanged, if the points are unusable.
+ *
+ * Counts outside the measured range follow the first or last segment,
+ * clamped to 0-65535 mV.
+ */
+
+bool AdcCalTable::fromPoints(const AdcCalPoint *points, size_t count,
+                             AdcCalSource source) {
+  if (count < 2 || count > ADC_CAL_MAX_POINTS)
+    return false;
+  for (size_t i = 0; i < count; i++) {
+    if (points[i].raw >= ADC_CAL_COUNTS ||
+        (i > 0 && points[i].raw <= points[i - 1].raw))
+      return false;
+  }
+
+  size_t segment = 0;
+  for (int32_t raw = 0; raw < ADC_CAL_COUNTS; raw++) {
+    while (segment + 2 < count && raw > points[segment + 1].raw)
+      segment++;
+
+    const AdcCalPoint &a = points[segment];
+    const AdcCalPoint &b = points[segment + 1];
+    int32_t span = b.raw - a.raw;
+    int32_t scaled = (raw - a.raw) * (b.millivolts - a.millivolts);
+    // Round half away from zero; `scaled` is negative when extrapolating
+    int32_t offset = (scaled + (scaled < 0 ? -span / 2 : span / 2)) / span;
+    int32_t value = a.millivolts + offset;
+    mv[raw] = (uint16_t)(value < 0 ? 0 : value > 0xFFFF ? 0xFFFF : value);
+  }
+
+  _source = source;
+  return true;
+}
+
+/**
+ * @brief Whether the millivolts never decrease as the count rises, as a
+ * real ADC's do. A table that fails this would make the index jump backwards.
+ */
+
+bool AdcCalTable::monotonic() const {
+  for (size_t raw = 1; raw < ADC_CAL_COUNTS; raw++) {
+    if (mv[raw] < mv[raw - 1])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes the table as an ADC_CAL_BLOB_SIZE blob.
+ */
+
+void AdcCalTable::encode(uint8_t *blob) const {
+  uint8_t *values = blob + ADC_CAL_HEADER_SIZE;
+  for (size_t raw = 0; raw < ADC_CAL_COUNTS; raw++)
+    putU16(values + 2 * raw, mv[raw]);
+
+  putU16(blob, ADC_CAL_MAGIC);
+  blob[2] = ADC_CAL_VERSION;
+  blob[3] = _source;
+  putU16(blob + 4, telemetryCrc16(values, 2 * ADC_CAL_COUNTS));
+  putU16(blob + 6, 0);
+}
+
+/**
+ * @brief Reads a blob written by `encode()`.
+ *
+ * @return `false`, leaving the table unchanged, if the blob has the wrong
+ * size, magic, version or CRC.
+ */
+
+bool AdcCalTable::decode(const uint8_t *blob, size_t length) {
+  const uint8_t *values = blob + ADC_CAL_HEADER_SIZE;
+  if (length != ADC_CAL_BLOB_SIZE || getU16(blob) != ADC_CAL_MAGIC ||
+      blob[2] != ADC_CAL_VERSION || blob[3] > ADC_CAL_MEASURED ||
+      getU16(blob + 4) != telemetryCrc16(values, 2 * ADC_CAL_COUNTS))
+    return false;
+
+  for (size_t raw = 0; raw < ADC_CAL_COUNTS; raw++)
+    mv[raw] = getU16(values + 2 * raw);
+  _source = (AdcCalSource)blob[3];
+  return true;
+}
+
+const char *adcCalSourceName(AdcCalSource source) {
+  switch (source) {
+  case ADC_CAL_LINEAR:
+    return "linear";
+  case ADC_CAL_EFUSE:
+    return "efuse";
+  case ADC_CAL_MEASURED:
+    return "measured";
+  default:
+    return "unknown";
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef ADC_CALIBRATION_H
+#define ADC_CALIBRATION_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ADC calibration table, shared by the firmware and the adc_cal host tool.
+ *
+ * The table maps every 12-bit count to the millivolts at the ADC pin. It is
+ * built from the chip's eFuse characterisation on first boot, or from
+ * points measured against a reference meter by adc_cal, and kept in NVS
+ * under ADC_CAL_KEY as an ADC_CAL_BLOB_SIZE blob:
+ *
+ *   [magic:u16][version:u8][source:u8][crc:u16][0:u16][millivolts:u16 x 4096]
+ *
+ * all little-endian. The CRC-16/CCITT-FALSE covers the millivolts.
+ * SolarIndex turns the table into volts at the divider input once, at boot
+ * (see BasicVoltageTable in main.h), so converting a sample is one lookup.
+ */
+
+#define ADC_CAL_COUNTS 4096
+#define ADC_CAL_MAX_POINTS 64
+#define ADC_CAL_MAGIC 0x4341
+#define ADC_CAL_VERSION 1
+#define ADC_CAL_HEADER_SIZE 8
+#define ADC_CAL_BLOB_SIZE (ADC_CAL_HEADER_SIZE + 2 * ADC_CAL_COUNTS)
+#define ADC_CAL_IDEAL_FULL_SCALE_MV 3300 // what `raw * 3.3 / 4095` assumes
+#define ADC_CAL_KEY "adc_cal"
+
+enum AdcCalSource : uint8_t {
+  ADC_CAL_LINEAR = 0,   // ideal ADC, no calibration data
+  ADC_CAL_EFUSE = 1,    // the chip's factory characterisation
+  ADC_CAL_MEASURED = 2, // points measured on this board
+};
+
+/**
+ * @brief One measured point: a count and the millivolts at the pin.
+ */
+struct AdcCalPoint {
+  uint16_t raw;
+  uint16_t millivolts;
+};
+
+/**
+ * @class AdcCalTable
+ * @brief Millivolts at the ADC pin for every count.
+ */
+
+class AdcCalTable {
+private:
+  uint16_t mv[ADC_CAL_COUNTS];
+  AdcCalSource _source = ADC_CAL_LINEAR;
+
+public:
+  void linear(uint16_t fullScaleMillivolts = ADC_CAL_IDEAL_FULL_SCALE_MV);
+  bool fromPoints(const AdcCalPoint *points, size_t count,
+                  AdcCalSource source = ADC_CAL_MEASURED);
+  void set(uint16_t raw, uint16_t millivolts) { mv[raw] = millivolts; }
+  void setSource(AdcCalSource source) { _source = source; }
+
+  uint16_t millivolts(uint16_t raw) const {
+    return mv[raw & (ADC_CAL_COUNTS - 1)];
+  }
+  AdcCalSource source() const { return _source; }
+  bool monotonic() const;
+
+  void encode(uint8_t *blob) const;
+  bool decode(const uint8_t *blob, size_t length);
+};
+
+const char *adcCalSourceName(AdcCalSource source);
+
+#endif
@@ -0,0 +1,348 @@
+/**
+ * @file AdcSampler.cpp
+ * @brief Implementation of the AdcSampler class.
+ */
+
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "main.h"
+
+#define ADC_DMA_FREQ_HZ SOC_ADC_SAMPLE_FREQ_THRES_LOW
+#define ADC_ATTEN ADC_ATTEN_DB_11 // 0-3.1 V at the pin, least linear
+#define ADC_FRAME_SIZE 256
+#define ADC_POOL_SIZE 1024
+#define ADC_DRAIN_TASK_STACK 3072
+#define ADC_DRAIN_TASK_PRIORITY 5
+
+/**
+ * @brief Constructs an AdcSampler object.
+ *
+ * @param channel The ADC1 channel connected to the solar index sensor.
+ * @param sampleRateHz The rate at which samples are pushed to the ring.
+ *
+ * The hardware converts at ADC_DMA_FREQ_HZ, the lowest rate the continuous
+ * driver accepts; the drain task keeps every Nth conversion so the ring is fed
+ * at `sampleRateHz` regardless of how fast the control loop runs.
+ */
+
+AdcSampler::AdcSampler(adc_channel_t channel, uint32_t sampleRateHz)
+    : _channel(channel), _sampleRateHz(sampleRateHz) {
+  if (_sampleRateHz == 0 || _sampleRateHz > ADC_DMA_FREQ_HZ)
+    _sampleRateHz = ADC_DMA_FREQ_HZ;
+  decimation = ADC_DMA_FREQ_HZ / _sampleRateHz;
+}
+
+/**
+ * @brief Destructor stopping the conversion and releasing the driver.
+ */
+
+AdcSampler::~AdcSampler() {
+  end();
+  releaseOneshot();
+}
+
+/**
+ * @brief Starts continuous conversion and the drain task.
+ *
+ * @return ESP_OK on success, otherwise the driver error.
+ *
+ * Releases the oneshot unit first, ending conversion on demand.
+ */
+
+esp_err_t AdcSampler::begin() {
+  if (handle != nullptr)
+    return ESP_OK;
+
+  releaseOneshot();
+  convertOnDemand = false;
+
+  adc_continuous_handle_cfg_t handleConfig = {
+      .max_store_buf_size = ADC_POOL_SIZE,
+      .conv_frame_size = ADC_FRAME_SIZE,
+  };
+  esp_err_t err = adc_continuous_new_handle(&handleConfig, &handle);
+  if (err != ESP_OK) {
+    handle = nullptr;
+    return err;
+  }
+
+  adc_digi_pattern_config_t pattern = {
+      .atten = ADC_ATTEN,
+      .channel = (uint8_t)_channel,
+      .unit = ADC_UNIT_1,
+      .bit_width = ADC_BITWIDTH_12,
+  };
+  adc_continuous_config_t config = {
+      .pattern_num = 1,
+      .adc_pattern = &pattern,
+      .sample_freq_hz = ADC_DMA_FREQ_HZ,
+      .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+      .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  };
+
+  adc_continuous_evt_cbs_t callbacks = {
+      .on_conv_done = onConversionDone,
+      .on_pool_ovf = nullptr,
+  };
+
+  if ((err = adc_continuous_config(handle, &config)) != ESP_OK ||
+      (err = adc_continuous_register_event_callbacks(handle, &callbacks,
+                                                     this)) != ESP_OK) {
+    adc_continuous_deinit(handle);
+    handle = nullptr;
+    return err;
+  }
+
+  if (xTaskCreate(drainTaskEntry, "adc_drain", ADC_DRAIN_TASK_STACK, this,
+                  ADC_DRAIN_TASK_PRIORITY, &drainTask) != pdPASS) {
+    adc_continuous_deinit(handle);
+    handle = nullptr;
+    return ESP_ERR_NO_MEM;
+  }
+
+  err = adc_continuous_start(handle);
+  if (err != ESP_OK)
+    end();
+
+  return err;
+}
+
+/**
+ * @brief Stops conversion, deletes the drain task and the driver handle.
+ */
+
+void AdcSampler::end() {
+  if (handle == nullptr)
+    return;
+
+  adc_continuous_stop(handle);
+  if (drainTask != nullptr) {
+    vTaskDelete(drainTask);
+    drainTask = nullptr;
+  }
+  adc_continuous_deinit(handle);
+  handle = nullptr;
+}
+
+/**
+ * @brief Gives access to the ring the drain task fills.
+ *
+ * @return The sample ring consumed by SolarIndex.
+ */
+
+SolarSampleRing &AdcSampler::samples() { return ring; }
+
+/**
+ * @brief Fills a calibration table from the eFuse characterisation.
+ *
+ * @param table [out] Millivolts at the pin for every count.
+ * @return `false` if the chip has no usable calibration data.
+ *
+ * Runs the driver's line-fitting scheme once per count, which for ADC1 at
+ * 11 dB includes its correction of the curve near full scale. About 4096
+ * conversions in software, so a few milliseconds; done once, at boot.
+ */
+
+bool AdcSampler::characterize(AdcCalTable &table) {
+  adc_cali_line_fitting_config_t config = {
+      .unit_id = ADC_UNIT_1,
+      .atten = ADC_ATTEN,
+      .bitwidth = ADC_BITWIDTH_12,
+  };
+  adc_cali_handle_t cali;
+  if (adc_cali_create_scheme_line_fitting(&config, &cali) != ESP_OK)
+    return false;
+
+  bool ok = true;
+  for (int raw = 0; raw < ADC_CAL_COUNTS && ok; raw++) {
+    int millivolts = 0;
+    ok = adc_cali_raw_to_voltage(cali, raw, &millivolts) == ESP_OK;
+    table.set((uint16_t)raw, (uint16_t)millivolts);
+  }
+  adc_cali_delete_scheme_line_fitting(cali);
+
+  table.setSource(ADC_CAL_EFUSE);
+  return ok;
+}
+
+/**
+ * @brief Claims the ADC1 oneshot unit if not held yet, and configures a
+ * channel on it if not configured yet.
+ *
+ * @return `false` if the driver refused either.
+ */
+
+bool AdcSampler::claimOneshot(adc_channel_t channel) {
+  if (oneshot == nullptr) {
+    adc_oneshot_unit_init_cfg_t unitConfig = {
+        .unit_id = ADC_UNIT_1,
+        .clk_src = ADC_RTC_CLK_SRC_DEFAULT,
+        .ulp_mode = ADC_ULP_MODE_DISABLE,
+    };
+    if (adc_oneshot_new_unit(&unitConfig, &oneshot) != ESP_OK) {
+      oneshot = nullptr;
+      return false;
+    }
+    oneshotChannels = 0;
+  }
+
+  if (oneshotChannels & (1u << channel))
+    return true;
+
+  adc_oneshot_chan_cfg_t channelConfig = {
+      .atten = ADC_ATTEN,
+      .bitwidth = ADC_BITWIDTH_12,
+  };
+  if (adc_oneshot_config_channel(oneshot, channel, &channelConfig) != ESP_OK)
+    return false;
+  oneshotChannels |= 1u << channel;
+  return true;
+}
+
+/**
+ * @brief Releases the ADC1 oneshot unit, if held.
+ */
+
+void AdcSampler::releaseOneshot() {
+  if (oneshot == nullptr)
+    return;
+
+  adc_oneshot_del_unit(oneshot);
+  oneshot = nullptr;
+  oneshotChannels = 0;
+}
+
+/**
+ * @brief Switches between continuous conversion and conversion on demand.
+ *
+ * @param onDemand `true` to stop the DMA conversion and read the channel
+ * through the oneshot driver in `convert()`.
+ * @return Whether the sampler is now in the requested mode.
+ *
+ * The continuous driver holds a power management lock while it runs, so the
+ * chip only light-sleeps between readings taken on demand. The two drivers
+ * cannot share ADC1, so each switch releases one and claims the other; if
+ * the oneshot driver cannot be claimed, conversion stays continuous.
+ */
+
+bool AdcSampler::setOnDemand(bool onDemand) {
+  if (onDemand == convertOnDemand)
+    return true;
+
+  if (!onDemand)
+    return begin() == ESP_OK;
+
+  end();
+  if (!claimOneshot(_channel)) {
+    begin();
+    return false;
+  }
+  convertOnDemand = true;
+  return true;
+}
+
+/**
+ * @brief Converts `count` samples back to back and pushes them to the ring.
+ *
+ * @return The number of samples pushed; 0 unless converting on demand.
+ *
+ * No decimation: the burst stands for the moment of the reading.
+ */
+
+size_t AdcSampler::convert(size_t count) {
+  if (!convertOnDemand)
+    return 0;
+
+  uint16_t burst[SOLAR_READ_BLOCK];
+  size_t pushed = 0;
+  while (pushed < count) {
+    size_t length = 0;
+    while (length < SOLAR_READ_BLOCK && pushed + length < count) {
+      int raw;
+      if (adc_oneshot_read(oneshot, _channel, &raw) != ESP_OK)
+        break;
+      burst[length++] = (uint16_t)raw;
+    }
+    if (length == 0 || ring.pushBatch(burst, length) != length)
+      break;
+    pushed += length;
+  }
+  return pushed;
+}
+
+/**
+ * @brief Reads one ADC1 channel through the oneshot unit, for
+ * `analogRead()`.
+ *
+ * @param channel The ADC1 channel.
+ * @return The 12-bit reading, or -1 while conversion is continuous, since
+ * the DMA driver then holds ADC1, or if the driver refused.
+ *
+ * Shares the unit with conversion on demand. While the sampler is stopped,
+ * the first read claims the unit; `begin()` releases it.
+ */
+
+int AdcSampler::read(adc_channel_t channel) {
+  int raw;
+  if (handle != nullptr || !claimOneshot(channel) ||
+      adc_oneshot_read(oneshot, channel, &raw) != ESP_OK)
+    return -1;
+  return raw;
+}
+
+/**
+ * @brief Conversion-done ISR callback.
+ *
+ * Only wakes the drain task; the frame itself is read outside the ISR.
+ */
+
+bool IRAM_ATTR AdcSampler::onConversionDone(
+    adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata,
+    void *user_data) {
+  BaseType_t mustYield = pdFALSE;
+  AdcSampler *sampler = static_cast<AdcSampler *>(user_data);
+  vTaskNotifyGiveFromISR(sampler->drainTask, &mustYield);
+  return (mustYield == pdTRUE);
+}
+
+/**
+ * @brief FreeRTOS entry point for the drain task.
+ */
+
+void AdcSampler::drainTaskEntry(void *arg) {
+  AdcSampler *sampler = static_cast<AdcSampler *>(arg);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    sampler->drain();
+  }
+}
+
+/**
+ * @brief Copies every completed DMA frame into the ring.
+ *
+ * Conversions for other channels are ignored, and only every `decimation`th
+ * conversion of our channel is kept. Each frame's samples are published to
+ * the ring in one batch.
+ */
+
+void AdcSampler::drain() {
+  uint8_t frame[ADC_FRAME_SIZE];
+  uint16_t kept[ADC_FRAME_SIZE / SOC_ADC_DIGI_RESULT_BYTES];
+  uint32_t length = 0;
+
+  while (adc_continuous_read(handle, frame, sizeof(frame), &length, 0) ==
+         ESP_OK) {
+    size_t count = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length;
+         i += SOC_ADC_DIGI_RESULT_BYTES) {
+      adc_digi_output_data_t *result = (adc_digi_output_data_t *)&frame[i];
+      if (result->type1.channel != _channel)
+        continue;
+      if (++skipped < decimation)
+        continue;
+      skipped = 0;
+      kept[count++] = result->type1.data;
+    }
+    ring.pushBatch(kept, count);
+  }
+}
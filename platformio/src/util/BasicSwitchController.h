@@ -0,0 +1,336 @@
+#ifndef BASIC_SWITCH_CONTROLLER_H
+#define BASIC_SWITCH_CONTROLLER_H
+#include "main.h"
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * @class BasicSwitchController
+ * @brief A SwitchController whose board description is fixed at compile
+ * time.
+ *
+ * Relay pin, threshold and interval bounds and the NVS slot come from
+ * `Config` as constants and are checked with static_assert, so a flash pin,
+ * an input-only pin or a slot without a key fails the build. The solar
+ * sensor is shared by every controller and described by SolarSensorConfig.
+ * The slot belongs to the type, so which thresholds a controller loads no
+ * longer depends on how many controllers were constructed before it. In
+ * `run()` and the setters the pin, key and bounds are immediates, and the
+ * relay's level is kept in a RelayOutput rather than read from the pin.
+ *
+ * @tparam Config A SwitchConfig or a struct derived from it.
+ */
+
+template <typename Config>
+class BasicSwitchController : public SwitchControl {
+  static_assert(Config::relayPin == -1 || switchOutputPin(Config::relayPin),
+                "relayPin must be an output GPIO (0-33, not 6-11) or -1");
+  static_assert(0.0 <= Config::thresholdFloor &&
+                    Config::thresholdFloor <= Config::thresholdCeiling &&
+                    Config::thresholdCeiling <= SOLAR_INDEX_MAX_VALUE,
+                "thresholds must satisfy 0 <= floor <= ceiling <= "
+                "SOLAR_INDEX_MAX_VALUE");
+  static_assert(Config::slot <= 9, "slot must be 0-9");
+  static_assert(1 <= Config::minIntervalMinutes &&
+                    Config::minIntervalMinutes <= Config::intervalMinutes &&
+                    Config::intervalMinutes <= Config::maxIntervalMinutes,
+                "interval bounds must satisfy 1 <= min <= default <= max");
+  static_assert((uint64_t)Config::maxIntervalMinutes * MINUTES_TO_MILLIS <=
+                    UINT32_MAX,
+                "maxIntervalMinutes overflows the millisecond clock");
+  static_assert(Config::hysteresis >= 0.0 &&
+                    Config::hysteresis <= SOLAR_INDEX_MAX_VALUE,
+                "hysteresis must be 0-SOLAR_INDEX_MAX_VALUE");
+
+public:
+  static constexpr hal_pin_t relayPin = Config::relayPin;
+  // The key switchSlotKey() builds for the same slot
+  static constexpr char slotKey[] = {'s', 'w', char('0' + Config::slot),
+                                     '\0'};
+
+private:
+  SolarThresholds threshold{solar_num_t(Config::thresholdCeiling),
+                            solar_num_t(Config::thresholdFloor)};
+  unsigned long previousMillis = 0;
+  unsigned long intervalMillis =
+      (unsigned long)Config::intervalMinutes * MINUTES_TO_MILLIS;
+  SolarIndexMonitor indexMonitor;
+  SwitchMode _mode = Config::mode;
+  SwitchPredictor predictor;
+  CrossingDebouncer debouncer;
+  RelayOutput relay{relayPin};
+  bool loaded = false;
+  std::mutex settingsLock;
+
+  void loadThresholds();
+  void switchTo(int level, unsigned long currentMillis);
+  static void crossed(IndexZone zone, unsigned long currentMillis,
+                      void *context) {
+    static_cast<BasicSwitchController *>(context)->debouncer.crossed(
+        zone, currentMillis);
+  }
+
+public:
+  BasicSwitchController();
+  void load();
+  bool begin() {
+    std::lock_guard<std::mutex> lock(settingsLock);
+    return relay.begin();
+  }
+  bool setInterval(unsigned short durationInMinutes) override;
+  unsigned short interval() override;
+  unsigned short minInterval() override { return Config::minIntervalMinutes; }
+  unsigned short maxInterval() override { return Config::maxIntervalMinutes; }
+  SolarThresholds thresholds() override;
+  bool acceptsThresholds(double max, double min) override;
+  bool setSolarThresholds(double max, double min) override;
+  void run(solar_num_t solarIndex, unsigned long currentMillis) override;
+  void setMode(SwitchMode mode);
+  void setPredictiveConfig(const PredictiveConfig &config);
+  void setEventConfig(const EventConfig &config);
+  void setHistory(SolarHistory *history) { indexMonitor.setHistory(history); }
+  uint32_t relayFailures() {
+    std::lock_guard<std::mutex> lock(settingsLock);
+    return relay.failures();
+  }
+  void debug() { indexMonitor.debugRecordedData(); }
+};
+
+/**
+ * @brief Constructs the controller with the configured bounds as thresholds.
+ *
+ * Touches neither storage nor the relay pin, so the controller may be a
+ * global; see `load()` and `begin()`.
+ */
+
+template <typename Config>
+BasicSwitchController<Config>::BasicSwitchController() {
+  indexMonitor.setThresholds(threshold);
+  indexMonitor.setHysteresis(solar_num_t(Config::hysteresis));
+  indexMonitor.setCrossingHandler(crossed, this);
+  debouncer.setDwell(Config::dwellMs);
+  relay.setReadback(Config::relayReadback);
+}
+
+/**
+ * @brief Loads the thresholds of the slot.
+ *
+ * Thresholds stored in the slot are used if they lie within the configured
+ * bounds; otherwise the bounds themselves are stored there. Call after
+ * `init_nvs()`; a controller that was not loaded loads before its first
+ * decision or threshold access.
+ */
+
+template <typename Config> void BasicSwitchController<Config>::load() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  loadThresholds();
+}
+
+template <typename Config>
+void BasicSwitchController<Config>::loadThresholds() {
+  loaded = true;
+  SolarThresholds stored;
+  if (retrieveSolarThresholds(slotKey, stored) && stored.max >= stored.min &&
+      stored.min >= solar_num_t(Config::thresholdFloor) &&
+      stored.max <= solar_num_t(Config::thresholdCeiling))
+    threshold = stored;
+  else
+    storeSolarThresholds(slotKey, threshold);
+  indexMonitor.setThresholds(threshold);
+}
+
+/**
+ * @brief Set the interval between switch decisions.
+ *
+ * @param durationInMinutes The interval duration in minutes, within
+ * `Config::minIntervalMinutes` and `Config::maxIntervalMinutes`.
+ * @return `true` if the interval is set successfully, `false` otherwise.
+ */
+
+template <typename Config>
+bool BasicSwitchController<Config>::setInterval(
+    unsigned short durationInMinutes) {
+  if (durationInMinutes < Config::minIntervalMinutes ||
+      durationInMinutes > Config::maxIntervalMinutes)
+    return false;
+
+  std::lock_guard<std::mutex> lock(settingsLock);
+  intervalMillis = (unsigned long)durationInMinutes * MINUTES_TO_MILLIS;
+  return true;
+}
+
+/**
+ * @brief Get the interval between switch decisions, in minutes.
+ */
+
+template <typename Config>
+unsigned short BasicSwitchController<Config>::interval() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return (unsigned short)(intervalMillis / MINUTES_TO_MILLIS);
+}
+
+/**
+ * @brief Get the current solar index thresholds.
+ */
+
+template <typename Config>
+SolarThresholds BasicSwitchController<Config>::thresholds() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  if (!loaded)
+    loadThresholds();
+  return threshold;
+}
+
+/**
+ * @brief Whether a pair of thresholds is within the configured bounds.
+ *
+ * @return `true` if both are finite, `min <= max` and both lie within
+ * `Config::thresholdFloor` and `Config::thresholdCeiling`.
+ */
+
+template <typename Config>
+bool BasicSwitchController<Config>::acceptsThresholds(double max,
+                                                      double min) {
+  return isfinite(max) && isfinite(min) && min >= Config::thresholdFloor &&
+         min <= max && max <= Config::thresholdCeiling;
+}
+
+/**
+ * @brief Set the solar index thresholds.
+ *
+ * @param max The maximum solar index value.
+ * @param min The minimum solar index value.
+ * @return `true` if `acceptsThresholds(max, min)`.
+ */
+
+template <typename Config>
+bool BasicSwitchController<Config>::setSolarThresholds(double max,
+                                                       double min) {
+  if (!acceptsThresholds(max, min))
+    return false;
+
+  SolarThresholds newValue{solar_num_t(max), solar_num_t(min)};
+
+  std::lock_guard<std::mutex> lock(settingsLock);
+  if (!loaded)
+    loadThresholds();
+  if (threshold != newValue) {
+    threshold = newValue;
+    indexMonitor.setThresholds(threshold);
+    storeSolarThresholds(slotKey, threshold);
+    flushStorage();
+  }
+
+  return true;
+}
+
+/**
+ * @brief Run the switch controller with a reading taken elsewhere.
+ *
+ * @param solarIndex The solar index value.
+ * @param currentMillis The time the value was read.
+ *
+ * Once per interval the relay is switched on if the index spent more than
+ * the interval within the thresholds, and off otherwise. In predictive mode
+ * a confident forecast switches ahead of the interval, and overrides the
+ * interval's verdict at its end; in event mode the relay follows threshold
+ * crossings after `Config::dwellMs` (see SwitchMode).
+ */
+
+template <typename Config>
+void BasicSwitchController<Config>::run(solar_num_t solarIndex,
+                                        unsigned long currentMillis) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  if (!loaded)
+    loadThresholds();
+  indexMonitor.updateSolarIndex(solarIndex, currentMillis);
+
+  if (_mode == SWITCH_MODE_EVENT) {
+    int level;
+    bool within = indexMonitor.withinThresholds();
+    if (debouncer.due(within, currentMillis, level))
+      switchTo(level, currentMillis);
+    return;
+  }
+
+  // A forecast switch starts a new interval, so the check below then waits,
+  // as in SwitchController
+  TrendVerdict verdict = TREND_UNSURE;
+  if (_mode == SWITCH_MODE_PREDICTIVE) {
+    bool refreshed = predictor.update(solarIndex, currentMillis, threshold);
+    verdict = predictor.verdict();
+    if (refreshed && verdict != TREND_UNSURE)
+      switchTo(verdict == TREND_INSIDE, currentMillis);
+  }
+
+  if (currentMillis - previousMillis < intervalMillis)
+    return;
+
+  unsigned long rangeDuration;
+  indexMonitor.getDurationWithinThreshold(rangeDuration);
+  switchTo(verdict != TREND_UNSURE ? verdict == TREND_INSIDE
+                                   : rangeDuration > intervalMillis,
+           currentMillis);
+}
+
+/**
+ * @brief Drives the relay to `level` and starts a new interval.
+ *
+ * The relay is only written, and the transition only reported, when its
+ * level changes; only then does a forecast or a crossing restart the
+ * interval.
+ */
+
+template <typename Config>
+void BasicSwitchController<Config>::switchTo(int level,
+                                             unsigned long currentMillis) {
+  bool changed = relay.set(level);
+  if (changed)
+    reportRelay(relayPin, level, currentMillis);
+
+  if (changed || currentMillis - previousMillis >= intervalMillis) {
+    previousMillis = currentMillis;
+    indexMonitor.resetTimer();
+  }
+}
+
+/**
+ * @brief Choose how the controller decides, overriding `Config::mode`.
+ *
+ * @param mode SWITCH_MODE_INTERVAL, SWITCH_MODE_PREDICTIVE or
+ * SWITCH_MODE_EVENT.
+ */
+
+template <typename Config>
+void BasicSwitchController<Config>::setMode(SwitchMode mode) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  _mode = mode;
+  predictor.reset();
+  debouncer.cancel();
+  indexMonitor.resetZone();
+}
+
+/**
+ * @brief Sets the forecast horizon and confidence of predictive mode.
+ */
+
+template <typename Config>
+void BasicSwitchController<Config>::setPredictiveConfig(
+    const PredictiveConfig &config) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  predictor.setConfig(config);
+}
+
+/**
+ * @brief Sets the dwell time and hysteresis band of event mode, overriding
+ * `Config::dwellMs` and `Config::hysteresis`.
+ */
+
+template <typename Config>
+void BasicSwitchController<Config>::setEventConfig(const EventConfig &config) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  debouncer.setDwell(config.dwellMs);
+  indexMonitor.setHysteresis(solar_num_t(config.hysteresis));
+}
+
+#endif
@@ -0,0 +1,447 @@
+/**
+ * @file Benchmark.cpp
+ * @brief Benchmark statistics, JSON report and the shared hot-path cases.
+ */
+
+#include "Benchmark.h"
+#include "BasicSwitchController.h"
+#include "main.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_JSON_LINE_SIZE 192
+#define BENCH_THRESHOLD_MAX 700.0
+#define BENCH_THRESHOLD_MIN 300.0
+#define BENCH_PERIOD_MS 100 // RuntimeConfig::samplePeriodMs
+#define BENCH_DOUBLE_STRING_SIZE 32 // as storeDouble() before store<T>
+// "%lf" of the stored values below, 100 to 969: ten characters and the NUL
+#define BENCH_DOUBLE_STRING_BYTES 11
+
+// No pin is driven by default; set an ADC-capable GPIO to include the relay
+// pin read and write in SwitchController::run.
+#ifndef BENCH_RELAY_PIN
+#define BENCH_RELAY_PIN -1
+#endif
+
+// The same controller with its board fixed at compile time. Slot 9 keeps the
+// bench away from the firmware's thresholds.
+struct BenchSwitchConfig : SwitchConfig {
+  static constexpr hal_pin_t relayPin = BENCH_RELAY_PIN;
+  static constexpr unsigned short slot = 9;
+};
+
+typedef BasicSwitchController<BenchSwitchConfig> BenchSwitchController;
+
+void BenchStats::reset() {
+  kept = 0;
+  calls = 0;
+  total = 0;
+  peak = 0;
+}
+
+/**
+ * @brief Records the duration of one call.
+ */
+
+void BenchStats::add(uint32_t ticks) {
+  calls++;
+  total += ticks;
+  if (ticks > peak)
+    peak = ticks;
+
+  if (kept < BENCH_RESERVOIR_SIZE) {
+    reservoir[kept++] = ticks;
+    return;
+  }
+
+  // Algorithm R: keep each call with probability kept / calls
+  rng = rng * 1664525u + 1013904223u;
+  uint32_t slot = (uint32_t)(((uint64_t)rng * calls) >> 32);
+  if (slot < BENCH_RESERVOIR_SIZE)
+    reservoir[slot] = ticks;
+}
+
+/**
+ * @brief Computes the summary. Reorders the reservoir.
+ */
+
+BenchSummary BenchStats::summarize(const char *name, uint32_t bytes) {
+  BenchSummary summary = {name, calls, 0.0, 0, peak, bytes};
+  if (calls == 0)
+    return summary;
+
+  summary.mean = (double)total / calls;
+  size_t rank = (kept * 99 + 99) / 100 - 1;
+  std::nth_element(reservoir, reservoir + rank, reservoir + kept);
+  summary.p99 = reservoir[rank];
+  return summary;
+}
+
+/**
+ * @brief Writes one JSON document with every summary.
+ *
+ * @param out Where to write.
+ * @param platform Free-form platform name.
+ * @param nsPerTick Nanoseconds per tick of the timer used. Tick values are
+ * included as `*_ticks` alongside the nanosecond values.
+ */
+
+void benchWriteJson(HalSerial &out, const char *platform, double nsPerTick,
+                    const BenchSummary *results, size_t count) {
+  char line[BENCH_JSON_LINE_SIZE];
+
+  snprintf(line, sizeof(line),
+           "{\"platform\":\"%s\",\"ns_per_tick\":%.4f,\"benchmarks\":[",
+           platform, nsPerTick);
+  out.send(line);
+
+  for (size_t i = 0; i < count; i++) {
+    const BenchSummary &r = results[i];
+    snprintf(line, sizeof(line),
+             "%s\n{\"name\":\"%s\",\"calls\":%lu,\"mean_ns\":%.1f,"
+             "\"p99_ns\":%.1f,\"max_ns\":%.1f,",
+             i ? "," : "", r.name, (unsigned long)r.calls, r.mean * nsPerTick,
+             r.p99 * nsPerTick, r.max * nsPerTick);
+    out.send(line);
+    snprintf(line, sizeof(line),
+             "\"mean_ticks\":%.1f,\"p99_ticks\":%lu,\"max_ticks\":%lu",
+             r.mean, (unsigned long)r.p99, (unsigned long)r.max);
+    out.send(line);
+    if (r.bytes != 0) {
+      snprintf(line, sizeof(line), ",\"bytes\":%lu", (unsigned long)r.bytes);
+      out.send(line);
+    }
+    out.send("}");
+  }
+
+  out.send("\n]}");
+  out.sendln();
+}
+
+static SolarSampleRing *benchRing;
+static SolarIndex *benchIndex;
+static SolarIndexMonitor *benchMonitor;
+static SolarSampleRing *benchDoubleRing;
+static SolarSampleRing *benchFixedRing;
+static BasicSolarIndex<double> *benchDoubleIndex;
+static BasicSolarIndex<Q16_16> *benchFixedIndex;
+static BasicSolarIndexMonitor<double> *benchDoubleMonitor;
+static BasicSolarIndexMonitor<Q16_16> *benchFixedMonitor;
+static double benchDoubleValue;
+static Q16_16 benchFixedValue;
+static char benchDoubleString[BENCH_DOUBLE_STRING_SIZE];
+static uint8_t benchStoredBlob[storedSize<double>()];
+static double benchDecoded;
+static SwitchController *benchController;
+static BenchSwitchController *benchStaticController;
+static SwitchPredictor *benchPredictor;
+static SolarThresholds benchThresholds(solar_num_t(BENCH_THRESHOLD_MAX),
+                                       solar_num_t(BENCH_THRESHOLD_MIN));
+static HalSerial *benchSink;
+static SolarReadingQueue *benchQueue;
+static VoltageTable *benchVoltageTable;
+static solar_num_t benchVoltsPerCount;
+static solar_num_t benchVolts;
+#ifdef ESP_PLATFORM
+static QueueHandle_t benchXQueue;
+#endif
+
+/**
+ * @brief Raw reading for an iteration: a triangle sweeping the full ADC range
+ * every 512 iterations, so every threshold is crossed.
+ */
+
+static uint16_t benchRaw(uint32_t iteration) {
+  uint32_t phase = iteration & 511;
+  return (uint16_t)((phase < 256 ? phase : 511 - phase) * 16);
+}
+
+static solar_num_t benchIndexValue(uint32_t iteration) {
+  return solar_num_t(benchRaw(iteration) * (SOLAR_INDEX_MAX_VALUE / 4095.0));
+}
+
+// One control period's worth of ADC samples at the default rates
+static void prepareRead(uint32_t iteration) {
+  for (int i = 0; i < SOLAR_OVERSAMPLE; i++)
+    benchRing->push(benchRaw(iteration));
+}
+
+static void callRead(uint32_t) { benchIndex->read(); }
+
+static void callUpdate(uint32_t iteration) {
+  benchMonitor->updateSolarIndex(benchIndexValue(iteration),
+                                 iteration * BENCH_PERIOD_MS);
+}
+
+// Both representations are built in every configuration, so one run compares
+// them; the input is converted untimed.
+static void prepareReadDouble(uint32_t iteration) {
+  for (int i = 0; i < SOLAR_OVERSAMPLE; i++)
+    benchDoubleRing->push(benchRaw(iteration));
+}
+
+static void prepareReadFixed(uint32_t iteration) {
+  for (int i = 0; i < SOLAR_OVERSAMPLE; i++)
+    benchFixedRing->push(benchRaw(iteration));
+}
+
+static void callReadDouble(uint32_t) { benchDoubleIndex->read(); }
+
+static void callReadFixed(uint32_t) { benchFixedIndex->read(); }
+
+static void prepareUpdateDouble(uint32_t iteration) {
+  benchDoubleValue = toDouble(benchIndexValue(iteration));
+}
+
+static void prepareUpdateFixed(uint32_t iteration) {
+  benchFixedValue = Q16_16(toDouble(benchIndexValue(iteration)));
+}
+
+static void callUpdateDouble(uint32_t iteration) {
+  benchDoubleMonitor->updateSolarIndex(benchDoubleValue,
+                                       iteration * BENCH_PERIOD_MS);
+}
+
+static void callUpdateFixed(uint32_t iteration) {
+  benchFixedMonitor->updateSolarIndex(benchFixedValue,
+                                      iteration * BENCH_PERIOD_MS);
+}
+
+// With a one-minute interval the decision path runs once every 600 calls
+static void callRun(uint32_t iteration) {
+  benchController->run(benchIndexValue(iteration),
+                       iteration * BENCH_PERIOD_MS);
+}
+
+static void callStaticRun(uint32_t iteration) {
+  benchStaticController->run(benchIndexValue(iteration),
+                             iteration * BENCH_PERIOD_MS);
+}
+
+// Closes a bucket, and so refits the trend, every tenth call
+static void callPredict(uint32_t iteration) {
+  benchPredictor->update(benchIndexValue(iteration),
+                         iteration * BENCH_PERIOD_MS, benchThresholds);
+}
+
+// Lands in the write-back cache; the NVS commit is deferred to storageTick()
+static void callStoreDouble(uint32_t iteration) {
+  storeDouble("bench_dbl", iteration * 0.5);
+}
+
+static double benchStoredValue(uint32_t iteration) {
+  return 100.0 + (iteration & 511) * 1.7;
+}
+
+// A double as storeDouble() encoded it before store<T>, and as it does now
+static void callEncodeString(uint32_t iteration) {
+  snprintf(benchDoubleString, sizeof(benchDoubleString), "%lf",
+           benchStoredValue(iteration));
+}
+
+static void prepareDecodeString(uint32_t iteration) {
+  callEncodeString(iteration);
+}
+
+static void callDecodeString(uint32_t) {
+  benchDecoded = atof(benchDoubleString);
+}
+
+static void callEncodeStored(uint32_t iteration) {
+  encodeStored(benchStoredValue(iteration), benchStoredBlob);
+}
+
+static void prepareDecodeStored(uint32_t iteration) {
+  callEncodeStored(iteration);
+}
+
+static void callDecodeStored(uint32_t) {
+  decodeStored(benchStoredBlob, sizeof(benchStoredBlob), benchDecoded);
+}
+
+// Drained untimed so every call sees an empty TX ring, not the drop path
+static void prepareSend(uint32_t) { benchSink->flush(); }
+
+// Raw count to volts at the divider input, as SolarIndex did before the
+// calibration table: one multiply in the numeric representation
+static void callScale(uint32_t iteration) {
+  benchVolts = benchVoltsPerCount * benchRaw(iteration);
+}
+
+static void callLookup(uint32_t iteration) {
+  benchVolts = (*benchVoltageTable)[benchRaw(iteration)];
+}
+
+// Filter stages run on every raw sample, SolarFilter once per filtered sample
+static Oversample<SOLAR_OVERSAMPLE> benchOversample;
+static MedianFilter<SOLAR_MEDIAN_WINDOW> benchMedian;
+static EmaFilter<SOLAR_EMA_SHIFT> benchEma;
+static SolarFilter benchFilter;
+static uint16_t benchFiltered;
+
+// The sweep with a full-scale spike every 64 samples for the median to drop
+static uint16_t benchSpikyRaw(uint32_t iteration) {
+  return (iteration & 63) == 63 ? 4095 : benchRaw(iteration);
+}
+
+static void callOversample(uint32_t iteration) {
+  benchOversample.process(benchSpikyRaw(iteration), benchFiltered);
+}
+
+static void callMedian(uint32_t iteration) {
+  benchMedian.process(benchSpikyRaw(iteration), benchFiltered);
+}
+
+static void callEma(uint32_t iteration) {
+  benchEma.process(benchSpikyRaw(iteration), benchFiltered);
+}
+
+// SOLAR_OVERSAMPLE raw samples make one filtered sample
+static void callFilter(uint32_t iteration) {
+  for (uint32_t i = 0; i < SOLAR_OVERSAMPLE; i++)
+    benchFilter.process(benchSpikyRaw(iteration * SOLAR_OVERSAMPLE + i),
+                        benchFiltered);
+}
+
+static void callSendDouble(uint32_t iteration) {
+  benchSink->send(benchRaw(iteration) * (3.3 / 4095.0));
+}
+
+static SolarReading benchReading(uint32_t iteration) {
+  return {benchIndexValue(iteration), iteration * BENCH_PERIOD_MS,
+          (int64_t)iteration * BENCH_PERIOD_MS * 1000};
+}
+
+// One hand-off between the sampling and the control context
+static void callQueue(uint32_t iteration) {
+  SolarReading reading = benchReading(iteration);
+  benchQueue->push(reading);
+  benchQueue->pop(reading);
+}
+
+static void callQueueBatch(uint32_t iteration) {
+  SolarReading block[RUNTIME_SAMPLE_QUEUE_LENGTH];
+  for (size_t i = 0; i < RUNTIME_SAMPLE_QUEUE_LENGTH; i++)
+    block[i] = benchReading(iteration + i);
+  benchQueue->pushBatch(block, RUNTIME_SAMPLE_QUEUE_LENGTH);
+  benchQueue->popBatch(block, RUNTIME_SAMPLE_QUEUE_LENGTH);
+}
+
+#ifdef ESP_PLATFORM
+// The same hand-off through the FreeRTOS queue Runtime used before
+static void callXQueue(uint32_t iteration) {
+  SolarReading reading = benchReading(iteration);
+  xQueueSend(benchXQueue, &reading, 0);
+  xQueueReceive(benchXQueue, &reading, 0);
+}
+#endif
+
+const BenchCase benchCases[] = {
+    {"SolarIndex::read", prepareRead, callRead},
+    {"SolarIndexMonitor::updateSolarIndex", nullptr, callUpdate},
+    {"SolarIndex<double>::read", prepareReadDouble, callReadDouble},
+    {"SolarIndex<Q16_16>::read", prepareReadFixed, callReadFixed},
+    {"SolarIndexMonitor<double>::updateSolarIndex", prepareUpdateDouble,
+     callUpdateDouble},
+    {"SolarIndexMonitor<Q16_16>::updateSolarIndex", prepareUpdateFixed,
+     callUpdateFixed},
+    {"SwitchController::run", nullptr, callRun},
+    {"BasicSwitchController::run", nullptr, callStaticRun},
+    {"SwitchPredictor::update", nullptr, callPredict},
+    {"raw to volts, multiply", nullptr, callScale},
+    {"raw to volts, table", nullptr, callLookup},
+    {"Oversample::process", nullptr, callOversample},
+    {"MedianFilter::process", nullptr, callMedian},
+    {"EmaFilter::process", nullptr, callEma},
+    {"SolarFilter, one filtered sample", nullptr, callFilter},
+    {"storeDouble", nullptr, callStoreDouble},
+    {"double to %lf string", nullptr, callEncodeString,
+     BENCH_DOUBLE_STRING_BYTES},
+    {"%lf string to double", prepareDecodeString, callDecodeString,
+     BENCH_DOUBLE_STRING_BYTES},
+    {"encodeStored<double>", nullptr, callEncodeStored,
+     storedSize<double>()},
+    {"decodeStored<double>", prepareDecodeStored, callDecodeStored,
+     storedSize<double>()},
+    {"HalSerial::send(double)", prepareSend, callSendDouble},
+    {"SolarReadingQueue push+pop", nullptr, callQueue},
+    {"SolarReadingQueue batch of 8", nullptr, callQueueBatch},
+#ifdef ESP_PLATFORM
+    {"xQueueSend+xQueueReceive", nullptr, callXQueue},
+#endif
+};
+
+const size_t benchCaseCount = sizeof(benchCases) / sizeof(benchCases[0]);
+
+/**
+ * @brief Builds the objects the cases exercise.
+ *
+ * @param sink Serial port written by the `send(double)` case.
+ *
+ * Call once, after the key-value store is initialised: the index and the
+ * controller read and write it like their production counterparts.
+ */
+
+void benchSetup(HalSerial &sink) {
+  static SolarSampleRing ring;
+  static SolarIndex index("bench_volt", ring);
+  static SolarIndexMonitor monitor;
+  static SolarSampleRing doubleRing;
+  static SolarSampleRing fixedRing;
+  static BasicSolarIndex<double> doubleIndex("bench_vd", doubleRing);
+  static BasicSolarIndex<Q16_16> fixedIndex("bench_vq", fixedRing);
+  static BasicSolarIndexMonitor<double> doubleMonitor;
+  static BasicSolarIndexMonitor<Q16_16> fixedMonitor;
+  static SwitchController controller(BENCH_RELAY_PIN);
+  static BenchSwitchController staticController;
+  static SwitchPredictor predictor;
+  static SolarReadingQueue queue;
+  static AdcCalTable calibration;
+  static VoltageTable voltageTable;
+
+  monitor.setThresholds(SolarThresholds(solar_num_t(BENCH_THRESHOLD_MAX),
+                                        solar_num_t(BENCH_THRESHOLD_MIN)));
+  controller.setInterval(1);
+  controller.setSolarThresholds(BENCH_THRESHOLD_MAX, BENCH_THRESHOLD_MIN);
+  staticController.setInterval(1);
+  staticController.setSolarThresholds(BENCH_THRESHOLD_MAX, BENCH_THRESHOLD_MIN);
+  doubleMonitor.setThresholds(BasicSolarThresholds<double>(
+      BENCH_THRESHOLD_MAX, BENCH_THRESHOLD_MIN));
+  fixedMonitor.setThresholds(BasicSolarThresholds<Q16_16>(
+      Q16_16(BENCH_THRESHOLD_MAX), Q16_16(BENCH_THRESHOLD_MIN)));
+  index.load();
+  doubleIndex.load();
+  fixedIndex.load();
+
+  benchRing = &ring;
+  benchIndex = &index;
+  benchMonitor = &monitor;
+  benchDoubleRing = &doubleRing;
+  benchFixedRing = &fixedRing;
+  benchDoubleIndex = &doubleIndex;
+  benchFixedIndex = &fixedIndex;
+  benchDoubleMonitor = &doubleMonitor;
+  benchFixedMonitor = &fixedMonitor;
+  benchController = &controller;
+  benchStaticController = &staticController;
+  benchPredictor = &predictor;
+  benchSink = &sink;
+  benchQueue = &queue;
+
+  // Roughly an ESP32 ADC1 at 11 dB: a dead band above 0 V and a flattening
+  // curve towards full scale
+  static const AdcCalPoint curve[] = {{0, 128},     {500, 520},
+                                      {1000, 940},  {2000, 1770},
+                                      {3000, 2570}, {3600, 2950},
+                                      {4095, 3180}};
+  calibration.fromPoints(curve, sizeof(curve) / sizeof(curve[0]));
+  voltageTable.build(calibration, dividerRatio(SolarSensorConfig::r1,
+                                               SolarSensorConfig::r2));
+  benchVoltageTable = &voltageTable;
+  benchVoltsPerCount = solar_num_t(
+      dividerVoltsPerCount(SolarSensorConfig::r1, SolarSensorConfig::r2));
+#ifdef ESP_PLATFORM
+  benchXQueue = xQueueCreate(RUNTIME_SAMPLE_QUEUE_LENGTH, sizeof(SolarReading));
+#endif
+}
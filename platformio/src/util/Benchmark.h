@@ -0,0 +1,77 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include "hal.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hot-path microbenchmarks shared by the firmware and the host build.
+ *
+ * Each BenchCase times one call per iteration; `prepare()` runs outside the
+ * timed region so only the function under test is measured. The firmware
+ * runner (bench_esp.cpp, `pio run -e bench`) times calls with the CPU cycle
+ * counter; the host runner (host/bench_host.cpp) runs the same cases under
+ * Google Benchmark against the Linux HAL. Both report mean, p99 and max as
+ * JSON.
+ */
+
+#define BENCH_RESERVOIR_SIZE 2048
+
+/**
+ * @brief Mean, 99th percentile and maximum of one benchmark, in ticks of the
+ * timer that measured it, and the case's `bytes`.
+ */
+struct BenchSummary {
+  const char *name;
+  uint32_t calls;
+  double mean;
+  uint32_t p99;
+  uint32_t max;
+  uint32_t bytes;
+};
+
+/**
+ * @class BenchStats
+ * @brief Per-call timing accumulator.
+ *
+ * Mean and max are exact over every call. The p99 is taken from a uniform
+ * reservoir sample of at most BENCH_RESERVOIR_SIZE calls, so memory stays
+ * fixed however long the benchmark runs.
+ */
+class BenchStats {
+private:
+  uint32_t reservoir[BENCH_RESERVOIR_SIZE];
+  size_t kept = 0;
+  uint32_t calls = 0;
+  uint64_t total = 0;
+  uint32_t peak = 0;
+  uint32_t rng = 0x9E3779B9;
+
+public:
+  void reset();
+  void add(uint32_t ticks);
+  BenchSummary summarize(const char *name, uint32_t bytes = 0);
+};
+
+/**
+ * @brief One hot-path function under test.
+ *
+ * `prepare()` may be null. `iteration` counts from zero and drives the input
+ * sequence, so both runners feed identical inputs. `bytes` is the size of
+ * what an encoding case produces, reported alongside its timings, or 0.
+ */
+struct BenchCase {
+  const char *name;
+  void (*prepare)(uint32_t iteration);
+  void (*call)(uint32_t iteration);
+  uint32_t bytes;
+};
+
+extern const BenchCase benchCases[];
+extern const size_t benchCaseCount;
+
+void benchSetup(HalSerial &sink);
+void benchWriteJson(HalSerial &out, const char *platform, double nsPerTick,
+                    const BenchSummary *results, size_t count);
+
+#endif
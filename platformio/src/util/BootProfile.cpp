@@ -0,0 +1,76 @@
+/**
+ * @file BootProfile.cpp
+ * @brief Boot stage timing.
+ */
+
+#include "BootProfile.h"
+
+static const char *const stageNames[BOOT_STAGE_COUNT] = {
+    "drivers", "storage", "config", "controllers", "services"};
+
+/**
+ * @brief Name of a stage as printed by `BootProfiler::report()`.
+ */
+
+const char *bootStageName(BootStage stage) {
+  return stage < BOOT_STAGE_COUNT ? stageNames[stage] : "?";
+}
+
+/**
+ * @brief Marks the start of a stage.
+ */
+
+void BootProfiler::enter(BootStage stage) {
+  stages[stage] = {micros(), 0, true, false, false};
+}
+
+/**
+ * @brief Marks the end of a stage.
+ *
+ * @param ok Whether the stage completed; a failed stage is reported as such.
+ */
+
+void BootProfiler::leave(BootStage stage, bool ok) {
+  stages[stage].endMicros = micros();
+  stages[stage].left = true;
+  stages[stage].ok = ok;
+}
+
+/**
+ * @brief Prints one line per stage that ran, then the first decision.
+ *
+ * Times are in microseconds since boot; the time before the first stage is
+ * spent in the bootloader and in static constructors.
+ */
+
+void BootProfiler::report(HalSerial &serial) const {
+  for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+    const BootStageTiming &stage = stages[i];
+    if (!stage.entered)
+      continue;
+
+    serial.send("boot: ");
+    serial.send(bootStageName((BootStage)i));
+    serial.send(" at ");
+    serial.send((unsigned long)stage.startMicros);
+    if (stage.left) {
+      serial.send(" us, took ");
+      serial.send((unsigned long)(stage.endMicros - stage.startMicros));
+      serial.send(" us");
+    } else {
+      serial.send(" us, unfinished");
+    }
+    if (stage.left && !stage.ok)
+      serial.send(", FAILED");
+    serial.sendln();
+  }
+
+  serial.send("boot: first decision at ");
+  if (firstDecisionMicros >= 0) {
+    serial.send((unsigned long)firstDecisionMicros);
+    serial.send(" us");
+  } else {
+    serial.send("-");
+  }
+  serial.sendln();
+}
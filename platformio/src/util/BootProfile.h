@@ -0,0 +1,60 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+#include "hal.h"
+#include <stdint.h>
+
+/**
+ * @brief Stages of the boot sequence, in the order they run.
+ *
+ * Drivers bring up the serial port, the relay pin and the ADC; storage opens
+ * NVS; config loads the calibration, the solar index and the thresholds;
+ * controllers start the runtime and end with its first relay decision.
+ * Services (telemetry, the solar log, the web server) are deferred until
+ * then.
+ */
+enum BootStage {
+  BOOT_STAGE_DRIVERS,
+  BOOT_STAGE_STORAGE,
+  BOOT_STAGE_CONFIG,
+  BOOT_STAGE_CONTROLLERS,
+  BOOT_STAGE_SERVICES,
+  BOOT_STAGE_COUNT
+};
+
+struct BootStageTiming {
+  int64_t startMicros; // since boot
+  int64_t endMicros;
+  bool entered;
+  bool left;
+  bool ok;
+};
+
+/**
+ * @class BootProfiler
+ * @brief Timestamps the boot stages against the HAL clock.
+ *
+ * `enter()` and `leave()` bracket each stage; `report()` prints when each
+ * stage ran and how long it took, and how long after boot the first relay
+ * decision was taken.
+ */
+
+class BootProfiler {
+private:
+  BootStageTiming stages[BOOT_STAGE_COUNT] = {};
+  int64_t firstDecisionMicros = -1;
+
+public:
+  void enter(BootStage stage);
+  void leave(BootStage stage, bool ok = true);
+  void decided(int64_t micros) { firstDecisionMicros = micros; }
+  const BootStageTiming &timing(BootStage stage) const {
+    return stages[stage];
+  }
+  // Microseconds since boot, or -1 before the first decision
+  int64_t firstDecision() const { return firstDecisionMicros; }
+  void report(HalSerial &serial) const;
+};
+
+const char *bootStageName(BootStage stage);
+
+#endif
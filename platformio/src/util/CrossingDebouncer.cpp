@@ -0,0 +1,57 @@
+/**
+ * @file CrossingDebouncer.cpp
+ * @brief Dwell timing for event-driven switching.
+ */
+
+#include "main.h"
+
+/**
+ * @brief Starts the dwell for a crossing into `zone`.
+ *
+ * @param zone The zone the index crossed into.
+ * @param currentMillis The time of the crossing.
+ *
+ * A crossing within the thresholds asks for the relay on; any other zone
+ * asks for it off. Moving straight from below the minimum to above the
+ * maximum, or back, asks for off again and keeps the dwell running.
+ */
+
+void CrossingDebouncer::crossed(IndexZone zone, unsigned long currentMillis) {
+  if (zone == INDEX_ZONE_UNKNOWN)
+    return;
+
+  int level = zone == INDEX_ZONE_WITHIN;
+  if (pending && level == pendingLevel)
+    return;
+
+  pending = true;
+  pendingLevel = level;
+  pendingSince = currentMillis;
+}
+
+/**
+ * @brief Reports the level of the last crossing once it has lasted the
+ * dwell time.
+ *
+ * @param within Whether the current reading lies within the thresholds,
+ * without hysteresis.
+ * @param currentMillis The time of the current reading.
+ * @param level [out] The relay level to apply.
+ * @return `true` once per crossing, when its dwell is over.
+ */
+
+bool CrossingDebouncer::due(bool within, unsigned long currentMillis,
+                            int &level) {
+  if (!pending)
+    return false;
+  if ((int)within != pendingLevel) {
+    pendingSince = currentMillis;
+    return false;
+  }
+  if (currentMillis - pendingSince < dwellMs)
+    return false;
+
+  pending = false;
+  level = pendingLevel;
+  return true;
+}
@@ -0,0 +1,64 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+#include <stdint.h>
+
+/**
+ * @class Q16_16
+ * @brief Signed Q16.16 fixed-point number.
+ *
+ * The Q16_16 class stores a value as a 32-bit integer with 16 fractional bits
+ * so that the solar index math runs on the ESP32's integer ALU instead of
+ * software-emulated doubles. The integer range (+/-32767) covers both the
+ * divider input voltage and the 0-1000 solar index. Products and quotients
+ * are computed in 64 bits and truncated toward zero.
+ */
+
+class Q16_16 {
+private:
+  int32_t _raw;
+
+  struct RawTag {};
+  constexpr Q16_16(int32_t raw, RawTag) : _raw(raw) {}
+
+public:
+  static constexpr int FRACTION_BITS = 16;
+  static constexpr int32_t ONE = (int32_t)1 << FRACTION_BITS;
+
+  constexpr Q16_16() : _raw(0) {}
+  explicit constexpr Q16_16(int value) : _raw((int32_t)value * ONE) {}
+  explicit constexpr Q16_16(double value)
+      : _raw((int32_t)(value * ONE + (value < 0 ? -0.5 : 0.5))) {}
+
+  static constexpr Q16_16 fromRaw(int32_t raw) { return Q16_16(raw, RawTag()); }
+  constexpr int32_t raw() const { return _raw; }
+  constexpr double toDouble() const { return (double)_raw / ONE; }
+
+  constexpr Q16_16 operator+(Q16_16 other) const {
+    return fromRaw(_raw + other._raw);
+  }
+  constexpr Q16_16 operator-(Q16_16 other) const {
+    return fromRaw(_raw - other._raw);
+  }
+  constexpr Q16_16 operator*(Q16_16 other) const {
+    return fromRaw((int32_t)(((int64_t)_raw * other._raw) >> FRACTION_BITS));
+  }
+  constexpr Q16_16 operator/(Q16_16 other) const {
+    return fromRaw((int32_t)(((int64_t)_raw << FRACTION_BITS) / other._raw));
+  }
+  constexpr Q16_16 operator*(int32_t factor) const {
+    return fromRaw(_raw * factor);
+  }
+
+  constexpr bool operator==(Q16_16 other) const { return _raw == other._raw; }
+  constexpr bool operator!=(Q16_16 other) const { return _raw != other._raw; }
+  constexpr bool operator<(Q16_16 other) const { return _raw < other._raw; }
+  constexpr bool operator>(Q16_16 other) const { return _raw > other._raw; }
+  constexpr bool operator<=(Q16_16 other) const { return _raw <= other._raw; }
+  constexpr bool operator>=(Q16_16 other) const { return _raw >= other._raw; }
+};
+
+inline constexpr double toDouble(double value) { return value; }
+inline constexpr double toDouble(float value) { return value; }
+inline constexpr double toDouble(Q16_16 value) { return value.toDouble(); }
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file Instrument.cpp
+ * @brief Histogram updates, snapshots and the text dump.
+ */
+
+#include "Instrument.h"
+
+#if SOLAR_INSTRUMENT
+#include <stdio.h>
+
+#define INSTR_LINE_SIZE 48
+
+static const char *const counterNames[INSTR_COUNTER_COUNT] = {
+    "adc_samples", "nvs_errors", "uart_bytes", "relay_toggles"};
+
+static const char *const histogramNames[INSTR_HISTOGRAM_COUNT] = {
+    "adc_read_us", "nvs_open_us", "nvs_commit_us", "uart_send_us", "loop_us"};
+
+Instrument instrument;
+
+static uint8_t bucketOf(uint32_t micros) {
+  uint8_t bucket = micros == 0 ? 0 : 32 - __builtin_clz(micros);
+  return bucket < INSTR_HISTOGRAM_BUCKETS ? bucket
+                                          : INSTR_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief Adds one duration to a histogram.
+ */
+
+void Instrument::record(InstrHistogram histogram, uint32_t micros) {
+  buckets[histogram][bucketOf(micros)].fetch_add(1,
+                                                 std::memory_order_relaxed);
+
+  uint32_t peak = maxMicros[histogram].load(std::memory_order_relaxed);
+  while (micros > peak &&
+         !maxMicros[histogram].compare_exchange_weak(
+             peak, micros, std::memory_order_relaxed))
+    ;
+}
+
+/**
+ * @brief Copies every counter and histogram.
+ */
+
+InstrSnapshot Instrument::snapshot() const {
+  InstrSnapshot snapshot;
+
+  for (size_t c = 0; c < INSTR_COUNTER_COUNT; c++)
+    snapshot.counters[c] = counters[c].load(std::memory_order_relaxed);
+
+  for (size_t h = 0; h < INSTR_HISTOGRAM_COUNT; h++) {
+    InstrHistogramSnapshot &out = snapshot.histograms[h];
+    out.count = 0;
+    for (size_t b = 0; b < INSTR_HISTOGRAM_BUCKETS; b++) {
+      out.buckets[b] = buckets[h][b].load(std::memory_order_relaxed);
+      out.count += out.buckets[b];
+    }
+    out.maxMicros = maxMicros[h].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Writes a snapshot as text, one counter or histogram per line.
+ *
+ * Histograms list only non-empty buckets, each as `<upper-bound-us:count`;
+ * the last bucket is open-ended and printed as `>=bound:count`.
+ */
+
+void Instrument::dump(HalSerial &out) const {
+  InstrSnapshot data = snapshot();
+  char line[INSTR_LINE_SIZE];
+
+  for (size_t c = 0; c < INSTR_COUNTER_COUNT; c++) {
+    snprintf(line, sizeof(line), "%s %lu\n", counterNames[c],
+             (unsigned long)data.counters[c]);
+    out.send(line);
+  }
+
+  for (size_t h = 0; h < INSTR_HISTOGRAM_COUNT; h++) {
+    const InstrHistogramSnapshot &hist = data.histograms[h];
+    snprintf(line, sizeof(line), "%s count %lu max %lu", histogramNames[h],
+             (unsigned long)hist.count, (unsigned long)hist.maxMicros);
+    out.send(line);
+
+    for (size_t b = 0; b < INSTR_HISTOGRAM_BUCKETS; b++) {
+      if (hist.buckets[b] == 0)
+        continue;
+      if (b == INSTR_HISTOGRAM_BUCKETS - 1)
+        snprintf(line, sizeof(line), " >=%lu:%lu", 1ul << (b - 1),
+                 (unsigned long)hist.buckets[b]);
+      else
+        snprintf(line, sizeof(line), " <%lu:%lu", 1ul << b,
+                 (unsigned long)hist.buckets[b]);
+      out.send(line);
+    }
+    out.sendln();
+  }
+}
+#endif
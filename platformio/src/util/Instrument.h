@@ -0,0 +1,107 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+#include "hal.h"
+#include <stdint.h>
+
+/*
+ * Runtime instrumentation: named monotonic counters and log2 latency
+ * histograms, updated with relaxed atomics from any task.
+ *
+ * Code is instrumented only through the INSTR_* macros. Build with
+ * SOLAR_INSTRUMENT=0 and they expand to nothing and no Instrument symbol
+ * exists at all, so a stray direct use fails to build instead of costing
+ * cycles.
+ */
+
+#ifndef SOLAR_INSTRUMENT
+#define SOLAR_INSTRUMENT 1
+#endif
+
+// Bucket 0 counts 0 us, bucket b in [1, N-2] counts [2^(b-1), 2^b) us and
+// the last bucket everything from 2^(N-2) us (262 ms) up.
+#define INSTR_HISTOGRAM_BUCKETS 20
+
+enum InstrCounter : uint8_t {
+  INSTR_ADC_SAMPLES,   // raw samples consumed by SolarIndex
+  INSTR_NVS_ERRORS,    // failed NVS opens and commits
+  INSTR_UART_BYTES,    // bytes handed to the UART driver or TX ring
+  INSTR_RELAY_TOGGLES, // relay level changes
+  INSTR_COUNTER_COUNT
+};
+
+enum InstrHistogram : uint8_t {
+  INSTR_ADC_READ,   // SolarIndex::read()
+  INSTR_NVS_OPEN,   // opening the storage namespace
+  INSTR_NVS_COMMIT, // NVS commit of the write-back cache
+  INSTR_UART_SEND,  // one UART write
+  INSTR_LOOP,       // one control iteration over every controller
+  INSTR_HISTOGRAM_COUNT
+};
+
+#if SOLAR_INSTRUMENT
+#include <atomic>
+
+struct InstrHistogramSnapshot {
+  uint32_t buckets[INSTR_HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t maxMicros;
+};
+
+struct InstrSnapshot {
+  uint32_t counters[INSTR_COUNTER_COUNT];
+  InstrHistogramSnapshot histograms[INSTR_HISTOGRAM_COUNT];
+};
+
+/**
+ * @class Instrument
+ * @brief Process-wide counters and histograms.
+ *
+ * Updates are single relaxed read-modify-writes, so they never block and are
+ * safe from any task. A snapshot is not atomic across values; each value is
+ * exact on its own.
+ */
+class Instrument {
+private:
+  std::atomic<uint32_t> counters[INSTR_COUNTER_COUNT] = {};
+  std::atomic<uint32_t> buckets[INSTR_HISTOGRAM_COUNT]
+                               [INSTR_HISTOGRAM_BUCKETS] = {};
+  std::atomic<uint32_t> maxMicros[INSTR_HISTOGRAM_COUNT] = {};
+
+public:
+  void count(InstrCounter counter, uint32_t n = 1) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void record(InstrHistogram histogram, uint32_t micros);
+  InstrSnapshot snapshot() const;
+  void dump(HalSerial &out) const;
+};
+
+extern Instrument instrument;
+
+/**
+ * @brief Records the lifetime of the enclosing scope into a histogram.
+ */
+class InstrScope {
+private:
+  InstrHistogram histogram;
+  int64_t start;
+
+public:
+  explicit InstrScope(InstrHistogram histogram)
+      : histogram(histogram), start(micros()) {}
+  ~InstrScope() { instrument.record(histogram, (uint32_t)(micros() - start)); }
+};
+
+#define INSTR_COUNT(counter, n) instrument.count(counter, n)
+#define INSTR_RECORD(histogram, micros) instrument.record(histogram, micros)
+#define INSTR_SCOPE(histogram) InstrScope instrScope(histogram)
+#define INSTR_DUMP(out) instrument.dump(out)
+#else
+#define INSTR_COUNT(counter, n) ((void)0)
+#define INSTR_RECORD(histogram, micros) ((void)0)
+#define INSTR_SCOPE(histogram) ((void)0)
+#define INSTR_DUMP(out) ((void)0)
+#endif
+
+#endif
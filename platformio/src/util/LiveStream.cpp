@@ -0,0 +1,194 @@
+/**
+ * @file LiveStream.cpp
+ * @brief Implementation of the live SSE event fan-out.
+ */
+
+#include "LiveStream.h"
+#include "SolarHistory.h"
+#include <stdio.h>
+
+LiveStream liveStream;
+
+/**
+ * @brief Adds one solar index reading to the current window.
+ *
+ * @param timeMillis When the reading was taken.
+ * @param value The reading in SolarHistory tenths (see `historyValue()`).
+ *
+ * The batch is published as one `samples` frame when the window has elapsed
+ * or LIVE_MAX_BATCH readings are waiting, whichever comes first.
+ */
+
+void LiveStream::sample(uint32_t timeMillis, uint16_t value) {
+  if (batchCount == 0)
+    batchStart = timeMillis;
+  batch[batchCount++] = value;
+  batchEnd = timeMillis;
+
+  if (batchCount == LIVE_MAX_BATCH ||
+      timeMillis - batchStart >= windowMillis.load(std::memory_order_relaxed))
+    flushBatch();
+}
+
+void LiveStream::flushBatch() {
+  char frame[LIVE_FRAME_SIZE];
+  int length = snprintf(frame, sizeof(frame),
+                        "event: samples\ndata: {\"t0\":%lu,\"t1\":%lu,\"v\":[",
+                        (unsigned long)batchStart, (unsigned long)batchEnd);
+
+  for (size_t i = 0; i < batchCount; i++) {
+    length += snprintf(frame + length, sizeof(frame) - length, "%s%u.%u",
+                       i == 0 ? "" : ",", batch[i] / SOLAR_HISTORY_SCALE,
+                       batch[i] % SOLAR_HISTORY_SCALE);
+  }
+  length += snprintf(frame + length, sizeof(frame) - length, "]}\n\n");
+  batchCount = 0;
+
+  publish(frame, length);
+}
+
+/**
+ * @brief Publishes a relay transition immediately and remembers the level
+ * for clients that attach later.
+ */
+
+void LiveStream::relay(hal_pin_t pin, int level, uint32_t timeMillis) {
+  char frame[LIVE_FRAME_SIZE];
+  int length = snprintf(frame, sizeof(frame),
+                        "event: relay\ndata: {\"t\":%lu,\"pin\":%d,"
+                        "\"level\":%d}\n\n",
+                        (unsigned long)timeMillis, (int)pin, level);
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t i = 0;
+    while (i < pinCount && pins[i].pin != pin)
+      i++;
+    if (i < LIVE_MAX_PINS) {
+      pins[i] = {pin, (uint8_t)level, timeMillis};
+      if (i == pinCount)
+        pinCount++;
+    }
+  }
+
+  publish(frame, length);
+}
+
+/**
+ * @brief Copies a frame into every attached client's queue, then runs the
+ * `onPublish()` callback if any client took it.
+ */
+
+void LiveStream::publish(const char *frame, size_t length) {
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    frames++;
+    for (Client &client : clients) {
+      if (!client.active)
+        continue;
+      if (client.queue.write(frame, length)) {
+        queued = true;
+      } else {
+        client.dropped++;
+        dropped++;
+      }
+    }
+  }
+
+  void (*callback)() = publishCallback.load();
+  if (queued && callback != nullptr)
+    callback();
+}
+
+/**
+ * @brief Sets the sample batching window.
+ *
+ * @return `false` if `millis` is outside [LIVE_MIN_WINDOW_MS,
+ * LIVE_MAX_WINDOW_MS]. Takes effect from the next reading.
+ */
+
+bool LiveStream::setWindow(uint32_t millis) {
+  if (millis < LIVE_MIN_WINDOW_MS || millis > LIVE_MAX_WINDOW_MS)
+    return false;
+  windowMillis.store(millis);
+  return true;
+}
+
+/**
+ * @brief Claims a client slot and queues its `hello` and current relay
+ * levels.
+ *
+ * @return The client index for `peek()`, `consume()` and `detach()`, or -1
+ * if LIVE_MAX_CLIENTS are attached.
+ */
+
+int LiveStream::attach() {
+  std::lock_guard<std::mutex> guard(lock);
+  for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    Client &client = clients[i];
+    if (client.active)
+      continue;
+
+    client.active = true;
+    client.dropped = 0;
+    clientCount++;
+
+    char frame[LIVE_FRAME_SIZE];
+    int length = snprintf(frame, sizeof(frame),
+                          "event: hello\ndata: {\"window\":%lu}\n\n",
+                          (unsigned long)windowMillis.load());
+    client.queue.write(frame, length);
+
+    for (size_t p = 0; p < pinCount; p++) {
+      length = snprintf(frame, sizeof(frame),
+                        "event: relay\ndata: {\"t\":%lu,\"pin\":%d,"
+                        "\"level\":%d}\n\n",
+                        (unsigned long)pins[p].timeMillis, (int)pins[p].pin,
+                        pins[p].level);
+      client.queue.write(frame, length);
+    }
+    return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Releases a client slot and discards whatever it had queued.
+ *
+ * Call from the client's sender, or before any sender has seen it.
+ */
+
+void LiveStream::detach(int client) {
+  std::lock_guard<std::mutex> guard(lock);
+  Client &slot = clients[client];
+  if (!slot.active)
+    return;
+
+  slot.active = false;
+  clientCount--;
+  slot.queue.consume(slot.queue.size());
+}
+
+/**
+ * @brief Returns the next contiguous span of a client's queued frames.
+ *
+ * @return Number of bytes at `data`, 0 if nothing is queued.
+ */
+
+size_t LiveStream::peek(int client, const uint8_t *&data) {
+  return clients[client].queue.peek(data);
+}
+
+/**
+ * @brief Releases bytes of a client's queue once they have been sent.
+ */
+
+void LiveStream::consume(int client, size_t length) {
+  clients[client].queue.consume(length);
+}
+
+LiveStreamStats LiveStream::stats() {
+  std::lock_guard<std::mutex> guard(lock);
+  return {frames, dropped, clientCount};
+}
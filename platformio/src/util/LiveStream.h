@@ -0,0 +1,116 @@
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+#include "TxRing.h"
+#include "hal.h"
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Live push of solar index samples and relay transitions to dashboard
+ * clients as Server-Sent Events.
+ *
+ * The control task publishes; every connected client has its own bounded
+ * TxRing of pre-formatted event frames, drained by the transport's sender
+ * (web_esp.cpp on target, host/HttpSocketServer.cpp on Linux). A frame that
+ * does not fit in a client's ring is dropped for that client only, so a slow
+ * browser costs its own frames and never blocks the publisher.
+ *
+ * Events, each `event: <name>\ndata: <json>\n\n`:
+ * - `hello`   `{"window":ms}` once, when the client attaches
+ * - `samples` `{"t0":ms,"t1":ms,"v":[index,..]}` once per window
+ * - `relay`   `{"t":ms,"pin":n,"level":0|1}` on every transition, and the
+ *             last known level of each pin when the client attaches
+ */
+
+#ifndef LIVE_MAX_CLIENTS
+#define LIVE_MAX_CLIENTS 4
+#endif
+#ifndef LIVE_QUEUE_SIZE
+#define LIVE_QUEUE_SIZE 2048 // per client, a power of two
+#endif
+#define LIVE_WINDOW_MS 1000
+#define LIVE_MIN_WINDOW_MS 100
+#define LIVE_MAX_WINDOW_MS 10000
+#define LIVE_MAX_BATCH 32 // samples per frame; a full batch ends the window
+#define LIVE_FRAME_SIZE 384
+#define LIVE_MAX_PINS 4 // relay pins whose level is replayed on attach
+
+/**
+ * @brief Totals across all clients since boot.
+ */
+struct LiveStreamStats {
+  uint32_t frames;  // frames published
+  uint32_t dropped; // frame copies dropped because a client queue was full
+  uint8_t clients;  // clients attached now
+};
+
+/**
+ * @class LiveStream
+ * @brief Batches samples into SSE frames and fans them out to per-client
+ * queues.
+ *
+ * `sample()` and `relay()` are called by a single publisher (the control
+ * task). `attach()` and `detach()` may be called from any task. Each
+ * client's `peek()`/`consume()` must come from one sender at a time. The
+ * internal lock is held only for memcpys, never across I/O.
+ *
+ * The callback set with `onPublish()` runs on the publisher, after the lock
+ * is released, whenever a frame has been queued for at least one client, so
+ * a sender can sleep until there is something to send.
+ */
+class LiveStream {
+private:
+  struct Client {
+    bool active = false;
+    uint32_t dropped = 0;
+    TxRing<LIVE_QUEUE_SIZE> queue;
+  };
+
+  struct PinLevel {
+    hal_pin_t pin;
+    uint8_t level;
+    uint32_t timeMillis;
+  };
+
+  Client clients[LIVE_MAX_CLIENTS];
+  std::mutex lock;
+  uint8_t clientCount = 0;
+  uint32_t frames = 0;
+  uint32_t dropped = 0;
+
+  PinLevel pins[LIVE_MAX_PINS];
+  size_t pinCount = 0;
+
+  // Publisher only
+  uint16_t batch[LIVE_MAX_BATCH];
+  size_t batchCount = 0;
+  uint32_t batchStart = 0;
+  uint32_t batchEnd = 0;
+  std::atomic<uint32_t> windowMillis{LIVE_WINDOW_MS};
+  std::atomic<void (*)()> publishCallback{nullptr};
+
+  void flushBatch();
+  void publish(const char *frame, size_t length);
+
+public:
+  void sample(uint32_t timeMillis, uint16_t value);
+  void relay(hal_pin_t pin, int level, uint32_t timeMillis);
+
+  void onPublish(void (*callback)()) { publishCallback.store(callback); }
+
+  bool setWindow(uint32_t millis);
+  uint32_t window() const { return windowMillis.load(); }
+
+  int attach();
+  void detach(int client);
+  size_t peek(int client, const uint8_t *&data);
+  void consume(int client, size_t length);
+
+  LiveStreamStats stats();
+};
+
+extern LiveStream liveStream;
+
+#endif
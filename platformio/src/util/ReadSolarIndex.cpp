@@ -4,22 +4,34 @@
  * @brief Constructs a SolarIndex object.
  *
  * @param key The key for storing the highest voltage value in NVS.
- * @param pin The ADC pin connected to the solar index sensor.
- * @param r1 The resistance value R1 in the voltage divider circuit.
- * @param r2 The resistance value R2 in the voltage divider circuit.
+ * @param samples The ring filled by the ADC sampler for this sensor.
+ * @param voltsPerCount Volts per ADC count, see `dividerVoltsPerCount()`.
  *
  * This constructor initializes the SolarIndex object with the provided
- * key, ADC pin, and resistance values R1 and R2. It also configures the
- * ADC settings and retrieves the highest voltage value from non-volatile
- * storage.
+ * key, sample ring, and scale. It does not touch storage, so a SolarIndex
+ * may be a global; the highest voltage is retrieved by `load()`. ADC
+ * configuration is owned by the AdcSampler feeding `samples`.
+ *
+ * The ADC reference and the divider ratio arrive folded into a single
+ * volts-per-count constant, computed at compile time by the caller, so each
+ * sample costs one multiply in either numeric representation.
  */
 
-SolarIndex::SolarIndex(const char *key, adc1_channel_t pin, double r1 = 30000.0,
-                       double r2 = 7500.0)
-    : _key(key), _pin(pin), R1(r1), R2(r2) {
-  adc1_config_width(ADC_WIDTH_BIT_12);
-  adc1_config_channel_atten((adc1_channel_t)pin, ADC_ATTEN_DB_11);
+template <typename T>
+BasicSolarIndex<T>::BasicSolarIndex(const char *key, SolarSampleRing &samples,
+                                    double voltsPerCount)
+    : _key(key), _samples(samples), voltsPerCount(voltsPerCount) {}
+
+/**
+ * @brief Retrieves the highest voltage seen from storage.
+ *
+ * Call after `init_nvs()`. A SolarIndex read without it loads on its first
+ * `read()`.
+ */
+
+template <typename T> void BasicSolarIndex<T>::load() {
   retrieveHighestVoltFromNVS();
+  loaded = true;
 }
 
 /**
@@ -27,15 +39,47 @@ SolarIndex::SolarIndex(const char *key, adc1_channel_t pin, double r1 = 30000.0,
  *
  * @return The voltage reading in volts.
  *
- * This method reads the voltage output from the solar index sensor, converts
- * it to volts, and adjusts it based on the voltage divider circuit (R1 and R2).
+ * This method drains the samples the ADC sampler produced since the last call,
+ * SOLAR_READ_BLOCK at a time, through the SolarFilter pipeline and converts
+ * the newest filtered value to volts, scaling it by the ADC reference and the
+ * voltage divider ratio, or through the calibrated voltage table if one is
+ * attached. It never waits for a conversion: if no new filtered sample is
+ * available, the previous one is reused.
  */
 
-double SolarIndex::readVoltage() {
-  uint32_t adc_reading = adc1_get_raw(_pin);
-  double adc_voltage = (adc_reading * 3.3) / 4095.0;
-  double in_voltage = adc_voltage / (R2 / (R1 + R2));
-  return in_voltage;
+template <typename T> T BasicSolarIndex<T>::readVoltage() {
+  uint16_t block[SOLAR_READ_BLOCK];
+  uint16_t filtered;
+  uint32_t consumed = 0;
+  size_t count;
+  while ((count = _samples.popBatch(block, SOLAR_READ_BLOCK)) != 0) {
+    consumed += count;
+    for (size_t i = 0; i < count; i++) {
+      if (filter.process(block[i], filtered)) {
+        lastRaw = filtered;
+        telemetry.sample((uint32_t)millis(), filtered);
+      }
+    }
+  }
+  INSTR_COUNT(INSTR_ADC_SAMPLES, consumed);
+
+  if (voltageTable != nullptr)
+    return (*voltageTable)[lastRaw];
+  return voltsPerCount * lastRaw;
+}
+
+/**
+ * @brief Converts counts through a calibrated table from now on.
+ *
+ * @param table Volts at the divider input per count, or `nullptr` to go back
+ * to the linear scale. Must outlive the index.
+ *
+ * Call before the sampling task starts; the pointer is not synchronised.
+ */
+
+template <typename T>
+void BasicSolarIndex<T>::setVoltageTable(const BasicVoltageTable<T> *table) {
+  voltageTable = table;
 }
 
 /**
@@ -46,12 +90,9 @@ double SolarIndex::readVoltage() {
  * variable.
  */
 
-void SolarIndex::retrieveHighestVoltFromNVS() {
-  double volt;
-  if (retrieveDouble(_key, &volt))
-    highestVolt = volt;
-  else
-    highestVolt = -1; // negative value indicate failure
+template <typename T> void BasicSolarIndex<T>::retrieveHighestVoltFromNVS() {
+  if (!retrieve(_key, highestVolt))
+    highestVolt = T(-1); // negative value indicate failure
 }
 
 /**
@@ -65,11 +106,25 @@ void SolarIndex::retrieveHighestVoltFromNVS() {
  * value.
  */
 
-double SolarIndex::read() {
-  double volt = readVoltage();
+template <typename T> T BasicSolarIndex<T>::read() {
+  INSTR_SCOPE(INSTR_ADC_READ);
+  if (!loaded)
+    load();
+  T volt = readVoltage();
   if (volt > highestVolt) {
-    if (storeDouble(_key, volt))
+    if (store(_key, volt))
       highestVolt = volt;
   }
-  return SOLAR_INDEX_MAX_VALUE * (volt / highestVolt);
-}
\ No newline at end of file
+  if (!(highestVolt > T(0)))
+    return T(0);
+  // The ratio first, so a reading at the highest voltage scales to exactly
+  // SOLAR_INDEX_MAX_VALUE in either representation; a reading above it (its
+  // store failed) is clamped.
+  T index = T(SOLAR_INDEX_MAX_VALUE) * (volt / highestVolt);
+  if (index > T(SOLAR_INDEX_MAX_VALUE))
+    return T(SOLAR_INDEX_MAX_VALUE);
+  return index;
+}
+
+template class BasicSolarIndex<double>;
+template class BasicSolarIndex<Q16_16>;
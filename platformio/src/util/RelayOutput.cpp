@@ -0,0 +1,64 @@
+/**
+ * @file RelayOutput.cpp
+ * @brief Relay pin driver with a cached level.
+ */
+
+#include "RelayOutput.h"
+
+/**
+ * @brief Configures the pin and reads the level it starts at.
+ *
+ * @return `true` once the pin is configured; later calls do nothing.
+ *
+ * A pin that cannot be read counts as off. One that cannot be configured
+ * also counts as off, and is configured again on next use.
+ */
+
+bool RelayOutput::begin() {
+  if (commanded >= 0)
+    return true;
+  if (_pin < 0) {
+    commanded = 0;
+    return true;
+  }
+  if (!halGpio.configureOutput(_pin)) {
+    _failures++;
+    return false;
+  }
+  commanded = halGpio.digitalRead(_pin) == 1;
+  return true;
+}
+
+/**
+ * @brief Drives the relay to `level`.
+ *
+ * @param level 0 for off, anything else for on.
+ * @return `true` if the relay changed level; `false` if it already was at
+ * `level` or the write failed.
+ *
+ * On a failed write the cached level stays as it was, so the next decision
+ * tries again. With readback, a pin found at another level than commanded
+ * counts as a failure and its actual level is kept.
+ */
+
+bool RelayOutput::set(int level) {
+  level = level != 0;
+  if (level == this->level())
+    return false;
+
+  if (_pin >= 0 && !halGpio.digitalWrite(_pin, level)) {
+    _failures++;
+    return false;
+  }
+  if (readback && _pin >= 0) {
+    int actual = halGpio.digitalRead(_pin);
+    if (actual != level) {
+      _failures++;
+      if (actual >= 0)
+        commanded = actual;
+      return false;
+    }
+  }
+  commanded = level;
+  return true;
+}
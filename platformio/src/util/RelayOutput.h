@@ -0,0 +1,42 @@
+#ifndef RELAY_OUTPUT_H
+#define RELAY_OUTPUT_H
+#include "hal.h"
+#include <stdint.h>
+
+/**
+ * @class RelayOutput
+ * @brief A relay pin that is configured once and remembers its level.
+ *
+ * The pin is configured by `begin()`, or on first use, not on construction,
+ * so a RelayOutput may be a static member without touching the hardware
+ * before `app_main()`. Its level is then read back once; from there on
+ * `level()` returns the level last commanded, and `set()` only writes when
+ * it changes. With readback enabled every write is checked against the pin,
+ * which catches a pin that does not follow but costs a read per switch. A
+ * pin of -1 drives nothing and only keeps the level.
+ */
+
+class RelayOutput {
+private:
+  hal_pin_t _pin;
+  int8_t commanded = -1; // -1 until configured
+  bool readback = false;
+  uint32_t _failures = 0;
+
+public:
+  explicit RelayOutput(hal_pin_t pin) : _pin(pin) {}
+
+  bool begin();
+  hal_pin_t pin() const { return _pin; }
+  // The level last commanded, 0 or 1
+  int level() {
+    if (commanded < 0)
+      begin();
+    return commanded > 0;
+  }
+  bool set(int level);
+  void setReadback(bool enabled) { readback = enabled; }
+  uint32_t failures() const { return _failures; }
+};
+
+#endif
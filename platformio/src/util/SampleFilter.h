@@ -0,0 +1,170 @@
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Filter stages sitting between the raw ADC samples and SolarIndex::read().
+ *
+ * Every stage exposes `bool process(uint16_t in, uint16_t &out)` and returns
+ * `false` while it is still collecting input (oversampling decimates, so it
+ * only produces one output every N inputs). Stages are chained at compile
+ * time with FilterPipeline; a stage configured as a no-op (`Oversample<1>`,
+ * `MedianFilter<1>`, `EmaFilter<0>`) is an empty class whose `process()`
+ * inlines away.
+ */
+
+/**
+ * @class Oversample
+ * @brief Averages N consecutive samples into one (oversampling + decimation).
+ *
+ * @tparam N Number of samples per output, must be a power of two so the
+ * division is a shift.
+ */
+
+template <unsigned N> class Oversample {
+  static_assert(N != 0 && (N & (N - 1)) == 0,
+                "Oversample factor must be a power of two");
+
+private:
+  uint32_t sum = 0;
+  unsigned count = 0;
+
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    sum += in;
+    if (++count < N)
+      return false;
+    out = (uint16_t)(sum / N);
+    sum = 0;
+    count = 0;
+    return true;
+  }
+};
+
+template <> class Oversample<1> {
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    out = in;
+    return true;
+  }
+};
+
+/**
+ * @class MedianFilter
+ * @brief Sliding-window median, drops isolated spikes.
+ *
+ * @tparam W Window length, must be odd. Until the window has filled the input
+ * is passed through unchanged.
+ */
+
+template <unsigned W> class MedianFilter {
+  static_assert(W % 2 == 1, "Median window must be odd");
+
+private:
+  uint16_t window[W];
+  unsigned next = 0;
+  unsigned filled = 0;
+
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    window[next] = in;
+    next = (next + 1) % W;
+    if (filled < W) {
+      filled++;
+      out = in;
+      return true;
+    }
+
+    uint16_t sorted[W];
+    for (unsigned i = 0; i < W; i++) {
+      uint16_t value = window[i];
+      unsigned j = i;
+      for (; j > 0 && sorted[j - 1] > value; j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = value;
+    }
+    out = sorted[W / 2];
+    return true;
+  }
+};
+
+template <> class MedianFilter<1> {
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    out = in;
+    return true;
+  }
+};
+
+/**
+ * @class EmaFilter
+ * @brief Integer exponential moving average with alpha = 1 / 2^Shift.
+ *
+ * The state keeps 8 fractional bits so small steps are not lost to
+ * truncation. The first sample seeds the average.
+ */
+
+template <unsigned Shift> class EmaFilter {
+  static_assert(Shift < 16, "EMA shift out of range");
+
+private:
+  int32_t state = -1;
+
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    int32_t scaled = (int32_t)in << 8;
+    if (state < 0)
+      state = scaled;
+    else
+      state += (scaled - state) >> Shift;
+    out = (uint16_t)((state + 128) >> 8);
+    return true;
+  }
+};
+
+template <> class EmaFilter<0> {
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    out = in;
+    return true;
+  }
+};
+
+/**
+ * @class FilterPipeline
+ * @brief Chains filter stages in the order they are listed.
+ *
+ * @code{.cpp}
+ * FilterPipeline<Oversample<4>, MedianFilter<5>, EmaFilter<4>> filter;
+ * uint16_t filtered;
+ * if (filter.process(raw, filtered)) {
+ *   // a new filtered sample is available
+ * }
+ * @endcode
+ */
+
+template <typename... Stages> class FilterPipeline;
+
+template <> class FilterPipeline<> {
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    out = in;
+    return true;
+  }
+};
+
+template <typename First, typename... Rest>
+class FilterPipeline<First, Rest...> {
+private:
+  First first;
+  FilterPipeline<Rest...> rest;
+
+public:
+  bool process(uint16_t in, uint16_t &out) {
+    uint16_t stageOut;
+    return first.process(in, stageOut) && rest.process(stageOut, out);
+  }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+#include "SpscQueue.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADC_SAMPLE_RING_SIZE 1024
+
+/**
+ * @class SampleRing
+ * @brief Single-producer/single-consumer ring buffer of raw ADC samples.
+ *
+ * The producer (the ADC drain task on target, or a waveform stand-in on the
+ * host) pushes 12-bit readings and the consumer (SolarIndex) pops them
+ * without ever blocking. When the ring is full the newest samples are
+ * dropped and counted, because the producer is not allowed to move the
+ * consumer's tail.
+ *
+ * @tparam Capacity Number of slots, must be a power of two.
+ */
+
+template <size_t Capacity> class SampleRing {
+private:
+  SpscQueue<uint16_t, Capacity> queue;
+  std::atomic<uint32_t> dropped{0};
+
+public:
+  /**
+   * @brief Appends a sample. Producer side only.
+   *
+   * @param sample The raw ADC reading.
+   * @return `false` if the ring was full and the sample was dropped.
+   */
+  bool push(uint16_t sample) { return pushBatch(&sample, 1) == 1; }
+
+  /**
+   * @brief Appends a block of samples, dropping those that do not fit.
+   * Producer side only.
+   *
+   * @return Number of samples kept.
+   */
+  size_t pushBatch(const uint16_t *samples, size_t count) {
+    size_t kept = queue.pushBatch(samples, count);
+    if (kept != count)
+      dropped.fetch_add(count - kept, std::memory_order_relaxed);
+    return kept;
+  }
+
+  /**
+   * @brief Removes the oldest sample. Consumer side only.
+   *
+   * @param sample [out] The oldest pending sample.
+   * @return `false` if the ring was empty.
+   */
+  bool pop(uint16_t &sample) { return queue.pop(sample); }
+
+  /**
+   * @brief Removes up to `max` of the oldest samples. Consumer side only.
+   *
+   * @return Number of samples written to `samples`.
+   */
+  size_t popBatch(uint16_t *samples, size_t max) {
+    return queue.popBatch(samples, max);
+  }
+
+  size_t size() const { return queue.size(); }
+
+  uint32_t droppedCount() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+};
+
+typedef SampleRing<ADC_SAMPLE_RING_SIZE> SolarSampleRing;
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file SampleScheduler.cpp
+ * @brief Adaptive solar index sampling period.
+ */
+
+#include "main.h"
+#include <math.h>
+
+/**
+ * @brief Constructs a scheduler starting at the shortest period.
+ *
+ * @param config Period bounds and sensitivity. `maxPeriodMs` below
+ * `minPeriodMs` is raised to it.
+ */
+
+SampleScheduler::SampleScheduler(const AdaptiveSamplingConfig &config)
+    : config(config) {
+  if (this->config.minPeriodMs == 0)
+    this->config.minPeriodMs = 1;
+  if (this->config.maxPeriodMs < this->config.minPeriodMs)
+    this->config.maxPeriodMs = this->config.minPeriodMs;
+  _period = this->config.minPeriodMs;
+}
+
+/**
+ * @brief Standard deviation of the readings around the trend, in index
+ * points.
+ */
+
+double SampleScheduler::noise() const { return sqrt(variance); }
+
+/**
+ * @brief Takes a reading into account and returns the period until the
+ * next one.
+ *
+ * @param solarIndex The reading.
+ * @param currentMillis The time it was taken.
+ * @return Milliseconds until the next reading.
+ *
+ * Each change between readings is compared with the change the smoothed
+ * slope predicts over the same time; half its square is one observation of
+ * the variance, so a reading-to-reading noise of `noiseLimit` points keeps
+ * the period short whatever the trend does.
+ */
+
+uint32_t SampleScheduler::next(solar_num_t solarIndex,
+                               unsigned long currentMillis) {
+  double value = toDouble(solarIndex);
+  if (!primed || currentMillis == lastMillis) {
+    primed = true;
+    lastValue = value;
+    lastMillis = currentMillis;
+    return _period;
+  }
+
+  double elapsed = (double)(currentMillis - lastMillis);
+  double change = value - lastValue;
+  _slope += ADAPTIVE_SMOOTHING * (change / elapsed - _slope);
+  double residual = change - _slope * elapsed;
+  variance += ADAPTIVE_SMOOTHING * (residual * residual / 2.0 - variance);
+  lastValue = value;
+  lastMillis = currentMillis;
+
+  double target = config.maxPeriodMs;
+  if (variance > config.noiseLimit * config.noiseLimit)
+    target = config.minPeriodMs;
+  else if (fabs(_slope) * target > config.resolution)
+    target = config.resolution / fabs(_slope);
+  if (target < config.minPeriodMs)
+    target = config.minPeriodMs;
+
+  uint32_t period = (uint32_t)target;
+  _period = period < _period ? period
+            : period > 2 * _period ? 2 * _period
+                                   : period;
+  return _period;
+}
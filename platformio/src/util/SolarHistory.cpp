@@ -0,0 +1,117 @@
+/**
+ * @file SolarHistory.cpp
+ * @brief Implementation of the SolarHistory class.
+ *
+ * This file has no ESP-IDF dependencies so host tools can link it as-is.
+ */
+
+#include "SolarHistory.h"
+
+void SolarHistory::Accumulator::reset() {
+  sum = 0;
+  count = 0;
+  min = SOLAR_HISTORY_NO_DATA;
+  max = 0;
+}
+
+void SolarHistory::Accumulator::add(const HistoryAggregate &aggregate) {
+  if (aggregate.mean == SOLAR_HISTORY_NO_DATA)
+    return;
+
+  sum += aggregate.mean;
+  count++;
+  if (aggregate.min < min)
+    min = aggregate.min;
+  if (aggregate.max > max)
+    max = aggregate.max;
+}
+
+HistoryAggregate SolarHistory::Accumulator::result() const {
+  if (count == 0)
+    return {SOLAR_HISTORY_NO_DATA, SOLAR_HISTORY_NO_DATA,
+            SOLAR_HISTORY_NO_DATA};
+  return {min, (uint16_t)((sum + count / 2) / count), max};
+}
+
+/**
+ * @brief Constructs an empty history.
+ */
+
+SolarHistory::SolarHistory() { clear(); }
+
+/**
+ * @brief Discards every tier and the running aggregates.
+ */
+
+void SolarHistory::clear() {
+  secondTier.clear();
+  minuteTier.clear();
+  hourTier.clear();
+  currentSecond.reset();
+  currentMinute.reset();
+  currentHour.reset();
+  secondsInMinute = 0;
+  minutesInHour = 0;
+  started = false;
+}
+
+/**
+ * @brief Records a sample.
+ *
+ * @param millis Time of the sample in milliseconds; may wrap.
+ * @param value The value in tenths of a solar index point.
+ *
+ * Closing the seconds that elapsed since the previous sample costs O(1) each.
+ * After a gap longer than the per-second tier the history restarts instead of
+ * filling an hour of empty seconds.
+ */
+
+void SolarHistory::add(uint32_t millis, uint16_t value) {
+  if (!started) {
+    started = true;
+    secondStartMillis = millis;
+  } else if (millis - secondStartMillis >= SOLAR_HISTORY_SECONDS * 1000UL) {
+    clear();
+    started = true;
+    secondStartMillis = millis;
+  }
+
+  while (millis - secondStartMillis >= 1000) {
+    closeSecond();
+    secondStartMillis += 1000;
+  }
+
+  currentSecond.sum += value;
+  currentSecond.count++;
+  if (value < currentSecond.min)
+    currentSecond.min = value;
+  if (value > currentSecond.max)
+    currentSecond.max = value;
+}
+
+/**
+ * @brief Pushes the current second and rolls completed minutes and hours up.
+ */
+
+void SolarHistory::closeSecond() {
+  HistoryAggregate second = currentSecond.result();
+  currentSecond.reset();
+  secondTier.push(second.mean);
+  currentMinute.add(second);
+
+  if (++secondsInMinute < 60)
+    return;
+  secondsInMinute = 0;
+
+  HistoryAggregate minute = currentMinute.result();
+  currentMinute.reset();
+  minuteTier.push(minute);
+  currentHour.add(minute);
+
+  if (++minutesInHour < 60)
+    return;
+  minutesInHour = 0;
+
+  hourTier.push(currentHour.result());
+  currentHour.reset();
+}
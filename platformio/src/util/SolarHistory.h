@@ -0,0 +1,127 @@
+#ifndef SOLAR_HISTORY_H
+#define SOLAR_HISTORY_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define SOLAR_HISTORY_SECONDS 3600 // one hour of per-second values
+#define SOLAR_HISTORY_MINUTES 1440 // one day of per-minute aggregates
+#define SOLAR_HISTORY_HOURS 720    // thirty days of per-hour aggregates
+#define SOLAR_HISTORY_RAM_BUDGET (20 * 1024)
+
+// Values are stored as tenths of a solar index point
+#define SOLAR_HISTORY_SCALE 10
+#define SOLAR_HISTORY_NO_DATA 0xFFFF
+
+/**
+ * @brief Minimum, mean and maximum of one minute or one hour.
+ *
+ * All three fields are SOLAR_HISTORY_NO_DATA for a period with no samples.
+ */
+struct HistoryAggregate {
+  uint16_t min;
+  uint16_t mean;
+  uint16_t max;
+};
+
+/**
+ * @class HistoryTier
+ * @brief Fixed-size ring keeping the newest `Capacity` entries of one tier.
+ */
+
+template <typename E, size_t Capacity> class HistoryTier {
+private:
+  E entries[Capacity];
+  uint16_t head = 0;
+  uint16_t count = 0;
+
+  static_assert(Capacity <= UINT16_MAX, "HistoryTier index is 16 bits");
+
+public:
+  void push(const E &entry) {
+    entries[head] = entry;
+    head = head + 1 == Capacity ? 0 : head + 1;
+    if (count < Capacity)
+      count++;
+  }
+
+  /**
+   * @brief Returns an entry by age, 0 being the newest. `age < size()`.
+   */
+  const E &at(size_t age) const {
+    size_t index = head + Capacity - 1 - age;
+    return entries[index >= Capacity ? index - Capacity : index];
+  }
+
+  size_t size() const { return count; }
+  void clear() { head = count = 0; }
+};
+
+/**
+ * @class SolarHistory
+ * @brief Tiered, fixed-memory history of solar index values.
+ *
+ * Samples are averaged into one value per second. Every closed second is
+ * folded into a running minute aggregate and every closed minute into a
+ * running hour aggregate, so each tier is maintained incrementally in O(1)
+ * per sample and nothing is ever rescanned. Seconds without samples are
+ * recorded as SOLAR_HISTORY_NO_DATA and skipped by the aggregates, which keeps
+ * every tier aligned to wall-clock time.
+ *
+ * Minute and hour minima and maxima are those of the raw samples; means are
+ * averaged from the tier below.
+ *
+ * The history has a single writer; readers on other tasks must not run
+ * concurrently with `add()`.
+ */
+
+class SolarHistory {
+private:
+  struct Accumulator {
+    uint32_t sum;
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+
+    void reset();
+    void add(const HistoryAggregate &aggregate);
+    HistoryAggregate result() const;
+  };
+
+  HistoryTier<uint16_t, SOLAR_HISTORY_SECONDS> secondTier;
+  HistoryTier<HistoryAggregate, SOLAR_HISTORY_MINUTES> minuteTier;
+  HistoryTier<HistoryAggregate, SOLAR_HISTORY_HOURS> hourTier;
+
+  Accumulator currentSecond;
+  Accumulator currentMinute;
+  Accumulator currentHour;
+  uint8_t secondsInMinute = 0;
+  uint8_t minutesInHour = 0;
+  bool started = false;
+  uint32_t secondStartMillis = 0;
+
+  void closeSecond();
+
+public:
+  SolarHistory();
+
+  void add(uint32_t millis, uint16_t value);
+  void clear();
+
+  size_t secondCount() const { return secondTier.size(); }
+  size_t minuteCount() const { return minuteTier.size(); }
+  size_t hourCount() const { return hourTier.size(); }
+
+  uint16_t second(size_t age) const { return secondTier.at(age); }
+  const HistoryAggregate &minute(size_t age) const {
+    return minuteTier.at(age);
+  }
+  const HistoryAggregate &hour(size_t age) const { return hourTier.at(age); }
+
+  // Start time of `second(0)`; minutes and hours close on the same boundary
+  uint32_t newestSecondMillis() const { return secondStartMillis - 1000; }
+};
+
+static_assert(sizeof(SolarHistory) <= SOLAR_HISTORY_RAM_BUDGET,
+              "SolarHistory exceeds its RAM budget");
+
+#endif
@@ -15,7 +15,7 @@
  * clean slate.
  */
 
-void SolarIndexMonitor::resetTimer() {
+template <typename T> void BasicSolarIndexMonitor<T>::resetTimer() {
   accumulatedDurationAboveMax = 0;
   accumulatedDurationBelowMin = 0;
   accumulatedDurationWithinThresholds = 0;
@@ -30,12 +30,79 @@ void SolarIndexMonitor::resetTimer() {
  * SolarThresholds structure, if the thresholds are valid.
  */
 
-void SolarIndexMonitor::setThresholds(const SolarThresholds &threshold) {
+template <typename T>
+void BasicSolarIndexMonitor<T>::setThresholds(
+    const BasicSolarThresholds<T> &threshold) {
   if (isValidThreshold(threshold)) {
     _currentThreshold = threshold;
   }
 }
 
+/**
+ * @brief Sets how far past a threshold the index must go for a crossing.
+ *
+ * @param band Index points beyond the threshold, in the direction of the
+ * crossing. Narrowed to half the threshold span when the thresholds are
+ * closer than two bands, so the index can still get between them.
+ *
+ * Only crossing events use the band; the accumulated durations compare the
+ * index with the thresholds as before.
+ */
+
+template <typename T> void BasicSolarIndexMonitor<T>::setHysteresis(T band) {
+  hysteresis = band < T(0) ? T(0) : band;
+}
+
+/**
+ * @brief Registers the function called on every crossing.
+ *
+ * @param handler Called from `updateSolarIndex()`, or `nullptr` to detach.
+ * @param context Passed back to the handler.
+ *
+ * The handler runs in the caller's context and must not update this
+ * monitor.
+ */
+
+template <typename T>
+void BasicSolarIndexMonitor<T>::setCrossingHandler(IndexCrossingHandler handler,
+                                                   void *context) {
+  onCrossing = handler;
+  crossingContext = context;
+}
+
+/**
+ * @brief Forgets the zone, so that the next value raises a crossing into
+ * whichever zone it lies in.
+ */
+
+template <typename T> void BasicSolarIndexMonitor<T>::resetZone() {
+  zone = INDEX_ZONE_UNKNOWN;
+}
+
+/**
+ * @brief Whether the last accepted value lies within the thresholds,
+ * without hysteresis.
+ */
+
+template <typename T>
+bool BasicSolarIndexMonitor<T>::withinThresholds() const {
+  return !(currentSolarIndex > _currentThreshold.max) &&
+         !(currentSolarIndex < _currentThreshold.min);
+}
+
+/**
+ * @brief Attaches a history that records every accepted value.
+ *
+ * @param history The history to feed, or `nullptr` to detach.
+ *
+ * The history is owned by the caller and is not touched by `resetTimer()`.
+ */
+
+template <typename T>
+void BasicSolarIndexMonitor<T>::setHistory(SolarHistory *history) {
+  this->history = history;
+}
+
 /**
  * @brief Updates the solar index and accumulates durations.
  *
@@ -45,12 +112,28 @@ void SolarIndexMonitor::setThresholds(const SolarThresholds &threshold) {
  * durations based on whether the value is within the specified thresholds.
  */
 
-void SolarIndexMonitor::updateSolarIndex(double newValue) {
-  if (newValue < 0) {
+template <typename T>
+void BasicSolarIndexMonitor<T>::updateSolarIndex(T newValue) {
+  updateSolarIndex(newValue, millis());
+}
+
+/**
+ * @brief Updates the solar index with a caller-supplied timestamp.
+ *
+ * @param newValue The new solar index value.
+ * @param currentMillis The time the value was sampled, in milliseconds.
+ *
+ * Lets a caller updating many monitors with the same sample read the clock
+ * once, and lets samples be replayed with their original timestamps.
+ */
+
+template <typename T>
+void BasicSolarIndexMonitor<T>::updateSolarIndex(T newValue,
+                                                 unsigned long currentMillis) {
+  if (newValue < T(0)) {
     return;
   }
 
-  unsigned long currentMillis = millis();
   bool isAboveMax = (newValue > _currentThreshold.max);
   bool isBelowMin = (newValue < _currentThreshold.min);
   bool isWithinThresholds = (!isAboveMax && !isBelowMin);
@@ -58,8 +141,12 @@ void SolarIndexMonitor::updateSolarIndex(double newValue) {
   handleThresholdExceed(isAboveMax, currentMillis);
   handleThresholdFall(isBelowMin, currentMillis);
   handleDurationWithinThreshold(isWithinThresholds, currentMillis);
+  trackZone(newValue, currentMillis);
 
   currentSolarIndex = newValue;
+
+  if (history != nullptr)
+    history->add(currentMillis, historyValue(newValue));
 }
 
 /**
@@ -72,13 +159,15 @@ void SolarIndexMonitor::updateSolarIndex(double newValue) {
  * below the specified thresholds.
  */
 
-void SolarIndexMonitor::getAccumulatedDurations(
+template <typename T>
+void BasicSolarIndexMonitor<T>::getAccumulatedDurations(
     unsigned long &durationAboveMax, unsigned long &durationBelowMin) {
   durationAboveMax = accumulatedDurationAboveMax;
   durationBelowMin = accumulatedDurationBelowMin;
 }
 
-void SolarIndexMonitor::getDurationWithinThreshold(
+template <typename T>
+void BasicSolarIndexMonitor<T>::getDurationWithinThreshold(
     unsigned long &durationWithinMax) {
   durationWithinMax = accumulatedDurationWithinThresholds;
 }
@@ -92,18 +181,18 @@ void SolarIndexMonitor::getDurationWithinThreshold(
  * the threshold range.
  */
 
-void SolarIndexMonitor::debugRecordedData() {
+template <typename T> void BasicSolarIndexMonitor<T>::debugRecordedData() {
   Serial.send("Total Duration above max threshold (ms): ");
   Serial.send(accumulatedDurationAboveMax);
   Serial.sendln();
   Serial.send("Max Threshold During Exceed: ");
-  Serial.send(maxThresholdDuringExceed);
+  Serial.send(toDouble(maxThresholdDuringExceed));
   Serial.sendln();
   Serial.send("Total Duration below min threshold (ms): ");
   Serial.send(accumulatedDurationBelowMin);
   Serial.sendln();
   Serial.send("Min Threshold During Fall: ");
-  Serial.send(minThresholdDuringFall);
+  Serial.send(toDouble(minThresholdDuringFall));
   Serial.sendln();
   Serial.send("Total Duration within threshold (ms): ");
   Serial.send(accumulatedDurationWithinThresholds);
@@ -121,7 +210,9 @@ void SolarIndexMonitor::debugRecordedData() {
  * threshold.
  */
 
-bool SolarIndexMonitor::isValidThreshold(const SolarThresholds &threshold) {
+template <typename T>
+bool BasicSolarIndexMonitor<T>::isValidThreshold(
+    const BasicSolarThresholds<T> &threshold) {
   return (threshold.max >= threshold.min);
 }
 
@@ -135,13 +226,16 @@ bool SolarIndexMonitor::isValidThreshold(const SolarThresholds &threshold) {
  * the max threshold value during exceedance.
  */
 
-void SolarIndexMonitor::handleThresholdExceed(bool isAboveMax,
-                                              unsigned long currentMillis) {
+template <typename T>
+void BasicSolarIndexMonitor<T>::handleThresholdExceed(
+    bool isAboveMax, unsigned long currentMillis) {
   if (isAboveMax && startMillisAboveMax == 0) {
     startMillisAboveMax = currentMillis;
     maxThresholdDuringExceed = _currentThreshold.max;
   } else if (!isAboveMax && startMillisAboveMax != 0) {
     accumulatedDurationAboveMax += (currentMillis - startMillisAboveMax);
+    telemetry.span(TELEMETRY_SPAN_ABOVE_MAX, currentMillis,
+                   currentMillis - startMillisAboveMax);
     startMillisAboveMax = 0;
   }
 }
@@ -156,13 +250,16 @@ void SolarIndexMonitor::handleThresholdExceed(bool isAboveMax,
  * the min threshold value during a fall.
  */
 
-void SolarIndexMonitor::handleThresholdFall(bool isBelowMin,
-                                            unsigned long currentMillis) {
+template <typename T>
+void BasicSolarIndexMonitor<T>::handleThresholdFall(
+    bool isBelowMin, unsigned long currentMillis) {
   if (isBelowMin && startMillisBelowMin == 0) {
     startMillisBelowMin = currentMillis;
     minThresholdDuringFall = _currentThreshold.min;
   } else if (!isBelowMin && startMillisBelowMin != 0) {
     accumulatedDurationBelowMin += (currentMillis - startMillisBelowMin);
+    telemetry.span(TELEMETRY_SPAN_BELOW_MIN, currentMillis,
+                   currentMillis - startMillisBelowMin);
     startMillisBelowMin = 0;
   }
 }
@@ -176,13 +273,60 @@ void SolarIndexMonitor::handleThresholdFall(bool isBelowMin,
  * This private method tracks the duration within the threshold.
  */
 
-void SolarIndexMonitor::handleDurationWithinThreshold(
+template <typename T>
+void BasicSolarIndexMonitor<T>::handleDurationWithinThreshold(
     bool isWithinThresholds, unsigned long currentMillis) {
   if (isWithinThresholds && startMillisWithinThresholds == 0) {
     startMillisWithinThresholds = currentMillis;
   } else if (!isWithinThresholds && startMillisWithinThresholds != 0) {
     accumulatedDurationWithinThresholds +=
         (currentMillis - startMillisWithinThresholds);
+    telemetry.span(TELEMETRY_SPAN_WITHIN, currentMillis,
+                   currentMillis - startMillisWithinThresholds);
     startMillisWithinThresholds = 0;
   }
 }
+
+/**
+ * @brief Moves the zone with hysteresis and raises a crossing event.
+ *
+ * @param newValue The new solar index value.
+ * @param currentMillis The current timestamp in milliseconds.
+ *
+ * Leaving a zone takes the index `hysteresis` past the threshold it
+ * crosses, so noise around a threshold raises one event rather than one per
+ * sample. The first value after `resetZone()` is placed without hysteresis.
+ */
+
+template <typename T>
+void BasicSolarIndexMonitor<T>::trackZone(T newValue,
+                                          unsigned long currentMillis) {
+  const T &max = _currentThreshold.max;
+  const T &min = _currentThreshold.min;
+  T band = hysteresis;
+  T halfSpan = (max - min) / T(2.0);
+  if (band > halfSpan)
+    band = halfSpan;
+
+  IndexZone next = zone;
+  if (zone == INDEX_ZONE_UNKNOWN)
+    next = newValue > max   ? INDEX_ZONE_ABOVE_MAX
+           : newValue < min ? INDEX_ZONE_BELOW_MIN
+                            : INDEX_ZONE_WITHIN;
+  else if (newValue > max + band)
+    next = INDEX_ZONE_ABOVE_MAX;
+  else if (newValue < min - band)
+    next = INDEX_ZONE_BELOW_MIN;
+  else if (zone != INDEX_ZONE_WITHIN && newValue <= max - band &&
+           newValue >= min + band)
+    next = INDEX_ZONE_WITHIN;
+
+  if (next == zone)
+    return;
+  zone = next;
+  if (onCrossing != nullptr)
+    onCrossing(zone, currentMillis, crossingContext);
+}
+
+template class BasicSolarIndexMonitor<double>;
+template class BasicSolarIndexMonitor<Q16_16>;
@@ -0,0 +1,190 @@
+/**
+ * @file SolarLog.cpp
+ * @brief Implementation of the SolarLog class.
+ */
+
+#include "main.h"
+
+SolarLog solarLog;
+
+/**
+ * @brief Maps the log region and resumes after its newest page.
+ *
+ * @return `false` if halLogFlash has no region to map, e.g. because the
+ * partition table has no "solarlog" partition.
+ */
+
+bool SolarLog::begin() {
+  if (mapped != nullptr)
+    return true;
+
+  const void *region = halLogFlash.map();
+  if (region == nullptr)
+    return false;
+
+  image.mount(region, halLogFlash.size());
+
+  SolarLogPageHeader newest;
+  if (image.newestHeader(newest)) {
+    nextSequence = newest.sequence + 1;
+    timeOffset = (int64_t)newest.lastMillis + 1 - millis();
+  }
+
+  writer.begin(pages[activePage]);
+  pageOpenedMillis = millis();
+  mapped = region;
+  return true;
+}
+
+/**
+ * @brief Returns the current log time in milliseconds.
+ */
+
+uint64_t SolarLog::now() const { return (uint64_t)(timeOffset + millis()); }
+
+/**
+ * @brief Logs a solar index sample.
+ *
+ * @param value The solar index in SOLAR_HISTORY_SCALE units.
+ * @return `false` if the log is not mounted or both page buffers are full.
+ */
+
+bool SolarLog::logSample(uint16_t value) {
+  return append({now(), SOLAR_LOG_SAMPLE, 0, value});
+}
+
+/**
+ * @brief Logs an event.
+ */
+
+bool SolarLog::logEvent(SolarLogEventType type, uint32_t value) {
+  return append({now(), SOLAR_LOG_EVENT, type, value});
+}
+
+bool SolarLog::append(const SolarLogRecord &record) {
+  if (mapped == nullptr)
+    return false;
+
+  std::lock_guard<std::mutex> lock(bufferLock);
+  bool appended = writer.append(record);
+  if (!appended && sealedPage < 0) {
+    seal();
+    appended = writer.append(record);
+  }
+  if (appended)
+    counters.records++;
+  else
+    counters.droppedRecords++;
+  return appended;
+}
+
+/**
+ * @brief Hands the active page to `tick()` and opens the other buffer.
+ *
+ * Called with `bufferLock` held and no page already sealed.
+ */
+
+void SolarLog::seal() {
+  writer.finish(nextSequence++);
+  sealedPage = activePage;
+  activePage ^= 1;
+  writer.begin(pages[activePage]);
+  pageOpenedMillis = millis();
+}
+
+/**
+ * @brief Writes the sealed page to the next sector of the ring.
+ *
+ * The sector is erased right before it is written, so at most one page is
+ * lost to a power failure. A page that cannot be written is dropped rather
+ * than retried forever.
+ */
+
+void SolarLog::writeSealed() {
+  bool written;
+  {
+    std::lock_guard<std::mutex> lock(flashLock);
+    size_t offset = image.nextPage() * SOLAR_LOG_PAGE_SIZE;
+    written = halLogFlash.erase(offset, SOLAR_LOG_PAGE_SIZE) &&
+              halLogFlash.write(offset, pages[sealedPage],
+                                SOLAR_LOG_PAGE_SIZE);
+    image.mount(mapped, halLogFlash.size());
+  }
+
+  std::lock_guard<std::mutex> lock(bufferLock);
+  if (written) {
+    counters.pagesWritten++;
+    counters.bytesWritten += SOLAR_LOG_PAGE_SIZE;
+  } else {
+    counters.writeErrors++;
+  }
+  sealedPage = -1;
+}
+
+/**
+ * @brief Writes a full page if one is waiting.
+ *
+ * A partially filled page is also sealed once it has been open for
+ * SOLAR_LOG_SEAL_INTERVAL_MS, which bounds how much a reset can lose.
+ */
+
+void SolarLog::tick() {
+  if (mapped == nullptr)
+    return;
+
+  bool pending;
+  {
+    std::lock_guard<std::mutex> lock(bufferLock);
+    if (sealedPage < 0 && !writer.empty() &&
+        millis() - pageOpenedMillis >= SOLAR_LOG_SEAL_INTERVAL_MS)
+      seal();
+    pending = sealedPage >= 0;
+  }
+
+  if (pending)
+    writeSealed();
+}
+
+/**
+ * @brief Writes everything logged so far, e.g. before a planned restart.
+ */
+
+void SolarLog::flush() {
+  if (mapped == nullptr)
+    return;
+
+  tick();
+
+  bool pending;
+  {
+    std::lock_guard<std::mutex> lock(bufferLock);
+    if (sealedPage < 0 && !writer.empty())
+      seal();
+    pending = sealedPage >= 0;
+  }
+
+  if (pending)
+    writeSealed();
+}
+
+/**
+ * @brief Visits logged records in a time range.
+ *
+ * @see SolarLogImage::query(). Records still in RAM are not included.
+ */
+
+size_t SolarLog::query(uint64_t fromMillis, uint64_t toMillis,
+                       bool (*visit)(const SolarLogRecord &record,
+                                     void *context),
+                       void *context) {
+  if (mapped == nullptr)
+    return 0;
+
+  std::lock_guard<std::mutex> lock(flashLock);
+  return image.query(fromMillis, toMillis, visit, context);
+}
+
+SolarLogStats SolarLog::stats() {
+  std::lock_guard<std::mutex> lock(bufferLock);
+  return counters;
+}
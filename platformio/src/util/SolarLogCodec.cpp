@@ -0,0 +1,341 @@
+/**
+ * @file SolarLogCodec.cpp
+ * @brief Page encoding, decoding and indexing of the solar log.
+ *
+ * This file has no ESP-IDF dependencies so the host reader links it as-is.
+ */
+
+#include "SolarLogCodec.h"
+#include "TelemetryCodec.h"
+#include <string.h>
+
+#define SOLAR_LOG_CRC_OFFSET 28
+
+static void putU16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+static void putU32(uint8_t *p, uint32_t value) {
+  putU16(p, (uint16_t)value);
+  putU16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void putU64(uint8_t *p, uint64_t value) {
+  putU32(p, (uint32_t)value);
+  putU32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint16_t getU16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+}
+
+static uint64_t getU64(const uint8_t *p) {
+  return getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+static uint8_t *putVarint(uint8_t *p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (uint8_t)value;
+  return p;
+}
+
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t byte = *p++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint16_t pageCrc(const uint8_t *page, size_t length) {
+  uint16_t crc = telemetryCrc16(page, SOLAR_LOG_CRC_OFFSET);
+  return telemetryCrc16(page + SOLAR_LOG_HEADER_SIZE, length, crc);
+}
+
+/**
+ * @brief Parses a page header without checking the records.
+ *
+ * @return `false` for an erased sector or a foreign format.
+ */
+
+bool readSolarLogHeader(const uint8_t *page, SolarLogPageHeader &header) {
+  if (getU16(page) != SOLAR_LOG_MAGIC || page[2] != SOLAR_LOG_VERSION)
+    return false;
+
+  header.sequence = getU32(page + 4);
+  header.firstMillis = getU64(page + 8);
+  header.lastMillis = getU64(page + 16);
+  header.records = getU16(page + 24);
+  header.length = getU16(page + 26);
+  header.crc = getU16(page + SOLAR_LOG_CRC_OFFSET);
+  return header.length <= SOLAR_LOG_PAGE_SIZE - SOLAR_LOG_HEADER_SIZE;
+}
+
+/**
+ * @brief Starts an empty page.
+ *
+ * @param page Buffer of SOLAR_LOG_PAGE_SIZE bytes.
+ */
+
+void SolarLogPageWriter::begin(uint8_t *page) {
+  this->page = page;
+  header = {};
+  previousDelta = 0;
+  previousValue = 0;
+}
+
+/**
+ * @brief Appends a record.
+ *
+ * @return `false` if the page is full; the record is not written.
+ *
+ * Timestamps must not go backwards; an earlier one is clamped to the previous
+ * record's.
+ */
+
+bool SolarLogPageWriter::append(const SolarLogRecord &record) {
+  if (SOLAR_LOG_PAGE_SIZE - length() < SOLAR_LOG_MAX_RECORD)
+    return false;
+
+  if (header.records == 0) {
+    header.firstMillis = record.millis;
+    previousMillis = record.millis;
+  }
+
+  uint64_t millis =
+      record.millis < previousMillis ? previousMillis : record.millis;
+  int64_t delta = (int64_t)(millis - previousMillis);
+  uint8_t *p = page + length();
+
+  p = putVarint(p, (zigzag(delta - previousDelta) << 1) | record.kind);
+  if (record.kind == SOLAR_LOG_SAMPLE) {
+    p = putVarint(p, zigzag((int64_t)record.value - previousValue));
+    previousValue = record.value;
+  } else {
+    *p++ = record.type;
+    p = putVarint(p, record.value);
+  }
+
+  previousMillis = millis;
+  previousDelta = delta;
+  header.lastMillis = millis;
+  header.records++;
+  header.length = (uint16_t)(p - page - SOLAR_LOG_HEADER_SIZE);
+  return true;
+}
+
+/**
+ * @brief Writes the header and erases the unused tail of the buffer.
+ *
+ * @param sequence The page's position in the log.
+ *
+ * The tail is filled with 0xFF, the erased state of NOR flash, so writing the
+ * whole buffer never programs bits that are not part of the page.
+ */
+
+void SolarLogPageWriter::finish(uint32_t sequence) {
+  header.sequence = sequence;
+  memset(page + length(), 0xFF, SOLAR_LOG_PAGE_SIZE - length());
+
+  putU16(page, SOLAR_LOG_MAGIC);
+  page[2] = SOLAR_LOG_VERSION;
+  page[3] = 0;
+  putU32(page + 4, header.sequence);
+  putU64(page + 8, header.firstMillis);
+  putU64(page + 16, header.lastMillis);
+  putU16(page + 24, header.records);
+  putU16(page + 26, header.length);
+  putU16(page + 30, 0);
+  header.crc = pageCrc(page, header.length);
+  putU16(page + SOLAR_LOG_CRC_OFFSET, header.crc);
+}
+
+/**
+ * @brief Opens a page for reading.
+ *
+ * @return `false` if the header or the CRC does not check out.
+ */
+
+bool SolarLogPageReader::open(const uint8_t *page) {
+  if (!readSolarLogHeader(page, _header) ||
+      pageCrc(page, _header.length) != _header.crc)
+    return false;
+
+  cursor = page + SOLAR_LOG_HEADER_SIZE;
+  end = cursor + _header.length;
+  previousMillis = _header.firstMillis;
+  previousDelta = 0;
+  previousValue = 0;
+  return true;
+}
+
+/**
+ * @brief Decodes the next record.
+ *
+ * @return `false` at the end of the page or on a malformed record.
+ */
+
+bool SolarLogPageReader::next(SolarLogRecord &record) {
+  uint64_t head, value;
+  if (cursor >= end || !getVarint(cursor, end, head))
+    return false;
+
+  int64_t delta = previousDelta + unzigzag(head >> 1);
+  record.kind = (SolarLogRecordKind)(head & 1);
+  record.millis = previousMillis + delta;
+
+  if (record.kind == SOLAR_LOG_SAMPLE) {
+    if (!getVarint(cursor, end, value))
+      return false;
+    record.type = 0;
+    record.value = (uint32_t)(previousValue + unzigzag(value));
+    previousValue = record.value;
+  } else {
+    if (cursor >= end)
+      return false;
+    record.type = *cursor++;
+    if (!getVarint(cursor, end, value))
+      return false;
+    record.value = (uint32_t)value;
+  }
+
+  previousMillis = record.millis;
+  previousDelta = delta;
+  return true;
+}
+
+/**
+ * @brief Locates the oldest and newest pages of a mapped partition.
+ *
+ * @param image Start of the partition.
+ * @param size Partition size; a trailing partial page is ignored.
+ *
+ * Pages are written in ring order, so the log runs from the page with the
+ * lowest sequence to the one with the highest. The oldest page is not
+ * necessarily the one after the newest: a reset between erasing that sector
+ * and writing it leaves it blank. Erased or torn pages in between are
+ * skipped by readers.
+ */
+
+void SolarLogImage::mount(const void *image, size_t size) {
+  base = static_cast<const uint8_t *>(image);
+  pageCount = size / SOLAR_LOG_PAGE_SIZE;
+  oldest = used = newest = 0;
+
+  bool found = false;
+  uint32_t newestSequence = 0, oldestSequence = 0;
+  SolarLogPageHeader header{};
+
+  for (size_t i = 0; i < pageCount; i++) {
+    if (!readSolarLogHeader(base + i * SOLAR_LOG_PAGE_SIZE, header))
+      continue;
+    if (!found || header.sequence > newestSequence) {
+      newestSequence = header.sequence;
+      newest = i;
+    }
+    if (!found || header.sequence < oldestSequence) {
+      oldestSequence = header.sequence;
+      oldest = i;
+    }
+    found = true;
+  }
+  if (found)
+    used = (newest + pageCount - oldest) % pageCount + 1;
+}
+
+const uint8_t *SolarLogImage::pageAt(size_t position) const {
+  return base + ((oldest + position) % pageCount) * SOLAR_LOG_PAGE_SIZE;
+}
+
+/**
+ * @brief Returns the header of the most recently written page.
+ */
+
+bool SolarLogImage::newestHeader(SolarLogPageHeader &header) const {
+  return used != 0 &&
+         readSolarLogHeader(base + newest * SOLAR_LOG_PAGE_SIZE, header);
+}
+
+/**
+ * @brief Binary search for the last page starting at or before `millis`.
+ *
+ * Pages with an unreadable header are skipped over.
+ */
+
+size_t SolarLogImage::lowerBound(uint64_t millis) const {
+  size_t low = 0, high = used;
+  SolarLogPageHeader header{};
+
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    size_t probe = mid;
+    while (probe < high && !readSolarLogHeader(pageAt(probe), header))
+      probe++;
+
+    if (probe == high)
+      high = mid;
+    else if (header.firstMillis <= millis)
+      low = probe + 1;
+    else
+      high = mid;
+  }
+  return low == 0 ? 0 : low - 1;
+}
+
+/**
+ * @brief Visits the records with `fromMillis <= millis <= toMillis`.
+ *
+ * @param visit Called per record in time order; return `false` to stop.
+ * @return The number of records visited.
+ *
+ * Only pages overlapping the range are decoded. Pages failing their CRC are
+ * skipped.
+ */
+
+size_t SolarLogImage::query(uint64_t fromMillis, uint64_t toMillis,
+                            bool (*visit)(const SolarLogRecord &record,
+                                          void *context),
+                            void *context) const {
+  size_t visited = 0;
+  SolarLogPageReader reader;
+  SolarLogRecord record;
+
+  for (size_t position = lowerBound(fromMillis); position < used; position++) {
+    if (!reader.open(pageAt(position)))
+      continue;
+    if (reader.header().firstMillis > toMillis)
+      break;
+    if (reader.header().lastMillis < fromMillis)
+      continue;
+
+    while (reader.next(record)) {
+      if (record.millis > toMillis)
+        return visited;
+      if (record.millis < fromMillis)
+        continue;
+      visited++;
+      if (!visit(record, context))
+        return visited;
+    }
+  }
+  return visited;
+}
@@ -0,0 +1,141 @@
+#ifndef SOLAR_LOG_CODEC_H
+#define SOLAR_LOG_CODEC_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-flash format of the solar log, shared by the firmware and host tools.
+ *
+ * The log partition is a ring of SOLAR_LOG_PAGE_SIZE pages, one flash sector
+ * each, written whole and in sequence order. A page is a 32-byte header
+ *
+ *   [magic:u16][version:u8][reserved:u8][sequence:u32]
+ *   [firstMillis:u64][lastMillis:u64][records:u16][length:u16][crc:u16][0:u16]
+ *
+ * followed by `length` bytes of records; the rest of the sector stays erased.
+ * The CRC-16/CCITT-FALSE covers the header up to `crc` and the records.
+ *
+ * Records are delta-encoded against the previous record of the same page, so
+ * every page decodes on its own:
+ *
+ *   varint((zigzag(dt - previous dt) << 1) | kind)
+ *   sample: varint(zigzag(value - previous value))
+ *   event:  [type:u8] varint(value)
+ *
+ * A steady sample stream therefore costs one byte of timestamp per record.
+ * Page headers double as a sparse time index: `firstMillis` is
+ * non-decreasing in sequence order, so a time range is found by binary search
+ * over headers without reading any records.
+ */
+
+#define SOLAR_LOG_PAGE_SIZE 4096
+#define SOLAR_LOG_HEADER_SIZE 32
+#define SOLAR_LOG_MAGIC 0x4C53
+#define SOLAR_LOG_VERSION 1
+#define SOLAR_LOG_MAX_RECORD 16
+
+enum SolarLogRecordKind : uint8_t {
+  SOLAR_LOG_SAMPLE = 0,
+  SOLAR_LOG_EVENT = 1,
+};
+
+enum SolarLogEventType : uint8_t {
+  SOLAR_LOG_BOOT = 1,
+  SOLAR_LOG_RELAY = 2, // value: (pin << 1) | level
+};
+
+struct SolarLogRecord {
+  uint64_t millis;
+  SolarLogRecordKind kind;
+  uint8_t type;    // SolarLogEventType, events only
+  uint32_t value;  // solar index in SOLAR_HISTORY_SCALE units for samples
+};
+
+struct SolarLogPageHeader {
+  uint32_t sequence;
+  uint64_t firstMillis;
+  uint64_t lastMillis;
+  uint16_t records;
+  uint16_t length;
+  uint16_t crc;
+};
+
+bool readSolarLogHeader(const uint8_t *page, SolarLogPageHeader &header);
+
+/**
+ * @class SolarLogPageWriter
+ * @brief Encodes records into one page buffer.
+ */
+
+class SolarLogPageWriter {
+private:
+  uint8_t *page = nullptr;
+  SolarLogPageHeader header = {};
+  uint64_t previousMillis = 0;
+  int64_t previousDelta = 0;
+  uint32_t previousValue = 0;
+
+public:
+  void begin(uint8_t *page);
+  bool append(const SolarLogRecord &record);
+  void finish(uint32_t sequence);
+
+  bool empty() const { return header.records == 0; }
+  size_t length() const { return SOLAR_LOG_HEADER_SIZE + header.length; }
+  uint64_t lastMillis() const { return header.lastMillis; }
+};
+
+/**
+ * @class SolarLogPageReader
+ * @brief Decodes the records of one page.
+ */
+
+class SolarLogPageReader {
+private:
+  const uint8_t *cursor = nullptr;
+  const uint8_t *end = nullptr;
+  SolarLogPageHeader _header = {};
+  uint64_t previousMillis = 0;
+  int64_t previousDelta = 0;
+  uint32_t previousValue = 0;
+
+public:
+  bool open(const uint8_t *page);
+  bool next(SolarLogRecord &record);
+
+  const SolarLogPageHeader &header() const { return _header; }
+};
+
+/**
+ * @class SolarLogImage
+ * @brief Read access to a log partition mapped into memory.
+ *
+ * Used by the firmware over `esp_partition_mmap()` and by host tools over a
+ * memory-mapped image of the partition.
+ */
+
+class SolarLogImage {
+private:
+  const uint8_t *base = nullptr;
+  size_t pageCount = 0;
+  size_t oldest = 0;
+  size_t used = 0;
+  size_t newest = 0;
+
+  const uint8_t *pageAt(size_t position) const;
+  size_t lowerBound(uint64_t millis) const;
+
+public:
+  void mount(const void *image, size_t size);
+
+  size_t pages() const { return pageCount; }
+  size_t usedPages() const { return used; }
+  size_t nextPage() const { return used == 0 ? 0 : (newest + 1) % pageCount; }
+  bool newestHeader(SolarLogPageHeader &header) const;
+
+  size_t query(uint64_t fromMillis, uint64_t toMillis,
+               bool (*visit)(const SolarLogRecord &record, void *context),
+               void *context) const;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Producer and consumer indices live on separate lines so the two sides
+// never write to the same line.
+#ifndef SPSC_CACHE_LINE
+#define SPSC_CACHE_LINE 64
+#endif
+
+/**
+ * @class SpscQueue
+ * @brief Wait-free single-producer/single-consumer queue of fixed-size
+ * elements.
+ *
+ * Every operation finishes in a bounded number of steps whatever the other
+ * side is doing, so the producer may be an ISR, an esp_timer callback or a
+ * task. Each side keeps a private copy of the other side's index and only
+ * reloads it when the queue looks full (producer) or empty (consumer), so
+ * the shared line is touched about once per batch instead of once per
+ * element. Nothing blocks: when the consumer must wait for data, or the
+ * producer for space, pair the queue with a task notification (Runtime's
+ * control task waits for readings this way).
+ *
+ * @tparam T Element type, copied by assignment.
+ * @tparam Capacity Number of slots, must be a power of two.
+ */
+
+template <typename T, size_t Capacity> class SpscQueue {
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+private:
+  // Producer line
+  alignas(SPSC_CACHE_LINE) std::atomic<size_t> head{0};
+  size_t cachedTail = 0;
+
+  // Consumer line
+  alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail{0};
+  size_t cachedHead = 0;
+
+  alignas(SPSC_CACHE_LINE) T buffer[Capacity];
+
+public:
+  /**
+   * @brief Appends one element. Producer side only.
+   *
+   * @return `false` if the queue was full.
+   */
+  bool push(const T &element) { return pushBatch(&element, 1) == 1; }
+
+  /**
+   * @brief Appends as many of `count` elements as fit. Producer side only.
+   *
+   * @return Number of elements appended, from the front of `elements`.
+   */
+  size_t pushBatch(const T *elements, size_t count) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (Capacity - (h - cachedTail) < count)
+      cachedTail = tail.load(std::memory_order_acquire);
+
+    size_t room = Capacity - (h - cachedTail);
+    if (count > room)
+      count = room;
+    for (size_t i = 0; i < count; i++)
+      buffer[(h + i) & (Capacity - 1)] = elements[i];
+    head.store(h + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief Removes the oldest element. Consumer side only.
+   *
+   * @return `false` if the queue was empty.
+   */
+  bool pop(T &element) { return popBatch(&element, 1) == 1; }
+
+  /**
+   * @brief Removes up to `max` of the oldest elements, in order. Consumer
+   * side only.
+   *
+   * @return Number of elements written to `elements`.
+   */
+  size_t popBatch(T *elements, size_t max) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (cachedHead - t < max)
+      cachedHead = head.load(std::memory_order_acquire);
+
+    size_t count = cachedHead - t;
+    if (count > max)
+      count = max;
+    for (size_t i = 0; i < count; i++)
+      elements[i] = buffer[(t + i) & (Capacity - 1)];
+    tail.store(t + count, std::memory_order_release);
+    return count;
+  }
+
+  size_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+};
+
+#endif
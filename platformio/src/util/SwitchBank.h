@@ -0,0 +1,191 @@
+#ifndef SWITCH_BANK_H
+#define SWITCH_BANK_H
+#include "main.h"
+
+/**
+ * @class SwitchBank
+ * @brief Drives N relays from one shared solar index sample.
+ *
+ * Where N `SwitchController`s would each read the sensor and check the clock,
+ * a SwitchBank reads the solar index and the clock once per `tick()` and then
+ * walks every channel in a tight loop. Per-channel state is kept in parallel
+ * arrays (relay pins, commanded levels, thresholds and the SolarIndexMonitors
+ * themselves) so that loop touches contiguous memory. All channels share one
+ * decision interval.
+ *
+ * Channel `i` persists its thresholds in the same NVS slot as the `i`th
+ * SwitchController ("sw<i>"), so a bank should replace standalone
+ * controllers rather than run beside them.
+ *
+ * @tparam N Maximum number of channels.
+ *
+ * @code{.cpp}
+ * SwitchBank<8> bank(solar);
+ * bank.addChannel(GPIO_NUM_4);
+ * bank.addChannel(GPIO_NUM_5);
+ * while (true)
+ *   bank.tick();
+ * @endcode
+ */
+
+template <size_t N> class SwitchBank {
+  static_assert(N > 0, "SwitchBank needs at least one channel");
+
+private:
+  SolarIndex &_index;
+  size_t count = 0;
+  unsigned long previousMillis = 0;
+  unsigned long intervalMillis = 5 * MINUTES_TO_MILLIS;
+
+  SolarIndexMonitor monitors[N];
+  SolarThresholds thresholds[N];
+  hal_pin_t relayPins[N];
+  uint8_t relayLevels[N];
+  char slotKeys[N][SWITCH_SLOT_KEY_SIZE];
+
+public:
+  explicit SwitchBank(SolarIndex &index);
+
+  int addChannel(hal_pin_t relaySignalPin);
+  size_t size() const { return count; }
+  bool setInterval(unsigned short durationInMinutes);
+  bool setSolarThresholds(size_t channel, double max, double min);
+  int relayLevel(size_t channel) const;
+  void tick();
+  void tick(solar_num_t solarIndex, unsigned long currentMillis);
+};
+
+/**
+ * @brief Constructs an empty SwitchBank.
+ *
+ * @param index The solar index sensor sampled once per tick.
+ */
+
+template <size_t N>
+SwitchBank<N>::SwitchBank(SolarIndex &index) : _index(index) {}
+
+/**
+ * @brief Adds a relay channel.
+ *
+ * @param relaySignalPin The GPIO pin connected to the relay control signal.
+ * @return The channel number, or -1 if the bank is full.
+ *
+ * The pin is configured as an output and driven low. Thresholds are loaded
+ * from the channel's NVS slot, or defaults are stored there on first use.
+ */
+
+template <size_t N> int SwitchBank<N>::addChannel(hal_pin_t relaySignalPin) {
+  if (count == N)
+    return -1;
+
+  size_t channel = count++;
+  relayPins[channel] = relaySignalPin;
+  relayLevels[channel] = 0;
+  halGpio.configureOutput(relaySignalPin);
+  digitalWrite(relaySignalPin, 0);
+
+  switchSlotKey(channel, slotKeys[channel]);
+  if (retrieveSolarThresholds(slotKeys[channel], thresholds[channel]))
+    monitors[channel].setThresholds(thresholds[channel]);
+  else
+    storeSolarThresholds(slotKeys[channel], thresholds[channel]);
+
+  return (int)channel;
+}
+
+/**
+ * @brief Set the interval between switch decisions for every channel.
+ *
+ * @param durationInMinutes The interval duration in minutes (1-60).
+ * @return `true` if the interval is set successfully, `false` otherwise.
+ */
+
+template <size_t N>
+bool SwitchBank<N>::setInterval(unsigned short durationInMinutes) {
+  if (durationInMinutes < SWITCH_MIN_INTERVAL_MINUTES ||
+      durationInMinutes > SWITCH_MAX_INTERVAL_MINUTES)
+    return false;
+
+  intervalMillis = durationInMinutes * MINUTES_TO_MILLIS;
+  return true;
+}
+
+/**
+ * @brief Set one channel's thresholds.
+ *
+ * @param channel The channel returned by `addChannel()`.
+ * @param max The maximum solar index value.
+ * @param min The minimum solar index value.
+ * @return `true` if the thresholds are set successfully, `false` otherwise.
+ */
+
+template <size_t N>
+bool SwitchBank<N>::setSolarThresholds(size_t channel, double max,
+                                       double min) {
+  if (channel >= count || max < min || max > SOLAR_INDEX_MAX_VALUE || min < 0)
+    return false;
+
+  SolarThresholds newValue{solar_num_t(max), solar_num_t(min)};
+  if (thresholds[channel] != newValue) {
+    thresholds[channel] = newValue;
+    monitors[channel].setThresholds(newValue);
+    storeSolarThresholds(slotKeys[channel], newValue);
+    flushStorage();
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the level last commanded on a channel, or -1.
+ */
+
+template <size_t N> int SwitchBank<N>::relayLevel(size_t channel) const {
+  return channel < count ? relayLevels[channel] : -1;
+}
+
+/**
+ * @brief Sample the solar index once and update every channel.
+ */
+
+template <size_t N> void SwitchBank<N>::tick() {
+  solar_num_t solarIndex = _index.read();
+  tick(solarIndex, millis());
+}
+
+/**
+ * @brief Update every channel with one sample.
+ *
+ * @param solarIndex The solar index shared by all channels.
+ * @param currentMillis The time of the sample.
+ *
+ * At each interval boundary a channel is switched on if its index stayed
+ * within thresholds for longer than the interval, and off otherwise. Relays
+ * are only written when their commanded level changes.
+ */
+
+template <size_t N>
+void SwitchBank<N>::tick(solar_num_t solarIndex, unsigned long currentMillis) {
+  for (size_t i = 0; i < count; i++)
+    monitors[i].updateSolarIndex(solarIndex, currentMillis);
+
+  if (currentMillis - previousMillis < intervalMillis)
+    return;
+
+  for (size_t i = 0; i < count; i++) {
+    unsigned long rangeDuration;
+    monitors[i].getDurationWithinThreshold(rangeDuration);
+    uint8_t level = rangeDuration > intervalMillis ? 1 : 0;
+
+    // A failed write keeps the old level, so the next interval retries
+    if (level != relayLevels[i] && digitalWrite(relayPins[i], level)) {
+      relayLevels[i] = level;
+      reportRelay(relayPins[i], level, currentMillis);
+    }
+    monitors[i].resetTimer();
+  }
+
+  previousMillis = currentMillis;
+}
+
+#endif
@@ -1,10 +1,21 @@
 #include "main.h"
+#include <math.h>
 
-#define MINUTES_TO_MILLIS 60000
-
-const char *swMemStorage[] = {"sw0", "sw1", "sw2", "sw3"};
 static unsigned short nextSwMem = 0;
-SolarIndex solar("SolarRead", ADC1_CHANNEL_0);
+
+/**
+ * @brief Builds the NVS key holding the thresholds of a switch slot.
+ *
+ * @param slot The slot number.
+ * @param key [out] Buffer of SWITCH_SLOT_KEY_SIZE bytes.
+ *
+ * Slots are shared by SwitchController and SwitchBank, so a bank of N
+ * channels picks up the thresholds of the first N controllers.
+ */
+
+void switchSlotKey(unsigned short slot, char *key) {
+  snprintf(key, SWITCH_SLOT_KEY_SIZE, "sw%u", slot);
+}
 
 /**
  * @brief Constructs a SwitchController object.
@@ -13,13 +24,14 @@ SolarIndex solar("SolarRead", ADC1_CHANNEL_0);
  *
  * This constructor initializes the `SwitchController` object with the specified
  * relay signal pin. It also sets up the initial threshold, interval, and
- * connects to the solar index sensor.
+ * connects to the solar index sensor. The pin is configured by `begin()`, or
+ * else on the first decision.
  */
 
-SwitchController::SwitchController(gpio_num_t relaySignalPin)
-    : _relaySignalPin(relaySignalPin),
-      swThresholdAdrress(swMemStorage[nextSwMem]),
+SwitchController::SwitchController(hal_pin_t relaySignalPin)
+    : relay(relaySignalPin),
       intervalMillis(intervalMinutes * MINUTES_TO_MILLIS) {
+  switchSlotKey(nextSwMem, swThresholdAdrress);
 
   if (retrieveSolarThresholds(swThresholdAdrress, threshold)) {
     indexMonitor.setThresholds(threshold);
@@ -29,6 +41,22 @@ SwitchController::SwitchController(gpio_num_t relaySignalPin)
     if (storeSolarThresholds(swThresholdAdrress, newThreshold))
       nextSwMem++;
   }
+
+  EventConfig events;
+  debouncer.setDwell(events.dwellMs);
+  indexMonitor.setHysteresis(solar_num_t(events.hysteresis));
+  indexMonitor.setCrossingHandler(crossed, this);
+}
+
+/**
+ * @brief Configures the relay pin and reads back the level it is at.
+ *
+ * @return `false` if the pin could not be configured.
+ */
+
+bool SwitchController::begin() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return relay.begin();
 }
 
 /**
@@ -43,14 +71,34 @@ SwitchController::SwitchController(gpio_num_t relaySignalPin)
  */
 
 bool SwitchController::setInterval(unsigned short durationInMinutes) {
-  if (durationInMinutes < 1 || durationInMinutes > 60)
+  if (durationInMinutes < SWITCH_MIN_INTERVAL_MINUTES ||
+      durationInMinutes > SWITCH_MAX_INTERVAL_MINUTES)
     return false;
 
+  std::lock_guard<std::mutex> lock(settingsLock);
   intervalMillis = durationInMinutes * MINUTES_TO_MILLIS;
 
   return true;
 }
 
+/**
+ * @brief Get the interval between switch control operations, in minutes.
+ */
+
+unsigned short SwitchController::interval() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return (unsigned short)(intervalMillis / MINUTES_TO_MILLIS);
+}
+
+/**
+ * @brief Get the current solar index thresholds.
+ */
+
+SolarThresholds SwitchController::thresholds() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return threshold;
+}
+
 /**
  * @brief Set the solar index sensor thresholds.
  *
@@ -64,9 +112,11 @@ bool SwitchController::setInterval(unsigned short durationInMinutes) {
  */
 
 bool SwitchController::setSolarThresholds(SolarThresholds newThreshold) {
+  std::lock_guard<std::mutex> lock(settingsLock);
   if (newThreshold.max >= newThreshold.min && newThreshold != threshold) {
     threshold = newThreshold;
     storeSolarThresholds(swThresholdAdrress, threshold);
+    flushStorage();
     indexMonitor.setThresholds(threshold);
     return true;
   }
@@ -74,6 +124,18 @@ bool SwitchController::setSolarThresholds(SolarThresholds newThreshold) {
   return false;
 }
 
+/**
+ * @brief Whether a pair of thresholds is within range.
+ *
+ * @return `true` if both are finite and 0 <= min <= max <=
+ * SOLAR_INDEX_MAX_VALUE.
+ */
+
+bool SwitchController::acceptsThresholds(double max, double min) {
+  return isfinite(max) && isfinite(min) && min >= 0 && min <= max &&
+         max <= SOLAR_INDEX_MAX_VALUE;
+}
+
 /**
  * @brief Set the solar index sensor thresholds (maximum and minimum values).
  *
@@ -87,15 +149,17 @@ bool SwitchController::setSolarThresholds(SolarThresholds newThreshold) {
  */
 
 bool SwitchController::setSolarThresholds(double max, double min) {
-  if (max < min || (max > SOLAR_INDEX_MAX_VALUE || min < 0))
+  if (!acceptsThresholds(max, min))
     return false;
 
-  SolarThresholds newValue{max, min};
+  SolarThresholds newValue{solar_num_t(max), solar_num_t(min)};
 
+  std::lock_guard<std::mutex> lock(settingsLock);
   if (threshold != newValue) {
     threshold = newValue;
     indexMonitor.setThresholds(threshold);
     storeSolarThresholds(swThresholdAdrress, threshold);
+    flushStorage();
   }
 
   return true;
@@ -116,13 +180,16 @@ bool SwitchController::setSolarThresholds(double min) {
   if (min < 0 || min > SOLAR_INDEX_MAX_VALUE)
     return false;
 
-  SolarThresholds newValue(SOLAR_INDEX_MAX_VALUE, min);
+  SolarThresholds newValue(solar_num_t(SOLAR_INDEX_MAX_VALUE),
+                           solar_num_t(min));
 
+  std::lock_guard<std::mutex> lock(settingsLock);
   if (threshold != newValue) {
     threshold = newValue;
     indexMonitor.setThresholds(threshold);
     indexMonitor.setThresholds(threshold);
     storeSolarThresholds(swThresholdAdrress, threshold);
+    flushStorage();
   }
 
   return true;
@@ -136,34 +203,161 @@ bool SwitchController::setSolarThresholds(double min) {
  */
 
 void SwitchController::run() {
+  solar_num_t solarIndex = solar.read();
+  run(solarIndex, millis());
+}
 
-  double solarIndex = solar.read();
-  indexMonitor.updateSolarIndex(solarIndex);
+/**
+ * @brief Run the switch controller with a reading taken elsewhere.
+ *
+ * @param solarIndex The solar index value.
+ * @param currentMillis The time the value was read.
+ *
+ * Used by the Runtime, whose sampling task reads the sensor once for every
+ * controller. Holds the settings lock, so thresholds and interval changed
+ * from another task (the web API) apply between runs. In SWITCH_MODE_EVENT
+ * the relay follows the crossing raised by this very reading once its dwell
+ * is over, whatever the interval.
+ */
 
-  unsigned long currentMillis = millis();
+void SwitchController::run(solar_num_t solarIndex,
+                           unsigned long currentMillis) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  indexMonitor.updateSolarIndex(solarIndex, currentMillis);
+
+  if (_mode == SWITCH_MODE_EVENT) {
+    int level;
+    bool within = indexMonitor.withinThresholds();
+    if (debouncer.due(within, currentMillis, level))
+      switchAhead(level, currentMillis);
+    return;
+  }
+
+  if (_mode == SWITCH_MODE_PREDICTIVE &&
+      predictor.update(solarIndex, currentMillis, threshold) &&
+      predictor.verdict() != TREND_UNSURE)
+    switchAhead(predictor.verdict() == TREND_INSIDE, currentMillis);
 
   if (currentMillis - previousMillis >= intervalMillis) {
     unsigned long rangeDuration;
     indexMonitor.getDurationWithinThreshold(rangeDuration);
-    int relaySignal = analogRead(_relaySignalPin);
-
-    if (rangeDuration > intervalMillis && relaySignal <= PIN_HIGH_THRESHOLD) {
-      digitalWrite(_relaySignalPin, 1);
-    } else if (rangeDuration <= intervalMillis &&
-               relaySignal > PIN_HIGH_THRESHOLD) {
-      digitalWrite(_relaySignalPin, 0);
-    }
-
-    if ((rangeDuration > intervalMillis && relaySignal <= PIN_HIGH_THRESHOLD) ||
-        (rangeDuration <= intervalMillis && relaySignal > PIN_HIGH_THRESHOLD)) {
-      digitalWrite(_relaySignalPin, !relaySignal);
-    }
+    bool inRange = rangeDuration > intervalMillis;
+    // A confident forecast holds the relay against the interval's verdict
+    if (_mode == SWITCH_MODE_PREDICTIVE && predictor.verdict() != TREND_UNSURE)
+      inRange = predictor.verdict() == TREND_INSIDE;
+    if (relay.set(inRange))
+      reportRelay(relay.pin(), inRange, currentMillis);
 
     previousMillis = currentMillis;
     indexMonitor.resetTimer();
   }
 }
 
+/**
+ * @brief Switches ahead of the interval, on a confident forecast or a
+ * crossing event.
+ *
+ * A switch starts a new interval, so the interval rule next judges a whole
+ * interval spent in the new state rather than one straddling the switch.
+ */
+
+void SwitchController::switchAhead(int level, unsigned long currentMillis) {
+  if (!relay.set(level))
+    return;
+
+  reportRelay(relay.pin(), level, currentMillis);
+  previousMillis = currentMillis;
+  indexMonitor.resetTimer();
+}
+
+/**
+ * @brief Monitor crossing handler; starts the dwell for the new zone.
+ */
+
+void SwitchController::crossed(IndexZone zone, unsigned long currentMillis,
+                               void *context) {
+  static_cast<SwitchController *>(context)->debouncer.crossed(zone,
+                                                              currentMillis);
+}
+
+/**
+ * @brief Choose how the controller decides.
+ *
+ * @param mode SWITCH_MODE_INTERVAL, SWITCH_MODE_PREDICTIVE or
+ * SWITCH_MODE_EVENT.
+ *
+ * The forecast starts from scratch, so predictive mode only acts after
+ * TREND_MIN_POINTS buckets. Event mode places the index afresh on the next
+ * reading and brings the relay in line with it after the dwell.
+ */
+
+void SwitchController::setMode(SwitchMode mode) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  _mode = mode;
+  predictor.reset();
+  debouncer.cancel();
+  indexMonitor.resetZone();
+}
+
+SwitchMode SwitchController::mode() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return _mode;
+}
+
+/**
+ * @brief Sets the forecast horizon and confidence of predictive mode.
+ */
+
+void SwitchController::setPredictiveConfig(const PredictiveConfig &config) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  predictor.setConfig(config);
+}
+
+/**
+ * @brief Sets the dwell time and hysteresis band of event mode.
+ *
+ * The band applies from the next reading; a dwell already running is timed
+ * against the new dwell.
+ */
+
+void SwitchController::setEventConfig(const EventConfig &config) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  debouncer.setDwell(config.dwellMs);
+  indexMonitor.setHysteresis(solar_num_t(config.hysteresis));
+}
+
+/**
+ * @brief Checks every relay write by reading the pin back.
+ *
+ * Off by default: the controller trusts the level it commanded.
+ */
+
+void SwitchController::setRelayReadback(bool enabled) {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  relay.setReadback(enabled);
+}
+
+/**
+ * @brief Relay writes that failed or, with readback, did not take.
+ */
+
+uint32_t SwitchController::relayFailures() {
+  std::lock_guard<std::mutex> lock(settingsLock);
+  return relay.failures();
+}
+
+/**
+ * @brief Reports a relay transition to every sink: instrumentation,
+ * telemetry, the live stream and the solar log.
+ */
+
+void reportRelay(hal_pin_t pin, int level, unsigned long currentMillis) {
+  INSTR_COUNT(INSTR_RELAY_TOGGLES, 1);
+  telemetry.relay(pin, level, currentMillis);
+  liveStream.relay(pin, level, currentMillis);
+  solarLog.logEvent(SOLAR_LOG_RELAY, ((uint32_t)pin << 1) | level);
+}
+
 /**
  * @brief Debug recorded data of the solar index monitor.
  *
@@ -172,3 +366,13 @@ void SwitchController::run() {
  */
 
 void SwitchController::debug() { indexMonitor.debugRecordedData(); }
+
+/**
+ * @brief Records every solar index value this controller sees.
+ *
+ * @param history The history to feed, or `nullptr` to detach.
+ */
+
+void SwitchController::setHistory(SolarHistory *history) {
+  indexMonitor.setHistory(history);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file SwitchPredictor.cpp
+ * @brief Trend forecasting for predictive switching.
+ */
+
+#include "main.h"
+
+/**
+ * @brief Forgets every sample, e.g. after the thresholds changed.
+ */
+
+void SwitchPredictor::reset() {
+  estimator.reset();
+  bucketSum = 0;
+  bucketCount = 0;
+  _verdict = TREND_UNSURE;
+}
+
+/**
+ * @brief Adds one sample and refreshes the verdict when a bucket completes.
+ *
+ * @param solarIndex The solar index value.
+ * @param currentMillis The time the value was read.
+ * @param threshold The band the forecast is checked against.
+ * @return `true` if the verdict was refreshed, once per TREND_BUCKET_MS.
+ *
+ * Samples are kept as SolarHistory tenths, so the estimator's sums are
+ * exact in either numeric representation. Buckets are consecutive
+ * TREND_BUCKET_MS slots from the first sample; a bucket is closed by the
+ * first sample past its end. When samples are further apart than a bucket,
+ * as with adaptive sampling, the closed bucket's mean stands for every slot
+ * up to that sample, so the slope stays per TREND_BUCKET_MS at any rate.
+ */
+
+bool SwitchPredictor::update(solar_num_t solarIndex,
+                             unsigned long currentMillis,
+                             const SolarThresholds &threshold) {
+  bool closed = bucketCount != 0 &&
+                currentMillis - bucketStart >= TREND_BUCKET_MS;
+  if (closed) {
+    int32_t mean = (int32_t)((bucketSum + bucketCount / 2) / bucketCount);
+    unsigned long spans = (currentMillis - bucketStart) / TREND_BUCKET_MS;
+    for (unsigned long i = 0; i < spans && i < TREND_WINDOW; i++)
+      estimator.push(mean);
+    bucketSum = 0;
+    bucketCount = 0;
+    bucketStart += spans * TREND_BUCKET_MS;
+  } else if (bucketCount == 0) {
+    bucketStart = currentMillis;
+  }
+  bucketSum += historyValue(solarIndex);
+  bucketCount++;
+
+  if (!closed)
+    return false;
+
+  if (estimator.size() < TREND_MIN_POINTS) {
+    _verdict = TREND_UNSURE;
+    return true;
+  }
+
+  TrendFit fit = estimator.fit();
+  double steps = (double)config.horizonMs / TREND_BUCKET_MS;
+  double now = fit.level;
+  double nowBand = config.confidence * fit.forecastError(0.0);
+  double ahead = fit.forecast(steps);
+  double aheadBand = config.confidence * fit.forecastError(steps);
+  double min = historyValue(threshold.min);
+  double max = historyValue(threshold.max);
+
+  if (now - nowBand >= min && now + nowBand <= max &&
+      ahead - aheadBand >= min && ahead + aheadBand <= max)
+    _verdict = TREND_INSIDE;
+  else if (ahead + aheadBand < min || ahead - aheadBand > max)
+    _verdict = TREND_OUTSIDE;
+  else
+    _verdict = TREND_UNSURE;
+  return true;
+}
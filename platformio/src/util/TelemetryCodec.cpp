@@ -0,0 +1,204 @@
+/**
+ * @file TelemetryCodec.cpp
+ * @brief Encoding and decoding of binary telemetry frames.
+ *
+ * This file has no ESP-IDF dependencies so the host decoder links it as-is.
+ */
+
+#include "TelemetryCodec.h"
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+ *
+ * Pass the result of a previous call as `crc` to continue over a second,
+ * non-contiguous buffer.
+ */
+
+uint16_t telemetryCrc16(const uint8_t *data, size_t length, uint16_t crc) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                           : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+/**
+ * @brief COBS-encodes a buffer.
+ *
+ * @param in Bytes to encode.
+ * @param length Number of bytes, at most 254 so one overhead byte suffices.
+ * @param out Output buffer of at least `length + 1` bytes.
+ * @return Encoded length; the output contains no zero bytes.
+ */
+
+size_t cobsEncode(const uint8_t *in, size_t length, uint8_t *out) {
+  size_t codeIndex = 0;
+  size_t outIndex = 1;
+  uint8_t code = 1;
+
+  for (size_t i = 0; i < length; i++) {
+    if (in[i] == 0) {
+      out[codeIndex] = code;
+      codeIndex = outIndex++;
+      code = 1;
+    } else {
+      out[outIndex++] = in[i];
+      code++;
+    }
+  }
+  out[codeIndex] = code;
+  return outIndex;
+}
+
+/**
+ * @brief Decodes a COBS buffer (without its 0x00 delimiter).
+ *
+ * @return Decoded length, or 0 if the input is malformed.
+ */
+
+size_t cobsDecode(const uint8_t *in, size_t length, uint8_t *out) {
+  size_t inIndex = 0;
+  size_t outIndex = 0;
+
+  while (inIndex < length) {
+    uint8_t code = in[inIndex++];
+    if (code == 0 || inIndex + code - 1 > length)
+      return 0;
+    for (uint8_t i = 1; i < code; i++)
+      out[outIndex++] = in[inIndex++];
+    if (code != 0xFF && inIndex < length)
+      out[outIndex++] = 0;
+  }
+  return outIndex;
+}
+
+static void putU16(uint8_t *&p, uint16_t value) {
+  *p++ = (uint8_t)value;
+  *p++ = (uint8_t)(value >> 8);
+}
+
+static void putU32(uint8_t *&p, uint32_t value) {
+  putU16(p, (uint16_t)value);
+  putU16(p, (uint16_t)(value >> 16));
+}
+
+static uint16_t getU16(const uint8_t *&p) {
+  uint16_t value = (uint16_t)(p[0] | (p[1] << 8));
+  p += 2;
+  return value;
+}
+
+static uint32_t getU32(const uint8_t *&p) {
+  uint32_t low = getU16(p);
+  return low | ((uint32_t)getU16(p) << 16);
+}
+
+/**
+ * @brief Encodes a record into a complete frame, delimiters included.
+ *
+ * @param record The record to encode.
+ * @param frame Output buffer of at least TELEMETRY_MAX_FRAME bytes.
+ * @return Frame length in bytes, 0 for an unknown record type.
+ */
+
+size_t encodeTelemetry(const TelemetryRecord &record, uint8_t *frame) {
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD + 2];
+  uint8_t *p = payload;
+
+  *p++ = record.type;
+  *p++ = record.seq;
+  putU32(p, record.millis);
+
+  switch (record.type) {
+  case TELEMETRY_SAMPLE:
+    putU16(p, record.sample.raw);
+    break;
+  case TELEMETRY_SPAN:
+    *p++ = record.span.kind;
+    putU32(p, record.span.durationMillis);
+    break;
+  case TELEMETRY_RELAY:
+    *p++ = record.relay.pin;
+    *p++ = record.relay.level;
+    break;
+  case TELEMETRY_COUNTERS:
+    putU32(p, record.counters.frames);
+    putU32(p, record.counters.uartDroppedBytes);
+    putU32(p, record.counters.adcDroppedSamples);
+    putU32(p, record.counters.storageStores);
+    putU32(p, record.counters.storageCommits);
+    break;
+  default:
+    return 0;
+  }
+
+  putU16(p, telemetryCrc16(payload, p - payload));
+  frame[0] = 0;
+  size_t length = 1 + cobsEncode(payload, p - payload, frame + 1);
+  frame[length++] = 0;
+  return length;
+}
+
+/**
+ * @brief Decodes one frame.
+ *
+ * @param frame COBS bytes of one frame, without the 0x00 delimiters.
+ * @param length Number of bytes in `frame`.
+ * @param record [out] The decoded record.
+ * @return `false` on a COBS, CRC, length or type error.
+ */
+
+bool decodeTelemetry(const uint8_t *frame, size_t length,
+                     TelemetryRecord &record) {
+  uint8_t payload[TELEMETRY_MAX_FRAME];
+  if (length > sizeof(payload))
+    return false;
+
+  size_t size = cobsDecode(frame, length, payload);
+  if (size < 8)
+    return false;
+
+  size -= 2;
+  const uint8_t *crc = payload + size;
+  if (getU16(crc) != telemetryCrc16(payload, size))
+    return false;
+
+  const uint8_t *p = payload;
+  record.type = (TelemetryRecordType)*p++;
+  record.seq = *p++;
+  record.millis = getU32(p);
+  size -= 6;
+
+  switch (record.type) {
+  case TELEMETRY_SAMPLE:
+    if (size != 2)
+      return false;
+    record.sample.raw = getU16(p);
+    return true;
+  case TELEMETRY_SPAN:
+    if (size != 5)
+      return false;
+    record.span.kind = *p++;
+    record.span.durationMillis = getU32(p);
+    return true;
+  case TELEMETRY_RELAY:
+    if (size != 2)
+      return false;
+    record.relay.pin = *p++;
+    record.relay.level = *p++;
+    return true;
+  case TELEMETRY_COUNTERS:
+    if (size != 20)
+      return false;
+    record.counters.frames = getU32(p);
+    record.counters.uartDroppedBytes = getU32(p);
+    record.counters.adcDroppedSamples = getU32(p);
+    record.counters.storageStores = getU32(p);
+    record.counters.storageCommits = getU32(p);
+    return true;
+  default:
+    return false;
+  }
+}
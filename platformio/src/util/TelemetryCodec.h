@@ -0,0 +1,82 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary telemetry wire format, shared by the firmware and the host decoder.
+ *
+ * A record is encoded as a payload of little-endian fields:
+ *
+ *   [type:u8][seq:u8][millis:u32][record fields...]
+ *
+ * followed by a CRC-16/CCITT-FALSE of the payload (little-endian). Payload
+ * and CRC are COBS-encoded and framed by 0x00 on both sides, so a reader can
+ * resynchronize on the next zero after any corruption, and text written to
+ * the same port between frames never merges into a frame.
+ */
+
+#define TELEMETRY_MAX_PAYLOAD 32
+#define TELEMETRY_MAX_FRAME (1 + TELEMETRY_MAX_PAYLOAD + 2 + 2 + 1)
+
+enum TelemetryRecordType : uint8_t {
+  TELEMETRY_SAMPLE = 0x01,
+  TELEMETRY_SPAN = 0x02,
+  TELEMETRY_RELAY = 0x03,
+  TELEMETRY_COUNTERS = 0x04,
+};
+
+enum TelemetrySpanKind : uint8_t {
+  TELEMETRY_SPAN_ABOVE_MAX = 0,
+  TELEMETRY_SPAN_BELOW_MIN = 1,
+  TELEMETRY_SPAN_WITHIN = 2,
+};
+
+// One filtered ADC sample
+struct TelemetrySample {
+  uint16_t raw;
+};
+
+// A threshold span that just ended
+struct TelemetrySpan {
+  uint8_t kind;
+  uint32_t durationMillis;
+};
+
+// A relay output that was driven
+struct TelemetryRelay {
+  uint8_t pin;
+  uint8_t level;
+};
+
+// Periodic health counters
+struct TelemetryCounters {
+  uint32_t frames;
+  uint32_t uartDroppedBytes;
+  uint32_t adcDroppedSamples;
+  uint32_t storageStores;
+  uint32_t storageCommits;
+};
+
+struct TelemetryRecord {
+  TelemetryRecordType type;
+  uint8_t seq;
+  uint32_t millis;
+  union {
+    TelemetrySample sample;
+    TelemetrySpan span;
+    TelemetryRelay relay;
+    TelemetryCounters counters;
+  };
+};
+
+uint16_t telemetryCrc16(const uint8_t *data, size_t length,
+                        uint16_t crc = 0xFFFF);
+size_t cobsEncode(const uint8_t *in, size_t length, uint8_t *out);
+size_t cobsDecode(const uint8_t *in, size_t length, uint8_t *out);
+
+size_t encodeTelemetry(const TelemetryRecord &record, uint8_t *frame);
+bool decodeTelemetry(const uint8_t *frame, size_t length,
+                     TelemetryRecord &record);
+
+#endif
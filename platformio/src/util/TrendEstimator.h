@@ -0,0 +1,114 @@
+#ifndef TREND_ESTIMATOR_H
+#define TREND_ESTIMATOR_H
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Least-squares line through the points of a TrendEstimator window.
+ *
+ * `x` counts points, 0 for the oldest in the window. `level` is the fitted
+ * value at the newest point and `slope` the change per point; `sigma` is the
+ * standard deviation of the residuals.
+ */
+struct TrendFit {
+  size_t points;
+  double level;
+  double slope;
+  double sigma;
+  double xMean;
+  double xSpread; // sum of (x - xMean)^2
+
+  /**
+   * @brief The fitted value `steps` points after the newest one.
+   */
+  double forecast(double steps) const { return level + slope * steps; }
+
+  /**
+   * @brief Standard error of one observation `steps` points after the newest
+   * one: residual noise plus the uncertainty of the fitted line there.
+   */
+  double forecastError(double steps) const {
+    double dx = (double)(points - 1) + steps - xMean;
+    return sigma * sqrt(1.0 + 1.0 / points + dx * dx / xSpread);
+  }
+};
+
+/**
+ * @class TrendEstimator
+ * @brief Sliding-window least-squares level and slope, O(1) per point.
+ *
+ * Keeps the last N points and the running sums Σy, Σxy and Σy² over them.
+ * When the window slides, every remaining point's x drops by one, which
+ * takes Σy off Σxy; so a push costs a few integer operations whatever N is,
+ * and the line is only solved when `fit()` is called. Points are integers
+ * (SolarHistory tenths), which keeps the sums exact: they never drift
+ * however long the estimator runs.
+ *
+ * @tparam N Window length in points.
+ */
+
+template <size_t N> class TrendEstimator {
+  static_assert(N >= 3, "a trend needs at least 3 points");
+
+private:
+  int32_t window[N];
+  size_t oldest = 0;
+  size_t count = 0;
+  int64_t sumY = 0;
+  int64_t sumXY = 0;
+  int64_t sumYY = 0;
+
+public:
+  void reset() {
+    oldest = 0;
+    count = 0;
+    sumY = sumXY = sumYY = 0;
+  }
+
+  /**
+   * @brief Adds the newest point, dropping the oldest once the window is
+   * full.
+   */
+  void push(int32_t y) {
+    if (count < N) {
+      window[(oldest + count) % N] = y;
+      sumXY += (int64_t)count * y;
+      count++;
+    } else {
+      int32_t dropped = window[oldest];
+      window[oldest] = y;
+      oldest = (oldest + 1) % N;
+      sumXY += (int64_t)(N - 1) * y - (sumY - dropped);
+      sumY -= dropped;
+      sumYY -= (int64_t)dropped * dropped;
+    }
+    sumY += y;
+    sumYY += (int64_t)y * y;
+  }
+
+  size_t size() const { return count; }
+  static constexpr size_t capacity() { return N; }
+
+  /**
+   * @brief Solves the line through the window. Needs at least 3 points.
+   */
+  TrendFit fit() const {
+    double n = (double)count;
+    double xMean = (n - 1.0) / 2.0;
+    double xSpread = n * (n * n - 1.0) / 12.0;
+    double yMean = sumY / n;
+    double xyCentred = sumXY - xMean * sumY;
+    double slope = xyCentred / xSpread;
+
+    double yyCentred = sumYY - yMean * sumY;
+    double residual = yyCentred - slope * xyCentred;
+    double sigma = count > 2 && residual > 0.0 ? sqrt(residual / (n - 2.0))
+                                               : 0.0;
+
+    return {count, yMean + slope * (n - 1.0 - xMean), slope, sigma, xMean,
+            xSpread};
+  }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef TX_RING_H
+#define TX_RING_H
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @class TxRing
+ * @brief Lock-free single-producer/single-consumer byte ring.
+ *
+ * Writers append whole fragments in O(1) (one or two memcpys); the reader
+ * takes contiguous spans with `peek()` and releases them with `consume()` so
+ * it can hand them straight to a driver without another copy. A fragment that
+ * does not fit is rejected as a whole, never split.
+ *
+ * @tparam Capacity Size in bytes, must be a power of two.
+ */
+
+template <size_t Capacity> class TxRing {
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                "TxRing capacity must be a power of two");
+
+private:
+  uint8_t buffer[Capacity];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+
+public:
+  /**
+   * @brief Appends a fragment. Producer side only.
+   *
+   * @return `false` if there was not room for all `length` bytes.
+   */
+  bool write(const void *data, size_t length) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (Capacity - (h - tail.load(std::memory_order_acquire)) < length)
+      return false;
+
+    size_t offset = h & (Capacity - 1);
+    size_t first = Capacity - offset < length ? Capacity - offset : length;
+    memcpy(buffer + offset, data, first);
+    memcpy(buffer, (const uint8_t *)data + first, length - first);
+    head.store(h + length, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Returns the longest contiguous readable span. Consumer side only.
+   *
+   * @param data [out] Start of the span.
+   * @return Number of readable bytes at `data`, 0 if the ring is empty.
+   */
+  size_t peek(const uint8_t *&data) const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - t;
+    size_t offset = t & (Capacity - 1);
+    data = buffer + offset;
+    return Capacity - offset < available ? Capacity - offset : available;
+  }
+
+  /**
+   * @brief Releases bytes returned by `peek()`. Consumer side only.
+   */
+  void consume(size_t length) {
+    tail.store(tail.load(std::memory_order_relaxed) + length,
+               std::memory_order_release);
+  }
+
+  size_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  size_t freeSpace() const { return Capacity - size(); }
+};
+
+#endif
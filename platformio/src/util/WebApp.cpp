@@ -0,0 +1,313 @@
+/**
+ * @file WebApp.cpp
+ * @brief Dashboard assets and JSON API, independent of the HTTP transport.
+ */
+
+#include "WebApp.h"
+#include "main.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WEB_JSON_SIZE 96
+#define WEB_FILE_PATH_SIZE (WEB_ROOT_SIZE + WEB_FILE_SIZE + 1)
+
+/**
+ * @brief Reason phrase for the status codes WebApp produces.
+ */
+
+const char *httpReason(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 406:
+    return "Not Acceptable";
+  case 501:
+    return "Not Implemented";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Internal Server Error";
+  }
+}
+
+/**
+ * @brief Sends a complete response with a small in-memory body.
+ */
+
+void HttpResponse::send(int status, const char *contentType,
+                        const char *body) {
+  begin(status, contentType);
+  chunk(body, strlen(body));
+  finish();
+}
+
+/**
+ * @brief Loads the asset manifest and attaches the controller the API acts
+ * on.
+ *
+ * @param assetRoot Directory holding the compressed assets and the manifest,
+ * e.g. the SPIFFS mount point.
+ * @return `true` if at least one asset is listed. The API works either way.
+ */
+
+bool WebApp::begin(const char *assetRoot, SwitchControl &switchController) {
+  controller = &switchController;
+  snprintf(root, sizeof(root), "%s", assetRoot);
+
+  char path[WEB_FILE_PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/%s", root, WEB_MANIFEST_NAME);
+  FILE *manifest = fopen(path, "r");
+  if (manifest == nullptr)
+    return false;
+
+  char etag[WEB_ETAG_SIZE - 2];
+  assetCount = 0;
+  while (assetCount < WEB_MAX_ASSETS) {
+    WebAsset &asset = assets[assetCount];
+    if (fscanf(manifest, "%31s %31s %21s %31s", asset.path, asset.file, etag,
+               asset.contentType) != 4)
+      break;
+    snprintf(asset.etag, sizeof(asset.etag), "\"%s\"", etag);
+    assetCount++;
+  }
+
+  fclose(manifest);
+  return assetCount != 0;
+}
+
+/**
+ * @brief Routes one request.
+ */
+
+void WebApp::handle(const HttpRequest &request, HttpResponse &response) {
+  if (strcmp(request.path, "/api/config") == 0) {
+    if (request.method == HTTP_METHOD_GET)
+      serveConfig(response);
+    else if (request.method == HTTP_METHOD_POST ||
+             request.method == HTTP_METHOD_PUT)
+      updateConfig(request, response);
+    else
+      response.send(405, "application/json",
+                    "{\"error\":\"method not allowed\"}\n");
+    return;
+  }
+
+  if (strcmp(request.path, "/api/live") == 0) {
+    serveLive(request, response);
+    return;
+  }
+
+  if (strncmp(request.path, "/api/", 5) == 0) {
+    response.send(404, "application/json", "{\"error\":\"not found\"}\n");
+    return;
+  }
+
+  serveAsset(request, response);
+}
+
+const WebAsset *WebApp::findAsset(const char *path) const {
+  if (strcmp(path, "/") == 0)
+    path = "/index.html";
+
+  for (size_t i = 0; i < assetCount; i++) {
+    if (strcmp(assets[i].path, path) == 0)
+      return &assets[i];
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Streams a compressed asset, or answers 304 if the client's copy is
+ * current.
+ */
+
+void WebApp::serveAsset(const HttpRequest &request, HttpResponse &response) {
+  const WebAsset *asset = findAsset(request.path);
+  if (asset == nullptr) {
+    response.send(404, "text/plain", "Not found\n");
+    return;
+  }
+
+  if (request.method != HTTP_METHOD_GET && request.method != HTTP_METHOD_HEAD) {
+    response.send(405, "text/plain", "Method not allowed\n");
+    return;
+  }
+
+  if (request.ifNoneMatch != nullptr &&
+      (strstr(request.ifNoneMatch, asset->etag) != nullptr ||
+       strcmp(request.ifNoneMatch, "*") == 0)) {
+    response.begin(304, nullptr);
+    response.header("ETag", asset->etag);
+    response.header("Cache-Control", "no-cache");
+    response.finish();
+    return;
+  }
+
+  // Only the gzipped copy is stored
+  if (!request.acceptsGzip) {
+    response.send(406, "text/plain", "gzip encoding required\n");
+    return;
+  }
+
+  char path[WEB_FILE_PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/%s", root, asset->file);
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    response.send(500, "text/plain", "Asset missing\n");
+    return;
+  }
+
+  response.begin(200, asset->contentType);
+  response.header("Content-Encoding", "gzip");
+  response.header("ETag", asset->etag);
+  response.header("Cache-Control", "no-cache");
+  response.header("Vary", "Accept-Encoding");
+
+  if (request.method == HTTP_METHOD_GET) {
+    char buffer[WEB_CHUNK_SIZE];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+      if (!response.chunk(buffer, length))
+        break;
+    }
+  }
+
+  fclose(file);
+  response.finish();
+}
+
+void WebApp::serveConfig(HttpResponse &response) {
+  SolarThresholds threshold = controller->thresholds();
+  char json[WEB_JSON_SIZE];
+  snprintf(json, sizeof(json),
+           "{\"max\":%.2f,\"min\":%.2f,\"interval\":%u,\"window\":%lu}\n",
+           toDouble(threshold.max), toDouble(threshold.min),
+           (unsigned)controller->interval(),
+           (unsigned long)liveStream.window());
+  response.send(200, "application/json", json);
+}
+
+/**
+ * @brief Finds `"key": <number>` in a flat JSON object.
+ */
+
+static bool jsonNumber(const char *body, const char *key, double &value) {
+  char quoted[WEB_PATH_SIZE];
+  snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+  const char *at = strstr(body, quoted);
+  if (at == nullptr)
+    return false;
+
+  at += strlen(quoted);
+  while (*at == ' ' || *at == '\t' || *at == '\r' || *at == '\n')
+    at++;
+  if (*at++ != ':')
+    return false;
+
+  char *end;
+  value = strtod(at, &end);
+  return end != at;
+}
+
+/**
+ * @brief Applies the fields present in the body; absent ones keep their
+ * value. Every field is checked before any is applied, so a rejected
+ * request changes nothing.
+ */
+
+void WebApp::updateConfig(const HttpRequest &request, HttpResponse &response) {
+  SolarThresholds current = controller->thresholds();
+  double max = toDouble(current.max), min = toDouble(current.min), interval,
+         window;
+
+  bool hasMax = jsonNumber(request.body, "max", max);
+  bool hasMin = jsonNumber(request.body, "min", min);
+  bool hasInterval = jsonNumber(request.body, "interval", interval);
+  bool hasWindow = jsonNumber(request.body, "window", window);
+
+  if (!hasMax && !hasMin && !hasInterval && !hasWindow) {
+    response.send(400, "application/json",
+                  "{\"error\":\"expected max, min, interval or window\"}\n");
+    return;
+  }
+
+  if ((hasMax || hasMin) && !controller->acceptsThresholds(max, min)) {
+    response.send(400, "application/json",
+                  "{\"error\":\"thresholds out of range\"}\n");
+    return;
+  }
+
+  // Negated so that NaN fails too; the casts below need a value in range
+  unsigned short minInterval = controller->minInterval(),
+                 maxInterval = controller->maxInterval();
+  if (hasInterval && (!(interval >= minInterval && interval <= maxInterval) ||
+                      interval != (unsigned short)interval)) {
+    char json[WEB_JSON_SIZE];
+    snprintf(json, sizeof(json),
+             "{\"error\":\"interval must be %u-%u minutes\"}\n",
+             (unsigned)minInterval, (unsigned)maxInterval);
+    response.send(400, "application/json", json);
+    return;
+  }
+
+  if (hasWindow &&
+      (!(window >= LIVE_MIN_WINDOW_MS && window <= LIVE_MAX_WINDOW_MS) ||
+       window != (uint32_t)window)) {
+    char json[WEB_JSON_SIZE];
+    snprintf(json, sizeof(json),
+             "{\"error\":\"window must be %u-%u ms\"}\n",
+             (unsigned)LIVE_MIN_WINDOW_MS, (unsigned)LIVE_MAX_WINDOW_MS);
+    response.send(400, "application/json", json);
+    return;
+  }
+
+  bool applied = true;
+  if (hasMax || hasMin)
+    applied = controller->setSolarThresholds(max, min) && applied;
+  if (hasInterval)
+    applied = controller->setInterval((unsigned short)interval) && applied;
+  if (hasWindow)
+    applied = liveStream.setWindow((uint32_t)window) && applied;
+  if (!applied) {
+    response.send(500, "application/json",
+                  "{\"error\":\"configuration not applied\"}\n");
+    return;
+  }
+
+  serveConfig(response);
+}
+
+/**
+ * @brief Attaches a live stream client and hands the connection to the
+ * transport.
+ */
+
+void WebApp::serveLive(const HttpRequest &request, HttpResponse &response) {
+  if (request.method != HTTP_METHOD_GET) {
+    response.send(405, "application/json",
+                  "{\"error\":\"method not allowed\"}\n");
+    return;
+  }
+
+  int client = liveStream.attach();
+  if (client < 0) {
+    response.send(503, "application/json",
+                  "{\"error\":\"too many live clients\"}\n");
+    return;
+  }
+
+  if (!response.stream(client)) {
+    liveStream.detach(client);
+    response.send(501, "application/json",
+                  "{\"error\":\"streaming not supported\"}\n");
+  }
+}
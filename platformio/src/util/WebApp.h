@@ -0,0 +1,129 @@
+#ifndef WEB_APP_H
+#define WEB_APP_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Platform-neutral HTTP request handling for the dashboard.
+ *
+ * A transport (web_esp.cpp over esp_http_server on target, host/
+ * HttpSocketServer.cpp over POSIX sockets on Linux) parses each request into
+ * an HttpRequest, hands it to WebApp::handle() and implements HttpResponse
+ * on its connection. WebApp itself never touches sockets.
+ */
+
+#define WEB_MAX_ASSETS 8
+#define WEB_PATH_SIZE 32
+#define WEB_FILE_SIZE 32
+#define WEB_ETAG_SIZE 24 // 16 hex digits, quoted
+#define WEB_TYPE_SIZE 32
+#define WEB_ROOT_SIZE 32
+#define WEB_CHUNK_SIZE 1024
+#define WEB_MAX_BODY 256
+#define WEB_MANIFEST_NAME "manifest"
+
+enum HttpMethod : uint8_t {
+  HTTP_METHOD_GET,
+  HTTP_METHOD_HEAD,
+  HTTP_METHOD_POST,
+  HTTP_METHOD_PUT,
+  HTTP_METHOD_OTHER
+};
+
+/**
+ * @brief One parsed request. Every string is null-terminated and owned by the
+ * transport for the duration of `WebApp::handle()`.
+ *
+ * `ifNoneMatch` is nullptr when the header is absent. `acceptsGzip` is true
+ * when Accept-Encoding is absent or lists gzip. `body` is truncated to
+ * WEB_MAX_BODY bytes.
+ */
+struct HttpRequest {
+  HttpMethod method;
+  const char *path;
+  const char *ifNoneMatch;
+  bool acceptsGzip;
+  const char *body;
+  size_t bodyLength;
+};
+
+/**
+ * @class HttpResponse
+ * @brief Response side of one request, implemented by the transport.
+ *
+ * Call `begin()` once, then `header()` any number of times, then `chunk()`
+ * any number of times, then `finish()`. Header names and values must stay
+ * valid until the first `chunk()` or `finish()`. Bodies are sent with chunked
+ * transfer encoding, so their length need not be known up front.
+ *
+ * Instead of all that, `stream()` answers with a `text/event-stream` head and
+ * hands the connection to the transport's sender, which forwards one
+ * LiveStream client's frames until either side closes. Transports that cannot
+ * keep a connection open return `false`.
+ */
+class HttpResponse {
+public:
+  virtual ~HttpResponse() {}
+  virtual void begin(int status, const char *contentType) = 0;
+  virtual void header(const char *name, const char *value) = 0;
+  virtual bool chunk(const char *data, size_t length) = 0;
+  virtual void finish() = 0;
+  virtual bool stream(int client) { return false; }
+
+  void send(int status, const char *contentType, const char *body);
+};
+
+const char *httpReason(int status);
+
+/**
+ * @brief A pre-compressed dashboard file, as listed in the manifest.
+ */
+struct WebAsset {
+  char path[WEB_PATH_SIZE];
+  char file[WEB_FILE_SIZE];
+  char etag[WEB_ETAG_SIZE];
+  char contentType[WEB_TYPE_SIZE];
+};
+
+class SwitchControl;
+
+/**
+ * @class WebApp
+ * @brief Serves the dashboard and the JSON API.
+ *
+ * Assets are gzipped at build time by tools/compress_assets.py, which also
+ * writes a manifest of `<path> <file> <etag> <content-type>` lines. Each asset
+ * is sent as stored, with Content-Encoding: gzip, its ETag and
+ * `Cache-Control: no-cache`, so browsers revalidate and get a 304 until the
+ * bundle changes. The body is streamed from the file in WEB_CHUNK_SIZE pieces,
+ * never loaded whole.
+ *
+ * API:
+ * - `GET /api/config` returns `{"max":..,"min":..,"interval":..}`.
+ * - `POST` or `PUT /api/config` with any of those fields sets them and
+ *   returns the resulting configuration, or 400 and no change if any value
+ *   is rejected. `window` is the live stream batching window in
+ *   milliseconds; it is not persisted.
+ * - `GET /api/live` is the Server-Sent Events stream (see LiveStream.h), or
+ *   503 when every client slot is taken.
+ */
+class WebApp {
+private:
+  char root[WEB_ROOT_SIZE] = "";
+  WebAsset assets[WEB_MAX_ASSETS];
+  size_t assetCount = 0;
+  SwitchControl *controller = nullptr;
+
+  const WebAsset *findAsset(const char *path) const;
+  void serveAsset(const HttpRequest &request, HttpResponse &response);
+  void serveConfig(HttpResponse &response);
+  void updateConfig(const HttpRequest &request, HttpResponse &response);
+  void serveLive(const HttpRequest &request, HttpResponse &response);
+
+public:
+  bool begin(const char *assetRoot, SwitchControl &controller);
+  void handle(const HttpRequest &request, HttpResponse &response);
+  size_t assetsLoaded() const { return assetCount; }
+};
+
+#endif
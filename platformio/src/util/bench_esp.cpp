@@ -0,0 +1,78 @@
+/**
+ * @file bench_esp.cpp
+ * @brief Firmware runner for the hot-path benchmarks.
+ *
+ * Built into every image but only reached from app_main() when SOLAR_BENCH is
+ * defined (`pio run -e bench -t upload -t monitor`). Each call is timed with
+ * the CPU cycle counter; the JSON report is printed on the console after the
+ * `send(double)` case's own output.
+ */
+
+#include "Benchmark.h"
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+#include "main.h"
+
+#define BENCH_ITERATIONS 4096
+#define BENCH_WARMUP_ITERATIONS 64
+#define BENCH_MAX_CASES 48
+
+static BenchStats stats;
+
+/**
+ * @brief Cycles taken by two back-to-back counter reads, subtracted from
+ * every measurement.
+ */
+
+static uint32_t timerOverhead() {
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < 32; i++) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    if (cycles < best)
+      best = cycles;
+  }
+  return best;
+}
+
+/**
+ * @brief Runs every BenchCase on the calling task and prints the report.
+ *
+ * Must run after `init_nvs()` and `uart0.beginAsync()`. Calls are not shielded
+ * from interrupts or other tasks; that noise is what p99 and max show.
+ */
+
+void runBenchmarks() {
+  benchSetup(uart0);
+
+  const uint32_t overhead = timerOverhead();
+  static BenchSummary results[BENCH_MAX_CASES];
+  size_t count =
+      benchCaseCount < BENCH_MAX_CASES ? benchCaseCount : BENCH_MAX_CASES;
+
+  for (size_t c = 0; c < count; c++) {
+    const BenchCase &bench = benchCases[c];
+    stats.reset();
+
+    for (uint32_t i = 0; i < BENCH_WARMUP_ITERATIONS + BENCH_ITERATIONS; i++) {
+      if (bench.prepare != nullptr)
+        bench.prepare(i);
+
+      uint32_t start = esp_cpu_get_cycle_count();
+      bench.call(i);
+      uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+      if (i >= BENCH_WARMUP_ITERATIONS)
+        stats.add(cycles > overhead ? cycles - overhead : 0);
+    }
+
+    results[c] = stats.summarize(bench.name, bench.bytes);
+    storageTick();
+  }
+
+  uart0.flush();
+  Serial.sendln();
+  benchWriteJson(Serial, "esp32", 1000.0 / (esp_clk_cpu_freq() / 1000000),
+                 results, count);
+  uart0.flush();
+}
@@ -0,0 +1,47 @@
+/**
+ * @file calibration.cpp
+ * @brief Boot-time ADC calibration of the solar index.
+ */
+
+#include "main.h"
+#include <memory>
+
+static VoltageTable solarVolts;
+
+/**
+ * @brief Loads or builds the ADC calibration table and attaches it to the
+ * solar index.
+ *
+ * @param index The index whose counts are converted through the table.
+ * @param dividerRatio Input volts per volt at the pin, see `dividerRatio()`.
+ * @return Where the table came from.
+ *
+ * The table comes from, in order: a valid ADC_CAL_KEY blob in NVS, either
+ * flashed at provisioning from adc_cal's output or stored on an earlier
+ * boot; the ADC backend's own characterisation, which is then stored so
+ * later boots skip it; or an ideal linear ADC, which is not stored. Tables
+ * that are not monotonic are rejected.
+ *
+ * Call after `init_nvs()` and before the runtime starts. The volts live in
+ * one static VoltageTable, so only one index can be calibrated.
+ */
+
+AdcCalSource calibrateSolarIndex(SolarIndex &index, double dividerRatio) {
+  std::unique_ptr<uint8_t[]> blob(new uint8_t[ADC_CAL_BLOB_SIZE]);
+  std::unique_ptr<AdcCalTable> table(new AdcCalTable);
+  size_t length = ADC_CAL_BLOB_SIZE;
+
+  if (!retrieveBlob(ADC_CAL_KEY, blob.get(), &length) ||
+      !table->decode(blob.get(), length) || !table->monotonic()) {
+    if (halAdc.characterize(*table) && table->monotonic()) {
+      table->encode(blob.get());
+      storeBlob(ADC_CAL_KEY, blob.get(), ADC_CAL_BLOB_SIZE);
+    } else {
+      table->linear();
+    }
+  }
+
+  solarVolts.build(*table, dividerRatio);
+  index.setVoltageTable(&solarVolts);
+  return table->source();
+}
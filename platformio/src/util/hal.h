@@ -0,0 +1,162 @@
+#ifndef HAL_H
+#define HAL_H
+#include "AdcCalibration.h"
+#include "SampleRing.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hardware abstraction layer.
+ *
+ * The controller core (SolarIndex, the monitors, SwitchController, the
+ * storage cache, telemetry and the solar log) reaches hardware only through
+ * the interfaces below. A backend provides one instance of each and binds it
+ * to the references at the end of this file: hal_esp.cpp on target,
+ * host/hal_linux.cpp for the Linux build.
+ */
+
+#define HAL_KV_KEY_SIZE 16 // including the terminator, as NVS
+
+// A GPIO number; the ESP-IDF backend casts it to gpio_num_t
+typedef int hal_pin_t;
+
+/**
+ * @brief Monotonic time since boot.
+ */
+class HalClock {
+public:
+  virtual ~HalClock() {}
+  virtual int64_t micros() = 0;
+};
+
+/**
+ * @brief Source of raw 12-bit solar sensor readings.
+ *
+ * The backend pushes readings into the ring at its own rate; SolarIndex pops
+ * them. `characterize()` fills a calibration table from the chip's own
+ * calibration data, or returns `false` if there is none.
+ *
+ * `setOnDemand(true)` stops converting at the backend's rate, so that the
+ * chip may sleep; `convert()` then pushes `count` readings taken there and
+ * then and returns how many it pushed. `setOnDemand()` returns whether the
+ * backend is now in the requested mode; backends that cannot convert on
+ * demand stay continuous.
+ */
+class HalAdc {
+public:
+  virtual ~HalAdc() {}
+  virtual SolarSampleRing &samples() = 0;
+  virtual bool characterize(AdcCalTable &table) { return false; }
+  virtual bool setOnDemand(bool onDemand) { return !onDemand; }
+  virtual size_t convert(size_t count) { return 0; }
+};
+
+/**
+ * @brief Relay outputs.
+ *
+ * `configureOutput()` makes a pin an output whose level can be read back
+ * and `digitalWrite()` drives it; both return `false` if the driver refused.
+ * `digitalRead()` returns the level the pin is at, or -1 if it cannot be
+ * read. `analogRead()` returns the 12-bit reading of a pin, or -1 if the pin
+ * cannot be read. Each call may reach the hardware, so controllers keep the
+ * state they commanded in a RelayOutput instead of reading it back.
+ */
+class HalGpio {
+public:
+  virtual ~HalGpio() {}
+  virtual bool configureOutput(hal_pin_t pin) = 0;
+  virtual bool digitalWrite(hal_pin_t pin, int level) = 0;
+  virtual int digitalRead(hal_pin_t pin) = 0;
+  virtual int analogRead(hal_pin_t pin) = 0;
+};
+
+/**
+ * @brief Typed key-value store with explicit commits, modelled on one NVS
+ * namespace.
+ *
+ * `init()` prepares the underlying medium and `open()` the namespace; both
+ * may be retried. Sets are only guaranteed durable after `commit()`. For
+ * `getStr()` and `getBlob()`, `length` is the buffer size in and the stored
+ * size out.
+ */
+class HalKvStore {
+public:
+  virtual ~HalKvStore() {}
+  virtual bool init() = 0;
+  virtual bool open() = 0;
+  virtual bool setI32(const char *key, int32_t value) = 0;
+  virtual bool getI32(const char *key, int32_t *value) = 0;
+  virtual bool setStr(const char *key, const char *value) = 0;
+  virtual bool getStr(const char *key, char *value, size_t *length) = 0;
+  virtual bool setBlob(const char *key, const void *value, size_t length) = 0;
+  virtual bool getBlob(const char *key, void *value, size_t *length) = 0;
+  virtual bool erase(const char *key) = 0;
+  virtual bool commit() = 0;
+};
+
+/**
+ * @brief Raw flash region holding the solar log.
+ *
+ * `map()` returns the whole region readable in place, or nullptr if the
+ * region does not exist. Offsets passed to `erase()` must be sector-aligned;
+ * `write()` follows NOR semantics and can only clear bits.
+ */
+class HalFlash {
+public:
+  virtual ~HalFlash() {}
+  virtual const void *map() = 0;
+  virtual size_t size() = 0;
+  virtual bool erase(size_t offset, size_t length) = 0;
+  virtual bool write(size_t offset, const void *data, size_t length) = 0;
+};
+
+/**
+ * @brief Counters kept by an asynchronous serial port.
+ */
+struct UartTxStats {
+  uint32_t queuedBytes;
+  uint32_t droppedBytes;
+  uint32_t droppedWrites;
+  uint32_t highWater;
+};
+
+/**
+ * @class HalSerial
+ * @brief Byte-oriented serial port with text formatting helpers.
+ *
+ * Backends implement `write()`; the `send()` overloads format values into it.
+ * `flush()` blocks until everything written has left the port.
+ */
+class HalSerial {
+public:
+  virtual ~HalSerial() {}
+  virtual void write(const char *data, size_t length) = 0;
+  virtual UartTxStats txStats() const { return {}; }
+  virtual void flush() {}
+
+  void send(const char *message);
+  void send(float value);
+  void send(double value);
+  void send(int value);
+  void send(unsigned int value);
+  void send(unsigned long value);
+  void sendln();
+};
+
+extern HalClock &halClock;
+extern HalAdc &halAdc;
+extern HalGpio &halGpio;
+extern HalKvStore &halKv;
+extern HalFlash &halLogFlash;
+extern HalSerial &Serial;
+
+inline int64_t micros() { return halClock.micros(); }
+inline int64_t millis() { return halClock.micros() / 1000; }
+
+inline int analogRead(hal_pin_t pin) { return halGpio.analogRead(pin); }
+inline bool digitalWrite(hal_pin_t pin, int value) {
+  return halGpio.digitalWrite(pin, value);
+}
+inline int digitalRead(hal_pin_t pin) { return halGpio.digitalRead(pin); }
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file hal_esp.cpp
+ * @brief ESP-IDF backend of the hardware abstraction layer.
+ *
+ * Also defines the board's peripherals: UART0 as the serial port, the ADC1
+ * channel and divider of SolarSensorConfig as the solar sensor, and the
+ * "solarlog" partition.
+ */
+
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "main.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define SW_STORAGE "storage"
+
+class EspClock : public HalClock {
+public:
+  int64_t micros() override { return esp_timer_get_time(); }
+};
+
+/**
+ * @brief HalGpio over the GPIO driver, reading ADC1 pads through the oneshot
+ * unit of the solar sampler.
+ *
+ * The legacy ADC driver aborts the boot when linked with the oneshot and
+ * continuous drivers, so `analogRead()` goes through `AdcSampler::read()`,
+ * which returns -1 while the sampler converts continuously.
+ */
+class EspGpio : public HalGpio {
+public:
+  /**
+   * @brief Configures a relay pin as an output whose level can be read back.
+   */
+  bool configureOutput(hal_pin_t pin) override {
+    return gpio_reset_pin((gpio_num_t)pin) == ESP_OK &&
+           gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT) ==
+               ESP_OK;
+  }
+
+  bool digitalWrite(hal_pin_t pin, int level) override {
+    return gpio_set_level((gpio_num_t)pin, level) == ESP_OK;
+  }
+
+  int digitalRead(hal_pin_t pin) override {
+    if (!GPIO_IS_VALID_GPIO((gpio_num_t)pin))
+      return -1;
+    return gpio_get_level((gpio_num_t)pin);
+  }
+
+  int analogRead(hal_pin_t pin) override {
+    adc_unit_t unit;
+    adc_channel_t channel;
+    if (adc_oneshot_io_to_channel(pin, &unit, &channel) != ESP_OK ||
+        unit != ADC_UNIT_1)
+      return -1; // Not an ADC1 pad
+    return solarSampler.read(channel);
+  }
+};
+
+/**
+ * @brief HalKvStore over the "storage" NVS namespace.
+ */
+class NvsKvStore : public HalKvStore {
+private:
+  nvs_handle_t handle = 0;
+
+public:
+  bool init() override {
+    esp_err_t ret = nvs_flash_init();
+    // Partitioning and version conflicts are not handled
+    return ret != ESP_ERR_NVS_NO_FREE_PAGES &&
+           ret != ESP_ERR_NVS_NEW_VERSION_FOUND;
+  }
+
+  bool open() override {
+    return nvs_open(SW_STORAGE, NVS_READWRITE, &handle) == ESP_OK;
+  }
+
+  bool setI32(const char *key, int32_t value) override {
+    return nvs_set_i32(handle, key, value) == ESP_OK;
+  }
+
+  bool getI32(const char *key, int32_t *value) override {
+    return nvs_get_i32(handle, key, value) == ESP_OK;
+  }
+
+  bool setStr(const char *key, const char *value) override {
+    return nvs_set_str(handle, key, value) == ESP_OK;
+  }
+
+  bool getStr(const char *key, char *value, size_t *length) override {
+    return nvs_get_str(handle, key, value, length) == ESP_OK;
+  }
+
+  bool setBlob(const char *key, const void *value, size_t length) override {
+    return nvs_set_blob(handle, key, value, length) == ESP_OK;
+  }
+
+  bool getBlob(const char *key, void *value, size_t *length) override {
+    return nvs_get_blob(handle, key, value, length) == ESP_OK;
+  }
+
+  bool erase(const char *key) override {
+    return nvs_erase_key(handle, key) == ESP_OK;
+  }
+
+  bool commit() override { return nvs_commit(handle) == ESP_OK; }
+};
+
+/**
+ * @brief HalFlash over a data partition, mapped on first use.
+ */
+class PartitionFlash : public HalFlash {
+private:
+  const char *_label;
+  uint8_t _subtype;
+  const esp_partition_t *partition = nullptr;
+  esp_partition_mmap_handle_t mapping = 0;
+  const void *mapped = nullptr;
+
+public:
+  PartitionFlash(const char *label, uint8_t subtype)
+      : _label(label), _subtype(subtype) {}
+
+  const void *map() override {
+    if (mapped != nullptr)
+      return mapped;
+
+    partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)_subtype, _label);
+    if (partition == nullptr ||
+        esp_partition_mmap(partition, 0, partition->size,
+                           ESP_PARTITION_MMAP_DATA, &mapped,
+                           &mapping) != ESP_OK)
+      mapped = nullptr;
+    return mapped;
+  }
+
+  size_t size() override { return partition ? partition->size : 0; }
+
+  bool erase(size_t offset, size_t length) override {
+    return esp_partition_erase_range(partition, offset, length) == ESP_OK;
+  }
+
+  bool write(size_t offset, const void *data, size_t length) override {
+    return esp_partition_write(partition, offset, data, length) == ESP_OK;
+  }
+};
+
+static EspClock espClock;
+static EspGpio espGpio;
+static NvsKvStore nvsStore;
+static PartitionFlash logPartition(SOLAR_LOG_PARTITION,
+                                   SOLAR_LOG_PARTITION_SUBTYPE);
+UartHandler uart0(UART_NUM_0, 115200);
+AdcSampler solarSampler((adc_channel_t)SolarSensorConfig::adcChannel);
+
+HalClock &halClock = espClock;
+HalAdc &halAdc = solarSampler;
+HalGpio &halGpio = espGpio;
+HalKvStore &halKv = nvsStore;
+HalFlash &halLogFlash = logPartition;
+HalSerial &Serial = uart0;
+
+// Defined after the backends so they are constructed first
+SolarIndex solar("SolarRead", solarSampler.samples(),
+                 dividerVoltsPerCount(SolarSensorConfig::r1,
+                                      SolarSensorConfig::r2));
@@ -1,62 +1,321 @@
 #ifndef MAIN_H
 #define MAIN_H
-#include "driver/adc.h"
+#ifdef ESP_PLATFORM
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_oneshot.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#endif
+#include "AdcCalibration.h"
+#include "BootProfile.h"
+#include "FixedPoint.h"
+#include "Instrument.h"
+#include "LiveStream.h"
+#include "RelayOutput.h"
+#include "SampleFilter.h"
+#include "SampleRing.h"
+#include "SolarHistory.h"
+#include "SolarLogCodec.h"
+#include "SpscQueue.h"
+#include "TelemetryCodec.h"
+#include "TrendEstimator.h"
+#include "TxRing.h"
+#include "WebApp.h"
+#include "hal.h"
+#include <atomic>
+#include <mutex>
 #include <string.h>
+#include <type_traits>
 
 #define MAX_VOLTAGE_ADDRESS 0
 #define SOLAR_THRESHOLDS_ADDRESS 8
 #define SOLAR_INDEX_MAX_VALUE 1000.0
-#define PIN_HIGH_THRESHOLD 2000
+#define MINUTES_TO_MILLIS 60000
+#define SWITCH_SLOT_KEY_SIZE 8
+#define SWITCH_MIN_INTERVAL_MINUTES 1
+#define SWITCH_MAX_INTERVAL_MINUTES 60
+#define ADC_SAMPLE_RATE_HZ 1000
+#define UART_TX_RING_SIZE 2048
+#define UART_TX_DRIVER_BUFFER 512
+#define TELEMETRY_COUNTERS_PERIOD_MS 10000
+#define RUNTIME_MAX_CONTROLLERS 4
+#define RUNTIME_SAMPLE_QUEUE_LENGTH 8 // a power of two
+#define SOLAR_READ_BLOCK 32 // raw samples popped per batch by SolarIndex
+
+// Write-back cache in front of NVS (see storage.cpp)
+#define STORAGE_CACHE_ENTRIES 8
+#define STORAGE_CACHE_VALUE_SIZE 32
+#define STORAGE_DIRTY_THRESHOLD 4
+#define STORAGE_FLUSH_INTERVAL_MS 60000
+
+// Append-only sample log on the "solarlog" data partition (see SolarLog.cpp)
+#define SOLAR_LOG_PARTITION "solarlog"
+#define SOLAR_LOG_PARTITION_SUBTYPE 0x40
+#define SOLAR_LOG_SAMPLE_PERIOD_MS 1000
+#define SOLAR_LOG_SEAL_INTERVAL_MS (30 * MINUTES_TO_MILLIS)
 
-UartHandler Serial(UART_NUM_0, 115200);
+// Predictive switching (see SwitchPredictor.cpp): samples are averaged into
+// one regression point per TREND_BUCKET_MS and the trend is fitted over the
+// last TREND_WINDOW points.
+#define TREND_BUCKET_MS 1000
+#define TREND_WINDOW 120
+#define TREND_MIN_POINTS 30
 
-struct SolarThresholds {
-  double max;
-  double min;
+// Filter stages applied to raw samples before SolarIndex::read().
+// Set SOLAR_OVERSAMPLE or SOLAR_MEDIAN_WINDOW to 1, or SOLAR_EMA_SHIFT to 0,
+// to compile a stage out.
+#ifndef SOLAR_OVERSAMPLE
+#define SOLAR_OVERSAMPLE 4
+#endif
+#ifndef SOLAR_MEDIAN_WINDOW
+#define SOLAR_MEDIAN_WINDOW 5
+#endif
+#ifndef SOLAR_EMA_SHIFT
+#define SOLAR_EMA_SHIFT 4
+#endif
+
+// Adaptive sampling (see SampleScheduler.cpp). A reading taken on demand
+// converts a burst long enough for the EMA stage to settle to within 2%.
+#define ADAPTIVE_SMOOTHING 0.25
+#define ADAPTIVE_BURST_SAMPLES                                                 \
+  (SOLAR_OVERSAMPLE * (SOLAR_MEDIAN_WINDOW + (4 << SOLAR_EMA_SHIFT)))
+
+// Numeric representation of voltages, solar index values and thresholds.
+// Define SOLAR_FIXED_POINT to run the hot path in Q16.16 integer math.
+#ifdef SOLAR_FIXED_POINT
+typedef Q16_16 solar_num_t;
+#else
+typedef double solar_num_t;
+#endif
 
-  SolarThresholds(double max_value = SOLAR_INDEX_MAX_VALUE,
-                  double min_value = 0.0)
+/**
+ * @brief Converts a solar index value to the uint16 tenths kept by
+ * SolarHistory and SolarLog.
+ */
+inline uint16_t historyValue(double value) {
+  return (uint16_t)(value * SOLAR_HISTORY_SCALE + 0.5);
+}
+
+inline uint16_t historyValue(const Q16_16 &value) {
+  return (uint16_t)(((value * (int32_t)SOLAR_HISTORY_SCALE).raw() + 0x8000) >>
+                    16);
+}
+
+typedef FilterPipeline<Oversample<SOLAR_OVERSAMPLE>,
+                       MedianFilter<SOLAR_MEDIAN_WINDOW>,
+                       EmaFilter<SOLAR_EMA_SHIFT>>
+    SolarFilter;
+
+template <typename T> struct BasicSolarThresholds {
+  T max;
+  T min;
+
+  BasicSolarThresholds(T max_value = T(SOLAR_INDEX_MAX_VALUE),
+                       T min_value = T(0.0))
       : max(max_value), min(min_value) {}
 
-  bool operator==(const SolarThresholds &other) const {
+  bool operator==(const BasicSolarThresholds &other) const {
     return (max == other.max) && (min == other.min);
   }
 
-  bool operator!=(const SolarThresholds &other) const {
+  bool operator!=(const BasicSolarThresholds &other) const {
     return !(*this == other);
   }
 };
 
+typedef BasicSolarThresholds<solar_num_t> SolarThresholds;
+
+/**
+ * @brief One solar index reading, stamped when it was taken. Passed from
+ * the sampling context to the control context through a SolarReadingQueue.
+ */
+struct SolarReading {
+  solar_num_t solarIndex;
+  uint32_t millis;
+  int64_t takenMicros;
+};
+
+typedef SpscQueue<SolarReading, RUNTIME_SAMPLE_QUEUE_LENGTH> SolarReadingQueue;
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief What an asynchronous UartHandler does when its TX ring is full.
+ *
+ * UART_OVERFLOW_DROP discards the whole fragment and counts the bytes;
+ * UART_OVERFLOW_BLOCK waits, one tick at a time, for the TX task to make room.
+ */
+enum UartOverflowPolicy { UART_OVERFLOW_DROP, UART_OVERFLOW_BLOCK };
+
 /**
  * @class UartHandler
  * @brief A utility class for UART communication.
  *
- * The UartHandler class provides a simple interface for sending various data
- * types over UART in ESP-IDF applications. It allows you to send messages as
+ * The UartHandler class is the ESP-IDF serial backend. Through HalSerial it
+ * provides a simple interface for sending various data types over UART:
  * strings, float, double, int, unsigned int, and unsigned long.
+ *
+ * Nothing reaches the port before `begin()` installs the driver; from then
+ * on every `send()` writes to the driver directly. After
+ * `beginAsync()`, `send()` only appends to an in-memory ring and a
+ * low-priority task drains it to the driver, so callers never wait for the
+ * UART. `read()` returns whatever the driver has received, without waiting.
  */
 
-class UartHandler {
+class UartHandler : public HalSerial {
 private:
   uart_port_t uart_num_;
+  int baudRate;
+  bool installed = false;
+  TxRing<UART_TX_RING_SIZE> txRing;
+  TaskHandle_t txTask = nullptr;
+  UartOverflowPolicy overflowPolicy = UART_OVERFLOW_DROP;
+  portMUX_TYPE writeLock = portMUX_INITIALIZER_UNLOCKED;
+  std::atomic<uint32_t> queuedBytes{0};
+  std::atomic<uint32_t> droppedBytes{0};
+  std::atomic<uint32_t> droppedWrites{0};
+  std::atomic<uint32_t> highWater{0};
+
+  static void txTaskEntry(void *arg);
+  bool enqueue(const char *data, size_t length);
 
 public:
   UartHandler(uart_port_t uart_num, int baud_rate);
   ~UartHandler();
 
-  void send(const char *message);
-  void send(float value);
-  void send(double value);
-  void send(int value);
-  void send(unsigned int value);
-  void send(unsigned long value);
-  void sendln();
+  bool begin();
+  bool beginAsync(UartOverflowPolicy policy = UART_OVERFLOW_DROP,
+                  UBaseType_t priority = 1);
+  void flush() override;
+  UartTxStats txStats() const override;
+  void write(const char *data, size_t length) override;
+  size_t read(char *data, size_t length);
+};
+#endif
+
+/**
+ * @class Telemetry
+ * @brief Streams binary telemetry records over a serial port.
+ *
+ * The Telemetry class encodes samples, threshold spans, relay transitions and
+ * periodic counters as COBS-framed, CRC-checked records (see
+ * TelemetryCodec.h) and writes them through the HalSerial. It is silent
+ * until `begin()` is called. Use the host `telemetry_decode` tool to turn the
+ * stream back into CSV.
+ */
+
+class Telemetry {
+private:
+  HalSerial &_uart;
+  bool enabled = false;
+  std::atomic<uint8_t> seq{0};
+  std::atomic<uint32_t> frames{0};
+  int64_t lastCountersMillis = 0;
+
+  void emit(TelemetryRecord &record);
+
+public:
+  explicit Telemetry(HalSerial &uart);
+
+  void begin();
+  void sample(uint32_t timeMillis, uint16_t raw);
+  void span(TelemetrySpanKind kind, uint32_t timeMillis,
+            uint32_t durationMillis);
+  void relay(hal_pin_t pin, int level, uint32_t timeMillis);
+  void counters(uint32_t timeMillis);
+  void tick();
+};
+
+extern Telemetry telemetry;
+
+#ifdef ESP_PLATFORM
+/**
+ * @class AdcSampler
+ * @brief Runs the ADC in continuous (DMA) mode and feeds a sample ring.
+ *
+ * The AdcSampler class configures one ADC1 channel for continuous conversion
+ * and starts a small drain task that moves completed DMA frames into a
+ * SolarSampleRing at a fixed rate. Readers pop samples from the ring and never
+ * wait for a conversion. It is the ESP-IDF HalAdc backend, and owns the ADC1
+ * oneshot unit that conversion on demand and `analogRead()` share.
+ */
+
+class AdcSampler : public HalAdc {
+private:
+  adc_channel_t _channel;
+  uint32_t _sampleRateHz;
+  uint32_t decimation = 1;
+  uint32_t skipped = 0;
+  adc_continuous_handle_t handle = nullptr;
+  adc_oneshot_unit_handle_t oneshot = nullptr;
+  uint32_t oneshotChannels = 0; // bit n: channel n configured on `oneshot`
+  bool convertOnDemand = false;
+  TaskHandle_t drainTask = nullptr;
+  SolarSampleRing ring;
+
+  static bool onConversionDone(adc_continuous_handle_t handle,
+                               const adc_continuous_evt_data_t *edata,
+                               void *user_data);
+  static void drainTaskEntry(void *arg);
+  void drain();
+  bool claimOneshot(adc_channel_t channel);
+  void releaseOneshot();
+
+public:
+  AdcSampler(adc_channel_t channel,
+             uint32_t sampleRateHz = ADC_SAMPLE_RATE_HZ);
+  ~AdcSampler();
+
+  esp_err_t begin();
+  void end();
+  SolarSampleRing &samples() override;
+  bool characterize(AdcCalTable &table) override;
+  bool setOnDemand(bool onDemand) override;
+  size_t convert(size_t count) override;
+  int read(adc_channel_t channel);
 };
+#endif
+
+/**
+ * @brief Voltage at the input of an R1/R2 divider per volt across R2.
+ */
+constexpr double dividerRatio(double r1, double r2) { return (r1 + r2) / r2; }
+
+/**
+ * @brief Volts at the divider input per ADC count, for an ideal 3.3 V 12-bit
+ * ADC reading the R2 leg of an R1/R2 divider.
+ */
+constexpr double dividerVoltsPerCount(double r1, double r2) {
+  return (3.3 / 4095.0) * dividerRatio(r1, r2);
+}
+
+/**
+ * @brief Volts at the divider input for every ADC count.
+ *
+ * Built once from an AdcCalTable, so SolarIndex converts a sample with one
+ * lookup and no arithmetic. Takes ADC_CAL_COUNTS * sizeof(T) bytes: 32 KiB
+ * for `double`, 16 KiB for `Q16_16`.
+ *
+ * @tparam T Numeric representation, `double` or `Q16_16`.
+ */
+template <typename T> class BasicVoltageTable {
+private:
+  T volts[ADC_CAL_COUNTS];
+
+public:
+  void build(const AdcCalTable &table, double ratio) {
+    for (uint32_t raw = 0; raw < ADC_CAL_COUNTS; raw++)
+      volts[raw] = T(table.millivolts((uint16_t)raw) * ratio / 1000.0);
+  }
+
+  T operator[](uint16_t raw) const { return volts[raw & (ADC_CAL_COUNTS - 1)]; }
+};
+
+typedef BasicVoltageTable<solar_num_t> VoltageTable;
 
 /**
  * @class SolarIndex
@@ -65,26 +324,55 @@ public:
  * The SolarIndex class provides functionality to read the voltage output
  * of a solar index sensor, calculate the solar index value based on the
  * voltage readings, and store and retrieve the highest voltage value in
- * non-volatile storage.
+ * non-volatile storage. Until a calibrated voltage table is attached (see
+ * `calibrateSolarIndex()`), counts are converted as if the ADC were linear.
+ *
+ * @tparam T Numeric representation, `double` or `Q16_16`.
  */
 
-class SolarIndex {
+template <typename T> class BasicSolarIndex {
 private:
   const char *_key;
-  const adc1_channel_t _pin;
-  double R1;
-  double R2;
-  double highestVolt;
+  SolarSampleRing &_samples;
+  SolarFilter filter;
+  T voltsPerCount;
+  const BasicVoltageTable<T> *voltageTable = nullptr;
+  T highestVolt;
+  uint16_t lastRaw = 0;
+  bool loaded = false;
 
-  double readVoltage();
+  T readVoltage();
   void retrieveHighestVoltFromNVS();
 
 public:
-  SolarIndex(const char *key, adc1_channel_t pin, double r1 = 30000.0,
-             double r2 = 7500.0);
-  double read();
+  BasicSolarIndex(const char *key, SolarSampleRing &samples,
+                  double voltsPerCount = dividerVoltsPerCount(30000.0,
+                                                              7500.0));
+  void load();
+  void setVoltageTable(const BasicVoltageTable<T> *table);
+  T read();
 };
 
+typedef BasicSolarIndex<solar_num_t> SolarIndex;
+
+/**
+ * @brief Where the solar index lies relative to the thresholds, as tracked
+ * with hysteresis by SolarIndexMonitor.
+ */
+enum IndexZone {
+  INDEX_ZONE_UNKNOWN,
+  INDEX_ZONE_BELOW_MIN,
+  INDEX_ZONE_WITHIN,
+  INDEX_ZONE_ABOVE_MAX
+};
+
+/**
+ * @brief Called by SolarIndexMonitor when the index crosses into `zone`.
+ */
+typedef void (*IndexCrossingHandler)(IndexZone zone,
+                                     unsigned long currentMillis,
+                                     void *context);
+
 /**
  * @class SolarIndexMonitor
  * @brief Monitors and records solar index data and durations.
@@ -94,36 +382,274 @@ public:
  * as the duration within the thresholds. It provides methods to set thresholds,
  * update the solar index, retrieve accumulated durations, and debug recorded
  * data.
+ *
+ * @tparam T Numeric representation, `double` or `Q16_16`.
  */
 
-class SolarIndexMonitor {
+template <typename T> class BasicSolarIndexMonitor {
 private:
-  SolarThresholds _currentThreshold;
-  double currentSolarIndex = 0;
+  BasicSolarThresholds<T> _currentThreshold;
+  T currentSolarIndex = T(0);
   unsigned long startMillisAboveMax = 0;
   unsigned long startMillisBelowMin = 0;
   unsigned long startMillisWithinThresholds = 0;
-  double maxThresholdDuringExceed = 0;
-  double minThresholdDuringFall = 0;
+  T maxThresholdDuringExceed = T(0);
+  T minThresholdDuringFall = T(0);
   unsigned long accumulatedDurationAboveMax = 0;
   unsigned long accumulatedDurationBelowMin = 0;
   unsigned long accumulatedDurationWithinThresholds = 0;
+  SolarHistory *history = nullptr;
+  IndexZone zone = INDEX_ZONE_UNKNOWN;
+  T hysteresis = T(0);
+  IndexCrossingHandler onCrossing = nullptr;
+  void *crossingContext = nullptr;
 
 public:
   void resetTimer();
-  void setThresholds(const SolarThresholds &threshold);
-  void updateSolarIndex(double newValue);
+  void setHistory(SolarHistory *history);
+  void setThresholds(const BasicSolarThresholds<T> &threshold);
+  void setHysteresis(T band);
+  void setCrossingHandler(IndexCrossingHandler handler, void *context);
+  void resetZone();
+  IndexZone currentZone() const { return zone; }
+  bool withinThresholds() const;
+  void updateSolarIndex(T newValue);
+  void updateSolarIndex(T newValue, unsigned long currentMillis);
   void getAccumulatedDurations(unsigned long &durationAboveMax,
                                unsigned long &durationBelowMin);
   void getDurationWithinThreshold(unsigned long &durationWithinMax);
   void debugRecordedData();
 
 private:
-  bool isValidThreshold(const SolarThresholds &threshold);
+  bool isValidThreshold(const BasicSolarThresholds<T> &threshold);
   void handleThresholdExceed(bool isAboveMax, unsigned long currentMillis);
   void handleThresholdFall(bool isBelowMin, unsigned long currentMillis);
   void handleDurationWithinThreshold(bool isWithinThresholds,
                                      unsigned long currentMillis);
+  void trackZone(T newValue, unsigned long currentMillis);
+};
+
+typedef BasicSolarIndexMonitor<solar_num_t> SolarIndexMonitor;
+
+/**
+ * @brief How a switch controller decides.
+ *
+ * SWITCH_MODE_INTERVAL switches once per interval on how long the index
+ * stayed within the thresholds during the interval that just ended.
+ * SWITCH_MODE_PREDICTIVE also forecasts the index with a SwitchPredictor: it
+ * switches as soon as the forecast is confidently inside or outside the
+ * thresholds, and holds at the end of an interval when the forecast
+ * contradicts the interval's verdict. SWITCH_MODE_EVENT ignores the interval
+ * and switches on SolarIndexMonitor's crossing events, once the index has
+ * stayed on its new side of a threshold for the dwell time.
+ */
+enum SwitchMode {
+  SWITCH_MODE_INTERVAL,
+  SWITCH_MODE_PREDICTIVE,
+  SWITCH_MODE_EVENT
+};
+
+/**
+ * @brief A SwitchPredictor's reading of where the index is heading.
+ */
+enum TrendVerdict { TREND_UNSURE, TREND_INSIDE, TREND_OUTSIDE };
+
+/**
+ * @brief Tuning of predictive switching.
+ *
+ * `horizonMs` is how far ahead threshold crossings are forecast and
+ * `confidence` the half-width of the forecast band, in standard errors; a
+ * wider band switches ahead less often and holds less often.
+ */
+struct PredictiveConfig {
+  uint32_t horizonMs = MINUTES_TO_MILLIS;
+  double confidence = 2.0;
+};
+
+/**
+ * @class SwitchPredictor
+ * @brief Forecasts whether the solar index will stay within the thresholds.
+ *
+ * Averages the samples of each TREND_BUCKET_MS into one point of a
+ * TrendEstimator and, every time a point is added, fits a line through the
+ * last TREND_WINDOW points and projects it `horizonMs` ahead with a
+ * `confidence`-wide prediction band. The verdict is TREND_INSIDE when the
+ * band lies within the thresholds both now and at the horizon (so, the line
+ * being straight, all the way), TREND_OUTSIDE when the band lies wholly
+ * beyond a threshold at the horizon, and TREND_UNSURE otherwise or until
+ * TREND_MIN_POINTS points are in.
+ */
+class SwitchPredictor {
+private:
+  TrendEstimator<TREND_WINDOW> estimator;
+  PredictiveConfig config;
+  unsigned long bucketStart = 0;
+  int64_t bucketSum = 0;
+  uint32_t bucketCount = 0;
+  TrendVerdict _verdict = TREND_UNSURE;
+
+public:
+  void setConfig(const PredictiveConfig &newConfig) { config = newConfig; }
+  const PredictiveConfig &getConfig() const { return config; }
+  bool update(solar_num_t solarIndex, unsigned long currentMillis,
+              const SolarThresholds &threshold);
+  TrendVerdict verdict() const { return _verdict; }
+  void reset();
+};
+
+/**
+ * @brief Tuning of event-driven switching.
+ *
+ * A crossing only counts once the index is `hysteresis` index points past
+ * the threshold, and the relay follows it once every reading for `dwellMs`
+ * has been on the new side of the threshold.
+ */
+struct EventConfig {
+  uint32_t dwellMs = 2000;
+  double hysteresis = 10.0;
+};
+
+/**
+ * @class CrossingDebouncer
+ * @brief Turns SolarIndexMonitor crossing events into relay levels once they
+ * have lasted the dwell time.
+ *
+ * A reading back on the old side of the threshold restarts the dwell, and a
+ * crossing back cancels it, so noise around a threshold that gets past the
+ * hysteresis band still has to stay past the threshold for a whole dwell.
+ */
+class CrossingDebouncer {
+private:
+  uint32_t dwellMs = 0;
+  bool pending = false;
+  int pendingLevel = 0;
+  unsigned long pendingSince = 0;
+
+public:
+  void setDwell(uint32_t ms) { dwellMs = ms; }
+  void crossed(IndexZone zone, unsigned long currentMillis);
+  bool due(bool within, unsigned long currentMillis, int &level);
+  void cancel() { pending = false; }
+};
+
+/**
+ * @brief Bounds and sensitivity of adaptive sampling.
+ *
+ * The period stays within `minPeriodMs` and `maxPeriodMs`. It is as long as
+ * the index's trend allows without moving more than `resolution` index
+ * points between readings, and drops to `minPeriodMs` while the reading to
+ * reading noise exceeds `noiseLimit` points. From `onDemandPeriodMs` the ADC
+ * stops converting continuously, so the chip can light-sleep between
+ * readings; below it, continuous conversion at ADC_SAMPLE_RATE_HZ must fit
+ * ADC_SAMPLE_RING_SIZE samples per period.
+ */
+struct AdaptiveSamplingConfig {
+  uint32_t minPeriodMs = 100;
+  uint32_t maxPeriodMs = 2000;
+  uint32_t onDemandPeriodMs = 500;
+  double resolution = 2.0;
+  double noiseLimit = 3.0;
+};
+
+/**
+ * @class SampleScheduler
+ * @brief Chooses the period until the next solar index reading.
+ *
+ * Tracks the index's slope, in points per millisecond, and the variance of
+ * readings around it with exponential smoothing (ADAPTIVE_SMOOTHING per
+ * reading), from the readings' own timestamps, so the estimates hold at any
+ * rate. The period shortens at once when the index speeds up or gets noisy,
+ * and at most doubles per reading when it calms down.
+ */
+class SampleScheduler {
+private:
+  AdaptiveSamplingConfig config;
+  bool primed = false;
+  double lastValue = 0;
+  unsigned long lastMillis = 0;
+  double _slope = 0;
+  double variance = 0;
+  uint32_t _period;
+
+public:
+  explicit SampleScheduler(const AdaptiveSamplingConfig &config = {});
+  uint32_t next(solar_num_t solarIndex, unsigned long currentMillis);
+  uint32_t period() const { return _period; }
+  bool onDemand() const { return _period >= config.onDemandPeriodMs; }
+  double slope() const { return _slope; }
+  double noise() const;
+};
+
+void reportRelay(hal_pin_t pin, int level, unsigned long currentMillis);
+
+/**
+ * @brief Whether an ESP32 GPIO can drive a relay. GPIO 6-11 belong to the
+ * SPI flash and 34-39 are input only.
+ */
+constexpr bool switchOutputPin(hal_pin_t pin) {
+  return pin >= 0 && pin <= 33 && !(pin >= 6 && pin <= 11);
+}
+
+/**
+ * @brief The solar sensor of the reference board: ADC1 channel 0 behind a
+ * 30k/7.5k divider.
+ *
+ * Every controller reads the same SolarIndex; the firmware's AdcSampler and
+ * the index's calibration are built from these constants.
+ */
+struct SolarSensorConfig {
+  static constexpr int adcChannel = 0; // ADC1
+  static constexpr double r1 = 30000.0;
+  static constexpr double r2 = 7500.0;
+};
+static_assert(SolarSensorConfig::adcChannel >= 0 &&
+                  SolarSensorConfig::adcChannel <= 7,
+              "adcChannel must be an ADC1 channel (0-7)");
+static_assert(SolarSensorConfig::r1 >= 0.0 && SolarSensorConfig::r2 > 0.0,
+              "divider needs r1 >= 0 and r2 > 0");
+
+/**
+ * @brief Board description of one switch, for BasicSwitchController.
+ *
+ * The defaults describe the reference board: relay on GPIO 4, thresholds in
+ * slot "sw0". To describe another switch, derive from it and redeclare the
+ * members that differ.
+ */
+struct SwitchConfig {
+  static constexpr hal_pin_t relayPin = 4; // -1 drives no pin
+  static constexpr double thresholdFloor = 0.0;
+  static constexpr double thresholdCeiling = SOLAR_INDEX_MAX_VALUE;
+  static constexpr unsigned short slot = 0; // NVS key "sw<slot>"
+  static constexpr unsigned short minIntervalMinutes =
+      SWITCH_MIN_INTERVAL_MINUTES;
+  static constexpr unsigned short maxIntervalMinutes =
+      SWITCH_MAX_INTERVAL_MINUTES;
+  static constexpr unsigned short intervalMinutes = 5;
+  static constexpr SwitchMode mode = SWITCH_MODE_INTERVAL;
+  static constexpr uint32_t dwellMs = 2000;  // SWITCH_MODE_EVENT
+  static constexpr double hysteresis = 10.0; // index points
+  static constexpr bool relayReadback = false; // check each relay write
+};
+
+/**
+ * @brief What the Runtime and the web API need from a switch controller.
+ *
+ * Implemented by SwitchController, configured at run time, and by
+ * BasicSwitchController, configured at compile time.
+ */
+class SwitchControl {
+public:
+  virtual ~SwitchControl() {}
+  virtual bool setInterval(unsigned short durationInMinutes) = 0;
+  virtual unsigned short interval() = 0;
+  // Bounds `setInterval()` accepts, in minutes
+  virtual unsigned short minInterval() = 0;
+  virtual unsigned short maxInterval() = 0;
+  virtual SolarThresholds thresholds() = 0;
+  // Whether `setSolarThresholds(max, min)` would accept the pair
+  virtual bool acceptsThresholds(double max, double min) = 0;
+  virtual bool setSolarThresholds(double max, double min) = 0;
+  virtual void run(solar_num_t solarIndex, unsigned long currentMillis) = 0;
 };
 
 /**
@@ -133,31 +659,239 @@ private:
  * solar index sensor and controlling the switch based on predefined thresholds
  * and time intervals. It provides methods to set thresholds, intervals, run the
  * controller, and debug recorded data.
+ *
+ * Pin and bounds are run-time values and threshold slots are numbered in
+ * construction order. Where the board is known at build time, prefer
+ * BasicSwitchController (BasicSwitchController.h).
  */
 
-class SwitchController {
+class SwitchController : public SwitchControl {
 private:
   SolarThresholds threshold;
-  gpio_num_t _relaySignalPin;
-  const char *swThresholdAdrress;
+  RelayOutput relay;
+  char swThresholdAdrress[SWITCH_SLOT_KEY_SIZE];
   unsigned long previousMillis = 0;
   unsigned long intervalMinutes = 5;
   unsigned long intervalMillis = 0;
   SolarIndexMonitor indexMonitor;
+  SwitchMode _mode = SWITCH_MODE_INTERVAL;
+  SwitchPredictor predictor;
+  CrossingDebouncer debouncer;
+  std::mutex settingsLock;
+
+  void switchAhead(int level, unsigned long currentMillis);
+  static void crossed(IndexZone zone, unsigned long currentMillis,
+                      void *context);
 
 public:
-  SwitchController(gpio_num_t relaySignalPin);
-  bool setInterval(unsigned short duration);
+  SwitchController(hal_pin_t relaySignalPin);
+  bool begin();
+  bool setInterval(unsigned short duration) override;
+  unsigned short interval() override;
+  unsigned short minInterval() override { return SWITCH_MIN_INTERVAL_MINUTES; }
+  unsigned short maxInterval() override { return SWITCH_MAX_INTERVAL_MINUTES; }
+  SolarThresholds thresholds() override;
+  bool acceptsThresholds(double max, double min) override;
   bool setSolarThresholds(SolarThresholds threshold);
-  bool setSolarThresholds(double max, double min);
+  bool setSolarThresholds(double max, double min) override;
   bool setSolarThresholds(double min);
   void run();
+  void run(solar_num_t solarIndex, unsigned long currentMillis) override;
+  void setMode(SwitchMode mode);
+  SwitchMode mode();
+  void setPredictiveConfig(const PredictiveConfig &config);
+  void setEventConfig(const EventConfig &config);
+  void setRelayReadback(bool enabled);
+  uint32_t relayFailures();
+  void setHistory(SolarHistory *history);
   void debug();
 };
 
-int64_t millis();
+/**
+ * @brief Timing counters of one runtime task.
+ *
+ * For the periodic tasks `jitter` is the deviation of each wake-up interval
+ * from the configured period and `overruns` counts wake-ups that came after
+ * the next deadline had already passed. For the control task `jitter` is the
+ * latency from a sample being taken to it being processed and `overruns`
+ * counts samples dropped because the queue was full. `busyMicros` is the time
+ * spent in the task body; `cpuPermille` relates it to the uptime.
+ */
+struct RuntimeTaskStats {
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t jitterMaxMicros;
+  uint32_t jitterMeanMicros;
+  uint64_t jitterTotalMicros;
+  uint64_t busyMicros;
+  uint16_t cpuPermille;
+};
+
+struct RuntimeStats {
+  RuntimeTaskStats sampling;
+  RuntimeTaskStats control;
+  RuntimeTaskStats service;
+  int64_t uptimeMicros;
+  uint32_t samplePeriodMs;   // current, with adaptive sampling
+  uint32_t onDemandReadings; // taken with the ADC converting on demand
+  int64_t firstDecisionMicros; // since boot; 0 before the first run
+};
 
-esp_err_t init_nvs();
+#ifdef ESP_PLATFORM
+/**
+ * @brief Priority, core and stack of one runtime task.
+ */
+struct RuntimeTaskConfig {
+  UBaseType_t priority;
+  BaseType_t core;
+  uint32_t stackSize;
+};
+
+/**
+ * @brief Task layout of the Runtime.
+ *
+ * Sampling and control run on core 1 (APP_CPU), away from the Wi-Fi stack;
+ * the service task, which commits NVS and feeds telemetry, runs at low
+ * priority on core 0. Periods are rounded to whole FreeRTOS ticks.
+ */
+// Byte that makes the service task print the runtime counters on uart0
+#define RUNTIME_DEBUG_COMMAND 's'
+
+struct RuntimeConfig {
+  uint32_t samplePeriodMs = 100;
+  bool adaptiveSampling = false; // samplePeriodMs is then the first period
+  AdaptiveSamplingConfig adaptive;
+  uint32_t servicePeriodMs = 1000;
+  RuntimeTaskConfig sampling = {5, 1, 3072};
+  RuntimeTaskConfig control = {4, 1, 4096};
+  RuntimeTaskConfig service = {1, 0, 4096};
+};
+
+/**
+ * @class Runtime
+ * @brief FreeRTOS task graph driving the SwitchControllers.
+ *
+ * A sampling task reads the solar index, at a fixed rate or at the rate a
+ * SampleScheduler picks, and pushes timestamped readings to a wait-free
+ * SolarReadingQueue, then notifies the control task;
+ * the control task sleeps on that notification, drains the queue in blocks
+ * and runs every registered SwitchController with each reading; a
+ * low-priority service task performs deferred NVS commits and telemetry
+ * housekeeping, and prints `debug()` when RUNTIME_DEBUG_COMMAND arrives on
+ * uart0. No task polls, so the idle tasks and the task watchdog keep
+ * running on both cores.
+ */
+class Runtime {
+private:
+  RuntimeConfig config;
+  SolarIndex &_index;
+  SwitchControl *controllers[RUNTIME_MAX_CONTROLLERS];
+  size_t controllerCount = 0;
+  SolarReadingQueue readings;
+  TaskHandle_t samplingTask = nullptr;
+  TaskHandle_t controlTask = nullptr;
+  TaskHandle_t serviceTask = nullptr;
+  StaticSemaphore_t decisionBuffer;
+  SemaphoreHandle_t decisionTaken; // given after the first decision
+  int64_t startMicros = 0;
+  RuntimeStats timing = {};
+  portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+  static void samplingEntry(void *arg);
+  static void controlEntry(void *arg);
+  static void serviceEntry(void *arg);
+  void record(RuntimeTaskStats &task, int64_t jitterMicros, int64_t busyMicros,
+              bool overrun);
+  void pollCommands();
+
+public:
+  explicit Runtime(SolarIndex &index, const RuntimeConfig &config = {});
+
+  bool addController(SwitchControl &controller);
+  bool start();
+  bool waitForFirstDecision(TickType_t timeout);
+  RuntimeStats stats();
+  void debug();
+};
+
+extern UartHandler uart0;
+extern AdcSampler solarSampler;
+
+void runBenchmarks();
+bool startWebServer(WebApp &app, SwitchControl &controller);
+#endif
+
+extern SolarIndex solar;
+
+AdcCalSource calibrateSolarIndex(SolarIndex &index, double dividerRatio);
+
+void switchSlotKey(unsigned short slot, char *key);
+
+/**
+ * @brief Counters kept by the NVS write-back cache.
+ *
+ * `stores` counts store calls, `commits` counts actual `nvs_commit`s and
+ * `commitsAvoided` is the difference: store calls that would each have cost a
+ * commit before the cache existed. `opens` counts `nvs_open` calls and
+ * `sessions` outermost NvsSessions, each of which opened and closed the
+ * namespace before sessions existed. The commit timings are in
+ * microseconds.
+ */
+struct StorageCacheStats {
+  uint32_t stores;
+  uint32_t commits;
+  uint32_t commitsAvoided;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t opens;
+  uint32_t sessions;
+  uint32_t commitMicrosTotal;
+  uint32_t commitMicrosMax;
+};
+
+/**
+ * @class NvsSession
+ * @brief RAII session on the "storage" NVS namespace.
+ *
+ * A session holds the storage lock for its lifetime, so it is safe to use
+ * from several FreeRTOS tasks; sessions nest within one task. The namespace
+ * handle stays open across sessions. Sets are queued and committed once, when
+ * `commit()` is called or the session goes out of scope.
+ *
+ * @code{.cpp}
+ * {
+ *   NvsSession session;
+ *   session.set("count", 3);
+ *   session.setBlob("sw0", &threshold, sizeof(threshold));
+ * } // one nvs_commit here
+ * @endcode
+ */
+
+class NvsSession {
+private:
+  bool pendingCommit = false;
+
+public:
+  NvsSession();
+  ~NvsSession();
+  NvsSession(const NvsSession &) = delete;
+  NvsSession &operator=(const NvsSession &) = delete;
+
+  bool isOpen() const;
+  bool set(const char *key, int32_t value);
+  bool set(const char *key, const char *value);
+  bool setBlob(const char *key, const void *value, size_t length);
+  bool get(const char *key, int32_t *value);
+  bool get(const char *key, char *value, size_t *length);
+  bool getBlob(const char *key, void *value, size_t *length);
+  bool erase(const char *key);
+  bool commit();
+};
+
+bool init_nvs();
+bool flushStorage();
+void storageTick();
+StorageCacheStats getStorageCacheStats();
 bool storeValue(const char *key, int32_t value);
 bool storeValue(const char *key, const char *value);
 bool storeDouble(const char *key, double value);
@@ -167,8 +901,238 @@ bool retrieveIntValue(const char *key, int32_t *value);
 bool storeSolarThresholds(const char *key, const SolarThresholds &value);
 bool retrieveSolarThresholds(const char *key, SolarThresholds &value);
 
-int analogRead(gpio_num_t pin);
-uint32_t analogRead(adc_channel_t channel);
-void digitalWrite(gpio_num_t pin, int value);
+bool storeBlob(const char *key, const void *value, size_t length);
+bool retrieveBlob(const char *key, void *value, size_t *length);
+bool retrieveLegacy(const char *key, double &value);
+bool retrieveLegacy(const char *key, Q16_16 &value);
+
+/**
+ * @brief Type tag stored in front of every value written by `store<T>()`.
+ */
+struct StorageTag {
+  uint8_t type;
+  uint8_t version;
+  uint8_t size;
+  uint8_t reserved;
+};
+
+/**
+ * @brief Maps a stored type to its tag id and layout version.
+ *
+ * Bump `version` whenever the layout of a stored type changes; values with a
+ * different version are rejected by `retrieve<T>()`. `Legacy` is the type
+ * the double build stores in place of `T`, which a Q16.16 build migrates
+ * from; `legacyRaw` marks types that used to be stored as an untagged
+ * `memcpy` of their `Legacy` struct.
+ */
+template <typename T> struct StorageType;
+
+template <> struct StorageType<int32_t> {
+  typedef int32_t Legacy;
+  static constexpr bool legacyRaw = false;
+  static constexpr uint8_t id = 0x01;
+  static constexpr uint8_t version = 1;
+};
+
+template <> struct StorageType<double> {
+  typedef double Legacy;
+  static constexpr bool legacyRaw = false;
+  static constexpr uint8_t id = 0x02;
+  static constexpr uint8_t version = 1;
+};
+
+template <> struct StorageType<Q16_16> {
+  typedef double Legacy;
+  static constexpr bool legacyRaw = false;
+  static constexpr uint8_t id = 0x03;
+  static constexpr uint8_t version = 1;
+};
+
+template <typename T> struct StorageType<BasicSolarThresholds<T>> {
+  typedef BasicSolarThresholds<double> Legacy;
+  static constexpr bool legacyRaw = true;
+  static constexpr uint8_t id = 0x10 | StorageType<T>::id;
+  static constexpr uint8_t version = 1;
+};
+
+/**
+ * @brief Converts a value of a `StorageType<T>::Legacy` type to `T`.
+ */
+template <typename T, typename Legacy>
+void fromLegacy(const Legacy &legacy, T &value) {
+  value = T(legacy);
+}
+
+template <typename T>
+void fromLegacy(const BasicSolarThresholds<double> &legacy,
+                BasicSolarThresholds<T> &value) {
+  value = BasicSolarThresholds<T>(T(legacy.max), T(legacy.min));
+}
+
+/**
+ * @brief Fallback for types with no pre-tag encoding to migrate from.
+ */
+template <typename T> bool retrieveLegacy(const char *key, T &value) {
+  return false;
+}
+
+/**
+ * @brief Bytes `store<T>()` writes for a `T`: the tag and the value.
+ */
+template <typename T> constexpr size_t storedSize() {
+  return sizeof(StorageTag) + sizeof(T);
+}
+
+/**
+ * @brief Encodes a value as `store<T>()` writes it.
+ *
+ * @param value The value to encode.
+ * @param blob [out] `storedSize<T>()` bytes.
+ */
+template <typename T> void encodeStored(const T &value, uint8_t *blob) {
+  StorageTag tag = {StorageType<T>::id, StorageType<T>::version,
+                    (uint8_t)sizeof(T), 0};
+  memcpy(blob, &tag, sizeof(tag));
+  memcpy(blob + sizeof(tag), &value, sizeof(T));
+}
+
+/**
+ * @brief Decodes a blob written by `store<T>()`.
+ *
+ * @return `false` if the length or the tag does not match `T`.
+ */
+template <typename T>
+bool decodeStored(const uint8_t *blob, size_t length, T &value) {
+  StorageTag tag;
+  memcpy(&tag, blob, sizeof(tag));
+  if (length != storedSize<T>() || tag.type != StorageType<T>::id ||
+      tag.version != StorageType<T>::version || tag.size != sizeof(T))
+    return false;
+
+  memcpy(&value, blob + sizeof(tag), sizeof(T));
+  return true;
+}
+
+/**
+ * @brief Stores a trivially-copyable value as a tagged binary blob.
+ *
+ * @param key The NVS key.
+ * @param value The value to store.
+ * @return `true` if the value was accepted by the write-back cache.
+ */
+template <typename T> bool store(const char *key, const T &value) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "store<T> requires a trivially copyable type");
+  static_assert(storedSize<T>() <= STORAGE_CACHE_VALUE_SIZE,
+                "value does not fit a storage cache slot");
+
+  uint8_t blob[storedSize<T>()];
+  encodeStored(value, blob);
+  return storeBlob(key, blob, sizeof(blob));
+}
+
+/**
+ * @brief Retrieves a value written by `store<T>()`.
+ *
+ * @param key The NVS key.
+ * @param value [out] The stored value.
+ * @return `false` if the key is missing or its tag does not match `T`.
+ *
+ * Values written before tagging existed are migrated on first read: an
+ * untagged blob of exactly `sizeof(Legacy)` bytes for `legacyRaw` types, or a
+ * legacy encoding known to `retrieveLegacy()`, is accepted and rewritten in
+ * the tagged format. So is a tagged `Legacy` value, which the double build
+ * left for a Q16.16 build flashed over it.
+ */
+template <typename T> bool retrieve(const char *key, T &value) {
+  typedef typename StorageType<T>::Legacy Legacy;
+  constexpr size_t largest =
+      sizeof(T) > sizeof(Legacy) ? sizeof(T) : sizeof(Legacy);
+  uint8_t blob[sizeof(StorageTag) + largest];
+  size_t length = sizeof(blob);
+
+  if (!retrieveBlob(key, blob, &length))
+    return retrieveLegacy(key, value);
+
+  if (StorageType<T>::legacyRaw && length == sizeof(Legacy)) {
+    Legacy legacy;
+    memcpy(&legacy, blob, sizeof(Legacy));
+    fromLegacy(legacy, value);
+    return store(key, value);
+  }
+
+  if (decodeStored(blob, length, value))
+    return true;
+
+  Legacy legacy;
+  if (std::is_same<T, Legacy>::value || !decodeStored(blob, length, legacy))
+    return false;
+  fromLegacy(legacy, value);
+  return store(key, value);
+}
+
+/**
+ * @brief Counters kept by the SolarLog.
+ */
+struct SolarLogStats {
+  uint32_t records;
+  uint32_t droppedRecords;
+  uint32_t pagesWritten;
+  uint32_t bytesWritten;
+  uint32_t writeErrors;
+};
+
+/**
+ * @class SolarLog
+ * @brief Append-only log of samples and events on a raw flash partition.
+ *
+ * Records are encoded into one of two RAM page buffers (see SolarLogCodec.h).
+ * When a page fills it is sealed and the other buffer takes over; `tick()`,
+ * run from the low-priority service task, erases the next sector and writes
+ * the sealed page in one go, so the control path never waits for flash and
+ * every sector is erased once per pass over the ring.
+ *
+ * Reads go through a memory mapping of the partition. Timestamps are
+ * milliseconds of logged operating time, continued across reboots from the
+ * newest page on flash.
+ */
+
+class SolarLog {
+private:
+  const void *mapped = nullptr;
+  SolarLogImage image;
+
+  uint8_t pages[2][SOLAR_LOG_PAGE_SIZE];
+  SolarLogPageWriter writer;
+  uint8_t activePage = 0;
+  int sealedPage = -1;
+  uint32_t nextSequence = 0;
+  int64_t timeOffset = 0;
+  int64_t pageOpenedMillis = 0;
+  SolarLogStats counters = {};
+
+  std::mutex bufferLock;
+  std::mutex flashLock;
+
+  bool append(const SolarLogRecord &record);
+  void seal();
+  void writeSealed();
+
+public:
+  bool begin();
+  uint64_t now() const;
+
+  bool logSample(uint16_t value);
+  bool logEvent(SolarLogEventType type, uint32_t value);
+  void tick();
+  void flush();
+
+  size_t query(uint64_t fromMillis, uint64_t toMillis,
+               bool (*visit)(const SolarLogRecord &record, void *context),
+               void *context);
+  SolarLogStats stats();
+};
+
+extern SolarLog solarLog;
 
 #endif
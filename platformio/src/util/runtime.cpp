@@ -0,0 +1,318 @@
+/**
+ * @file runtime.cpp
+ * @brief Implementation of the Runtime task graph.
+ */
+
+#include "esp_timer.h"
+#include "main.h"
+
+/**
+ * @brief Constructs a Runtime that is not yet running.
+ *
+ * @param index The solar index read by the sampling task.
+ * @param config Task priorities, cores, stacks and periods.
+ */
+
+Runtime::Runtime(SolarIndex &index, const RuntimeConfig &config)
+    : config(config), _index(index),
+      decisionTaken(xSemaphoreCreateBinaryStatic(&decisionBuffer)) {}
+
+/**
+ * @brief Registers a controller to be run with every reading.
+ *
+ * @return `false` if RUNTIME_MAX_CONTROLLERS are registered or the runtime has
+ * already started.
+ */
+
+bool Runtime::addController(SwitchControl &controller) {
+  if (controllerCount == RUNTIME_MAX_CONTROLLERS || samplingTask != nullptr)
+    return false;
+
+  controllers[controllerCount++] = &controller;
+  return true;
+}
+
+/**
+ * @brief Creates the three tasks.
+ *
+ * @return `true` if every task is running.
+ *
+ * The consumers are created before the producer so the first notification
+ * always has a control task to wake.
+ */
+
+bool Runtime::start() {
+  if (samplingTask != nullptr)
+    return true;
+
+  startMicros = esp_timer_get_time();
+
+  return xTaskCreatePinnedToCore(serviceEntry, "rt_service",
+                                 config.service.stackSize, this,
+                                 config.service.priority, &serviceTask,
+                                 config.service.core) == pdPASS &&
+         xTaskCreatePinnedToCore(controlEntry, "rt_control",
+                                 config.control.stackSize, this,
+                                 config.control.priority, &controlTask,
+                                 config.control.core) == pdPASS &&
+         xTaskCreatePinnedToCore(samplingEntry, "rt_sampling",
+                                 config.sampling.stackSize, this,
+                                 config.sampling.priority, &samplingTask,
+                                 config.sampling.core) == pdPASS;
+}
+
+/**
+ * @brief Blocks until the controllers have run with the first reading.
+ *
+ * @param timeout Ticks to wait at most.
+ * @return `true` once the first decision has been taken.
+ *
+ * May be called from any task, any number of times. The control task gives
+ * a semaphore the Runtime owns, so a caller that timed out and ended leaves
+ * nothing behind for it to signal.
+ */
+
+bool Runtime::waitForFirstDecision(TickType_t timeout) {
+  if (xSemaphoreTake(decisionTaken, timeout) != pdTRUE)
+    return false;
+  // Left given for later callers
+  xSemaphoreGive(decisionTaken);
+  return true;
+}
+
+/**
+ * @brief Adds one run of a task to its counters.
+ */
+
+void Runtime::record(RuntimeTaskStats &task, int64_t jitterMicros,
+                     int64_t busyMicros, bool overrun) {
+  uint32_t jitter = (uint32_t)(jitterMicros < 0 ? -jitterMicros : jitterMicros);
+
+  portENTER_CRITICAL(&statsLock);
+  task.runs++;
+  task.overruns += overrun;
+  task.jitterTotalMicros += jitter;
+  if (jitter > task.jitterMaxMicros)
+    task.jitterMaxMicros = jitter;
+  task.busyMicros += busyMicros;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+/**
+ * @brief Sampling task: reads the solar index every samplePeriodMs, or at
+ * the period a SampleScheduler picks with adaptive sampling.
+ *
+ * `xTaskDelayUntil()` keeps the period free of drift; its return value tells
+ * whether the deadline had already passed. Jitter is measured against the
+ * period the task slept for. While the scheduler's period is long enough,
+ * the ADC converts on demand: each reading converts ADAPTIVE_BURST_SAMPLES
+ * first, and in between nothing holds the chip awake.
+ */
+
+void Runtime::samplingEntry(void *arg) {
+  Runtime *self = static_cast<Runtime *>(arg);
+  SampleScheduler scheduler(self->config.adaptive);
+  uint32_t periodMs = self->config.samplePeriodMs;
+  bool onDemand = false;
+  TickType_t lastWake = xTaskGetTickCount();
+  int64_t previousMicros = esp_timer_get_time();
+
+  while (true) {
+    TickType_t period = pdMS_TO_TICKS(periodMs);
+    bool overrun = xTaskDelayUntil(&lastWake, period) == pdFALSE;
+    int64_t wokeMicros = esp_timer_get_time();
+
+    bool burst = onDemand && halAdc.convert(ADAPTIVE_BURST_SAMPLES) != 0;
+    SolarReading reading = {self->_index.read(), (uint32_t)millis(),
+                            wokeMicros};
+    if (self->readings.push(reading)) {
+      xTaskNotifyGive(self->controlTask);
+    } else {
+      portENTER_CRITICAL(&self->statsLock);
+      self->timing.control.overruns++;
+      portEXIT_CRITICAL(&self->statsLock);
+    }
+
+    if (self->config.adaptiveSampling) {
+      periodMs = scheduler.next(reading.solarIndex, reading.millis);
+      if (scheduler.onDemand() != onDemand &&
+          halAdc.setOnDemand(scheduler.onDemand()))
+        onDemand = scheduler.onDemand();
+    }
+
+    portENTER_CRITICAL(&self->statsLock);
+    self->timing.samplePeriodMs = periodMs;
+    self->timing.onDemandReadings += burst;
+    portEXIT_CRITICAL(&self->statsLock);
+
+    int64_t periodMicros = (int64_t)period * portTICK_PERIOD_MS * 1000;
+    self->record(self->timing.sampling,
+                 wokeMicros - previousMicros - periodMicros,
+                 esp_timer_get_time() - wokeMicros, overrun);
+    previousMicros = wokeMicros;
+  }
+}
+
+/**
+ * @brief Control task: runs every controller with each queued reading.
+ *
+ * One notification may stand for several readings, so each wake drains the
+ * whole queue, RUNTIME_SAMPLE_QUEUE_LENGTH readings at a time. Every reading
+ * also goes to the live stream, and one per SOLAR_LOG_SAMPLE_PERIOD_MS to the
+ * flash log; both only touch RAM. The end of the first run is recorded as
+ * the first decision and wakes the task that started the runtime, if it is
+ * still waiting.
+ */
+
+void Runtime::controlEntry(void *arg) {
+  Runtime *self = static_cast<Runtime *>(arg);
+  SolarReading block[RUNTIME_SAMPLE_QUEUE_LENGTH];
+  uint32_t loggedMillis = 0;
+  bool logged = false;
+  bool decided = false;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    size_t count;
+    while ((count = self->readings.popBatch(block,
+                                            RUNTIME_SAMPLE_QUEUE_LENGTH)) !=
+           0) {
+      for (size_t r = 0; r < count; r++) {
+        const SolarReading &reading = block[r];
+        int64_t beginMicros = esp_timer_get_time();
+        for (size_t i = 0; i < self->controllerCount; i++)
+          self->controllers[i]->run(reading.solarIndex, reading.millis);
+        if (!decided) {
+          decided = true;
+          portENTER_CRITICAL(&self->statsLock);
+          self->timing.firstDecisionMicros = esp_timer_get_time();
+          portEXIT_CRITICAL(&self->statsLock);
+          xSemaphoreGive(self->decisionTaken);
+        }
+        liveStream.sample(reading.millis, historyValue(reading.solarIndex));
+
+        if (!logged ||
+            reading.millis - loggedMillis >= SOLAR_LOG_SAMPLE_PERIOD_MS) {
+          solarLog.logSample(historyValue(reading.solarIndex));
+          loggedMillis = reading.millis;
+          logged = true;
+        }
+
+        int64_t busyMicros = esp_timer_get_time() - beginMicros;
+        INSTR_RECORD(INSTR_LOOP, (uint32_t)busyMicros);
+        self->record(self->timing.control, beginMicros - reading.takenMicros,
+                     busyMicros, false);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Service task: deferred NVS commits, flash log pages, telemetry
+ * counters and commands received on uart0.
+ */
+
+void Runtime::serviceEntry(void *arg) {
+  Runtime *self = static_cast<Runtime *>(arg);
+  const TickType_t period = pdMS_TO_TICKS(self->config.servicePeriodMs);
+  const int64_t periodMicros = (int64_t)period * portTICK_PERIOD_MS * 1000;
+  TickType_t lastWake = xTaskGetTickCount();
+  int64_t previousMicros = esp_timer_get_time();
+
+  while (true) {
+    bool overrun = xTaskDelayUntil(&lastWake, period) == pdFALSE;
+    int64_t wokeMicros = esp_timer_get_time();
+
+    storageTick();
+    solarLog.tick();
+    telemetry.tick();
+    self->pollCommands();
+
+    self->record(self->timing.service,
+                 wokeMicros - previousMicros - periodMicros,
+                 esp_timer_get_time() - wokeMicros, overrun);
+    previousMicros = wokeMicros;
+  }
+}
+
+/**
+ * @brief Runs `debug()` for every RUNTIME_DEBUG_COMMAND received on uart0
+ * since the last call; other bytes are discarded.
+ */
+
+void Runtime::pollCommands() {
+  char received[16];
+  size_t length;
+  while ((length = uart0.read(received, sizeof(received))) != 0) {
+    for (size_t i = 0; i < length; i++) {
+      if (received[i] == RUNTIME_DEBUG_COMMAND)
+        debug();
+    }
+  }
+}
+
+/**
+ * @brief Returns a consistent snapshot of the task counters.
+ */
+
+RuntimeStats Runtime::stats() {
+  portENTER_CRITICAL(&statsLock);
+  RuntimeStats snapshot = timing;
+  portEXIT_CRITICAL(&statsLock);
+
+  snapshot.uptimeMicros = esp_timer_get_time() - startMicros;
+  for (RuntimeTaskStats *task :
+       {&snapshot.sampling, &snapshot.control, &snapshot.service}) {
+    if (task->runs != 0)
+      task->jitterMeanMicros = (uint32_t)(task->jitterTotalMicros / task->runs);
+    if (snapshot.uptimeMicros > 0)
+      task->cpuPermille =
+          (uint16_t)(task->busyMicros * 1000 / snapshot.uptimeMicros);
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Prints the task counters, live stream totals and the
+ * instrumentation snapshot over Serial.
+ */
+
+void Runtime::debug() {
+  RuntimeStats snapshot = stats();
+  const char *names[] = {"sampling", "control", "service"};
+  const RuntimeTaskStats *tasks[] = {&snapshot.sampling, &snapshot.control,
+                                     &snapshot.service};
+
+  for (size_t i = 0; i < 3; i++) {
+    Serial.send(names[i]);
+    Serial.send(": runs ");
+    Serial.send((unsigned long)tasks[i]->runs);
+    Serial.send(", overruns ");
+    Serial.send((unsigned long)tasks[i]->overruns);
+    Serial.send(", jitter mean/max (us) ");
+    Serial.send((unsigned long)tasks[i]->jitterMeanMicros);
+    Serial.send("/");
+    Serial.send((unsigned long)tasks[i]->jitterMaxMicros);
+    Serial.send(", cpu (permille) ");
+    Serial.send((unsigned int)tasks[i]->cpuPermille);
+    Serial.sendln();
+  }
+
+  Serial.send("sample period (ms) ");
+  Serial.send((unsigned long)snapshot.samplePeriodMs);
+  Serial.send(", on-demand readings ");
+  Serial.send((unsigned long)snapshot.onDemandReadings);
+  Serial.sendln();
+
+  LiveStreamStats live = liveStream.stats();
+  Serial.send("live: clients ");
+  Serial.send((unsigned int)live.clients);
+  Serial.send(", frames ");
+  Serial.send((unsigned long)live.frames);
+  Serial.send(", dropped ");
+  Serial.send((unsigned long)live.dropped);
+  Serial.sendln();
+
+  INSTR_DUMP(Serial);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file serial.cpp
+ * @brief Text formatting helpers shared by every HalSerial backend.
+ */
+
+#include "hal.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SERIAL_BUFFER_SIZE 20
+
+/**
+ * @brief Send a string message over the serial port.
+ *
+ * @param message The message to be sent as a null-terminated string.
+ */
+
+void HalSerial::send(const char *message) {
+  write(message, strlen(message));
+}
+
+/**
+ * @brief Send a float value over the serial port.
+ *
+ * @param value The float value to be sent.
+ */
+
+void HalSerial::send(float value) {
+  char buffer[SERIAL_BUFFER_SIZE];
+  snprintf(buffer, SERIAL_BUFFER_SIZE, "%f", value);
+  send(buffer);
+}
+
+/**
+ * @brief Send a double value over the serial port.
+ *
+ * @param value The double value to be sent.
+ */
+
+void HalSerial::send(double value) {
+  char buffer[SERIAL_BUFFER_SIZE];
+  snprintf(buffer, SERIAL_BUFFER_SIZE, "%f", value);
+  send(buffer);
+}
+
+/**
+ * @brief Send a integer value over the serial port.
+ *
+ * @param value The integer value to be sent.
+ */
+
+void HalSerial::send(int value) {
+  char buffer[SERIAL_BUFFER_SIZE];
+  snprintf(buffer, SERIAL_BUFFER_SIZE, "%d", value);
+  send(buffer);
+}
+
+/**
+ * @brief Send an unsigned integer value over the serial port.
+ *
+ * @param value The unsigned integer value to be sent.
+ */
+
+void HalSerial::send(unsigned int value) {
+  char buffer[SERIAL_BUFFER_SIZE];
+  snprintf(buffer, SERIAL_BUFFER_SIZE, "%u", value);
+  send(buffer);
+}
+
+/**
+ * @brief Send an unsigned long value over the serial port.
+ *
+ * @param value The unsigned long value to be sent.
+ */
+
+void HalSerial::send(unsigned long value) {
+  char buffer[SERIAL_BUFFER_SIZE];
+  snprintf(buffer, SERIAL_BUFFER_SIZE, "%lu", value);
+  send(buffer);
+}
+
+/**
+ * @brief Send a newline character over the serial port.
+ */
+
+void HalSerial::sendln() { send("\n"); }
@@ -1,178 +1,447 @@
-#include "esp_system.h"
-#include "esp_timer.h"
 #include "main.h"
-#include "nvs.h"
-#include "nvs_flash.h"
 
-#define SW_STORAGE "storage"
+// The "storage" namespace of halKv is opened once and kept open; NvsSession
+// serializes access to it across tasks with a recursive mutex.
+static bool namespaceOpen = false;
+static std::recursive_mutex storageMutex;
+static unsigned int sessionDepth = 0;
+
+// Write-back cache in front of NVS. Stores land here and are marked dirty;
+// flushStorage() writes every dirty key with a single commit.
+enum CacheType : uint8_t { CACHE_EMPTY, CACHE_I32, CACHE_STR, CACHE_BLOB };
+
+struct CacheEntry {
+  char key[HAL_KV_KEY_SIZE];
+  CacheType type;
+  bool dirty;
+  uint8_t length;
+  uint8_t value[STORAGE_CACHE_VALUE_SIZE];
+};
+
+static CacheEntry cache[STORAGE_CACHE_ENTRIES];
+static unsigned int dirtyEntries = 0;
+static int64_t lastFlushMillis = 0;
+static StorageCacheStats cacheStats;
+
+static bool cachePut(const char *key, CacheType type, const void *value,
+                     size_t length, bool dirty);
+static void cacheRemove(const char *key);
 
-int64_t millis() { return (esp_timer_get_time() / 1000); }
+// Initialize NVS
+bool init_nvs() {
+  if (!halKv.init())
+    return false;
+  lastFlushMillis = millis();
 
-nvs_handle_t SwNamespace;
+  NvsSession session; // open the shared handle up front
+  return session.isOpen();
+}
 
-// Initialize NVS
-esp_err_t init_nvs() {
-  esp_err_t ret = nvs_flash_init();
-  if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
-      ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    // Handle NVS partitioning and version conflicts
-    return ESP_FAIL;
+/**
+ * @brief Opens a session on the "storage" namespace.
+ *
+ * Blocks until no other task holds a session. The namespace handle is opened
+ * on first use and then kept open for the lifetime of the program, so nested
+ * or back-to-back sessions cost no `nvs_open`.
+ */
+
+NvsSession::NvsSession() {
+  storageMutex.lock();
+  if (sessionDepth++ == 0)
+    cacheStats.sessions++;
+
+  if (!namespaceOpen) {
+    INSTR_SCOPE(INSTR_NVS_OPEN);
+    namespaceOpen = halKv.open();
+    if (namespaceOpen)
+      cacheStats.opens++;
+    else
+      INSTR_COUNT(INSTR_NVS_ERRORS, 1);
   }
-  return ESP_OK;
 }
 
-// Open an NVS namespace
-esp_err_t open_nvs_namespace(const char *nameSpace) {
-  return nvs_open(nameSpace, NVS_READWRITE, &SwNamespace);
+/**
+ * @brief Commits queued sets, if any, and releases the session.
+ */
+
+NvsSession::~NvsSession() {
+  commit();
+  sessionDepth--;
+  storageMutex.unlock();
 }
 
-// Close the NVS namespace
-void close_nvs_namespace() { nvs_close(SwNamespace); }
+/**
+ * @brief Reports whether the namespace handle is usable.
+ */
 
-// Store an integer value in NVS
-bool storeValue(const char *key, int32_t value) {
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
-    return false;
+bool NvsSession::isOpen() const { return namespaceOpen; }
 
-  if (nvs_set_i32(SwNamespace, key, value) != ESP_OK) {
-    close_nvs_namespace();
-    return false;
-  }
+/**
+ * @brief Queues an integer write; committed with the session.
+ */
 
-  if (nvs_commit(SwNamespace) != ESP_OK) {
-    close_nvs_namespace();
+bool NvsSession::set(const char *key, int32_t value) {
+  if (!namespaceOpen || !halKv.setI32(key, value))
     return false;
-  }
-
-  close_nvs_namespace();
+  cachePut(key, CACHE_I32, &value, sizeof(value), false);
+  pendingCommit = true;
   return true;
 }
 
-// Store a string value in NVS
-bool storeValue(const char *key, const char *value) {
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
-    return false;
+/**
+ * @brief Queues a string write; committed with the session.
+ */
 
-  if (nvs_set_str(SwNamespace, key, value) != ESP_OK) {
-    close_nvs_namespace();
+bool NvsSession::set(const char *key, const char *value) {
+  if (!namespaceOpen || !halKv.setStr(key, value))
     return false;
-  }
+  cachePut(key, CACHE_STR, value, strlen(value) + 1, false);
+  pendingCommit = true;
+  return true;
+}
 
-  if (nvs_commit(SwNamespace) != ESP_OK) {
-    close_nvs_namespace();
-    return false;
-  }
+/**
+ * @brief Queues a blob write; committed with the session.
+ */
 
-  close_nvs_namespace();
+bool NvsSession::setBlob(const char *key, const void *value, size_t length) {
+  if (!namespaceOpen || !halKv.setBlob(key, value, length))
+    return false;
+  cachePut(key, CACHE_BLOB, value, length, false);
+  pendingCommit = true;
   return true;
 }
 
-// Store a double value in NVS as a string
-bool storeDouble(const char *key, double value) {
-  char doubleStr[32]; // Adjust the buffer size as needed
-  snprintf(doubleStr, sizeof(doubleStr), "%lf", value);
+/**
+ * @brief Reads an integer value.
+ */
 
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
-    return false;
+bool NvsSession::get(const char *key, int32_t *value) {
+  return namespaceOpen && halKv.getI32(key, value);
+}
+
+/**
+ * @brief Reads a string value.
+ *
+ * @param length [in,out] Buffer size in, string length with terminator out.
+ */
+
+bool NvsSession::get(const char *key, char *value, size_t *length) {
+  return namespaceOpen && halKv.getStr(key, value, length);
+}
+
+/**
+ * @brief Reads a blob value.
+ *
+ * @param length [in,out] Buffer size in, blob size out.
+ */
+
+bool NvsSession::getBlob(const char *key, void *value, size_t *length) {
+  return namespaceOpen && halKv.getBlob(key, value, length);
+}
+
+/**
+ * @brief Queues removal of a key of any type; committed with the session.
+ */
 
-  if (nvs_set_str(SwNamespace, key, doubleStr) != ESP_OK) {
-    close_nvs_namespace();
+bool NvsSession::erase(const char *key) {
+  if (!namespaceOpen || !halKv.erase(key))
     return false;
+  cacheRemove(key);
+  pendingCommit = true;
+  return true;
+}
+
+/**
+ * @brief Commits queued sets now instead of at the end of the session.
+ *
+ * @return `true` if there was nothing to commit or the commit succeeded.
+ */
+
+bool NvsSession::commit() {
+  if (!pendingCommit)
+    return true;
+  pendingCommit = false;
+
+  int64_t start = micros();
+  bool committed = halKv.commit();
+  uint32_t elapsed = (uint32_t)(micros() - start);
+  INSTR_RECORD(INSTR_NVS_COMMIT, elapsed);
+  if (!committed)
+    INSTR_COUNT(INSTR_NVS_ERRORS, 1);
+
+  cacheStats.commits++;
+  cacheStats.commitMicrosTotal += elapsed;
+  if (elapsed > cacheStats.commitMicrosMax)
+    cacheStats.commitMicrosMax = elapsed;
+  return committed;
+}
+
+// Find the cache entry holding a key, or nullptr
+static CacheEntry *findEntry(const char *key) {
+  for (CacheEntry &entry : cache) {
+    if (entry.type != CACHE_EMPTY &&
+        strncmp(entry.key, key, sizeof(entry.key)) == 0)
+      return &entry;
   }
+  return nullptr;
+}
+
+// Find a free or clean entry to reuse, flushing if every entry is dirty
+static CacheEntry *allocEntry() {
+  CacheEntry *clean = nullptr;
+  for (CacheEntry &entry : cache) {
+    if (entry.type == CACHE_EMPTY)
+      return &entry;
+    if (!entry.dirty && clean == nullptr)
+      clean = &entry;
+  }
+  if (clean != nullptr)
+    return clean;
+
+  if (!flushStorage())
+    return nullptr;
+  return &cache[0];
+}
 
-  if (nvs_commit(SwNamespace) != ESP_OK) {
-    close_nvs_namespace();
+// Put a value in the cache; `dirty` is false when it already matches NVS
+static bool cachePut(const char *key, CacheType type, const void *value,
+                     size_t length, bool dirty) {
+  size_t keyLength = strlen(key);
+  if (length > STORAGE_CACHE_VALUE_SIZE || keyLength >= HAL_KV_KEY_SIZE)
     return false;
+
+  CacheEntry *entry = findEntry(key);
+  if (entry != nullptr && entry->type == type && entry->length == length &&
+      memcmp(entry->value, value, length) == 0)
+    return true; // unchanged, nothing to write
+
+  if (entry == nullptr) {
+    entry = allocEntry();
+    if (entry == nullptr)
+      return false;
+    memcpy(entry->key, key, keyLength + 1);
+    entry->dirty = false;
   }
 
-  close_nvs_namespace();
+  entry->type = type;
+  entry->length = (uint8_t)length;
+  memcpy(entry->value, value, length);
+  if (dirty && !entry->dirty)
+    dirtyEntries++;
+  entry->dirty = entry->dirty || dirty;
   return true;
 }
 
-// Function to store the struct in NVS
-bool storeSolarThresholds(const char *key, const SolarThresholds &value) {
-  if (open_nvs_namespace("storage") != ESP_OK)
+// Drop a key from the cache, dirty or not
+static void cacheRemove(const char *key) {
+  CacheEntry *entry = findEntry(key);
+  if (entry == nullptr)
+    return;
+  if (entry->dirty)
+    dirtyEntries--;
+  entry->type = CACHE_EMPTY;
+  entry->dirty = false;
+}
+
+// Record a store and flush if the dirty threshold is reached. The interval
+// flush is left to `storageTick()` on the service task, so a store from the
+// sampling task never waits for a commit it did not fill the cache for.
+static bool cacheStore(const char *key, CacheType type, const void *value,
+                       size_t length) {
+  NvsSession session;
+  cacheStats.stores++;
+  if (!cachePut(key, type, value, length, true))
     return false;
 
-  // Serialize the struct to a byte array
-  uint8_t serializedData[sizeof(SolarThresholds)];
-  memcpy(serializedData, &value, sizeof(SolarThresholds));
+  if (dirtyEntries >= STORAGE_DIRTY_THRESHOLD)
+    return flushStorage();
+  return true;
+}
 
-  if (nvs_set_blob(SwNamespace, key, serializedData, sizeof(SolarThresholds)) !=
-      ESP_OK) {
-    close_nvs_namespace();
+// Copy a cached value out, or return false on a miss
+static bool cacheGet(const char *key, CacheType type, void *value,
+                     size_t *length) {
+  CacheEntry *entry = findEntry(key);
+  if (entry == nullptr || entry->type != type || entry->length > *length) {
+    cacheStats.misses++;
     return false;
   }
+  memcpy(value, entry->value, entry->length);
+  *length = entry->length;
+  cacheStats.hits++;
+  return true;
+}
 
-  if (nvs_commit(SwNamespace) != ESP_OK) {
-    close_nvs_namespace();
-    return false;
+// Write every dirty key and commit once
+bool flushStorage() {
+  NvsSession session;
+  lastFlushMillis = millis();
+  if (dirtyEntries == 0)
+    return true;
+
+  for (CacheEntry &entry : cache) {
+    if (!entry.dirty)
+      continue;
+
+    bool written = false;
+    switch (entry.type) {
+    case CACHE_I32: {
+      int32_t value;
+      memcpy(&value, entry.value, sizeof(value));
+      written = session.set(entry.key, value);
+      break;
+    }
+    case CACHE_STR:
+      written = session.set(entry.key, (const char *)entry.value);
+      break;
+    case CACHE_BLOB:
+      written = session.setBlob(entry.key, entry.value, entry.length);
+      break;
+    default:
+      written = true;
+      break;
+    }
+    if (!written)
+      return false;
   }
 
-  close_nvs_namespace();
+  if (!session.commit())
+    return false;
+
+  for (CacheEntry &entry : cache)
+    entry.dirty = false;
+  dirtyEntries = 0;
   return true;
 }
 
-// Retrieve a string value from NVS
-bool retrieveValue(const char *key, char *value, size_t max_len) {
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
-    return false;
+// Flush when STORAGE_FLUSH_INTERVAL_MS has elapsed since the last flush
+void storageTick() {
+  NvsSession session;
+  if (dirtyEntries != 0 &&
+      millis() - lastFlushMillis >= STORAGE_FLUSH_INTERVAL_MS)
+    flushStorage();
+}
+
+// Cache counters; every store that did not cost its own commit is avoided
+StorageCacheStats getStorageCacheStats() {
+  std::lock_guard<std::recursive_mutex> lock(storageMutex);
+  StorageCacheStats stats = cacheStats;
+  stats.commitsAvoided =
+      stats.stores > stats.commits ? stats.stores - stats.commits : 0;
+  return stats;
+}
+
+// Store an integer value in NVS
+bool storeValue(const char *key, int32_t value) {
+  return cacheStore(key, CACHE_I32, &value, sizeof(value));
+}
+
+// Store a string value in NVS
+bool storeValue(const char *key, const char *value) {
+  size_t length = strlen(value) + 1;
+  if (length <= STORAGE_CACHE_VALUE_SIZE)
+    return cacheStore(key, CACHE_STR, value, length);
+
+  // Too long to cache: write through
+  NvsSession session;
+  cacheStats.stores++;
+  return session.set(key, value) && session.commit();
+}
 
-  if (nvs_get_str(SwNamespace, key, value, &max_len) == ESP_OK) {
-    close_nvs_namespace();
+// Store a tagged binary value (see store<T>)
+bool storeBlob(const char *key, const void *value, size_t length) {
+  if (length <= STORAGE_CACHE_VALUE_SIZE)
+    return cacheStore(key, CACHE_BLOB, value, length);
+
+  // Too long to cache: write through
+  NvsSession session;
+  cacheStats.stores++;
+  return session.setBlob(key, value, length) && session.commit();
+}
+
+// Retrieve a binary value; `length` is the buffer size in, blob size out
+bool retrieveBlob(const char *key, void *value, size_t *length) {
+  NvsSession session;
+  if (cacheGet(key, CACHE_BLOB, value, length))
     return true;
-  } else {
-    close_nvs_namespace();
+
+  if (!session.getBlob(key, value, length))
     return false;
-  }
+
+  cachePut(key, CACHE_BLOB, value, *length, false);
+  return true;
 }
 
-bool retrieveDouble(const char *key, double *value) {
-  char doubleStr[32]; // Adjust the buffer size as needed
-  size_t max_len = sizeof(doubleStr);
+/**
+ * @brief Migrates a double stored as a "%lf" string to the tagged binary
+ * format, as `T`.
+ */
+
+template <typename T>
+static bool migrateDoubleString(const char *key, T &value) {
+  NvsSession session;
+  char doubleStr[32];
+  size_t length = sizeof(doubleStr);
 
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
+  if (!session.get(key, doubleStr, &length))
     return false;
 
-  if (nvs_get_str(SwNamespace, key, doubleStr, &max_len) == ESP_OK) {
-    *value = atof(doubleStr); // Convert the string back to a double
-    close_nvs_namespace();
+  value = T(atof(doubleStr));
+  // NVS keeps one item per key and type, so drop the string before the
+  // blob is written; both land in the same commit.
+  return session.erase(key) && store(key, value) && flushStorage();
+}
+
+bool retrieveLegacy(const char *key, double &value) {
+  return migrateDoubleString(key, value);
+}
+
+bool retrieveLegacy(const char *key, Q16_16 &value) {
+  return migrateDoubleString(key, value);
+}
+
+// Store a double value in NVS
+bool storeDouble(const char *key, double value) { return store(key, value); }
+
+// Function to store the struct in NVS
+bool storeSolarThresholds(const char *key, const SolarThresholds &value) {
+  return store(key, value);
+}
+
+// Retrieve a string value from NVS
+bool retrieveValue(const char *key, char *value, size_t max_len) {
+  NvsSession session;
+  size_t length = max_len;
+  if (cacheGet(key, CACHE_STR, value, &length))
     return true;
-  } else {
-    close_nvs_namespace();
+
+  if (!session.get(key, value, &max_len))
     return false;
-  }
+
+  cachePut(key, CACHE_STR, value, max_len, false);
+  return true;
+}
+
+bool retrieveDouble(const char *key, double *value) {
+  return retrieve(key, *value);
 }
 
 // Retrieve an integer value from NVS
 bool retrieveIntValue(const char *key, int32_t *value) {
-  if (open_nvs_namespace(SW_STORAGE) != ESP_OK)
-    return false;
-
-  if (nvs_get_i32(SwNamespace, key, value) == ESP_OK) {
-    close_nvs_namespace();
+  NvsSession session;
+  size_t length = sizeof(*value);
+  if (cacheGet(key, CACHE_I32, value, &length))
     return true;
-  } else {
-    close_nvs_namespace();
-    return false;
-  }
-}
 
-// Retrieve the olarThresholds from NVS
-bool retrieveSolarThresholds(const char *key, SolarThresholds &value) {
-  if (open_nvs_namespace("storage") != ESP_OK)
+  if (!session.get(key, value))
     return false;
 
-  size_t data_size = sizeof(SolarThresholds);
-  uint8_t serializedData[data_size];
+  cachePut(key, CACHE_I32, value, sizeof(*value), false);
+  return true;
+}
 
-  if (nvs_get_blob(SwNamespace, key, serializedData, &data_size) == ESP_OK) {
-    // Deserialize the byte array back to the struct
-    memcpy(&value, serializedData, sizeof(SolarThresholds));
-    close_nvs_namespace();
-    return true;
-  } else {
-    close_nvs_namespace();
-    return false;
-  }
+// Retrieve the SolarThresholds from NVS
+bool retrieveSolarThresholds(const char *key, SolarThresholds &value) {
+  return retrieve(key, value);
 }
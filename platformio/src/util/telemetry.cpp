@@ -0,0 +1,115 @@
+/**
+ * @file telemetry.cpp
+ * @brief Implementation of the Telemetry class.
+ */
+
+#include "main.h"
+
+Telemetry telemetry(Serial);
+
+/**
+ * @brief Constructs a Telemetry stream on a serial port.
+ *
+ * @param uart The serial port the frames are written to.
+ */
+
+Telemetry::Telemetry(HalSerial &uart) : _uart(uart) {}
+
+/**
+ * @brief Start streaming records.
+ */
+
+void Telemetry::begin() {
+  lastCountersMillis = millis();
+  enabled = true;
+}
+
+/**
+ * @brief Stamp a record with a sequence number, encode and send it.
+ *
+ * The sequence number wraps at 256 and lets the decoder count lost frames.
+ */
+
+void Telemetry::emit(TelemetryRecord &record) {
+  if (!enabled)
+    return;
+
+  uint8_t frame[TELEMETRY_MAX_FRAME];
+  record.seq = seq.fetch_add(1, std::memory_order_relaxed);
+  size_t length = encodeTelemetry(record, frame);
+  if (length == 0)
+    return;
+
+  _uart.write((const char *)frame, length);
+  frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Send one filtered ADC sample.
+ */
+
+void Telemetry::sample(uint32_t timeMillis, uint16_t raw) {
+  TelemetryRecord record;
+  record.type = TELEMETRY_SAMPLE;
+  record.millis = timeMillis;
+  record.sample.raw = raw;
+  emit(record);
+}
+
+/**
+ * @brief Send a threshold span that just ended.
+ */
+
+void Telemetry::span(TelemetrySpanKind kind, uint32_t timeMillis,
+                     uint32_t durationMillis) {
+  TelemetryRecord record;
+  record.type = TELEMETRY_SPAN;
+  record.millis = timeMillis;
+  record.span.kind = kind;
+  record.span.durationMillis = durationMillis;
+  emit(record);
+}
+
+/**
+ * @brief Send a relay output transition.
+ */
+
+void Telemetry::relay(hal_pin_t pin, int level, uint32_t timeMillis) {
+  TelemetryRecord record;
+  record.type = TELEMETRY_RELAY;
+  record.millis = timeMillis;
+  record.relay.pin = (uint8_t)pin;
+  record.relay.level = level ? 1 : 0;
+  emit(record);
+}
+
+/**
+ * @brief Send the current health counters.
+ */
+
+void Telemetry::counters(uint32_t timeMillis) {
+  UartTxStats uart = _uart.txStats();
+  StorageCacheStats storage = getStorageCacheStats();
+
+  TelemetryRecord record;
+  record.type = TELEMETRY_COUNTERS;
+  record.millis = timeMillis;
+  record.counters.frames = frames.load(std::memory_order_relaxed);
+  record.counters.uartDroppedBytes = uart.droppedBytes;
+  record.counters.adcDroppedSamples = halAdc.samples().droppedCount();
+  record.counters.storageStores = storage.stores;
+  record.counters.storageCommits = storage.commits;
+  emit(record);
+}
+
+/**
+ * @brief Send the counters every TELEMETRY_COUNTERS_PERIOD_MS.
+ */
+
+void Telemetry::tick() {
+  int64_t now = millis();
+  if (enabled && now - lastCountersMillis >= TELEMETRY_COUNTERS_PERIOD_MS) {
+    lastCountersMillis = now;
+    counters((uint32_t)now);
+  }
+}
@@ -1,25 +1,43 @@
 #include "main.h"
 
-#define UART_BUFFER_SIZE 20
+#define UART_TX_TASK_STACK 2048
 
 /**
  * @brief Construct a UartHandler object.
  *
  * @param uart_num The UART port to be used.
  * @param baud_rate The baud rate for UART communication.
+ *
+ * Only records the settings, so the handler may be a global: the driver is
+ * installed by `begin()`, in the boot sequence.
  */
 
 UartHandler::UartHandler(uart_port_t uart_num, int baud_rate)
-    : uart_num_(uart_num) {
+    : uart_num_(uart_num), baudRate(baud_rate) {}
+
+/**
+ * @brief Configure the port and install the UART driver.
+ *
+ * @return `true` if the driver is installed; later calls do nothing.
+ *
+ * Until then everything written is dropped and counted.
+ */
+
+bool UartHandler::begin() {
+  if (installed)
+    return true;
+
   uart_config_t uart_config = {
-      .baud_rate = baud_rate,
+      .baud_rate = baudRate,
       .data_bits = UART_DATA_8_BITS,
       .parity = UART_PARITY_DISABLE,
       .stop_bits = UART_STOP_BITS_1,
   };
 
-  uart_param_config(uart_num_, &uart_config);
-  uart_driver_install(uart_num_, 256, 0, 0, NULL, 0);
+  installed = uart_param_config(uart_num_, &uart_config) == ESP_OK &&
+              uart_driver_install(uart_num_, 256, UART_TX_DRIVER_BUFFER, 0,
+                                  NULL, 0) == ESP_OK;
+  return installed;
 }
 
 /**
@@ -28,84 +46,140 @@ UartHandler::UartHandler(uart_port_t uart_num, int baud_rate)
  * When a UartHandler object goes out of scope, this destructor is automatically
  * called to release UART resources.
  */
-UartHandler::~UartHandler() { uart_driver_delete(uart_num_); }
+UartHandler::~UartHandler() {
+  if (txTask != nullptr)
+    vTaskDelete(txTask);
+  if (installed)
+    uart_driver_delete(uart_num_);
+}
 
 /**
- * @brief Send a string message over UART.
+ * @brief Switch to asynchronous transmission.
  *
- * @param message The message to be sent as a null-terminated string.
+ * @param policy What `send()` does when the TX ring is full.
+ * @param priority Priority of the TX task; keep it below the control tasks.
+ * @return `true` if the TX task is running.
+ *
+ * After this call `send()` appends to an in-memory ring in O(1) and returns;
+ * a low-priority task drains the ring to the UART driver. Installs the
+ * driver first if `begin()` has not.
  */
 
-void UartHandler::send(const char *message) {
-  uart_write_bytes(uart_num_, message, strlen(message));
+bool UartHandler::beginAsync(UartOverflowPolicy policy, UBaseType_t priority) {
+  overflowPolicy = policy;
+  if (!begin())
+    return false;
+  if (txTask != nullptr)
+    return true;
+
+  return xTaskCreate(txTaskEntry, "uart_tx", UART_TX_TASK_STACK, this,
+                     priority, &txTask) == pdPASS;
 }
 
 /**
- * @brief Send a float value over UART.
+ * @brief FreeRTOS entry point of the TX task.
  *
- * @param value The float value to be sent.
+ * Sleeps until a writer notifies it, then hands contiguous spans of the ring
+ * to the driver until the ring is empty.
  */
 
-void UartHandler::send(float value) {
-  char buffer[UART_BUFFER_SIZE];
-  snprintf(buffer, UART_BUFFER_SIZE, "%f", value);
-  send(buffer);
+void UartHandler::txTaskEntry(void *arg) {
+  UartHandler *uart = static_cast<UartHandler *>(arg);
+  const uint8_t *data;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    size_t length;
+    while ((length = uart->txRing.peek(data)) != 0) {
+      int written = uart_write_bytes(uart->uart_num_, data, length);
+      if (written <= 0)
+        break;
+      uart->txRing.consume(written);
+    }
+  }
 }
 
 /**
- * @brief Send a double value over UART.
+ * @brief Append a fragment to the TX ring according to the overflow policy.
+ *
+ * Writers from different tasks are serialized by a short critical section
+ * around the copy; the TX task reads without taking it.
  *
- * @param value The double value to be sent.
+ * @return `false` if the fragment was dropped.
  */
 
-void UartHandler::send(double value) {
-  char buffer[UART_BUFFER_SIZE];
-  snprintf(buffer, UART_BUFFER_SIZE, "%f", value);
-  send(buffer);
+bool UartHandler::enqueue(const char *data, size_t length) {
+  while (true) {
+    portENTER_CRITICAL(&writeLock);
+    bool queued = txRing.write(data, length);
+    size_t used = txRing.size();
+    portEXIT_CRITICAL(&writeLock);
+
+    if (queued) {
+      queuedBytes.fetch_add(length, std::memory_order_relaxed);
+      if (used > highWater.load(std::memory_order_relaxed))
+        highWater.store(used, std::memory_order_relaxed);
+      xTaskNotifyGive(txTask);
+      return true;
+    }
+
+    if (overflowPolicy == UART_OVERFLOW_DROP ||
+        length > UART_TX_RING_SIZE) {
+      droppedBytes.fetch_add(length, std::memory_order_relaxed);
+      droppedWrites.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    xTaskNotifyGive(txTask);
+    vTaskDelay(1);
+  }
 }
 
 /**
- * @brief Send a integer value over UART.
- *
- * @param value The integer value to be sent.
+ * @brief Wait until the TX ring and the driver have sent everything queued.
  */
 
-void UartHandler::send(int value) {
-  char buffer[UART_BUFFER_SIZE];
-  snprintf(buffer, UART_BUFFER_SIZE, "%d", value);
-  send(buffer);
+void UartHandler::flush() {
+  while (txTask != nullptr && txRing.size() != 0)
+    vTaskDelay(1);
+  if (installed)
+    uart_wait_tx_done(uart_num_, portMAX_DELAY);
 }
 
 /**
- * @brief Send an unsigned integer value over UART.
- *
- * @param value The unsigned integer value to be sent.
+ * @brief Snapshot of the asynchronous TX counters.
  */
 
-void UartHandler::send(unsigned int value) {
-  char buffer[UART_BUFFER_SIZE];
-  snprintf(buffer, UART_BUFFER_SIZE, "%u", value);
-  send(buffer);
+UartTxStats UartHandler::txStats() const {
+  UartTxStats stats;
+  stats.queuedBytes = queuedBytes.load(std::memory_order_relaxed);
+  stats.droppedBytes = droppedBytes.load(std::memory_order_relaxed);
+  stats.droppedWrites = droppedWrites.load(std::memory_order_relaxed);
+  stats.highWater = highWater.load(std::memory_order_relaxed);
+  return stats;
 }
 
 /**
- * @brief Send an unsigned long value over UART.
+ * @brief Send raw bytes over UART.
  *
- * @param value The unsigned long value to be sent.
+ * @param data The bytes to send.
+ * @param length Number of bytes.
  */
 
-void UartHandler::send(unsigned long value) {
-  char buffer[UART_BUFFER_SIZE];
-  snprintf(buffer, UART_BUFFER_SIZE, "%lu\n", value);
-  send(buffer);
+void UartHandler::write(const char *data, size_t length) {
+  INSTR_SCOPE(INSTR_UART_SEND);
+  INSTR_COUNT(INSTR_UART_BYTES, length);
+  if (txTask != nullptr) {
+    enqueue(data, length);
+  } else if (installed) {
+    uart_write_bytes(uart_num_, data, length);
+  } else {
+    droppedBytes.fetch_add(length, std::memory_order_relaxed);
+    droppedWrites.fetch_add(1, std::memory_order_relaxed);
+  }
 }
 
-/**
- * @brief Send a newline character over UART.
- */
-
-void UartHandler::sendln() { send("\n"); }
-
 /**
  * @brief Example usage of UartHandler for sending various data types over UART.
  *
@@ -120,4 +194,19 @@ void UartHandler::sendln() { send("\n"); }
  *     uart0_handler.send(1000u);
  * }
  * @endcode
- */
\ No newline at end of file
+ */
+/**
+ * @brief Take received bytes out of the driver's RX buffer.
+ *
+ * @param data Where to copy them.
+ * @param length Size of `data`.
+ * @return Number of bytes copied; 0 if nothing was received or the driver is
+ * not installed. Never waits.
+ */
+
+size_t UartHandler::read(char *data, size_t length) {
+  if (!installed)
+    return 0;
+  int received = uart_read_bytes(uart_num_, data, length, 0);
+  return received > 0 ? (size_t)received : 0;
+}
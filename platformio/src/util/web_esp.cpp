@@ -0,0 +1,479 @@
+/**
+ * @file web_esp.cpp
+ * @brief ESP-IDF transport for WebApp: Wi-Fi access point, the SPIFFS asset
+ * partition and esp_http_server.
+ */
+
+#include "WebApp.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_sleep.h"
+#include "esp_spiffs.h"
+#include "esp_wifi.h"
+#include "freertos/timers.h"
+#include "lwip/sockets.h"
+#include "main.h"
+
+#ifndef WEB_AP_SSID
+#define WEB_AP_SSID "SolarSwitch"
+#endif
+#ifdef WEB_AP_PASSWORD
+#error "WEB_AP_PASSWORD would be shared by every device; each makes its own"
+#endif
+#define WEB_AP_PASSWORD_KEY "ap_pass"
+#define WEB_AP_PASSWORD_LENGTH 12 // generated; 5 bits a character
+#define WEB_AP_PASSWORD_MIN 8     // WPA2 limits
+#define WEB_AP_PASSWORD_MAX 63
+#define WEB_AP_DEFAULT_PASSWORD "solarswitch" // shipped by older builds
+#define WEB_AP_MAX_CLIENTS 4
+#define WEB_AP_IDLE_MINUTES 10 // the AP stops this long without a station
+#define WEB_AP_BUTTON_PIN GPIO_NUM_0 // BOOT; restarts a stopped AP
+#define WEB_ASSET_ROOT "/www"
+#define WEB_ASSET_PARTITION "www"
+#define WEB_SERVER_STACK_SIZE 6144 // WEB_CHUNK_SIZE buffer plus the body
+#define WEB_HEADER_SIZE 64
+#define WEB_STATUS_SIZE 32
+#define WEB_LIVE_RETRY_MS 20 // while a client's socket buffer is full
+#define WEB_LIVE_TASK_STACK 3072
+#define WEB_LIVE_TASK_PRIORITY 2
+
+static const char liveHead[] = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/event-stream\r\n"
+                               "Cache-Control: no-cache\r\n"
+                               "\r\n";
+
+/**
+ * @brief An esp_http_server socket handed over to the live sender.
+ */
+struct LiveSocket {
+  int fd;
+  int client;
+};
+
+static httpd_handle_t server = nullptr;
+static TaskHandle_t liveTask = nullptr;
+static LiveSocket liveSockets[LIVE_MAX_CLIENTS];
+static size_t liveSocketCount = 0;
+static std::mutex liveSocketLock;
+
+static void removeLiveSocket(size_t index) {
+  liveStream.detach(liveSockets[index].client);
+  liveSockets[index] = liveSockets[--liveSocketCount];
+}
+
+/**
+ * @brief Sends what one live client has queued without blocking.
+ *
+ * @return `false` if the connection failed and should be closed.
+ */
+
+static bool drainLiveSocket(const LiveSocket &socket) {
+  const uint8_t *data;
+  size_t length;
+  while ((length = liveStream.peek(socket.client, data)) != 0) {
+    ssize_t sent = send(socket.fd, data, length, MSG_DONTWAIT);
+    if (sent < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    liveStream.consume(socket.client, sent);
+    if ((size_t)sent < length)
+      break;
+  }
+  return true;
+}
+
+/**
+ * @brief Wakes the live sender; LiveStream's publish callback.
+ */
+
+static void wakeLiveSender() { xTaskNotifyGive(liveTask); }
+
+/**
+ * @brief Live sender task: drains every live client when a frame is
+ * published or a client attaches.
+ *
+ * Sends are non-blocking, so a client whose socket buffer is full only
+ * leaves its frames queued, and then dropped by LiveStream once its queue
+ * fills. While any are left the task retries every WEB_LIVE_RETRY_MS;
+ * otherwise, and whenever no client is connected, it sleeps until woken.
+ */
+
+static void liveSenderEntry(void *arg) {
+  TickType_t timeout = portMAX_DELAY;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, timeout);
+
+    std::lock_guard<std::mutex> guard(liveSocketLock);
+    timeout = portMAX_DELAY;
+    for (size_t i = 0; i < liveSocketCount;) {
+      const uint8_t *data;
+      if (drainLiveSocket(liveSockets[i])) {
+        if (liveStream.peek(liveSockets[i].client, data) != 0)
+          timeout = pdMS_TO_TICKS(WEB_LIVE_RETRY_MS);
+        i++;
+        continue;
+      }
+      httpd_sess_trigger_close(server, liveSockets[i].fd);
+      removeLiveSocket(i);
+    }
+  }
+}
+
+/**
+ * @brief esp_http_server close hook: stops streaming to a socket before its
+ * descriptor can be reused.
+ */
+
+static void closeSocket(httpd_handle_t handle, int fd) {
+  {
+    std::lock_guard<std::mutex> guard(liveSocketLock);
+    for (size_t i = 0; i < liveSocketCount; i++) {
+      if (liveSockets[i].fd == fd) {
+        removeLiveSocket(i);
+        break;
+      }
+    }
+  }
+  close(fd);
+}
+
+/**
+ * @brief HttpResponse over one esp_http_server request.
+ *
+ * esp_http_server frames `chunk()` calls with chunked encoding itself; a
+ * response without a body is sent with Content-Length: 0 instead, as a 304
+ * must not carry a chunk terminator.
+ */
+class EspHttpResponse : public HttpResponse {
+private:
+  httpd_req_t *req;
+  char status[WEB_STATUS_SIZE];
+  bool chunked = false;
+
+public:
+  explicit EspHttpResponse(httpd_req_t *req) : req(req) {}
+
+  void begin(int code, const char *contentType) override {
+    snprintf(status, sizeof(status), "%d %s", code, httpReason(code));
+    httpd_resp_set_status(req, status);
+    if (contentType != nullptr)
+      httpd_resp_set_type(req, contentType);
+  }
+
+  void header(const char *name, const char *value) override {
+    httpd_resp_set_hdr(req, name, value);
+  }
+
+  bool chunk(const char *data, size_t length) override {
+    chunked = true;
+    return httpd_resp_send_chunk(req, data, length) == ESP_OK;
+  }
+
+  void finish() override {
+    if (chunked)
+      httpd_resp_send_chunk(req, nullptr, 0);
+    else
+      httpd_resp_send(req, nullptr, 0);
+  }
+
+  /**
+   * The head goes out raw, without a length or chunked encoding, so the
+   * body runs until the socket closes. The session stays open in
+   * esp_http_server, which calls `closeSocket()` when it ends.
+   */
+  bool stream(int client) override {
+    int length = sizeof(liveHead) - 1;
+    if (httpd_send(req, liveHead, length) != length)
+      return false;
+
+    {
+      std::lock_guard<std::mutex> guard(liveSocketLock);
+      liveSockets[liveSocketCount++] = {httpd_req_to_sockfd(req), client};
+    }
+    // Its hello and relay levels are already queued
+    wakeLiveSender();
+    return true;
+  }
+};
+
+static HttpMethod toHttpMethod(int method) {
+  switch (method) {
+  case HTTP_GET:
+    return HTTP_METHOD_GET;
+  case HTTP_HEAD:
+    return HTTP_METHOD_HEAD;
+  case HTTP_POST:
+    return HTTP_METHOD_POST;
+  case HTTP_PUT:
+    return HTTP_METHOD_PUT;
+  default:
+    return HTTP_METHOD_OTHER;
+  }
+}
+
+/**
+ * @brief Translates an esp_http_server request and passes it to the WebApp.
+ */
+
+static esp_err_t handleRequest(httpd_req_t *req) {
+  WebApp *app = static_cast<WebApp *>(req->user_ctx);
+
+  char path[WEB_PATH_SIZE];
+  size_t pathLength = strcspn(req->uri, "?");
+  if (pathLength >= sizeof(path))
+    pathLength = sizeof(path) - 1;
+  memcpy(path, req->uri, pathLength);
+  path[pathLength] = '\0';
+
+  char ifNoneMatch[WEB_HEADER_SIZE];
+  bool hasIfNoneMatch = httpd_req_get_hdr_value_str(req, "If-None-Match",
+                                                    ifNoneMatch,
+                                                    sizeof(ifNoneMatch)) ==
+                        ESP_OK;
+
+  char encoding[WEB_HEADER_SIZE];
+  esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding",
+                                              encoding, sizeof(encoding));
+  bool acceptsGzip = err == ESP_ERR_NOT_FOUND ||
+                     ((err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) &&
+                      strstr(encoding, "gzip") != nullptr);
+
+  char body[WEB_MAX_BODY + 1];
+  size_t bodyLength = 0;
+  size_t wanted =
+      req->content_len < WEB_MAX_BODY ? req->content_len : WEB_MAX_BODY;
+  while (bodyLength < wanted) {
+    int received = httpd_req_recv(req, body + bodyLength, wanted - bodyLength);
+    if (received <= 0)
+      return ESP_FAIL;
+    bodyLength += received;
+  }
+  body[bodyLength] = '\0';
+
+  HttpRequest request = {toHttpMethod(req->method),
+                         path,
+                         hasIfNoneMatch ? ifNoneMatch : nullptr,
+                         acceptsGzip,
+                         body,
+                         bodyLength};
+  EspHttpResponse response(req);
+  app->handle(request, response);
+  return ESP_OK;
+}
+
+/**
+ * @brief Whether a stored access point password may be used: WPA2 length,
+ * and not the default every older build shared.
+ */
+
+static bool usableApPassword(const char *password) {
+  size_t length = strlen(password);
+  return length >= WEB_AP_PASSWORD_MIN && length <= WEB_AP_PASSWORD_MAX &&
+         strcmp(password, WEB_AP_DEFAULT_PASSWORD) != 0;
+}
+
+/**
+ * @brief Loads this device's access point password, generating and storing
+ * a random one on first boot or if the stored one is unusable.
+ *
+ * @param password [out] Buffer of at least WEB_AP_PASSWORD_MAX + 1 bytes.
+ * @param size The size of `password`.
+ * @return `false` if a new password could not be persisted.
+ *
+ * The password is printed on the serial console at every boot, so it can
+ * be read off the device it belongs to.
+ */
+
+static bool provisionApPassword(char *password, size_t size) {
+  if (!retrieveValue(WEB_AP_PASSWORD_KEY, password, size) ||
+      !usableApPassword(password)) {
+    // 32 characters, without l and o, so each byte maps without bias
+    static const char alphabet[] = "abcdefghijkmnpqrstuvwxyz23456789";
+    static_assert(sizeof(alphabet) - 1 == 32, "alphabet is 5 bits");
+    uint8_t random[WEB_AP_PASSWORD_LENGTH];
+    esp_fill_random(random, sizeof(random));
+    for (size_t i = 0; i < WEB_AP_PASSWORD_LENGTH; i++)
+      password[i] = alphabet[random[i] & 31];
+    password[WEB_AP_PASSWORD_LENGTH] = '\0';
+
+    if (!storeValue(WEB_AP_PASSWORD_KEY, password) || !flushStorage())
+      return false;
+  }
+
+  Serial.send("Wi-Fi " WEB_AP_SSID " password: ");
+  Serial.send(password);
+  Serial.sendln();
+  return true;
+}
+
+static TimerHandle_t apIdleTimer = nullptr;
+static int apStations = 0; // event loop task only
+
+/**
+ * @brief Stops the access point and arms the button that restarts it.
+ *
+ * Runs on the timer service task once no station has been associated for
+ * WEB_AP_IDLE_MINUTES. While the AP is started the Wi-Fi driver holds a
+ * power management lock, so only then can the chip light-sleep.
+ */
+
+static void stopAccessPoint(TimerHandle_t timer) {
+  if (esp_wifi_stop() == ESP_OK)
+    gpio_intr_enable(WEB_AP_BUTTON_PIN);
+}
+
+/**
+ * @brief Restarts the access point; pended by the button interrupt.
+ */
+
+static void restartAccessPoint(void *arg, uint32_t unused) {
+  if (esp_wifi_start() == ESP_OK)
+    xTimerReset(apIdleTimer, 0);
+  else
+    gpio_intr_enable(WEB_AP_BUTTON_PIN);
+}
+
+/**
+ * @brief Button interrupt: disarms itself, so a held button fires once, and
+ * leaves the restart to the timer service task.
+ */
+
+static void IRAM_ATTR apButtonPressed(void *arg) {
+  gpio_intr_disable(WEB_AP_BUTTON_PIN);
+  BaseType_t woken = pdFALSE;
+  if (xTimerPendFunctionCallFromISR(restartAccessPoint, nullptr, 0, &woken) !=
+      pdPASS)
+    gpio_intr_enable(WEB_AP_BUTTON_PIN);
+  portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief Wi-Fi event handler: holds the idle timer while any station is
+ * associated and restarts it when the last one leaves.
+ */
+
+static void onStationEvent(void *arg, esp_event_base_t base, int32_t id,
+                           void *data) {
+  if (id == WIFI_EVENT_AP_STACONNECTED) {
+    apStations++;
+    xTimerStop(apIdleTimer, 0);
+  } else if (id == WIFI_EVENT_AP_STADISCONNECTED && apStations > 0 &&
+             --apStations == 0) {
+    xTimerReset(apIdleTimer, 0);
+  }
+}
+
+/**
+ * @brief Stops the access point WEB_AP_IDLE_MINUTES after it starts or its
+ * last station leaves; a press of WEB_AP_BUTTON_PIN brings it back.
+ *
+ * The button is also a light-sleep wakeup source, so a press is seen while
+ * the chip sleeps.
+ */
+
+static bool gateAccessPoint() {
+  apIdleTimer = xTimerCreate("ap_idle",
+                             pdMS_TO_TICKS(WEB_AP_IDLE_MINUTES * 60000),
+                             pdFALSE, nullptr, stopAccessPoint);
+  if (apIdleTimer == nullptr)
+    return false;
+
+  esp_err_t err = gpio_install_isr_service(0);
+  if ((err != ESP_OK && err != ESP_ERR_INVALID_STATE) ||
+      gpio_set_direction(WEB_AP_BUTTON_PIN, GPIO_MODE_INPUT) != ESP_OK ||
+      gpio_pullup_en(WEB_AP_BUTTON_PIN) != ESP_OK ||
+      gpio_wakeup_enable(WEB_AP_BUTTON_PIN, GPIO_INTR_LOW_LEVEL) != ESP_OK ||
+      gpio_isr_handler_add(WEB_AP_BUTTON_PIN, apButtonPressed, nullptr) !=
+          ESP_OK ||
+      esp_sleep_enable_gpio_wakeup() != ESP_OK)
+    return false;
+  gpio_intr_disable(WEB_AP_BUTTON_PIN);
+
+  return esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                    onStationEvent, nullptr) == ESP_OK &&
+         xTimerStart(apIdleTimer, 0) == pdPASS;
+}
+
+static bool startAccessPoint() {
+  esp_err_t err = esp_event_loop_create_default();
+  if (esp_netif_init() != ESP_OK ||
+      (err != ESP_OK && err != ESP_ERR_INVALID_STATE))
+    return false;
+
+  esp_netif_create_default_wifi_ap();
+  wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+  if (esp_wifi_init(&init) != ESP_OK)
+    return false;
+
+  char password[WEB_AP_PASSWORD_MAX + 1];
+  if (!provisionApPassword(password, sizeof(password)))
+    return false;
+
+  wifi_config_t config = {};
+  snprintf((char *)config.ap.ssid, sizeof(config.ap.ssid), "%s", WEB_AP_SSID);
+  snprintf((char *)config.ap.password, sizeof(config.ap.password), "%s",
+           password);
+  config.ap.ssid_len = strlen(WEB_AP_SSID);
+  config.ap.channel = 1;
+  config.ap.max_connection = WEB_AP_MAX_CLIENTS;
+  config.ap.authmode = WIFI_AUTH_WPA2_PSK;
+
+  return esp_wifi_set_mode(WIFI_MODE_AP) == ESP_OK &&
+         esp_wifi_set_config(WIFI_IF_AP, &config) == ESP_OK &&
+         gateAccessPoint() && esp_wifi_start() == ESP_OK;
+}
+
+/**
+ * @brief Brings up the access point and serves the dashboard and API.
+ *
+ * @param app The WebApp to serve; must outlive the server.
+ * @param controller The controller the API reads and configures.
+ * @return `true` if the server is running. A missing or empty asset
+ * partition only disables the dashboard; the API is still served.
+ *
+ * Must run after `init_nvs()`, which Wi-Fi needs. The server task and the
+ * live sender run on core 0 with the Wi-Fi stack, away from sampling and
+ * control. The access point stops when unused (see `gateAccessPoint()`);
+ * the server stays up and serves again once it is restarted.
+ */
+
+bool startWebServer(WebApp &app, SwitchControl &controller) {
+  esp_vfs_spiffs_conf_t spiffs = {};
+  spiffs.base_path = WEB_ASSET_ROOT;
+  spiffs.partition_label = WEB_ASSET_PARTITION;
+  spiffs.max_files = WEB_AP_MAX_CLIENTS;
+  spiffs.format_if_mount_failed = false;
+  esp_vfs_spiffs_register(&spiffs);
+
+  app.begin(WEB_ASSET_ROOT, controller);
+
+  if (!startAccessPoint())
+    return false;
+
+  if (xTaskCreatePinnedToCore(liveSenderEntry, "live_tx", WEB_LIVE_TASK_STACK,
+                              nullptr, WEB_LIVE_TASK_PRIORITY, &liveTask,
+                              0) != pdPASS)
+    return false;
+  liveStream.onPublish(wakeLiveSender);
+
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.uri_match_fn = httpd_uri_match_wildcard;
+  config.stack_size = WEB_SERVER_STACK_SIZE;
+  config.core_id = 0;
+  config.lru_purge_enable = true;
+  config.close_fn = closeSocket;
+
+  if (httpd_start(&server, &config) != ESP_OK)
+    return false;
+
+  for (httpd_method_t method : {HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT}) {
+    httpd_uri_t uri = {};
+    uri.uri = "/*";
+    uri.method = method;
+    uri.handler = handleRequest;
+    uri.user_ctx = &app;
+    httpd_register_uri_handler(server, &uri);
+  }
+  return true;
+}
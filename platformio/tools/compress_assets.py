@@ -0,0 +1,79 @@
+"""Gzip the dashboard assets and write the manifest WebApp serves them from.
+
+As a PlatformIO pre-script (see platformio.ini) it compresses data/ into
+.pio/build/<env>/www and points the filesystem image at that directory, so
+`pio run -t buildfs` / `-t uploadfs` flash only the compressed files.
+
+Standalone, for the host build:
+
+    python3 tools/compress_assets.py data /tmp/www
+
+Each manifest line is `<path> <file> <etag> <content-type>`. The ETag is a
+hash of the uncompressed content, and gzip runs with a fixed mtime, so
+unchanged assets keep their ETag and browsers keep their cached copy.
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+MANIFEST = "manifest"
+SKIPPED_SUFFIXES = (".map", ".LICENSE.txt")
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+}
+# WebApp limits: WEB_MAX_ASSETS entries, 31-character paths and file names
+MAX_ASSETS = 8
+MAX_NAME = 31
+
+
+def compress(source, target):
+    os.makedirs(target, exist_ok=True)
+    for name in os.listdir(target):
+        os.remove(os.path.join(target, name))
+
+    lines = []
+    for name in sorted(os.listdir(source)):
+        path = os.path.join(source, name)
+        extension = os.path.splitext(name)[1]
+        if (not os.path.isfile(path) or name.endswith(SKIPPED_SUFFIXES)
+                or extension not in CONTENT_TYPES):
+            continue
+
+        with open(path, "rb") as f:
+            data = f.read()
+        stored = name + ".gz"
+        if len(stored) > MAX_NAME:
+            sys.exit("compress_assets: name too long: " + name)
+
+        with open(os.path.join(target, stored), "wb") as f:
+            f.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+        etag = hashlib.sha1(data).hexdigest()[:16]
+        lines.append("/%s %s %s %s\n" %
+                     (name, stored, etag, CONTENT_TYPES[extension]))
+
+    if len(lines) > MAX_ASSETS:
+        sys.exit("compress_assets: more than %d assets" % MAX_ASSETS)
+    with open(os.path.join(target, MANIFEST), "w") as f:
+        f.writelines(lines)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: compress_assets.py <source-dir> <target-dir>")
+    compress(sys.argv[1], sys.argv[2])
+else:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+
+    www = os.path.join(env.subst("$BUILD_DIR"), "www")  # noqa: F821
+    compress(env.subst("$PROJECT_DATA_DIR"), www)  # noqa: F821
+    env.Replace(PROJECT_DATA_DIR=www)  # noqa: F821
@@ -1,10 +1,11 @@
 import React from "react";
+import LiveView from "./LiveView";
 
 const App = () => (
     <div>
         <h1>Solar Switch</h1>
-        <p>Under Development</p>
+        <LiveView />
     </div>
 )
 
-export default App;
\ No newline at end of file
+export default App;
@@ -0,0 +1,75 @@
+import React from 'react';
+import PropTypes from 'prop-types';
+import useLiveStream from '../hooks/useLiveStream';
+
+const CHART_WIDTH = 600;
+const CHART_HEIGHT = 150;
+const INDEX_MAX = 1000;
+
+const Sparkline = ({ samples }) => {
+  if (samples.length < 2) {
+    return null;
+  }
+
+  const start = samples[0].time;
+  const span = samples[samples.length - 1].time - start || 1;
+  const points = samples
+    .map(({ time, value }) => {
+      const x = ((time - start) / span) * CHART_WIDTH;
+      const y = CHART_HEIGHT - (value / INDEX_MAX) * CHART_HEIGHT;
+      return `${x.toFixed(1)},${y.toFixed(1)}`;
+    })
+    .join(' ');
+
+  return (
+    <svg
+      className="live-chart"
+      viewBox={`0 0 ${CHART_WIDTH} ${CHART_HEIGHT}`}
+      preserveAspectRatio="none"
+      role="img"
+      aria-label="Solar index history"
+    >
+      <polyline points={points} fill="none" stroke="currentColor" />
+    </svg>
+  );
+};
+
+Sparkline.propTypes = {
+  samples: PropTypes.arrayOf(
+    PropTypes.shape({
+      time: PropTypes.number,
+      value: PropTypes.number,
+    }),
+  ).isRequired,
+};
+
+const LiveView = () => {
+  const {
+    connected, windowMs, samples, relays,
+  } = useLiveStream();
+  const latest = samples.length ? samples[samples.length - 1].value : null;
+
+  return (
+    <section className="live">
+      <p className="live-status">
+        {connected ? `Live, updated every ${windowMs} ms` : 'Connecting...'}
+      </p>
+      <p className="live-index">
+        Solar index:
+        {' '}
+        <strong>{latest === null ? '-' : latest.toFixed(1)}</strong>
+      </p>
+      <Sparkline samples={samples} />
+      <ul className="live-relays">
+        {Object.entries(relays).map(([pin, { level }]) => (
+          <li key={pin}>
+            {`Relay on pin ${pin}: `}
+            <strong>{level ? 'ON' : 'OFF'}</strong>
+          </li>
+        ))}
+      </ul>
+    </section>
+  );
+};
+
+export default LiveView;
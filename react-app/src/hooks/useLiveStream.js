@@ -0,0 +1,46 @@
+import { useEffect, useState } from 'react';
+
+// Samples kept for the chart, about five minutes at the default 100 ms period
+const HISTORY_LENGTH = 3000;
+
+// Spreads a batch evenly between its first and last reading time
+const expandBatch = ({ t0, t1, v }) => {
+  const step = v.length > 1 ? (t1 - t0) / (v.length - 1) : 0;
+  return v.map((value, i) => ({ time: t0 + step * i, value }));
+};
+
+const useLiveStream = (url = '/api/live') => {
+  const [connected, setConnected] = useState(false);
+  const [windowMs, setWindowMs] = useState(null);
+  const [samples, setSamples] = useState([]);
+  const [relays, setRelays] = useState({});
+
+  useEffect(() => {
+    const source = new EventSource(url);
+
+    source.onopen = () => setConnected(true);
+    source.onerror = () => setConnected(false);
+
+    source.addEventListener('hello', (event) => {
+      setWindowMs(JSON.parse(event.data).window);
+    });
+
+    source.addEventListener('samples', (event) => {
+      const batch = expandBatch(JSON.parse(event.data));
+      setSamples((previous) => previous.concat(batch).slice(-HISTORY_LENGTH));
+    });
+
+    source.addEventListener('relay', (event) => {
+      const { t, pin, level } = JSON.parse(event.data);
+      setRelays((previous) => ({ ...previous, [pin]: { level, time: t } }));
+    });
+
+    return () => source.close();
+  }, [url]);
+
+  return {
+    connected, windowMs, samples, relays,
+  };
+};
+
+export default useLiveStream;